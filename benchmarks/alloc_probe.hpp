@@ -0,0 +1,43 @@
+#pragma once
+
+#include "alloc_stats.hpp"
+#include "bench_harness.hpp"
+#include <algorithm>
+#include <array>
+#include <string>
+
+
+namespace bench {
+
+/**
+ * Reports heap allocations per subsystem over each measured region, as
+ * alloc.<subsystem>.{count,bytes,peak_bytes}. Only meaningful in a build
+ * with -Denable-alloc-stats=true; otherwise every count is zero.
+ */
+class AllocProbe : public Probe {
+public:
+	void start() override {
+		CellGeometry::alloc_stats::reset_peak();
+		before = CellGeometry::alloc_stats::snapshot();
+	}
+
+	void stop(std::map<std::string, double>& out) override {
+		namespace as = CellGeometry::alloc_stats;
+		const auto after = as::snapshot();
+		for (size_t i=0; i<as::num_subsystems; i++){
+			const auto& a = after[i];
+			const auto& b = before[i];
+			if (a.allocations == b.allocations) continue;
+			const std::string key = std::string("alloc.") + as::name(as::Subsystem(i));
+			out[key + ".count"] += a.allocations - b.allocations;
+			out[key + ".bytes"] += a.bytes - b.bytes;
+			auto& peak = out[key + ".peak_bytes"];
+			peak = std::max(peak, double(a.peak_live_bytes) - double(b.live_bytes));
+		}
+	}
+
+private:
+	std::array<CellGeometry::alloc_stats::Counters, CellGeometry::alloc_stats::num_subsystems> before;
+};
+
+}; // end of namespace
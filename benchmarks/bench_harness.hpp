@@ -0,0 +1,273 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+
+/**
+ * A small benchmark harness.
+ *
+ * Each benchmark is a function called once per repetition with an
+ * Iteration. The whole call is timed unless the body marks the measured
+ * region itself with it.start() / it.stop(), so that set-up and tear-down
+ * stay out of the numbers:
+ *
+ *   bench::Runner r(cfg);
+ *   r.run("lookup/point", {{"preset", "diamond"}}, n, [&](bench::Iteration& it){
+ *       auto keys = shuffled_positions();   // not timed
+ *       it.start();
+ *       for (auto& x : keys) bench::do_not_optimize(lat.get_point_at(x));
+ *       it.stop();
+ *   });
+ *
+ * Every benchmark gets `warmup` untimed calls and then `repetitions` timed
+ * ones; results report the median and the median absolute deviation (MAD)
+ * of the repetitions, also per item. Probes measure extra quantities over
+ * the same region as the timer, one value per repetition, reported by
+ * median in `counters`.
+ */
+namespace bench {
+
+template<typename T>
+inline void do_not_optimize(const T& x){
+	asm volatile("" : : "r,m"(x) : "memory");
+}
+
+inline void clobber(){
+	asm volatile("" : : : "memory");
+}
+
+
+// Something measured around each timed region alongside the clock
+struct Probe {
+	virtual ~Probe() = default;
+	virtual void start() = 0;
+	// Adds the values since the last start() to `out`. A region may be
+	// restarted, so start() can come twice without a stop()
+	virtual void stop(std::map<std::string, double>& out) = 0;
+};
+
+
+struct Config {
+	unsigned warmup = 1;
+	unsigned repetitions = 7;
+	// Only run benchmarks whose name matches (ECMAScript regex)
+	std::string filter = ".*";
+	// Write results here as JSON, if not empty
+	std::string json_path;
+	bool quiet = false;
+};
+
+
+struct Stats {
+	double median = 0;
+	double mad = 0;
+	double min = 0;
+	double max = 0;
+};
+
+inline double median_of(std::vector<double> x){
+	if (x.empty()) return 0;
+	const size_t m = x.size() / 2;
+	std::nth_element(x.begin(), x.begin() + m, x.end());
+	if (x.size() % 2) return x[m];
+	const double hi = x[m];
+	return 0.5 * (hi + *std::max_element(x.begin(), x.begin() + m));
+}
+
+inline Stats stats_of(const std::vector<double>& x){
+	Stats s;
+	if (x.empty()) return s;
+	s.median = median_of(x);
+	std::vector<double> dev(x.size());
+	for (size_t i=0; i<x.size(); i++) dev[i] = std::abs(x[i] - s.median);
+	s.mad = median_of(dev);
+	s.min = *std::min_element(x.begin(), x.end());
+	s.max = *std::max_element(x.begin(), x.end());
+	return s;
+}
+
+
+struct Result {
+	std::string name;
+	std::map<std::string, std::string> params;
+	// Work done per repetition (cells built, lookups, ...), for per-item rates
+	size_t items = 0;
+	std::vector<double> samples_ns;
+	Stats time_ns;
+	std::map<std::string, std::vector<double>> counter_samples;
+	std::map<std::string, double> counters;
+};
+
+
+class Iteration {
+public:
+	// (Re)starts the measured region; anything measured since the last
+	// start() without a stop() is dropped
+	inline void start(){
+		for (auto* p : probes) p->start();
+		running = true;
+		t0 = std::chrono::steady_clock::now();
+	}
+
+	// Ends the region, adding it to this repetition's total
+	inline void stop(){
+		const auto t1 = std::chrono::steady_clock::now();
+		if (!running) return;
+		running = false;
+		elapsed += std::chrono::duration<double, std::nano>(t1 - t0).count();
+		for (auto* p : probes) p->stop(counters);
+	}
+
+private:
+	friend class Runner;
+	explicit Iteration(const std::vector<Probe*>& probes) : probes(probes) {}
+
+	const std::vector<Probe*>& probes;
+	std::chrono::steady_clock::time_point t0;
+	double elapsed = 0;
+	bool running = false;
+	std::map<std::string, double> counters;
+};
+
+
+class Runner {
+public:
+	explicit Runner(Config cfg) : cfg(std::move(cfg)), filter(this->cfg.filter) {}
+
+	~Runner(){
+		if (!cfg.json_path.empty()) write_json(cfg.json_path);
+	}
+
+	Runner(const Runner&) = delete;
+	Runner& operator=(const Runner&) = delete;
+
+	// The probe must outlive the runner
+	inline void add_probe(Probe& p){ probes.push_back(&p); }
+
+	inline bool selected(const std::string& name) const {
+		return std::regex_search(name, filter);
+	}
+
+	template<typename F>
+	void run(const std::string& name, std::map<std::string, std::string> params,
+			size_t items, F&& body)
+	{
+		if (!selected(name)) return;
+		Result r;
+		r.name = name;
+		r.params = std::move(params);
+		r.items = items;
+		for (unsigned i=0; i<cfg.warmup; i++){
+			Iteration it(no_probes);
+			call(it, body);
+		}
+		for (unsigned i=0; i<cfg.repetitions; i++){
+			Iteration it(probes);
+			call(it, body);
+			r.samples_ns.push_back(it.elapsed);
+			for (const auto& [k, v] : it.counters) r.counter_samples[k].push_back(v);
+		}
+		r.time_ns = stats_of(r.samples_ns);
+		for (const auto& [k, v] : r.counter_samples) r.counters[k] = median_of(v);
+		if (!cfg.quiet) print(r);
+		results.push_back(std::move(r));
+	}
+
+	inline const std::vector<Result>& get_results() const { return results; }
+
+	void write_json(const std::string& path) const {
+		using nlohmann::json;
+		json j;
+		char host[256] = {};
+		gethostname(host, sizeof(host) - 1);
+		const std::time_t now = std::time(nullptr);
+		char date[32];
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+		j["context"] = {
+			{"date", date},
+			{"host_name", host},
+			{"num_cpus", sysconf(_SC_NPROCESSORS_ONLN)},
+			{"compiler", __VERSION__},
+			{"warmup", cfg.warmup},
+			{"repetitions", cfg.repetitions},
+		};
+		j["benchmarks"] = json::array();
+		for (const auto& r : results){
+			const double per = r.items ? 1.0 / r.items : 1.0;
+			json b = {
+				{"name", r.name},
+				{"params", r.params},
+				{"items", r.items},
+				{"samples_ns", r.samples_ns},
+				{"median_ns", r.time_ns.median},
+				{"mad_ns", r.time_ns.mad},
+				{"min_ns", r.time_ns.min},
+				{"max_ns", r.time_ns.max},
+				{"median_ns_per_item", r.time_ns.median * per},
+				{"mad_ns_per_item", r.time_ns.mad * per},
+			};
+			if (!r.counters.empty()) {
+				b["counters"] = r.counters;
+				b["counter_samples"] = r.counter_samples;
+				json rates;
+				for (const auto& [k, v] : r.counters) rates[k] = v * per;
+				b["counters_per_item"] = rates;
+			}
+			j["benchmarks"].push_back(b);
+		}
+		std::ofstream of(path);
+		if (!of.is_open()) {
+			std::cerr << "Cannot write benchmark results to " << path << "\n";
+			return;
+		}
+		of << j.dump(1) << "\n";
+	}
+
+private:
+	Config cfg;
+	std::regex filter;
+	std::vector<Probe*> probes;
+	const std::vector<Probe*> no_probes;
+	std::vector<Result> results;
+
+	template<typename F>
+	static void call(Iteration& it, F& body){
+		it.start();
+		body(it);
+		it.stop();
+	}
+
+	static void print(const Result& r){
+		std::string label = r.name;
+		for (const auto& [k, v] : r.params) label += " " + k + "=" + v;
+		const double per = r.items ? 1.0 / r.items : 1.0;
+		std::cout << std::left << std::setw(56) << label << std::right
+			<< std::setw(12) << std::fixed << std::setprecision(2) << r.time_ns.median * per
+			<< " ns/item  +- " << std::setw(5) << std::setprecision(1)
+			<< (r.time_ns.median > 0 ? 100 * r.time_ns.mad / r.time_ns.median : 0) << "%"
+			<< "  (" << r.items << " items)";
+		for (const auto& [k, v] : r.counters){
+			if (v == 0) continue;
+			std::cout << "  " << k << "=" << std::setprecision(3) << v * per << "/item";
+		}
+		std::cout << std::endl;
+	}
+};
+
+}; // end of namespace
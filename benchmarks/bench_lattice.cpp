@@ -0,0 +1,318 @@
+#include "alloc_probe.hpp"
+#include "bench_harness.hpp"
+#include "lattice_helpers.hpp"
+#include "perf_probe.hpp"
+
+#include "argparse/argparse.hpp"
+#include "binary_lattice_IO.hpp"
+#include "cell_geometry.hpp"
+#include "chain.hpp"
+#include "lattice_IO.hpp"
+#include "npy_IO.hpp"
+#include "preset_cellspecs.hpp"
+#include "static_lattice.hpp"
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace CellGeometry;
+using std::string;
+using bench::Case, bench::num_cells, bench::release;
+
+typedef PeriodicPointLattice<Cell<0>> PointLattice;
+typedef PeriodicLinkLattice<Cell<0>,Cell<1>> LinkLattice;
+typedef PeriodicPlaqLattice<Cell<0>,Cell<1>,Cell<2>> PlaqLattice;
+typedef PeriodicVolLattice<Cell<0>,Cell<1>,Cell<2>,Cell<3>> VolLattice;
+
+// The same lattices with the unit cell fixed at compile time
+template<auto Spec> using StaticPoint = StaticLattice<Spec, PointLattice>;
+template<auto Spec> using StaticLink = StaticLattice<Spec, LinkLattice>;
+template<auto Spec> using StaticPlaq = StaticLattice<Spec, PlaqLattice>;
+template<auto Spec> using StaticVol = StaticLattice<Spec, VolLattice>;
+
+template<typename Lattice>
+std::unique_ptr<Lattice> make_lattice(const Case& c){
+	if constexpr (std::is_constructible_v<Lattice, const imat33_t&>) {
+		return std::make_unique<Lattice>(c.supercell);
+	} else {
+		return std::make_unique<Lattice>(c.spec, c.supercell);
+	}
+}
+
+
+// Cells of the map, in a fixed random order
+template<typename Map>
+auto shuffled(const Map& cellmap, std::mt19937& gen){
+	std::vector<std::pair<idx_t, typename Map::mapped_type>> byJ(cellmap.begin(), cellmap.end());
+	std::sort(byJ.begin(), byJ.end());
+	std::shuffle(byJ.begin(), byJ.end(), gen);
+	std::vector<typename Map::mapped_type> v;
+	v.reserve(byJ.size());
+	for (const auto& [_, x] : byJ) v.push_back(x);
+	return v;
+}
+
+
+template<typename Lattice>
+void bench_construct(bench::Runner& r, const Case& c, const string& name){
+	const string bname = "construct/" + name;
+	if (!r.selected(bname)) return;
+	size_t n;
+	{
+		auto lat = make_lattice<Lattice>(c);
+		n = num_cells(*lat);
+		release(*lat);
+	}
+	r.run(bname, c.params, n, [&](bench::Iteration& it){
+		auto lat = make_lattice<Lattice>(c);
+		it.stop();
+		release(*lat);
+	});
+}
+
+
+template<typename Lattice>
+void bench_lookup(bench::Runner& r, const Case& c, const Lattice& lat, const string& prefix=""){
+	std::mt19937 gen(42);
+	auto positions = [&](const auto& cellmap){
+		std::vector<ipos_t> x;
+		for (const auto* p : shuffled(cellmap, gen)) x.push_back(p->position);
+		return x;
+	};
+	auto run = [&](const char* name, const std::vector<ipos_t>& xs, auto&& get){
+		r.run("lookup/" + prefix + name, c.params, xs.size(), [&](bench::Iteration&){
+			int64_t s = 0;
+			for (const auto& x : xs) s += get(x).position[0];
+			bench::do_not_optimize(s);
+		});
+	};
+	run("point", positions(lat.points), [&](const ipos_t& x) -> const auto& { return lat.get_point_at(x); });
+	run("link", positions(lat.links), [&](const ipos_t& x) -> const auto& { return lat.get_link_at(x); });
+	run("plaq", positions(lat.plaqs), [&](const ipos_t& x) -> const auto& { return lat.get_plaq_at(x); });
+	run("vol", positions(lat.vols), [&](const ipos_t& x) -> const auto& { return lat.get_vol_at(x); });
+}
+
+
+// Construction and lookup with the unit cell as a template argument, to set
+// against construct/* and lookup/*
+template<auto Spec>
+void bench_static(bench::Runner& r, const Case& c){
+	bench_construct<StaticPoint<Spec>>(r, c, "static_point");
+	bench_construct<StaticLink<Spec>>(r, c, "static_link");
+	bench_construct<StaticPlaq<Spec>>(r, c, "static_plaq");
+	bench_construct<StaticVol<Spec>>(r, c, "static_vol");
+	bool any = false;
+	for (const char* k : {"point", "link", "plaq", "vol"}) any |= r.selected(string("lookup/static_") + k);
+	if (!any) return;
+	StaticVol<Spec> lat(c.supercell);
+	bench_lookup(r, c, lat, "static_");
+	release(lat);
+}
+
+
+void bench_traverse(bench::Runner& r, const Case& c, const VolLattice& lat){
+	auto run = [&](const string& name, const auto& cellmap, auto&& chain_of){
+		r.run("traverse/" + name, c.params, cellmap.size(), [&](bench::Iteration&){
+			int64_t s = 0;
+			for (const auto& [_, x] : cellmap){
+				for (const auto& [y, m] : chain_of(*x)) s += m * y->position[0];
+			}
+			bench::do_not_optimize(s);
+		});
+	};
+	auto bdry = [](const auto& x) -> const auto& { return x.boundary; };
+	auto cobdry = [](const auto& x) -> const auto& { return x.coboundary; };
+	run("boundary/link", lat.links, bdry);
+	run("boundary/plaq", lat.plaqs, bdry);
+	run("boundary/vol", lat.vols, bdry);
+	run("coboundary/point", lat.points, cobdry);
+	run("coboundary/link", lat.links, cobdry);
+	run("coboundary/plaq", lat.plaqs, cobdry);
+}
+
+
+void bench_chains(bench::Runner& r, const Case& c, const VolLattice& lat){
+	std::mt19937 gen(7);
+	const size_t n = std::min<size_t>(4096, lat.plaqs.size() / 2);
+	auto plaqs = shuffled(lat.plaqs, gen);
+	auto links = shuffled(lat.links, gen);
+	Chain<2> c1, c2;
+	Chain<1> l1;
+	for (size_t i=0; i<n; i++){
+		c1[plaqs[i]] = 1;
+		c2[plaqs[i + n/2]] = -1;
+		l1[links[i]] = (i % 2) ? 1 : -1;
+	}
+	r.run("chain/d", c.params, n, [&](bench::Iteration&){
+		bench::do_not_optimize(d(c1).size());
+	});
+	r.run("chain/dd", c.params, n, [&](bench::Iteration&){
+		bench::do_not_optimize(d(d(c1)).size());
+	});
+	r.run("chain/co_d", c.params, n, [&](bench::Iteration&){
+		bench::do_not_optimize(co_d(l1).size());
+	});
+	r.run("chain/add", c.params, n, [&](bench::Iteration&){
+		bench::do_not_optimize((c1 + c2).size());
+	});
+}
+
+
+// Erases a fixed random 5% of the cells of one order from a fresh lattice
+template<int order>
+void bench_erase(bench::Runner& r, const Case& c, const VolLattice& ref, const char* name){
+	const string bname = string("erase/") + name;
+	if (!r.selected(bname)) return;
+	std::mt19937 gen(11);
+	std::vector<idx_t> victims;
+	for (const auto& [J, _] : cells_of<order>(ref)) victims.push_back(J);
+	std::sort(victims.begin(), victims.end());
+	std::shuffle(victims.begin(), victims.end(), gen);
+	victims.resize(std::max<size_t>(1, victims.size() / 20));
+
+	r.run(bname, c.params, victims.size(), [&](bench::Iteration& it){
+		auto lat = std::make_unique<VolLattice>(c.spec, c.supercell);
+		it.start();
+		for (idx_t J : victims){
+			auto found = cells_of<order>(*lat).find(J);
+			if (found != cells_of<order>(*lat).end()) erase_cell<order>(*lat, found->second);
+		}
+		it.stop();
+		release(*lat);
+	});
+}
+
+
+void bench_io(bench::Runner& r, const Case& c, const VolLattice& lat,
+		const std::filesystem::path& dir)
+{
+	const size_t n = num_cells(lat);
+	const auto json = dir / "bench.lat.json";
+	const auto latb = dir / "bench.latb";
+	JsonWriteOptions compact;
+	compact.schema = JsonSchema::Compact;
+
+	r.run("io/save_json", c.params, n, [&](bench::Iteration&){ save(lat, json); });
+	r.run("io/save_json_compact", c.params, n, [&](bench::Iteration&){
+		save(lat, dir / "bench_compact.lat.json", compact);
+	});
+	r.run("io/save_latb", c.params, n, [&](bench::Iteration&){ save_binary(lat, latb); });
+	r.run("io/save_npz", c.params, n, [&](bench::Iteration&){ save_npz(lat, dir / "bench.npz"); });
+
+	if (r.selected("io/load_json")) {
+		save(lat, json);
+		r.run("io/load_json", c.params, n, [&](bench::Iteration& it){
+			auto loaded = load(json);
+			it.stop();
+			release(*loaded);
+		});
+	}
+	if (r.selected("io/map_latb")) {
+		save_binary(lat, latb);
+		r.run("io/map_latb", c.params, n, [&](bench::Iteration&){
+			MappedLattice m(latb, true);
+			bench::do_not_optimize(m.num_cells(0));
+		});
+	}
+}
+
+
+int main(int argc, char* argv[]){
+	argparse::ArgumentParser prog("bench_lattice");
+	prog.add_description("Benchmarks lattice construction, lookups, traversal, chain algebra, erasure and I/O");
+	prog.add_argument("--sizes")
+		.help("Linear supercell sizes L (8 L^3 points)")
+		.nargs(argparse::nargs_pattern::at_least_one)
+		.scan<'i', int>()
+		.default_value(std::vector<int>{4, 8});
+	prog.add_argument("--presets")
+		.help("Unit cells to benchmark: diamond, cubic")
+		.nargs(argparse::nargs_pattern::at_least_one)
+		.default_value(std::vector<string>{"diamond", "cubic"});
+	prog.add_argument("--filter")
+		.help("Only run benchmarks whose name matches this regex")
+		.default_value(string(".*"));
+	prog.add_argument("--repetitions")
+		.scan<'i', int>()
+		.default_value(7);
+	prog.add_argument("--warmup")
+		.scan<'i', int>()
+		.default_value(1);
+	prog.add_argument("--json")
+		.help("Write results to this file as JSON")
+		.default_value(string(""));
+	prog.add_argument("--perf")
+		.help("Count cycles, instructions and cache, TLB and branch misses (Linux perf_event_open)")
+		.flag();
+
+	try {
+		prog.parse_args(argc, argv);
+	} catch (const std::exception& err) {
+		std::cerr << err.what() << std::endl;
+		std::cerr << prog;
+		return 1;
+	}
+
+	bench::Config cfg;
+	cfg.filter = prog.get<string>("--filter");
+	cfg.repetitions = std::max(1, prog.get<int>("--repetitions"));
+	cfg.warmup = std::max(0, prog.get<int>("--warmup"));
+	cfg.json_path = prog.get<string>("--json");
+	const auto presets = prog.get<std::vector<string>>("--presets");
+	for (const auto& preset : presets){
+		if (!bench::is_preset(preset)) {
+			std::cerr << "Unknown preset " << preset << std::endl;
+			return 1;
+		}
+	}
+
+	const auto dir = std::filesystem::temp_directory_path()
+		/ ("latticelab_bench_" + std::to_string(getpid()));
+	std::filesystem::create_directories(dir);
+
+	{
+		bench::Runner r(cfg);
+		bench::AllocProbe alloc_probe;
+		if (alloc_stats::enabled) r.add_probe(alloc_probe);
+		std::unique_ptr<bench::PerfProbe> perf_probe;
+		if (prog.get<bool>("--perf")) {
+			perf_probe = std::make_unique<bench::PerfProbe>();
+			for (const auto& why : perf_probe->skipped()){
+				std::cerr << "perf counter unavailable, skipped: " << why << std::endl;
+			}
+			if (perf_probe->available()) r.add_probe(*perf_probe);
+		}
+		for (const auto& preset : presets){
+			for (int L : prog.get<std::vector<int>>("--sizes")){
+				const Case c = bench::make_case(preset, L);
+
+				bench_construct<PointLattice>(r, c, "point");
+				bench_construct<LinkLattice>(r, c, "link");
+				bench_construct<PlaqLattice>(r, c, "plaq");
+				bench_construct<VolLattice>(r, c, "vol");
+				if (preset == "diamond") {
+					bench_static<PrimitiveSpecifiers::StaticDiamondSpec>(r, c);
+				} else {
+					bench_static<PrimitiveSpecifiers::StaticCubicSpec>(r, c);
+				}
+
+				VolLattice lat(c.spec, c.supercell);
+				bench_lookup(r, c, lat);
+				bench_traverse(r, c, lat);
+				bench_chains(r, c, lat);
+				bench_erase<0>(r, c, lat, "point");
+				bench_erase<1>(r, c, lat, "link");
+				bench_erase<2>(r, c, lat, "plaq");
+				bench_io(r, c, lat, dir);
+				release(lat);
+			}
+		}
+	}
+	std::filesystem::remove_all(dir);
+	return 0;
+}
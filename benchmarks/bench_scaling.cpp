@@ -0,0 +1,480 @@
+#include "bench_harness.hpp"
+#include "lattice_helpers.hpp"
+
+#include "argparse/argparse.hpp"
+#include "cell_geometry.hpp"
+#include "cell_rows.hpp"
+#include "graph_distance.hpp"
+#include "memory_usage.hpp"
+#include "neighbour_table.hpp"
+#include "parallel.hpp"
+#include "sparse_export.hpp"
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+/**
+ * bench_scaling: how far the parallel paths scale.
+ *
+ * For each lattice size L and thread count p (workers of the global
+ * ThreadPool, pinned one per CPU), times
+ *
+ *   weak/construct    p lattices built at once, one per worker
+ *   weak/dilute       p lattices each losing 10% of their points at once
+ *   strong/cluster    parallel BFS labelling the cluster of a point on a
+ *                     20% diluted lattice (point-link graph)
+ *   strong/curl_cells B = curl A over the plaquettes, following the
+ *                     boundary pointers (parallel_for_each)
+ *   strong/curl_csr   the same through a CSR plaquette -> link incidence
+ *   strong/energy     sum of B^2 (parallel_reduce)
+ *   stream/triad      a[i] = b[i] + s c[i], the bandwidth reference
+ *
+ * Weak kernels construction and erasure are serial in the library, so they
+ * scale by running independent lattices (an ensemble) side by side;
+ * efficiency is T(1)/T(p). Strong kernels share one lattice; efficiency is
+ * T(1)/(p T(p)). Streaming kernels also report bandwidth, against the
+ * triad at the same p. Sizes whose footprint (from estimate_memory) would
+ * exceed --mem-fraction of RAM are skipped.
+ *
+ * Each row also records the most workers the kernel's loops were spread
+ * over (ThreadPool::peak_workers), with a warning when that is not p.
+ */
+
+using namespace CellGeometry;
+using std::string;
+using bench::release;
+
+struct Link : public Cell<1> {
+	double A = 0;
+};
+
+struct Plaq : public Cell<2> {
+	double B = 0;
+};
+
+typedef PeriodicVolLattice<Cell<0>, Link, Plaq, Cell<3>> FieldLattice;
+
+
+std::vector<int> allowed_cpus(){
+	cpu_set_t s;
+	CPU_ZERO(&s);
+	std::vector<int> cpus;
+	if (sched_getaffinity(0, sizeof(s), &s) == 0) {
+		for (int c=0; c<CPU_SETSIZE; c++) if (CPU_ISSET(c, &s)) cpus.push_back(c);
+	}
+	return cpus;
+}
+
+bool pin_current_thread(int cpu){
+	cpu_set_t s;
+	CPU_ZERO(&s);
+	CPU_SET(cpu, &s);
+	return pthread_setaffinity_np(pthread_self(), sizeof(s), &s) == 0;
+}
+
+// Pins worker w of the pool to cpus[w % cpus.size()], for good: workers
+// keep their threads. Returns the number of workers pinned.
+unsigned pin_pool(ThreadPool& pool, const std::vector<int>& cpus){
+	if (cpus.empty()) return 0;
+	std::vector<char> pinned(pool.size(), 0);
+	// many slow chunks, so that every worker gets some
+	pool.parallel_for(pool.size() * 8, 1, [&](size_t, size_t, unsigned w){
+		if (!pinned[w]) pinned[w] = pin_current_thread(cpus[w % cpus.size()]) ? 1 : 2;
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	});
+	return std::count(pinned.begin(), pinned.end(), 1);
+}
+
+
+struct Row {
+	string kernel;
+	string preset;
+	int L;
+	unsigned threads;
+	size_t items;
+	bench::Stats time_ns;
+	// most workers any of the kernel's parallel loops actually ran on
+	unsigned workers = 0;
+	// bytes moved per call, if the kernel streams (0 otherwise)
+	double bytes = 0;
+	double speedup = 0;
+	double efficiency = 0;
+	double bandwidth = 0;
+	double stream_fraction = 0;
+};
+
+
+class Scaling {
+public:
+	Scaling(bench::Runner& r, std::vector<Row>& rows) : r(r), rows(rows) {}
+
+	// Times body over the global pool limited to p workers, and checks that
+	// it was spread over p of them
+	template<typename F>
+	void run(const string& kernel, const string& preset, int L, unsigned p,
+			size_t items, double bytes, F&& body)
+	{
+		ThreadPool& pool = ThreadPool::global();
+		const size_t before = r.get_results().size();
+		pool.reset_peak_workers();
+		r.run(kernel, {{"preset", preset}, {"L", std::to_string(L)}, {"threads", std::to_string(p)}},
+				items, std::forward<F>(body));
+		if (r.get_results().size() == before) return;
+		const unsigned workers = pool.peak_workers();
+		if (workers != p) {
+			std::cerr << "Warning: " << kernel << " (L=" << L << ", " << p
+				<< " threads) ran on at most " << workers << " workers" << std::endl;
+		}
+		rows.push_back({kernel, preset, L, p, items, r.get_results().back().time_ns, workers, bytes});
+	}
+
+private:
+	bench::Runner& r;
+	std::vector<Row>& rows;
+};
+
+
+// Erases the given fraction of points, chosen by seed
+std::vector<idx_t> victims(const FieldLattice& lat, double fraction, unsigned seed){
+	std::vector<idx_t> v;
+	for (const auto& [J, _] : lat.points) v.push_back(J);
+	std::sort(v.begin(), v.end());
+	std::mt19937 gen(seed);
+	std::shuffle(v.begin(), v.end(), gen);
+	v.resize(size_t(fraction * v.size()));
+	return v;
+}
+
+void dilute(FieldLattice& lat, const std::vector<idx_t>& js){
+	for (idx_t J : js){
+		auto it = lat.points.find(J);
+		if (it != lat.points.end()) lat.erase_point(it->second);
+	}
+}
+
+
+void weak_kernels(Scaling& s, const bench::Case& c, int L, unsigned p, size_t cells){
+	ThreadPool& pool = ThreadPool::global();
+	s.run("weak/construct", c.preset, L, p, p * cells, 0, [&](bench::Iteration& it){
+		std::vector<std::unique_ptr<FieldLattice>> lats(p);
+		pool.parallel_for(p, 1, [&](size_t i0, size_t i1, unsigned){
+			for (size_t i=i0; i<i1; i++) lats[i] = std::make_unique<FieldLattice>(c.spec, c.supercell);
+		}, p);
+		it.stop();
+		for (auto& lat : lats) release(*lat);
+	});
+
+	std::vector<idx_t> js;
+	{
+		FieldLattice ref(c.spec, c.supercell);
+		js = victims(ref, 0.1, 11);
+		release(ref);
+	}
+	s.run("weak/dilute", c.preset, L, p, p * js.size(), 0, [&](bench::Iteration& it){
+		std::vector<std::unique_ptr<FieldLattice>> lats(p);
+		pool.parallel_for(p, 1, [&](size_t i0, size_t i1, unsigned){
+			for (size_t i=i0; i<i1; i++) lats[i] = std::make_unique<FieldLattice>(c.spec, c.supercell);
+		}, p);
+		it.start();
+		pool.parallel_for(p, 1, [&](size_t i0, size_t i1, unsigned){
+			for (size_t i=i0; i<i1; i++) dilute(*lats[i], js);
+		}, p);
+		it.stop();
+		for (auto& lat : lats) release(*lat);
+	});
+}
+
+
+void strong_kernels(Scaling& s, const bench::Case& c, int L, unsigned p,
+		FieldLattice& diluted, FieldLattice& lat, const IncidenceCSR& plaq_links,
+		std::vector<double>& A, std::vector<double>& B)
+{
+	ParallelOptions opts;
+	opts.n_threads = p;
+
+	const auto& nbrs = neighbour_table<0, NeighbourRelation::Coboundary>(diluted);
+	const idx_t source = diluted.points.begin()->first;
+	BFSOptions bopts;
+	bopts.n_threads = p;
+	// the default grain leaves every level of a small lattice serial
+	bopts.grain = 512;
+	size_t reached = 0;
+	{
+		const auto res = bfs(nbrs, source, bopts);
+		for (auto d : res.dist) reached += d != BFSResult::unreached;
+	}
+	s.run("strong/cluster", c.preset, L, p, reached, 0, [&](bench::Iteration&){
+		bench::do_not_optimize(bfs(nbrs, source, bopts).dist.data());
+	});
+
+	const size_t n_plaq = lat.plaqs.size();
+	size_t nnz = 0;
+	for (const auto& [_, x] : lat.plaqs) nnz += x->boundary.size();
+	// the plaquette, its chain entries, and a gather per entry
+	const double cell_bytes = n_plaq * sizeof(Plaq) + nnz * (sizeof(std::pair<Cell<1>*, int>) + sizeof(Link));
+	s.run("strong/curl_cells", c.preset, L, p, n_plaq, cell_bytes, [&](bench::Iteration&){
+		parallel_for_each<2>(lat, [](Plaq& x){
+			double b = 0;
+			for (const auto& [l, m] : x.boundary) b += m * static_cast<const Link*>(l)->A;
+			x.B = b;
+		}, opts);
+	});
+
+	const size_t rows = plaq_links.rows();
+	const double csr_bytes = rows * (sizeof(uint32_t) + sizeof(double))
+		+ plaq_links.nnz() * (sizeof(uint32_t) + sizeof(int32_t) + sizeof(double));
+	s.run("strong/curl_csr", c.preset, L, p, rows, csr_bytes, [&](bench::Iteration&){
+		ThreadPool::global().parallel_for(rows, 1024, [&](size_t r0, size_t r1, unsigned){
+			for (size_t r=r0; r<r1; r++){
+				double b = 0;
+				for (uint32_t e=plaq_links.row_ptr[r]; e<plaq_links.row_ptr[r+1]; e++){
+					b += plaq_links.val[e] * A[plaq_links.col[e]];
+				}
+				B[r] = b;
+			}
+		}, p);
+		bench::clobber();
+	});
+
+	s.run("strong/energy", c.preset, L, p, n_plaq, n_plaq * sizeof(Plaq), [&](bench::Iteration&){
+		const double e = parallel_reduce<2>(lat, 0.0,
+				[](const Plaq& x){ return x.B * x.B; },
+				[](double a, double b){ return a + b; }, opts);
+		bench::do_not_optimize(e);
+	});
+}
+
+
+// STREAM triad over n doubles per array, first touched by the same workers
+void stream_triad(Scaling& s, size_t n, unsigned p){
+	ThreadPool& pool = ThreadPool::global();
+	const size_t grain = 1 << 16;
+	std::unique_ptr<double[]> a(new double[n]), b(new double[n]), c(new double[n]);
+	pool.parallel_for(n, grain, [&](size_t i0, size_t i1, unsigned){
+		for (size_t i=i0; i<i1; i++){ a[i] = 0; b[i] = 1; c[i] = 2; }
+	}, p);
+	s.run("stream/triad", "-", 0, p, n, 3.0 * sizeof(double) * n, [&](bench::Iteration&){
+		pool.parallel_for(n, grain, [&](size_t i0, size_t i1, unsigned){
+			for (size_t i=i0; i<i1; i++) a[i] = b[i] + 3.0 * c[i];
+		}, p);
+		bench::clobber();
+	});
+}
+
+
+// Speedup, efficiency and bandwidth against the 1-thread row of the same
+// kernel and size, and the triad at the same thread count
+void derive(std::vector<Row>& rows){
+	auto find = [&](const Row& like, const string& kernel, unsigned p) -> const Row* {
+		for (const auto& x : rows){
+			if (x.kernel == kernel && x.preset == like.preset && x.L == like.L && x.threads == p) return &x;
+		}
+		return nullptr;
+	};
+	for (auto& x : rows){
+		const double t = x.time_ns.median;
+		if (t <= 0) continue;
+		if (const Row* one = find(x, x.kernel, 1)) {
+			const double t1 = one->time_ns.median;
+			const bool weak = x.kernel.starts_with("weak/");
+			x.speedup = weak ? x.threads * t1 / t : t1 / t;
+			x.efficiency = x.speedup / x.threads;
+		}
+		x.bandwidth = x.bytes / t;  // bytes/ns = GB/s
+	}
+	for (auto& x : rows){
+		for (const auto& ref : rows){
+			if (ref.kernel == "stream/triad" && ref.threads == x.threads && ref.bandwidth > 0) {
+				x.stream_fraction = x.bandwidth / ref.bandwidth;
+			}
+		}
+	}
+}
+
+
+void write_csv(const string& path, const std::vector<Row>& rows){
+	std::ofstream of(path);
+	if (!of.is_open()) {
+		std::cerr << "Cannot write " << path << std::endl;
+		return;
+	}
+	of << "kernel,preset,L,threads,workers,items,median_ns,mad_ns,ns_per_item,speedup,efficiency,bandwidth_GBps,stream_fraction\n";
+	for (const auto& x : rows){
+		of << x.kernel << "," << x.preset << "," << x.L << "," << x.threads << ","
+			<< x.workers << "," << x.items << "," << x.time_ns.median << "," << x.time_ns.mad << ","
+			<< (x.items ? x.time_ns.median / x.items : 0) << "," << x.speedup << ","
+			<< x.efficiency << "," << x.bandwidth << "," << x.stream_fraction << "\n";
+	}
+}
+
+void write_json(const string& path, const std::vector<Row>& rows, unsigned pinned){
+	using nlohmann::json;
+	json j;
+	j["context"] = {
+		{"num_cpus", sysconf(_SC_NPROCESSORS_ONLN)},
+		{"pool_size", ThreadPool::global().size()},
+		{"pinned_workers", pinned},
+		{"compiler", __VERSION__},
+	};
+	j["rows"] = json::array();
+	for (const auto& x : rows){
+		j["rows"].push_back({
+			{"kernel", x.kernel}, {"preset", x.preset}, {"L", x.L},
+			{"threads", x.threads}, {"workers", x.workers}, {"items", x.items},
+			{"median_ns", x.time_ns.median}, {"mad_ns", x.time_ns.mad},
+			{"speedup", x.speedup}, {"efficiency", x.efficiency},
+			{"bandwidth_GBps", x.bandwidth}, {"stream_fraction", x.stream_fraction},
+		});
+	}
+	std::ofstream of(path);
+	if (!of.is_open()) {
+		std::cerr << "Cannot write " << path << std::endl;
+		return;
+	}
+	of << j.dump(1) << "\n";
+}
+
+
+int main(int argc, char* argv[]){
+	argparse::ArgumentParser prog("bench_scaling");
+	prog.add_description("Thread and size scaling of construction, dilution, cluster labelling and field kernels");
+	const unsigned hw = ThreadPool::global().size();
+	std::vector<int> default_threads;
+	for (unsigned p=1; p<hw; p*=2) default_threads.push_back(p);
+	default_threads.push_back(hw);
+	prog.add_argument("--threads")
+		.help("Thread counts (at most the global pool size)")
+		.nargs(argparse::nargs_pattern::at_least_one)
+		.scan<'i', int>()
+		.default_value(default_threads);
+	prog.add_argument("--sizes")
+		.help("Linear supercell sizes L (8 L^3 points)")
+		.nargs(argparse::nargs_pattern::at_least_one)
+		.scan<'i', int>()
+		.default_value(std::vector<int>{8, 16});
+	prog.add_argument("--preset")
+		.help("Unit cell: diamond or cubic")
+		.default_value(string("diamond"));
+	prog.add_argument("--mem-fraction")
+		.help("Skip sizes expected to need more than this fraction of RAM")
+		.scan<'g', double>()
+		.default_value(0.5);
+	prog.add_argument("--stream-mb")
+		.help("Total size of the triad arrays")
+		.scan<'i', int>()
+		.default_value(384);
+	prog.add_argument("--no-pin")
+		.help("Leave the workers unpinned")
+		.flag();
+	prog.add_argument("--filter")
+		.help("Only run kernels whose name matches this regex")
+		.default_value(string(".*"));
+	prog.add_argument("--repetitions")
+		.scan<'i', int>()
+		.default_value(5);
+	prog.add_argument("--csv")
+		.help("Write rows to this file as CSV")
+		.default_value(string(""));
+	prog.add_argument("--json")
+		.help("Write rows to this file as JSON")
+		.default_value(string(""));
+
+	try {
+		prog.parse_args(argc, argv);
+	} catch (const std::exception& err) {
+		std::cerr << err.what() << std::endl;
+		std::cerr << prog;
+		return 1;
+	}
+
+	const string preset = prog.get<string>("--preset");
+	if (!bench::is_preset(preset)) {
+		std::cerr << "Unknown preset " << preset << std::endl;
+		return 1;
+	}
+	std::vector<unsigned> threads;
+	for (int p : prog.get<std::vector<int>>("--threads")){
+		if (p < 1 || unsigned(p) > hw) {
+			std::cerr << "Skipping " << p << " threads: the pool has " << hw << std::endl;
+			continue;
+		}
+		threads.push_back(p);
+	}
+	auto sizes = prog.get<std::vector<int>>("--sizes");
+	std::sort(sizes.begin(), sizes.end());
+
+	unsigned pinned = 0;
+	if (!prog.get<bool>("--no-pin")) {
+		pinned = pin_pool(ThreadPool::global(), allowed_cpus());
+		std::cout << "Pinned " << pinned << " of " << hw << " workers" << std::endl;
+	}
+
+	bench::Config cfg;
+	cfg.filter = prog.get<string>("--filter");
+	cfg.repetitions = std::max(1, prog.get<int>("--repetitions"));
+	std::vector<Row> rows;
+	bench::Runner r(cfg);
+	Scaling s(r, rows);
+
+	const size_t stream_n = size_t(prog.get<int>("--stream-mb")) * (1 << 20) / (3 * sizeof(double));
+	for (unsigned p : threads) stream_triad(s, stream_n, p);
+
+	const double ram = double(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+	const double budget = prog.get<double>("--mem-fraction") * ram;
+	const unsigned max_p = threads.empty() ? 1 : *std::max_element(threads.begin(), threads.end());
+	for (int L : sizes){
+		const bench::Case c = bench::make_case(preset, L);
+		// two shared lattices plus one per thread in the weak kernels
+		const double need = double(estimate_memory<FieldLattice>(c.spec, c.supercell).total()) * (2 + max_p);
+		if (need > budget) {
+			std::cout << "Skipping L=" << L << ": expected to need "
+				<< need / (1 << 30) << " GiB" << std::endl;
+			continue;
+		}
+
+		FieldLattice lat(c.spec, c.supercell);
+		FieldLattice diluted(c.spec, c.supercell);
+		dilute(diluted, victims(diluted, 0.2, 5));
+
+		std::vector<double> A, B;
+		std::mt19937 gen(3);
+		std::uniform_real_distribution<double> u(-1, 1);
+		for (auto& [_, l] : lat.links) l->A = u(gen);
+		CellRows link_rows(lat.links), plaq_rows(lat.plaqs);
+		for (uint32_t J : link_rows.index) A.push_back(lat.links.at(J)->A);
+		B.assign(plaq_rows.size(), 0);
+		const IncidenceCSR plaq_links = detail::build_incidence_parallel(lat.plaqs, plaq_rows,
+				link_rows, [](const auto& x) -> const auto& { return x.boundary; }, {});
+
+		for (unsigned p : threads){
+			weak_kernels(s, c, L, p, bench::num_cells(lat));
+			strong_kernels(s, c, L, p, diluted, lat, plaq_links, A, B);
+		}
+		release(lat);
+		release(diluted);
+	}
+
+	derive(rows);
+	std::cout << "\n" << std::left << std::setw(20) << "kernel" << std::right << std::setw(5) << "L"
+		<< std::setw(8) << "threads" << std::setw(14) << "ns/item" << std::setw(10) << "speedup"
+		<< std::setw(8) << "eff" << std::setw(10) << "GB/s" << std::setw(10) << "/triad" << "\n";
+	for (const auto& x : rows){
+		std::cout << std::left << std::setw(20) << x.kernel << std::right << std::setw(5) << x.L
+			<< std::setw(8) << x.threads << std::fixed << std::setprecision(2)
+			<< std::setw(14) << (x.items ? x.time_ns.median / x.items : 0)
+			<< std::setw(10) << x.speedup << std::setw(8) << x.efficiency
+			<< std::setw(10) << x.bandwidth << std::setw(10) << x.stream_fraction << "\n";
+	}
+
+	if (!prog.get<string>("--csv").empty()) write_csv(prog.get<string>("--csv"), rows);
+	if (!prog.get<string>("--json").empty()) write_json(prog.get<string>("--json"), rows, pinned);
+	return 0;
+}
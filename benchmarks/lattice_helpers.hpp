@@ -0,0 +1,63 @@
+#pragma once
+
+#include "cell_geometry.hpp"
+#include "cell_rows.hpp"
+#include "preset_cellspecs.hpp"
+#include <map>
+#include <string>
+
+
+/**
+ * Lattice set-up shared by the benchmark drivers.
+ */
+namespace bench {
+
+// The lattices have no destructors; free the cells so that repetitions
+// don't pile up
+template<typename Lattice>
+void release(Lattice& lat){
+	constexpr int K = CellGeometry::max_order_of<Lattice>();
+	auto drop = [](auto& cellmap){
+		for (auto& [_, x] : cellmap) delete x;
+		cellmap.clear();
+	};
+	drop(lat.points);
+	if constexpr (K >= 1) drop(lat.links);
+	if constexpr (K >= 2) drop(lat.plaqs);
+	if constexpr (K >= 3) drop(lat.vols);
+}
+
+template<typename Lattice>
+size_t num_cells(const Lattice& lat){
+	constexpr int K = CellGeometry::max_order_of<Lattice>();
+	size_t n = lat.points.size();
+	if constexpr (K >= 1) n += lat.links.size();
+	if constexpr (K >= 2) n += lat.plaqs.size();
+	if constexpr (K >= 3) n += lat.vols.size();
+	return n;
+}
+
+
+struct Case {
+	std::string preset;
+	CellGeometry::UnitCellSpecifier spec;
+	imat33_t supercell;
+	std::map<std::string, std::string> params;
+};
+
+inline bool is_preset(const std::string& preset){
+	return preset == "diamond" || preset == "cubic";
+}
+
+// A supercell of linear size L of a preset; both have 8 L^3 points
+inline Case make_case(const std::string& preset, int L){
+	using namespace CellGeometry;
+	return {preset,
+		preset == "cubic" ? PrimitiveSpecifiers::CubicSpec()
+			: PrimitiveSpecifiers::DiamondSpec(),
+		preset == "cubic" ? imat33_t::from_cols({2*L,0,0},{0,2*L,0},{0,0,2*L})
+			: imat33_t::from_cols({-L,L,L},{L,-L,L},{L,L,-L}),
+		{{"preset", preset}, {"L", std::to_string(L)}}};
+}
+
+}; // end of namespace
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "bench_harness.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace bench {
+
+/**
+ * Hardware counters over each measured region, through Linux
+ * perf_event_open, reported as perf.<counter>. Since the harness prints
+ * counters per item (and writes counters_per_item to JSON), these read as
+ * rates: perf.llc_misses of traverse/boundary/link is LLC misses per link
+ * traversed.
+ *
+ * Counts are of this process in user space, including threads it starts
+ * after the probe is made. Counters the kernel or the machine refuses
+ * (containers, VMs, perf_event_paranoid) are left out and listed in
+ * skipped(); with none open, available() is false and the probe adds
+ * nothing. If the kernel multiplexes counters, values are scaled by the
+ * fraction of the region each was running.
+ */
+class PerfProbe : public Probe {
+public:
+	struct Counter {
+		const char* name;
+		uint32_t type;
+		uint64_t config;
+	};
+
+#ifdef __linux__
+	static std::vector<Counter> default_counters(){
+		auto cache_miss = [](uint64_t cache){
+			return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		};
+		return {
+			{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+			{"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+			{"l1d_misses", PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D)},
+			{"llc_misses", PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_LL)},
+			{"dtlb_misses", PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_DTLB)},
+			{"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+		};
+	}
+#else
+	static std::vector<Counter> default_counters(){ return {}; }
+#endif
+
+	PerfProbe() : PerfProbe(default_counters()) {}
+
+	explicit PerfProbe(const std::vector<Counter>& which){
+#ifdef __linux__
+		for (const auto& c : which){
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = c.type;
+			attr.config = c.config;
+			attr.disabled = 1;
+			attr.inherit = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			const int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+			if (fd < 0) {
+				skipped_.push_back(std::string(c.name) + ": " + std::strerror(errno));
+				continue;
+			}
+			fds.push_back({c.name, fd});
+		}
+#else
+		for (const auto& c : which) skipped_.push_back(std::string(c.name) + ": not Linux");
+#endif
+	}
+
+	~PerfProbe(){
+#ifdef __linux__
+		for (const auto& f : fds) ::close(f.fd);
+#endif
+	}
+
+	PerfProbe(const PerfProbe&) = delete;
+	PerfProbe& operator=(const PerfProbe&) = delete;
+
+	inline bool available() const { return !fds.empty(); }
+
+	// Counters that opened
+	std::vector<std::string> counters() const {
+		std::vector<std::string> out;
+		for (const auto& f : fds) out.push_back(f.name);
+		return out;
+	}
+
+	// "<counter>: <reason>" for each counter that did not open
+	inline const std::vector<std::string>& skipped() const { return skipped_; }
+
+	void start() override {
+#ifdef __linux__
+		for (const auto& f : fds){
+			ioctl(f.fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(f.fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	void stop(std::map<std::string, double>& out) override {
+#ifdef __linux__
+		for (const auto& f : fds) ioctl(f.fd, PERF_EVENT_IOC_DISABLE, 0);
+		for (const auto& f : fds){
+			uint64_t v[3];  // value, time enabled, time running
+			if (::read(f.fd, v, sizeof(v)) != ssize_t(sizeof(v))) continue;
+			double x = double(v[0]);
+			if (v[2] == 0) continue;  // never scheduled; nothing to report
+			if (v[2] < v[1]) x *= double(v[1]) / double(v[2]);
+			out[std::string("perf.") + f.name] += x;
+		}
+#else
+		(void)out;
+#endif
+	}
+
+private:
+	struct Fd {
+		const char* name;
+		int fd;
+	};
+	std::vector<Fd> fds;
+	std::vector<std::string> skipped_;
+};
+
+}; // end of namespace
@@ -82,6 +82,7 @@ public:
         return false;
     }
 
+	using value_type = Pair;
 	using iterator = typename std::vector<Pair>::iterator;
 	using const_iterator = typename std::vector<Pair>::const_iterator;
 
@@ -96,6 +97,9 @@ public:
     // Empty
     bool empty() const { return data.empty(); }
 
+    // Entries the storage holds without reallocating
+    size_t capacity() const { return data.capacity(); }
+
     // Iterators
     auto begin() { return data.begin(); }
     auto end() { return data.end(); }
@@ -3,7 +3,15 @@
 
 #include "chain.hpp"
 #include "matrix.hpp"
+#include "modulus.hpp"
 #include "smithNormalForm.hpp"
+#include <cassert>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 // #include "rationalmath.hpp"
 
 namespace CellGeometry {
@@ -61,6 +69,11 @@ struct SNF_decomp {
 		Rinv(from_snfmat(SmithNormalFormCalculator::inverse(decomp.R)))
 	{}
 
+	SNF_decomp(const imat33_t& L_, const imat33_t& Linv_, const ivec3_t& D_,
+			const imat33_t& R_, const imat33_t& Rinv_) :
+		L(L_), Linv(Linv_), D(D_), R(R_), Rinv(Rinv_)
+	{}
+
 	const imat33_t L;
 	const imat33_t Linv;
 	const ivec3_t D;
@@ -68,8 +81,34 @@ struct SNF_decomp {
 	const imat33_t Rinv;
 };
 
+namespace nd {
+
+namespace detail {
+	template<int Dim, typename Orders>
+	struct cell_spec_lists;
+
+	template<int Dim, int... k>
+	struct cell_spec_lists<Dim, std::integer_sequence<int, k...>> {
+		typedef std::tuple<std::vector<CellSpecifier<Dim, k>>...> type;
+	};
+}
+
+/**
+ * The unit cell of a Dim-dimensional lattice: its lattice vectors and, for
+ * each order 0 <= k <= Dim, the k-cells in it. UnitCellSpecifier is this at
+ * Dim = 3, where the cells also go by name (add_link, sl_of_plaq, ...).
+ */
+template<int Dim>
 struct UnitCellSpecifier {	
-	UnitCellSpecifier(const imat33_t& lattice_vectors_);
+	// The columns of lattice_vectors_ span the lattice
+	UnitCellSpecifier(const imat<Dim>& lattice_vectors_) :
+		latvecs(make_positive(lattice_vectors_)),
+		latvecs_unnormed_inverse(vectorn::adjugate(latvecs)),
+		abs_det_latvecs(vectorn::det(latvecs))
+	{
+		if (abs_det_latvecs == 0) throw std::invalid_argument("Lattice vectors are singular");
+	}
+
 	/**
 	 * Creates a new unitcell from the points of the old one, with
 	 * new primitive_vectors such that
@@ -79,105 +118,155 @@ struct UnitCellSpecifier {
 	 * @param other -> another UnitCellSpecifier to build from
 	 * @param cellspec -> the change of basis matrix
 	 */
-	UnitCellSpecifier(const UnitCellSpecifier& other, const imat33_t& cellspec);
+	UnitCellSpecifier(const UnitCellSpecifier& other, const imat<Dim>& cellspec) :
+		UnitCellSpecifier(other.latvecs * cellspec)
+	{
+		const int64_t d = vectorn::det(cellspec);
+		if (d != 1 && d != -1) {
+			throw std::invalid_argument(
+					"cellspec of re-parameterised unit cell must have determinant 1");
+		}
+		// populate the cells
+		[&]<int... k>(std::integer_sequence<int, k...>){
+			(..., [&]{
+				for (const auto& c : std::get<k>(other.cells)) add_cell(c);
+			}());
+		}(std::make_integer_sequence<int, Dim+1>{});
+	}
 
 	// The lattice vectors (columns are interpreted as vectors)
 	// [ a1  a2  a3]
-	const imat33_t latvecs;
-	const imat33_t latvecs_unnormed_inverse;
+	const imat<Dim> latvecs;
+	const imat<Dim> latvecs_unnormed_inverse;
 	const int64_t abs_det_latvecs; // determinant of the lattice vectors
-	// Smith decomposition of lattice_vectors
-	//const SNF_decomp UPV;
 
-	// Creation methods
-	// Use these over manipulating the arrays directly
-	void add_point(const PointSpec& p);
-	void add_link(const LinkSpec& p);
-	void add_plaq(const PlaqSpec& p);
-	void add_vol(const VolSpec& v);
+	// Creation method, wrapping the cell into the unit cell; its boundary
+	// must land on cells already added
+	// Use this over manipulating the arrays directly
+	template<int order>
+	void add_cell(const CellSpecifier<Dim, order>& c){
+		auto& list = std::get<order>(cells);
+		list.push_back(c);
+		wrap(list.back());
+		// check that boundary is resolvable
+		if constexpr (order > 0) {
+			for (const auto& dp : c.boundary){
+				const auto x = wrap_copy(c.position + dp.relative_position);
+				if (!is_cell<order-1>(x)) {
+					std::stringstream s;
+					s << "Problem with boundary of " << order << "-cell specifier ";
+					s << "at " << c.position << ": ";
+					s << "There is no " << order-1 << "-cell at " << x;
+					throw std::out_of_range(s.str());
+				}
+			}
+		}
+	}
 
 	// Wraps the vector X in-place to within this unit cell, i.e. such that
-	// unnormed_inverse_latvecs * X in [0,abs_det_latvecs)^3
-	void wrap(ipos_t& X) const;
-	void wrap(GeometricObject& X) const;
-	ipos_t wrap_copy(const ipos_t& X) const {
-		ipos_t Y(X);
+	// unnormed_inverse_latvecs * X in [0,abs_det_latvecs)^Dim
+	void wrap(ivec<Dim>& X) const {
+		ivec<Dim> x = latvecs_unnormed_inverse * X; // this / det(A) is the true x
+		for (int i=0; i<Dim; i++){
+			x[i] = mod(x[i], abs_det_latvecs);
+		}
+		X = latvecs*x;
+		for (int i=0; i<Dim; i++){
+			assert(X[i] % abs_det_latvecs == 0);
+			X[i] /= abs_det_latvecs;
+		}
+	}
+	void wrap(GeometricObject<Dim>& X) const { wrap(X.position); }
+	ivec<Dim> wrap_copy(const ivec<Dim>& X) const {
+		ivec<Dim> Y(X);
 		wrap(Y);
 		return Y;
 	}
 
-	// Const access methods 
-	// with bounds check (consider if needed)
-	const PointSpec& point_no(sl_t sl) const { return points.at(sl); }
-	const LinkSpec&  link_no (sl_t sl) const { return links.at(sl); }
-	const PlaqSpec&  plaq_no(sl_t sl) const { return plaqs.at(sl); }
-	const VolSpec&   vol_no(sl_t sl) const { return vols.at(sl); }
+	// Const access, with bounds check
+	template<int order>
+	const CellSpecifier<Dim, order>& cell_no(sl_t sl) const {
+		return std::get<order>(cells).at(sl);
+	}
 
-	// Sublattice counters
-	sl_t num_point_sl() const { return points.size(); }
-	sl_t num_link_sl() const { return links.size(); }
-	sl_t num_plaq_sl() const { return plaqs.size(); }
-	sl_t num_vol_sl() const { return vols.size(); }
+	// Sublattice counter
+	sl_t num_sl(int order) const {
+		sl_t n = -1;
+		[&]<int... k>(std::integer_sequence<int, k...>){
+			(..., (k == order ? void(n = std::get<k>(cells).size()) : void()));
+		}(std::make_integer_sequence<int, Dim+1>{});
+		if (n < 0) {
+			throw std::out_of_range("Cell order must be in [0," + std::to_string(Dim) + "]");
+		}
+		return n;
+	}
 
 	// Sublattice index access from a physical position (real units)
 	// Linear search suboptimal here -- optimisation pointless, 
 	// pointers to everything already stored.
-	sl_t sl_of_point(const ipos_t& R) const;
-	sl_t sl_of_link(const ipos_t& R) const;
-	sl_t sl_of_plaq(const ipos_t& R) const;
-	sl_t sl_of_vol(const ipos_t& R) const;
+	template<int order>
+	sl_t sl_of(const ivec<Dim>& R_) const {
+		const auto R = wrap_copy(R_);
+		const auto& list = std::get<order>(cells);
+		for (size_t i=0; i<list.size(); i++) { if (list[i].position == R) return i; }
+		std::stringstream s;
+		s << "No " << order << "-cell found at " << R;
+		throw std::out_of_range(s.str()); 
+	}
+
+	template<int order>
+	bool is_cell(const ivec<Dim>& R_) const {
+		const auto R = wrap_copy(R_);
+		for (const auto& c : std::get<order>(cells)) { if (c.position == R) return true; }
+		return false;
+	}
 
-	bool is_point(const ipos_t& R);
-	bool is_link(const ipos_t& R);
-	bool is_plaq(const ipos_t& R);
-	bool is_vol(const ipos_t& R);
+	// The same by name
+	void add_point(const CellSpecifier<Dim, 0>& p){ add_cell(p); }
+	void add_link(const CellSpecifier<Dim, 1>& p) { add_cell(p); }
+	void add_plaq(const CellSpecifier<Dim, 2>& p) requires (Dim >= 2) { add_cell(p); }
+	void add_vol(const CellSpecifier<Dim, 3>& v) requires (Dim >= 3) { add_cell(v); }
 
+	const CellSpecifier<Dim, 0>& point_no(sl_t sl) const { return cell_no<0>(sl); }
+	const CellSpecifier<Dim, 1>& link_no(sl_t sl) const { return cell_no<1>(sl); }
+	const CellSpecifier<Dim, 2>& plaq_no(sl_t sl) const requires (Dim >= 2) { return cell_no<2>(sl); }
+	const CellSpecifier<Dim, 3>& vol_no(sl_t sl) const requires (Dim >= 3) { return cell_no<3>(sl); }
 
+	sl_t num_point_sl() const { return std::get<0>(cells).size(); }
+	sl_t num_link_sl() const { return std::get<1>(cells).size(); }
+	sl_t num_plaq_sl() const requires (Dim >= 2) { return std::get<2>(cells).size(); }
+	sl_t num_vol_sl() const requires (Dim >= 3) { return std::get<3>(cells).size(); }
 
-protected:
-	std::vector<PointSpec> points;
-	std::vector<LinkSpec> links;
-	std::vector<PlaqSpec> plaqs;
-	std::vector<VolSpec> vols;
+	sl_t sl_of_point(const ivec<Dim>& R) const { return sl_of<0>(R); }
+	sl_t sl_of_link(const ivec<Dim>& R) const { return sl_of<1>(R); }
+	sl_t sl_of_plaq(const ivec<Dim>& R) const requires (Dim >= 2) { return sl_of<2>(R); }
+	sl_t sl_of_vol(const ivec<Dim>& R) const requires (Dim >= 3) { return sl_of<3>(R); }
+
+	bool is_point(const ivec<Dim>& R) const { return is_cell<0>(R); }
+	bool is_link(const ivec<Dim>& R) const { return is_cell<1>(R); }
+	bool is_plaq(const ivec<Dim>& R) const requires (Dim >= 2) { return is_cell<2>(R); }
+	bool is_vol(const ivec<Dim>& R) const requires (Dim >= 3) { return is_cell<3>(R); }
 
-//	bool is_valid_position(const ipos_t& R){
-//		return (R[0].denom != 0) && (R[1].denom != 0) && (R[2].denom != 0);
-//	}
+protected:
+	typename detail::cell_spec_lists<Dim,
+		std::make_integer_sequence<int, Dim+1>>::type cells;
 
 private:
-//	void assert_valid_position(const ipos_t& R){
-//		if ( !is_valid_position(R) ) {
-//			throw std::invalid_argument("spec has invalid location");
-//		}
-//	}
-
-
-	/*
-	// An index of hashmap-like things. Thought of as a function, it is
-	// index : [0,D[0]) x [0,D[1]) x [0,D[2]) -> sl_t
-	// point_index[ {D[0], 0, 0} ] or similar will throw.
-	// It is an index of U*R's.
-	point_idx_t point_index;	
-	point_idx_t link_index;	
-	point_idx_t plaq_index;	
-	point_idx_t vol_index;
-	*/
-/*
-    // attempts to insert the position `x` into the pointMap hmap, throwing
-    // exceptions if `x` is outside the index scheme.
-	// @param obj_name only used to make the error message easier to read. 
-    inline void insert_position(point_idx_t& hmap, ipos_t x, sl_t sl,
-		const char* obj_name="object");
-
-    // attempts to read the value at position `x` of pointMap hmap, 
-	// no bounds check.
-	// @param obj_name only used to make the error message easier to read. 
-    sl_t sl_from_position(point_idx_t& hmap, ipos_t x);
-
-	// Checks if the point 'x' in the index scheme is initialised in hmap.
-	// If x is an invalid coordinate, an exception is thrown.
-	bool is_initialised(point_idx_t& hmap,ipos_t x, const char* obj_name="object");
-*/
+	// Negating all of the vectors only flips the determinant in odd
+	// dimensions; otherwise negate the first
+	static imat<Dim> make_positive(imat<Dim> A){
+		if (vectorn::det(A) >= 0) return A;
+		if constexpr (Dim % 2 == 1) return -1 * A;
+		for (int i=0; i<Dim; i++) A(i,0) = -A(i,0);
+		return A;
+	}
 };
 
+}; // end of namespace nd
+
+
+typedef nd::UnitCellSpecifier<3> UnitCellSpecifier;
+
+extern template struct nd::UnitCellSpecifier<3>;
+
 }; // end of namespace
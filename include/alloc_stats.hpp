@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * Heap allocation counters, per subsystem.
+ *
+ * Built with -DLATLIB_ALLOC_STATS (meson -Denable-alloc-stats=true), the
+ * library replaces the global operator new/delete and charges every
+ * allocation to the subsystem named by the innermost Scope on the
+ * allocating thread (Other if none). Frees are charged to the subsystem
+ * that made the allocation, so live and peak bytes are exact.
+ *
+ *   alloc_stats::reset();
+ *   Lattice lat(spec, supercell);
+ *   auto c = alloc_stats::get(alloc_stats::Subsystem::Chains);
+ *   std::cout << c.allocations << " chain allocations, peak " << c.peak_live_bytes;
+ *
+ * Without the flag Scope is empty, get() returns zeros and `enabled` is
+ * false, so the instrumentation costs nothing. The flag changes the
+ * layout of nothing but must be the same for the library and its users.
+ */
+namespace CellGeometry {
+namespace alloc_stats {
+
+enum class Subsystem : uint8_t {
+	Other,
+	Cells,      // the cell objects themselves
+	Chains,     // boundary/coboundary storage and chain algebra
+	IndexMaps,  // the J -> cell maps
+	IO,         // file writers' and readers' buffers
+};
+inline constexpr size_t num_subsystems = 5;
+
+inline const char* name(Subsystem s){
+	switch (s) {
+		case Subsystem::Cells: return "cells";
+		case Subsystem::Chains: return "chains";
+		case Subsystem::IndexMaps: return "index_maps";
+		case Subsystem::IO: return "io";
+		default: return "other";
+	}
+}
+
+struct Counters {
+	uint64_t allocations = 0;
+	uint64_t frees = 0;
+	// total requested since reset()
+	uint64_t bytes = 0;
+	uint64_t live_bytes = 0;
+	// highest live_bytes since reset() or reset_peak()
+	uint64_t peak_live_bytes = 0;
+};
+
+
+#ifdef LATLIB_ALLOC_STATS
+
+inline constexpr bool enabled = true;
+
+namespace detail {
+	inline thread_local Subsystem current = Subsystem::Other;
+}
+
+Counters get(Subsystem s);
+std::array<Counters, num_subsystems> snapshot();
+// Zeroes the counts (live bytes are kept, and the peak starts from them)
+void reset();
+// Restarts the peaks from the current live bytes
+void reset_peak();
+
+// Subsystem charged for allocations on this thread
+inline Subsystem current(){ return detail::current; }
+
+// Charges allocations on this thread to `s` while in scope
+class Scope {
+public:
+	explicit Scope(Subsystem s) : prev(detail::current) { detail::current = s; }
+	~Scope(){ detail::current = prev; }
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+private:
+	Subsystem prev;
+};
+
+#else
+
+inline constexpr bool enabled = false;
+
+inline Counters get(Subsystem){ return {}; }
+inline std::array<Counters, num_subsystems> snapshot(){ return {}; }
+inline void reset(){}
+inline void reset_peak(){}
+inline Subsystem current(){ return Subsystem::Other; }
+
+class Scope {
+public:
+	explicit Scope(Subsystem){}
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+};
+
+#endif
+
+}; // end of namespace alloc_stats
+}; // end of namespace
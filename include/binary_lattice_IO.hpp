@@ -0,0 +1,466 @@
+#pragma once
+
+#include "UnitCellSpecifier.hpp"
+#include "cell_geometry.hpp"
+#include "cell_rows.hpp"
+#include "chain.hpp"
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/**
+ * The native binary lattice format (.latb).
+ *
+ * A fixed-size Header followed by flat arrays ("sections"), each starting on
+ * a 64-byte boundary. Everything is stored in host byte order; the header
+ * records a byte-order mark so that foreign files are rejected rather than
+ * misread. Cells of each order are stored in rows sorted by lattice index J:
+ *
+ *   index[k]          uint32  J of each row
+ *   position[k]       ipos_t  (3 x int64) position of each row
+ *   boundary CSR      uint32 row_ptr[N_k + 1], uint32 col[nnz], int32 val[nnz]
+ *                     col = row of the (k-1)-cell, val = incidence number
+ *   coboundary CSR    as above, into rows of the (k+1)-cells
+ *
+ * plus the primitive spec in use (the one after Smith reparametrisation).
+ * Files are read back by mmap with no parsing; see MappedLattice.
+ */
+namespace CellGeometry {
+namespace latb {
+
+constexpr char magic[8] = {'L','A','T','B','I','N','\0','\0'};
+constexpr uint32_t version = 1;
+constexpr uint32_t byte_order_mark = 0x01020304;
+constexpr uint64_t alignment = 64;
+
+// A byte range of the file
+struct Section {
+	uint64_t offset = 0;
+	uint64_t size = 0;
+};
+
+struct Header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t header_size;
+
+	// 3x3 integer matrices, row-major
+	int64_t cell_vectors[9];
+	int64_t index_cell_vectors[9];
+	int64_t primitive_cell_vectors[9];
+	// Smith decomposition of the supercell (see SNF_decomp)
+	int64_t L[9], Linv[9], R[9], Rinv[9];
+	int64_t D[3];
+	int64_t num_primitive;
+
+	// Highest cell order present (0 for a point lattice, ..., 3)
+	uint32_t max_order;
+	uint32_t num_sl[4];
+	uint64_t num_cells[4];
+
+	Section spec_cells;
+	Section spec_boundary;
+	Section index[4];
+	Section position[4];
+	Section boundary_ptr[4], boundary_col[4], boundary_val[4];
+	Section coboundary_ptr[4], coboundary_col[4], coboundary_val[4];
+};
+
+// One cell of the primitive spec, with its boundary as a slice of the
+// spec_boundary section
+struct SpecCell {
+	int64_t position[3];
+	uint32_t order;
+	uint32_t sl;
+	uint32_t boundary_begin;
+	uint32_t boundary_len;
+};
+
+struct SpecBoundary {
+	int64_t relative_position[3];
+	int32_t multiplier;
+	int32_t pad;
+};
+
+static_assert(std::is_trivially_copyable_v<Header>);
+static_assert(std::is_trivially_copyable_v<ipos_t> && sizeof(ipos_t) == 3*sizeof(int64_t),
+		"positions are mapped directly as ipos_t");
+
+}; // end of namespace latb
+
+
+// Row-major view of the rows -> cols incidence of one cell order
+struct CSRView {
+	std::span<const uint32_t> row_ptr;
+	std::span<const uint32_t> col;
+	std::span<const int32_t> val;
+
+	inline size_t rows() const { return row_ptr.empty() ? 0 : row_ptr.size() - 1; }
+	inline size_t nnz() const { return col.size(); }
+	inline std::span<const uint32_t> cols(size_t row) const {
+		return col.subspan(row_ptr[row], row_ptr[row+1] - row_ptr[row]);
+	}
+	inline std::span<const int32_t> vals(size_t row) const {
+		return val.subspan(row_ptr[row], row_ptr[row+1] - row_ptr[row]);
+	}
+};
+
+
+namespace detail {
+	template<typename T>
+	inline void store_mat(int64_t (&out)[9], const vector3::mat33<T>& m){
+		for (int i=0; i<3; i++)
+			for (int j=0; j<3; j++)
+				out[3*i + j] = m(i,j);
+	}
+
+	inline imat33_t load_mat(const int64_t (&in)[9]){
+		imat33_t m;
+		for (int i=0; i<3; i++)
+			for (int j=0; j<3; j++)
+				m(i,j) = in[3*i + j];
+		return m;
+	}
+
+	inline uint64_t align_up(uint64_t x){
+		return (x + latb::alignment - 1) / latb::alignment * latb::alignment;
+	}
+}
+
+
+/**
+ * Writes the lattice to `out_path` in the .latb format.
+ * Returns false if the file could not be opened, like save().
+ */
+template<typename lat_t>
+	requires std::derived_from<lat_t, PeriodicAbstractLattice>
+bool save_binary(const lat_t& lat, const std::filesystem::path& out_path){
+	constexpr int K = max_order_of<lat_t>();
+	alloc_stats::Scope scope(alloc_stats::Subsystem::IO);
+	trace::Scope phase("save_binary", "io");
+	latb::Header h;
+	std::memset(static_cast<void*>(&h), 0, sizeof(h));
+	std::memcpy(h.magic, latb::magic, sizeof(h.magic));
+	h.version = latb::version;
+	h.byte_order = latb::byte_order_mark;
+	h.header_size = sizeof(latb::Header);
+
+	const auto& LDW = lat.smith_decomposition();
+	detail::store_mat(h.cell_vectors, lat.cell_vectors);
+	detail::store_mat(h.index_cell_vectors, lat.index_cell_vectors);
+	detail::store_mat(h.primitive_cell_vectors, lat.primitive_spec.latvecs);
+	detail::store_mat(h.L, LDW.L);
+	detail::store_mat(h.Linv, LDW.Linv);
+	detail::store_mat(h.R, LDW.R);
+	detail::store_mat(h.Rinv, LDW.Rinv);
+	for (int n=0; n<3; n++) h.D[n] = LDW.D[n];
+	h.num_primitive = lat.num_primitive;
+	h.max_order = K;
+
+	// the primitive spec
+	const UnitCellSpecifier& spec = lat.primitive_spec;
+	std::vector<latb::SpecCell> spec_cells;
+	std::vector<latb::SpecBoundary> spec_boundary;
+	auto add_spec = [&](const auto& cs, uint32_t order, uint32_t sl){
+		latb::SpecCell c = {};
+		for (int n=0; n<3; n++) c.position[n] = cs.position[n];
+		c.order = order;
+		c.sl = sl;
+		c.boundary_begin = checked_u32(spec_boundary.size());
+		c.boundary_len = checked_u32(cs.boundary.size());
+		for (const auto& b : cs.boundary){
+			latb::SpecBoundary e = {};
+			for (int n=0; n<3; n++) e.relative_position[n] = b.relative_position[n];
+			e.multiplier = b.multiplier;
+			spec_boundary.push_back(e);
+		}
+		spec_cells.push_back(c);
+	};
+	for (sl_t sl=0; sl<spec.num_point_sl(); sl++) add_spec(spec.point_no(sl), 0, sl);
+	for (sl_t sl=0; sl<spec.num_link_sl(); sl++) add_spec(spec.link_no(sl), 1, sl);
+	for (sl_t sl=0; sl<spec.num_plaq_sl(); sl++) add_spec(spec.plaq_no(sl), 2, sl);
+	for (sl_t sl=0; sl<spec.num_vol_sl(); sl++) add_spec(spec.vol_no(sl), 3, sl);
+	for (int k=0; k<4; k++) h.num_sl[k] = spec.num_sl(k);
+
+	// the cells
+	std::vector<CellRows> rows;
+	rows.reserve(K+1);
+	std::array<IncidenceCSR, 4> bdry, cobdry;
+	auto build = [&]<int k>(){
+		rows.emplace_back(cells_of<k>(lat));
+		h.num_cells[k] = rows[k].index.size();
+	};
+	auto link_up = [&]<int k>(){
+		// k-cells <-> (k-1)-cells
+		bdry[k] = build_incidence(cells_of<k>(lat), rows[k], rows[k-1],
+				[](const auto& c) -> const auto& { return c.boundary; });
+		cobdry[k-1] = build_incidence(cells_of<k-1>(lat), rows[k-1], rows[k],
+				[](const auto& c) -> const auto& { return c.coboundary; });
+	};
+	build.template operator()<0>();
+	if constexpr (K >= 1) { build.template operator()<1>(); link_up.template operator()<1>(); }
+	if constexpr (K >= 2) { build.template operator()<2>(); link_up.template operator()<2>(); }
+	if constexpr (K >= 3) { build.template operator()<3>(); link_up.template operator()<3>(); }
+
+	// lay out the sections
+	uint64_t offset = detail::align_up(sizeof(latb::Header));
+	auto place = [&offset](latb::Section& s, uint64_t bytes){
+		s.offset = offset;
+		s.size = bytes;
+		offset = detail::align_up(offset + bytes);
+	};
+	place(h.spec_cells, spec_cells.size() * sizeof(latb::SpecCell));
+	place(h.spec_boundary, spec_boundary.size() * sizeof(latb::SpecBoundary));
+	for (int k=0; k<=K; k++){
+		place(h.index[k], rows[k].index.size() * sizeof(uint32_t));
+		place(h.position[k], rows[k].position.size() * sizeof(ipos_t));
+		place(h.boundary_ptr[k], bdry[k].row_ptr.size() * sizeof(uint32_t));
+		place(h.boundary_col[k], bdry[k].col.size() * sizeof(uint32_t));
+		place(h.boundary_val[k], bdry[k].val.size() * sizeof(int32_t));
+		place(h.coboundary_ptr[k], cobdry[k].row_ptr.size() * sizeof(uint32_t));
+		place(h.coboundary_col[k], cobdry[k].col.size() * sizeof(uint32_t));
+		place(h.coboundary_val[k], cobdry[k].val.size() * sizeof(int32_t));
+	}
+
+	std::ofstream of(out_path, std::ios::binary | std::ios::trunc);
+	if (!of.is_open()) return false;
+	std::vector<char> buffer(1 << 20);
+	of.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+
+	uint64_t written = 0;
+	auto put = [&](const latb::Section& s, const void* data){
+		static const char zeros[latb::alignment] = {};
+		of.write(zeros, s.offset - written);
+		of.write(static_cast<const char*>(data), s.size);
+		written = s.offset + s.size;
+	};
+	of.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	written = sizeof(h);
+	put(h.spec_cells, spec_cells.data());
+	put(h.spec_boundary, spec_boundary.data());
+	for (int k=0; k<=K; k++){
+		put(h.index[k], rows[k].index.data());
+		put(h.position[k], rows[k].position.data());
+		put(h.boundary_ptr[k], bdry[k].row_ptr.data());
+		put(h.boundary_col[k], bdry[k].col.data());
+		put(h.boundary_val[k], bdry[k].val.data());
+		put(h.coboundary_ptr[k], cobdry[k].row_ptr.data());
+		put(h.coboundary_col[k], cobdry[k].col.data());
+		put(h.coboundary_val[k], cobdry[k].val.data());
+	}
+	of.close();
+	return !of.fail();
+}
+
+
+/**
+ * A read-only lattice backed by a memory-mapped .latb file. Construction
+ * validates the header and section table and does nothing else; every
+ * accessor is a view straight into the mapping, paged in on first use.
+ *
+ *   MappedLattice m("out.latb");
+ *   for (size_t r=0; r<m.num_cells(3); r++)
+ *       for (uint32_t p : m.boundary(3).cols(r)) ... m.positions(2)[p] ...
+ */
+class MappedLattice {
+public:
+	static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+	// With deep_check, also scans every CSR array for out-of-range entries
+	// (touching the whole file); otherwise only the header is checked.
+	explicit MappedLattice(const std::filesystem::path& path, bool deep_check = false){
+		trace::Scope phase("map_latb", "io");
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) throw std::runtime_error("Cannot open " + path.string());
+		struct stat st;
+		if (::fstat(fd, &st) != 0) {
+			::close(fd);
+			throw std::runtime_error("Cannot stat " + path.string());
+		}
+		length = st.st_size;
+		if (length < sizeof(latb::Header)) {
+			::close(fd);
+			throw std::runtime_error(path.string() + " is too short to be a .latb file");
+		}
+		void* p = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED) throw std::runtime_error("Cannot mmap " + path.string());
+		base = static_cast<const std::byte*>(p);
+		try {
+			validate(deep_check);
+		} catch (const std::runtime_error& e) {
+			::munmap(const_cast<std::byte*>(base), length);
+			throw std::runtime_error(path.string() + ": " + e.what());
+		}
+	}
+
+	MappedLattice(MappedLattice&& other) noexcept :
+		base(std::exchange(other.base, nullptr)),
+		length(std::exchange(other.length, 0))
+	{}
+	MappedLattice& operator=(MappedLattice&& other) noexcept {
+		if (this != &other) {
+			unmap();
+			base = std::exchange(other.base, nullptr);
+			length = std::exchange(other.length, 0);
+		}
+		return *this;
+	}
+	MappedLattice(const MappedLattice&) = delete;
+	MappedLattice& operator=(const MappedLattice&) = delete;
+	~MappedLattice(){ unmap(); }
+
+	inline const latb::Header& header() const {
+		return *reinterpret_cast<const latb::Header*>(base);
+	}
+
+	imat33_t cell_vectors() const { return detail::load_mat(header().cell_vectors); }
+	imat33_t index_cell_vectors() const { return detail::load_mat(header().index_cell_vectors); }
+	imat33_t primitive_cell_vectors() const {
+		return detail::load_mat(header().primitive_cell_vectors);
+	}
+	ivec3_t size() const { return {header().D[0], header().D[1], header().D[2]}; }
+	inline int max_order() const { return header().max_order; }
+	inline size_t num_cells(int order) const { return header().num_cells[check(order)]; }
+
+	std::span<const latb::SpecCell> spec_cells() const {
+		return section<latb::SpecCell>(header().spec_cells);
+	}
+	std::span<const latb::SpecBoundary> spec_boundary() const {
+		return section<latb::SpecBoundary>(header().spec_boundary);
+	}
+
+	// Lattice index J of each row, ascending
+	std::span<const uint32_t> indices(int order) const {
+		return section<uint32_t>(header().index[check(order)]);
+	}
+	std::span<const ipos_t> positions(int order) const {
+		return section<ipos_t>(header().position[check(order)]);
+	}
+
+	// Rows of order-1 cells on the boundary of each order cell (empty for 0)
+	CSRView boundary(int order) const {
+		const auto& h = header();
+		check(order);
+		return {section<uint32_t>(h.boundary_ptr[order]),
+			section<uint32_t>(h.boundary_col[order]),
+			section<int32_t>(h.boundary_val[order])};
+	}
+	// Rows of order+1 cells on the coboundary of each order cell
+	CSRView coboundary(int order) const {
+		const auto& h = header();
+		check(order);
+		return {section<uint32_t>(h.coboundary_ptr[order]),
+			section<uint32_t>(h.coboundary_col[order]),
+			section<int32_t>(h.coboundary_val[order])};
+	}
+
+	// Row of the cell with lattice index J, or npos if it is absent
+	size_t row_of(int order, idx_t J) const {
+		auto idx = indices(order);
+		auto it = std::lower_bound(idx.begin(), idx.end(), J);
+		return (it != idx.end() && *it == J) ? size_t(it - idx.begin()) : npos;
+	}
+
+private:
+	const std::byte* base = nullptr;
+	size_t length = 0;
+
+	void unmap(){
+		if (base) ::munmap(const_cast<std::byte*>(base), length);
+		base = nullptr;
+	}
+
+	int check(int order) const {
+		if (order < 0 || order > 3) throw std::out_of_range("Cell order must be in [0,3]");
+		return order;
+	}
+
+	template<typename T>
+	std::span<const T> section(const latb::Section& s) const {
+		return {reinterpret_cast<const T*>(base + s.offset), s.size / sizeof(T)};
+	}
+
+	void validate(bool deep_check) const {
+		const auto& h = header();
+		if (std::memcmp(h.magic, latb::magic, sizeof(h.magic)) != 0) {
+			throw std::runtime_error("not a .latb file");
+		}
+		if (h.byte_order != latb::byte_order_mark) {
+			throw std::runtime_error("written with a different byte order");
+		}
+		if (h.version != latb::version || h.header_size != sizeof(latb::Header)) {
+			throw std::runtime_error("unsupported .latb version "
+					+ std::to_string(h.version));
+		}
+		if (h.max_order > 3) throw std::runtime_error("corrupt header");
+
+		auto check_section = [&](const latb::Section& s, size_t elem, size_t count){
+			if (s.offset % latb::alignment != 0 || s.offset > length
+					|| s.size > length - s.offset || s.size != elem * count) {
+				throw std::runtime_error("corrupt section table");
+			}
+		};
+		size_t n_spec_boundary = h.spec_boundary.size / sizeof(latb::SpecBoundary);
+		check_section(h.spec_cells, sizeof(latb::SpecCell),
+				h.spec_cells.size / sizeof(latb::SpecCell));
+		check_section(h.spec_boundary, sizeof(latb::SpecBoundary), n_spec_boundary);
+		for (const auto& c : spec_cells()){
+			if (c.order > 3 || c.boundary_begin + uint64_t(c.boundary_len) > n_spec_boundary) {
+				throw std::runtime_error("corrupt spec");
+			}
+		}
+
+		for (uint32_t k=0; k<=h.max_order; k++){
+			const size_t n = h.num_cells[k];
+			check_section(h.index[k], sizeof(uint32_t), n);
+			check_section(h.position[k], sizeof(ipos_t), n);
+			auto check_csr = [&](const latb::Section& ptr, const latb::Section& col,
+					const latb::Section& val, bool present, size_t n_target){
+				if (!present) {
+					check_section(ptr, sizeof(uint32_t), 0);
+					check_section(col, sizeof(uint32_t), 0);
+					check_section(val, sizeof(int32_t), 0);
+					return;
+				}
+				check_section(ptr, sizeof(uint32_t), n + 1);
+				const size_t nnz = col.size / sizeof(uint32_t);
+				check_section(col, sizeof(uint32_t), nnz);
+				check_section(val, sizeof(int32_t), nnz);
+				auto rp = section<uint32_t>(ptr);
+				if (rp[0] != 0 || rp[n] != nnz) throw std::runtime_error("corrupt CSR");
+				if (!deep_check) return;
+				for (size_t r=0; r<n; r++){
+					if (rp[r] > rp[r+1]) throw std::runtime_error("corrupt CSR");
+				}
+				for (uint32_t c : section<uint32_t>(col)){
+					if (c >= n_target) throw std::runtime_error("corrupt CSR");
+				}
+			};
+			check_csr(h.boundary_ptr[k], h.boundary_col[k], h.boundary_val[k],
+					k > 0, k > 0 ? h.num_cells[k-1] : 0);
+			check_csr(h.coboundary_ptr[k], h.coboundary_col[k], h.coboundary_val[k],
+					k < h.max_order, k < h.max_order ? h.num_cells[k+1] : 0);
+		}
+	}
+};
+
+}; // end of namespace
@@ -1,18 +1,27 @@
 #pragma once 
 
+#include <algorithm>
 #include <cstddef>
 #include <memory>
+#include <ranges>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 #include <cstdlib>
 #include <smithNormalForm.hpp>
 #include <cassert>
 
+#include "alloc_stats.hpp"
 #include "chain.hpp"
 #include "modulus.hpp"
 #include "vec3.hpp"
 #include "UnitCellSpecifier.hpp"
 #include "SortedVectorMap.hpp"
+#include "neighbour_table.hpp"
+#include "normal_forms.hpp"
+#include "normal_forms_nd.hpp"
+#include "phase_trace.hpp"
 
 
  
@@ -29,130 +38,251 @@ namespace CellGeometry {
 
 typedef ivec3_t idx3_t;
 
+// Tag for constructors that set up the index scheme but create no cells,
+// for loaders that insert the cells themselves
+struct empty_lattice_t { explicit empty_lattice_t() = default; };
+inline constexpr empty_lattice_t empty_lattice{};
+
+// Allocates a cell, charged to alloc_stats::Subsystem::Cells
+template<typename T>
+inline T* new_cell(){
+	alloc_stats::Scope scope(alloc_stats::Subsystem::Cells);
+	return new T();
+}
+
 template<class Key, class Tp>
 using SparseMap = std::unordered_map<Key, Tp>;
 // using SparseMap = SortedVectorMap<Key, Tp>;
 //using SparseMap = FilteredVector<Key, Tp>;
 
-// Does the main part of the 3d indexing work
-// Represents a periodic region of space with nothing filling it
+// Smith decomposition of a supercell spec, timed as the "snf" phase; repeat
+// supercells come from the cache (see normal_forms.hpp)
+inline SNF_decomp smith_decompose(const imat33_t& supercell){
+	trace::Scope phase("snf", "construct");
+	return cached_smith_normal_form(supercell);
+}
+
+namespace nd {
+
+namespace detail {
+	// Trace phase names by cell order: the 3D names, then one name for
+	// every higher order
+	inline constexpr const char* initialise_phase[] = {"initialise_points",
+		"initialise_links", "initialise_plaqs", "initialise_vols", "initialise_cells"};
+	inline constexpr const char* connect_phase[] = {"", "connect_link_boundaries",
+		"connect_plaq_boundaries", "connect_vol_boundaries", "connect_boundaries"};
+	inline constexpr const char* erase_phase[] = {"erase_point", "erase_link",
+		"erase_plaq", "erase_vol", "erase_cell"};
+
+	constexpr int phase_of(int order){ return order < 4 ? order : 4; }
+
+	// The cell type stored in the order'th of some cell maps
+	template<int order, typename... Maps>
+	using mapped_cell_t = std::remove_pointer_t<
+		typename std::tuple_element_t<order, std::tuple<Maps...>>::mapped_type>;
+}
+
+// Does the main part of the indexing work, in Dim dimensions
+// Represents a periodic region of space with nothing filling it; the
+// Periodic*Lattice types (Dim = 3) and nd::PeriodicLattice add the cells,
+// through initialise_cells, connect_boundaries and erase_cascade
+template<int Dim>
 struct PeriodicAbstractLattice {
+	// The 3D decomposition, and its cache, in three dimensions
+	typedef std::conditional_t<Dim == 3, CellGeometry::SNF_decomp, SNF_decomp<Dim>> snf_type;
+
 	PeriodicAbstractLattice(
-			const UnitCellSpecifier& specified_primitive,
-			const imat33_t& supercell
+			const UnitCellSpecifier<Dim>& specified_primitive,
+			const imat<Dim>& supercell
 			) : 
 	// Smith decopose the supercell spec to find a primitive cell that aligns 
 	// nicely with the supercell
-	LDW(ComputeSmithNormalForm( to_snfmat(supercell))),
+	LDW(decompose(supercell)),
 	// Store the reparameterised supercell
-	cell_vectors(specified_primitive.latvecs 
-			* imat33_t::from_other(supercell)),
+	cell_vectors(specified_primitive.latvecs * supercell),
 	// Cell vectors only used for indexing
-	index_cell_vectors(specified_primitive.latvecs 
-			* imat33_t::from_other(supercell * LDW.R)),
-	num_primitive(LDW.D[0]*LDW.D[1]*LDW.D[2]),
+	index_cell_vectors(specified_primitive.latvecs * (supercell * LDW.R)),
+	num_primitive(volume(LDW.D)),
 	// Store the new primitve cell
 	primitive_spec( specified_primitive,  LDW.Linv )
 	{
 	}
 
 	// Size of the supercell in units of primitive cells
-	inline ivec3_t size() const {return LDW.D;} 
-	inline int size(int idx) const {
-		assert(idx >= 0 && idx < 3);
+	inline ivec<Dim> size() const {return LDW.D;} 
+	inline int64_t size(int idx) const {
+		assert(idx >= 0 && idx < Dim);
 		return LDW.D[idx];
 	}
 
-	// Converts a position R of a supercell point into a three-tuple lying in
-	// [0, D[0]) x [0, D[1]) x [0, D[2]) \subset Z^3
+	// Converts a position R of a supercell point into a Dim-tuple lying in
+	// [0, D[0]) x ... x [0, D[Dim-1]) \subset Z^Dim
 	// Modifies its argument, leaving remainder there
-	idx3_t get_supercell_IDX(ipos_t&R);
+	ivec<Dim> get_supercell_IDX(ivec<Dim>& R) const;
 
+	// Lattice index J (the key in the cell map) of the cell of the given
+	// order at position R
+	template<int order>
+	inline sl_t get_idx_at(const ivec<Dim>& R) const {
+		ivec<Dim> r(R);
+		const ivec<Dim> I = get_supercell_IDX(r); // r now contains the sublattice index
+		sl_t sl = primitive_spec.template sl_of<order>(r);
+		return idx_from_idxn(I) + sl * num_primitive;
+	}
 
 
 protected:
 	// The Smith decompositions of the supercell spec Z, for indexing purposes
-	const SNF_decomp LDW;
-	inline size_t idx_from_idx3(const idx3_t&I){
-		return (I[2]*LDW.D[1] + I[1])*LDW.D[0] + I[0];
+	const snf_type LDW;
+	inline size_t idx_from_idxn(const ivec<Dim>& I) const {
+		int64_t f = 0;
+		for (int n=Dim-1; n>=0; n--) f = f * LDW.D[n] + I[n];
+		return f;
 	}
 public:
+	// The Smith decomposition behind the index scheme, e.g. for serialisation
+	inline const snf_type& smith_decomposition() const { return LDW; }
+
 	///////////////////////////////////////////////////////
-	// 3-vectors, arranged columnwise, corresponding to supercell lengths 
+	// Dim-vectors, arranged columnwise, corresponding to supercell lengths 
 	// i.e. j'th vector is cell_vectors[:, j]
 	// a0 b0 c0
 	// a1 b1 c1
 	// a2 b2 c2
-	const imat33_t cell_vectors; // = specified primitive * supercell
-	const imat33_t index_cell_vectors;
+	const imat<Dim> cell_vectors; // = specified primitive * supercell
+	const imat<Dim> index_cell_vectors;
 
 	// The number of primitive cells
-	const int num_primitive;
+	const int64_t num_primitive;
 
 	// The primitive cell used after SNF decomposition
-	const UnitCellSpecifier primitive_spec;
-	//const rational::rmat33 primitive_cell_vectors;
-};
+	const UnitCellSpecifier<Dim> primitive_spec;
 
+	// Size of the lattice index space J of the given cell order
+	inline size_t index_size(int order) const {
+		return static_cast<size_t>(primitive_spec.num_sl(order)) * num_primitive;
+	}
 
-/**
- * Wraps r to primitive cell, and returns the primitive-cell index
- *
- * Given a 3D unit cell, seek an index I in [0,D_0) x [0, D_2) x [0, D_3)
- * such that R = b * I + A N + r
- * for some int vector N we do not care about
- * where the columns of A are the cell_vectors, 
- * cols of b are the primitive_lattice vectors, and 
- * r is within the primitive cell specified by b.
- *
- * Letting a be the specified cell_vectors, constructor set up
- * A = a Z = a L^-1 D W ^-1
- * b = a L^-1
- *
- * R = b * (I + D W^-1 N) + r
- */
-//inline idx3_t PeriodicAbstractLattice::get_supercell_IDX(ipos_t& R)
-//{	
-//	ipos_t UR = primitive_spec.UPV.L * R;
-//	auto [quot, rem] = moddiv(UR, primitive_spec.UPV.D);
-//	quot = primitive_spec.UPV.R  * quot;
-//	R =  primitive_spec.UPV.Linv * rem;
-//	// quot = V * ( UR // diag[P] ) 
-//	// R  = Uinv * mod( UR, diag[P] )
-//	// the sl position
-//	
-//	// wrap quot around supercell to  yield the index
-//	return mod(quot, LDW.D);
-//}
+	// Adjacency tables, built on demand by neighbour_table<order, rel>(lat)
+	// and kept up to date by the erase_* methods
+	mutable NeighbourCache neighbour_cache;
+
+protected:
+	// Allocates a cell of every sublattice in every primitive cell
+	template<int order, typename T>
+	void initialise_cells(SparseMap<sl_t, T*>& cellmap){
+		trace::Scope phase(detail::initialise_phase[detail::phase_of(order)], "construct");
+		alloc_stats::Scope scope(alloc_stats::Subsystem::IndexMaps);
+		const sl_t n_sl = primitive_spec.num_sl(order);
+		// IDX runs over the primitive cells, its last coordinate fastest
+		ivec<Dim> IDX = {};
+		for (int64_t n=0; n<num_primitive; n++){
+			for (sl_t sl=0; sl<n_sl; sl++){
+				const auto& spec = primitive_spec.template cell_no<order>(sl);
+				T* tmp = new_cell<T>();
+				tmp->position = spec.position + primitive_spec.latvecs * IDX;
+				cellmap[get_idx_at<order>(tmp->position)] = tmp;
+			}
+			for (int i=Dim-1; i>=0 && ++IDX[i] == LDW.D[i]; i--) IDX[i] = 0;
+		}
+	}
+
+	// Stitches together the boundaries of cellmap's cells and the
+	// coboundaries of facemap's
+	template<int order, typename T, typename S>
+	void connect_boundaries(const SparseMap<sl_t, T*>& cellmap,
+			const SparseMap<sl_t, S*>& facemap){
+		trace::Scope phase(detail::connect_phase[detail::phase_of(order)], "construct");
+		alloc_stats::Scope scope(alloc_stats::Subsystem::Chains);
+		for (auto [J, x] : cellmap){
+			const auto& spec = primitive_spec.template cell_no<order>(J / num_primitive);
+			for (const auto& bp : spec.boundary) {
+				S* y = facemap.at(get_idx_at<order-1>(x->position + bp.relative_position));
+				x->boundary[y] = bp.multiplier;
+				y->coboundary[x] = bp.multiplier;
+			}
+		}
+	}
+
+	// Deletes x, the cells of higher order it bounds (recursively) and all
+	// references to them. maps are the cell maps of orders 0, 1, ... up to
+	// the highest order of the lattice.
+	template<int order, typename... Maps>
+	void erase_cascade(const std::tuple<Maps&...>& maps,
+			detail::mapped_cell_t<order, Maps...>* x){
+		trace::CascadeScope phase(detail::erase_phase[detail::phase_of(order)]);
+		if constexpr (order + 1 < static_cast<int>(sizeof...(Maps))) {
+			typedef detail::mapped_cell_t<order+1, Maps...> U;
+			// note that erasing a cell modifies x->coboundary, so we must
+			// iterate then store
+			std::vector<U*> to_purge;
+			for (auto [y, _] : x->coboundary){
+				to_purge.push_back(static_cast<U*>(y));
+			}
+			for (auto y : to_purge) erase_cascade<order+1>(maps, y);
+		}
+		if constexpr (order > 0) {
+			// remove coreferences
+			for (auto [y, _] : x->boundary) y->coboundary.erase(x);
+		}
+		// remove from the index
+		const sl_t J = get_idx_at<order>(x->position);
+		std::get<order>(maps).erase(J);
+		neighbour_cache.on_erase(order, J);
+		delete x;
+	}
+
+private:
+	static snf_type decompose(const imat<Dim>& supercell){
+		if constexpr (Dim == 3) {
+			return smith_decompose(supercell);
+		} else {
+			trace::Scope phase("snf", "construct");
+			return smith_normal_form(supercell);
+		}
+	}
 
+	static int64_t volume(const ivec<Dim>& D){
+		int64_t v = 1;
+		for (int n=0; n<Dim; n++) v *= D[n];
+		return v;
+	}
+};
 
 
 /*
  * Wraps r to primitive cell, and returns the primitive-cell index
  *
- * Given a 3D unit cell, seek an index I in [0,D_0) x [0, D_1) x [0, D_2)
+ * Given a unit cell, seek an index I in [0,D_0) x ... x [0, D_{Dim-1})
  * such that R = b * (I + D N) + r
- * for some N in Z3
+ * for some N in Z^Dim
  * where b is primitive_spec.lattice_vectors
  * mutating R to now contain the remainder r
 */
-inline idx3_t PeriodicAbstractLattice::get_supercell_IDX(ipos_t& R) {
+template<int Dim>
+inline ivec<Dim> PeriodicAbstractLattice<Dim>::get_supercell_IDX(ivec<Dim>& R) const {
 	// b^-1 R  = I + D N + b^-1 r
-	ipos_t x = this->primitive_spec.latvecs_unnormed_inverse * R;
-	idx3_t I;
-	for (int n=0; n<3; n++){
+	ivec<Dim> x = this->primitive_spec.latvecs_unnormed_inverse * R;
+	ivec<Dim> I;
+	for (int n=0; n<Dim; n++){
 		auto res = moddiv(x[n], primitive_spec.abs_det_latvecs);
 		x[n] = res.rem;
 		I[n] = res.quot;
 		I[n] = mod(I[n], LDW.D[n]);
 	}
 	R = this->primitive_spec.latvecs * x;
-	for (int n=0; n<3; n++){
+	for (int n=0; n<Dim; n++){
 		R[n] /= primitive_spec.abs_det_latvecs;
 	}
 	return I;
 }
 
+}; // end of namespace nd
+
+
+typedef nd::PeriodicAbstractLattice<3> PeriodicAbstractLattice;
+
+
 /* for reference:
  *  specified_unitcell:
  *      primitive_vectors <- a
@@ -193,6 +323,36 @@ void display_coboundary(T coboundary, unsigned verbosity){
 }
 
 
+// Allocation-free views over a chain, casting to the user's derived cell type
+//   for (Point& p : cells_view<Point>(link.boundary)) ...
+//   for (auto [p, m] : terms_view<Point>(link.boundary)) ...
+template<typename Derived, int order>
+requires CellLike<Derived, order>
+inline auto cells_view(const Chain<order>& c){
+	return c | std::views::keys
+		| std::views::transform([](Cell<order>* x) -> Derived& {
+				return *static_cast<Derived*>(x);
+			});
+}
+
+template<typename Derived, int order>
+requires CellLike<Derived, order>
+inline auto terms_view(const Chain<order>& c){
+	return c | std::views::transform(
+			[](const std::pair<Cell<order>*, int>& t) -> std::pair<Derived&, int> {
+				return {*static_cast<Derived*>(t.first), t.second};
+			});
+}
+
+// Allocation-free view of the values of a cell map as references
+template<typename T, typename Map>
+inline auto deref_values_view(Map& cellmap){
+	return cellmap | std::views::values
+		| std::views::transform([](T* x) -> std::conditional_t<
+				std::is_const_v<Map>, const T&, T&> { return *x; });
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 ///////// POINTS
@@ -208,6 +368,12 @@ struct PeriodicPointLattice : public PeriodicAbstractLattice {
 	{
 		initialise_points();
 	}
+	PeriodicPointLattice(
+			const UnitCellSpecifier& specified_primitive,
+			const imat33_t& supercell,
+			empty_lattice_t
+			) : PeriodicAbstractLattice(specified_primitive, supercell)
+	{}
 
 	// Object access
 	// For all below:
@@ -220,7 +386,9 @@ struct PeriodicPointLattice : public PeriodicAbstractLattice {
 	}
 
 	// const accessors	
-	inline const Point& get_point_at(const ipos_t& R) const { return get_point_at(R); }
+	inline const Point& get_point_at(const ipos_t& R) const {
+		return *points.at(get_point_idx_at(R));
+	}
 //	inline const Point& get_point_at(const idx3_t& I, sl_t sl) const { return get_point_at(I, sl);}
 
 	// Tests if point exists in the map (slow; in principle can do in log time if we know spin* are sorted)
@@ -233,8 +401,7 @@ struct PeriodicPointLattice : public PeriodicAbstractLattice {
 
 	// Deletes a point and all references to it
 	void erase_point(Point* point_it){
-		points.erase(this->get_point_idx_at(point_it->position));
-		delete point_it;
+		this->template erase_cascade<0>(cell_maps(), point_it);
 	}
 
 	void print_state(unsigned verbosity=3){
@@ -248,47 +415,25 @@ struct PeriodicPointLattice : public PeriodicAbstractLattice {
 		}
 	}
 
-/*
-    auto get_points() {
-        return points 
-             | std::views::values 
-             | std::views::transform([](Point* p) -> Point& { return *p; });
-    }
-
-    auto get_points() const {
-        return points 
-             | std::views::values 
-             | std::views::transform([](Point* p) -> Point const& { return *p; });
-    } 
-	*/
+	// Views yielding Point&, composable with std::views, e.g.
+	//   for (Point& p : lat.get_points() | std::views::filter(pred))
+	auto get_points() { return deref_values_view<Point>(points); }
+	auto get_points() const { return deref_values_view<Point>(points); }
 
 	// Contains the 'point' geometric objects
 	SparseMap<sl_t, Point*> points;
 
-private:
-
-	inline sl_t get_point_idx_at(const ipos_t& R){	
-		ipos_t r(R);
-		const idx3_t& I = get_supercell_IDX(r); // r now contains the sublattice index
-		sl_t sl = this->primitive_spec.sl_of_point(r);
-		return this->idx_from_idx3(I)  + sl * this->num_primitive;
+	// Lattice index J (the key in points) of the point at position R
+	inline sl_t get_point_idx_at(const ipos_t& R) const {
+		return this->template get_idx_at<0>(R);
 	}
 
+private:
 	void initialise_points(){	
-		idx3_t IDX = {0,0,0};
-		// Allocate memory for all of the points we want
-	
-		for (IDX[0]=0; IDX[0]<this->size(0); IDX[0]++){
-		for (IDX[1]=0; IDX[1]<this->size(1); IDX[1]++){
-		for (IDX[2]=0; IDX[2]<this->size(2); IDX[2]++){
-			for (sl_t sl=0; sl< this->primitive_spec.num_point_sl(); sl++){
-				const PointSpec& spec = primitive_spec.point_no(sl);
-				Point* tmp = new Point();
-				tmp->position = spec.position + primitive_spec.latvecs * IDX;
-				points[get_point_idx_at(tmp->position)] = tmp;
-			}
-		}}}	
+		this->template initialise_cells<0>(points);
 	}
+
+	auto cell_maps(){ return std::tie(points); }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -310,6 +455,13 @@ struct PeriodicLinkLattice : public PeriodicPointLattice<Point>
 		initialise_links();
 		connect_link_boundaries();
 	}
+	PeriodicLinkLattice(
+			const UnitCellSpecifier& primitive,
+			const imat33_t& supercell,
+			empty_lattice_t e
+			) :
+		PeriodicPointLattice<Point>(primitive, supercell, e)
+	{}
 
 	// Object access
 	// For all below:
@@ -321,17 +473,13 @@ struct PeriodicLinkLattice : public PeriodicPointLattice<Point>
 		return *links.at(get_link_idx_at(R));
 	}
 
-	inline const Link& get_link_at(const ipos_t& R) const { return get_link_at(R); }
+	inline const Link& get_link_at(const ipos_t& R) const {
+		return *links.at(get_link_idx_at(R));
+	}
 
 	// Deletes a link (and erases corresponding coboundary terms in point)
 	void erase_link(Link* link_ptr){
-		for (auto [p, _] : link_ptr->boundary){
-			p->coboundary.erase(link_ptr);
-			// silently fails if link_it not in the coboundary
-		}
-		// remove from the index
-		links.erase(get_link_idx_at(link_ptr->position));
-		delete link_ptr;
+		this->template erase_cascade<1>(cell_maps(), link_ptr);
 	}
 
 
@@ -345,21 +493,20 @@ struct PeriodicLinkLattice : public PeriodicPointLattice<Point>
 
 	// Deletes a point (and connected links)
 	void erase_point(Point* point_ptr) {
-		// remove connected links
-		std::vector<Link*> to_purge;
-		for (auto [link_ptr, _] : point_ptr->coboundary){
-			to_purge.push_back(static_cast<Link*>(link_ptr));
-		}
-		// note that erase_link modifies the point coboundary,
-		// invalidating the iterator
-		for (auto& link_ptr : to_purge) {
-			erase_link( link_ptr );
-		}
-		PeriodicPointLattice<Point>::erase_point(point_ptr);
+		this->template erase_cascade<0>(cell_maps(), point_ptr);
 	}
 
 	SparseMap<sl_t, Link*> links;
 
+	// Views yielding Link&
+	auto get_links() { return deref_values_view<Link>(links); }
+	auto get_links() const { return deref_values_view<Link>(links); }
+
+	// Boundary / coboundary cells as the derived types (multipliers dropped;
+	// see terms_view to keep them)
+	static auto boundary_of(const Link& l) { return cells_view<Point>(l.boundary); }
+	static auto coboundary_of(const Point& p) { return cells_view<Link>(p.coboundary); }
+
 	void print_state(unsigned verbosity=3){
 		PeriodicPointLattice<Point>::print_state(verbosity);
 		if (verbosity == 0) {
@@ -375,46 +522,23 @@ struct PeriodicLinkLattice : public PeriodicPointLattice<Point>
 		}
 	}
 
-private:
-
-	inline sl_t get_link_idx_at(const ipos_t& R){	
-		ipos_t r(R);
-		const idx3_t& I = this->get_supercell_IDX(r); // r now contains the sublattice index
-		sl_t sl = this->primitive_spec.sl_of_link(r);
-		return this->idx_from_idx3(I)  + sl * this->num_primitive;
+	// Lattice index J (the key in links) of the link at position R
+	inline sl_t get_link_idx_at(const ipos_t& R) const {
+		return this->template get_idx_at<1>(R);
 	}
 
 
+private:
 	void initialise_links(){
-		idx3_t IDX = {0,0,0};
-		// Aloocate memory for the links
-		// Place all of the links	
-		for (IDX[0]=0; IDX[0]<this->size(0); IDX[0]++){
-		for (IDX[1]=0; IDX[1]<this->size(1); IDX[1]++){
-		for (IDX[2]=0; IDX[2]<this->size(2); IDX[2]++){
-			for (sl_t sl=0; sl<this->primitive_spec.num_link_sl(); sl++){
-				const LinkSpec& spec = this->primitive_spec.link_no(sl);
-				auto tmp = new Link();
-				tmp->position = spec.position + this->primitive_spec.latvecs * IDX;
-				links[get_link_idx_at(tmp->position)] = tmp;
-			}
-		}}}
+		this->template initialise_cells<1>(links);
 	}
 	
 	void connect_link_boundaries(){ 
-		// Stitch together the boundaries and coboundaries
-		for (auto [R, l] : links){
-			// Iterate over link sublattices
-			sl_t sl = this->primitive_spec.sl_of_link(l->position);
-			const auto& linkspec = this->primitive_spec.link_no(sl); // link reference
-			for (const auto& bp : linkspec.boundary) {
-				auto& point = this->get_point_at(l->position + bp.relative_position);
-				l->boundary[std::addressof(point)] = bp.multiplier;
-				point.coboundary[l] = bp.multiplier;
-			}
-		}
+		this->template connect_boundaries<1>(links, this->points);
 	}
 
+	auto cell_maps(){ return std::tie(this->points, links); }
+
 };
 
 
@@ -439,6 +563,13 @@ struct PeriodicPlaqLattice : public PeriodicLinkLattice<Point,Link>
 		initialise_plaqs();
 		connect_plaq_boundaries();
 	}
+	PeriodicPlaqLattice(
+			const UnitCellSpecifier& primitive,
+			const imat33_t& supercell,
+			empty_lattice_t e
+			) :
+		PeriodicLinkLattice<Point,Link>(primitive, supercell, e)
+	{}
 
 	// Object access
 	// For all below:
@@ -451,7 +582,9 @@ struct PeriodicPlaqLattice : public PeriodicLinkLattice<Point,Link>
 	}
 
 	// const accessors	
-	inline const Plaq& get_plaq_at(const ipos_t& R) const { return get_plaq_at(R); }
+	inline const Plaq& get_plaq_at(const ipos_t& R) const {
+		return *plaqs.at(get_plaq_idx_at(R));
+	}
 
 
 	// Tests if plaq exists in the map (slow; in principle can do in log time if we know spin* are sorted)
@@ -464,47 +597,31 @@ struct PeriodicPlaqLattice : public PeriodicLinkLattice<Point,Link>
 
 	//Deletes a plaquette
 	void erase_plaq(Plaq* plaq_ptr){
-		// remove coreferences
-		for (auto [l, _] : plaq_ptr->boundary){
-			l->coboundary.erase(plaq_ptr);
-			// silently fails if plaq_ptr not in the coboundary
-		}
-		// remove from index
-		plaqs.erase(get_plaq_idx_at(plaq_ptr->position));
-		delete plaq_ptr;
+		this->template erase_cascade<2>(cell_maps(), plaq_ptr);
 	}
 
 	// Deletes a link (and associated points, plaqs...)
 	void erase_link(Link* link_ptr){
-		// remove connected plaqs 
-		// note that erase_plaq invalidates the coboundary iterator, 
-		// so we must iterate then store
-		std::vector<Plaq*> to_purge;
-		for (auto [plaq_ptr, _]: link_ptr->coboundary){
-			to_purge.push_back(static_cast<Plaq*>(plaq_ptr));
-		}
-		for (auto plaq_ptr : to_purge){
-			erase_plaq(plaq_ptr);
-		}
-		PeriodicLinkLattice<Point, Link>::erase_link(link_ptr);
+		this->template erase_cascade<1>(cell_maps(), link_ptr);
 	}
 
 	// cascades up - deletes all connected plaqs too
-	void erase_point(const Point* point_ptr){
-		// remove connected links
-		std::vector<Link*> to_purge; 
-		for (auto [link_ptr, _] : point_ptr->coboundary){
-			to_purge.push_back(static_cast<Link*>(link_ptr));
-		}
-		for (auto link_ptr : to_purge){
-			erase_link(link_ptr);
-		}
-		PeriodicPointLattice<Point>::erase_point(point_ptr);
+	void erase_point(Point* point_ptr){
+		this->template erase_cascade<0>(cell_maps(), point_ptr);
 	}
 
 
 	SparseMap<sl_t, Plaq*> plaqs;
 
+	// Views yielding Plaq&
+	auto get_plaqs() { return deref_values_view<Plaq>(plaqs); }
+	auto get_plaqs() const { return deref_values_view<Plaq>(plaqs); }
+
+	using PeriodicLinkLattice<Point, Link>::boundary_of;
+	using PeriodicLinkLattice<Point, Link>::coboundary_of;
+	static auto boundary_of(const Plaq& p) { return cells_view<Link>(p.boundary); }
+	static auto coboundary_of(const Link& l) { return cells_view<Plaq>(l.coboundary); }
+
 
 	void print_state(unsigned verbosity =3){
 		PeriodicLinkLattice<Point, Link>::print_state(verbosity);	
@@ -521,43 +638,21 @@ struct PeriodicPlaqLattice : public PeriodicLinkLattice<Point,Link>
 
 	}
 
-private:
-	inline sl_t get_plaq_idx_at(const ipos_t& R){	
-		ipos_t r(R);
-		const idx3_t& I = this->get_supercell_IDX(r); // r now contains the sublattice index
-		sl_t sl = this->primitive_spec.sl_of_plaq(r);
-		return this->idx_from_idx3(I)  + sl * this->num_primitive;
+	// Lattice index J (the key in plaqs) of the plaq at position R
+	inline sl_t get_plaq_idx_at(const ipos_t& R) const {
+		return this->template get_idx_at<2>(R);
 	}
 
+private:
 	void initialise_plaqs(){
-		idx3_t IDX = {0,0,0};
-		// ensure all have the right number of spaces
-	
-		for (IDX[0]=0; IDX[0]<this->size(0); IDX[0]++){
-		for (IDX[1]=0; IDX[1]<this->size(1); IDX[1]++){
-		for (IDX[2]=0; IDX[2]<this->size(2); IDX[2]++){
-			for (sl_t sl=0; sl<this->primitive_spec.num_plaq_sl(); sl++){
-				const PlaqSpec& spec = this->primitive_spec.plaq_no(sl);
-				auto tmp = new Plaq();
-				tmp->position = spec.position + this->primitive_spec.latvecs * IDX;
-				plaqs[get_plaq_idx_at(tmp->position)] = tmp;
-			}
-		}}}
+		this->template initialise_cells<2>(plaqs);
 	}
 	
 	void connect_plaq_boundaries(){ 
-		// Stitch together the boundaries and coboundaries
-		for (auto [R, pl] : plaqs){
-			// Iterate over plaq sublattices
-			int sl = this->primitive_spec.sl_of_plaq(pl->position);
-			const auto& plaqspec = this->primitive_spec.plaq_no(sl); // plaq reference
-			for (const auto& bp : plaqspec.boundary) {
-				auto& link = this->get_link_at(pl->position + bp.relative_position);
-				pl->boundary[std::addressof(link)] = bp.multiplier;
-				link.coboundary[pl] = bp.multiplier;
-			}
-		}
+		this->template connect_boundaries<2>(plaqs, this->links);
 	}
+
+	auto cell_maps(){ return std::tie(this->points, this->links, plaqs); }
 };
 
 
@@ -582,6 +677,13 @@ struct PeriodicVolLattice : public PeriodicPlaqLattice<Point,Link,Plaq>
 		initialise_vols();
 		connect_vol_boundaries();
 	}
+	PeriodicVolLattice(
+			const UnitCellSpecifier& primitive,
+			const imat33_t& supercell,
+			empty_lattice_t e
+			) :
+		PeriodicPlaqLattice<Point,Link,Plaq>(primitive, supercell, e)
+	{}
 
 	// Object access
 	// For all below:
@@ -594,7 +696,9 @@ struct PeriodicVolLattice : public PeriodicPlaqLattice<Point,Link,Plaq>
 	}
 
 	// const accessors	
-	inline const Vol& get_vol_at(const ipos_t& R) const { return get_vol_at(R); }
+	inline const Vol& get_vol_at(const ipos_t& R) const {
+		return *vols.at(get_vol_idx_at(R));
+	}
 
 
 	// Tests if vol exists in the map (slow; in principle can do in log time if we know spin* are sorted)
@@ -607,57 +711,36 @@ struct PeriodicVolLattice : public PeriodicPlaqLattice<Point,Link,Plaq>
 
 
 	void erase_vol(Vol* vol_ptr){
-		// remove coreferences
-		for (auto [p, _] : vol_ptr->boundary){
-			p->coboundary.erase(vol_ptr);
-		}
-		// remove from index
-		vols.erase(get_vol_idx_at(vol_ptr->position));
-		delete vol_ptr;
+		this->template erase_cascade<3>(cell_maps(), vol_ptr);
 	}
 
 
 	//Deletes a plaquette
 	void erase_plaq(Plaq* plaq_ptr){
-		// delete volumes
-		std::vector<Vol*> to_purge;
-		for (auto [v, _] : plaq_ptr->coboundary){
-			to_purge.push_back(static_cast<Vol*>(v));
-		}
-		for (auto v : to_purge) { erase_vol(v); }
-
-		PeriodicPlaqLattice<Point, Link, Plaq>::erase_plaq(plaq_ptr);
+		this->template erase_cascade<2>(cell_maps(), plaq_ptr);
 	}
 
 	// Deletes a link (and associated points, plaqs...)
 	void erase_link(Link* link_ptr){
-		// remove connected plaqs (merging too weird to think about...)
-		std::vector<Plaq*> to_purge;
-		for (auto [plaq_ptr, _]: link_ptr->coboundary){
-			to_purge.push_back(static_cast<Plaq*>(plaq_ptr));
-		}
-		for (auto plaq_ptr : to_purge){
-			erase_plaq(plaq_ptr);
-		}
-		PeriodicLinkLattice<Point, Link>::erase_link(link_ptr);
+		this->template erase_cascade<1>(cell_maps(), link_ptr);
 	}
 
 	// cascades up - deletes all connected plaqs too
 	void erase_point(Point* point_ptr){
-		// remove connected links
-
-		std::vector<Link*> to_purge;
-		for (auto [c1_ptr, _] : point_ptr->coboundary){
-			to_purge.push_back(static_cast<Link*>(c1_ptr));
-		}
-		for (auto link_ptr: to_purge){
-			erase_link(link_ptr);
-		}
-		PeriodicPointLattice<Point>::erase_point(point_ptr);
+		this->template erase_cascade<0>(cell_maps(), point_ptr);
 	}
 
 	SparseMap<sl_t, Vol*> vols;
 
+	// Views yielding Vol&
+	auto get_vols() { return deref_values_view<Vol>(vols); }
+	auto get_vols() const { return deref_values_view<Vol>(vols); }
+
+	using PeriodicPlaqLattice<Point, Link, Plaq>::boundary_of;
+	using PeriodicPlaqLattice<Point, Link, Plaq>::coboundary_of;
+	static auto boundary_of(const Vol& v) { return cells_view<Plaq>(v.boundary); }
+	static auto coboundary_of(const Plaq& p) { return cells_view<Vol>(p.coboundary); }
+
 
 	void print_state(unsigned verbosity=3){
 		PeriodicPlaqLattice<Point, Link, Plaq>::print_state(verbosity);
@@ -674,46 +757,99 @@ struct PeriodicVolLattice : public PeriodicPlaqLattice<Point,Link,Plaq>
 	}
 
 
-private:
-	inline sl_t get_vol_idx_at(const ipos_t& R){
-		ipos_t r(R);
-		const idx3_t& I = this->get_supercell_IDX(r); // r now contains the sublattice index
-		sl_t sl = this->primitive_spec.sl_of_vol(r);
-		return this->idx_from_idx3(I)  + sl * this->num_primitive;
+	// Lattice index J (the key in vols) of the vol at position R
+	inline sl_t get_vol_idx_at(const ipos_t& R) const {
+		return this->template get_idx_at<3>(R);
 	}
 
+private:
 	void initialise_vols(){
-		idx3_t IDX = {0,0,0};
-	
-		for (IDX[0]=0; IDX[0]<this->size(0); IDX[0]++){
-		for (IDX[1]=0; IDX[1]<this->size(1); IDX[1]++){
-		for (IDX[2]=0; IDX[2]<this->size(2); IDX[2]++){
-			for (sl_t sl=0; sl<this->primitive_spec.num_vol_sl(); sl++){
-				const VolSpec& spec = this->primitive_spec.vol_no(sl);
-				auto tmp = new Vol();
-				tmp->position = spec.position + this->primitive_spec.latvecs * IDX;
-				vols[get_vol_idx_at(tmp->position)] = tmp;
-			} 
-		}}}
+		this->template initialise_cells<3>(vols);
 	}
 
 	void connect_vol_boundaries(){ 
-		// Stitch together the boundaries and coboundaries
-		for (auto [R, v]: vols){
-			// Iterate over vol sublattices
-			int sl = this->primitive_spec.sl_of_vol(v->position);
-			const auto& volspec = this->primitive_spec.vol_no(sl); // vol reference
-			for (const auto& bp : volspec.boundary) {
-				auto& plaq = this->get_plaq_at(v->position + bp.relative_position);
-				v->boundary[std::addressof(plaq)] = bp.multiplier;
-				plaq.coboundary[v] = bp.multiplier;
-			}
-		}
+		this->template connect_boundaries<3>(vols, this->plaqs);
 	}
+
+	auto cell_maps(){ return std::tie(this->points, this->links, this->plaqs, vols); }
 };
 
 
 
+// Generic access to the cell map of a given order, e.g. cells_of<1>(lat) is
+// lat.links
+template<int order, typename Lattice>
+requires (order >= 0 && order <= 3)
+inline auto& cells_of(Lattice& lat){
+	if constexpr (order == 0) { return lat.points; }
+	else if constexpr (order == 1) { return lat.links; }
+	else if constexpr (order == 2) { return lat.plaqs; }
+	else { return lat.vols; }
+}
+
+// Lattice index J of the cell of a given order at position R, e.g.
+// cell_idx_at<1>(lat, R) is lat.get_link_idx_at(R)
+template<int order, typename Lattice>
+requires (order >= 0 && order <= 3)
+inline sl_t cell_idx_at(const Lattice& lat, const ipos_t& R){
+	if constexpr (order == 0) { return lat.get_point_idx_at(R); }
+	else if constexpr (order == 1) { return lat.get_link_idx_at(R); }
+	else if constexpr (order == 2) { return lat.get_plaq_idx_at(R); }
+	else { return lat.get_vol_idx_at(R); }
+}
+
+// Erases a cell of a given order with the usual cascade, e.g.
+// erase_cell<1>(lat, x) is lat.erase_link(x)
+template<int order, typename Lattice, typename T>
+requires (order >= 0 && order <= 3)
+inline void erase_cell(Lattice& lat, T* x){
+	if constexpr (order == 0) { lat.erase_point(x); }
+	else if constexpr (order == 1) { lat.erase_link(x); }
+	else if constexpr (order == 2) { lat.erase_plaq(x); }
+	else { lat.erase_vol(x); }
+}
+
+// The (derived) cell type stored at a given order
+template<int order, typename Lattice>
+using cell_type_of = std::remove_pointer_t<typename std::remove_cvref_t<
+	decltype(cells_of<order>(std::declval<Lattice&>()))>::mapped_type>;
+
+
+/**
+ * Returns the cached CSR neighbour table of the given order, building it on
+ * first use. Typical hot loop:
+ *
+ *   const auto& nbrs = neighbour_table<3, NeighbourRelation::Boundary>(lat);
+ *   for (idx_t J1 : nbrs[J]) { Vol& v = nbrs.cell(J1); ... }
+ *
+ * The reference stays valid (and is patched) across erase_* calls, except
+ * when an erasure of an intermediate cell forces a rebuild; re-fetch the
+ * table after erasing.
+ *
+ * @param weighted -> also store the summed incidence products (see
+ *                    NeighbourTableBase)
+ */
+template<int order, NeighbourRelation rel, typename Lattice>
+requires std::derived_from<Lattice, PeriodicAbstractLattice>
+const NeighbourTable<cell_type_of<order, Lattice>>& neighbour_table(
+		Lattice& lat, bool weighted=false)
+{
+	typedef cell_type_of<order, Lattice> T;
+	static_assert(rel != NeighbourRelation::Boundary || order > 0,
+			"points have no boundary");
+	static_assert(rel != NeighbourRelation::Coboundary || order < 3,
+			"volumes have no coboundary");
+	auto& slot = lat.neighbour_cache.slot(order, rel);
+	if (!slot || (weighted && !slot->weighted())) {
+		slot = std::make_unique<NeighbourTable<T>>(
+				cells_of<order>(lat), lat.index_size(order), rel, weighted);
+	}
+	return static_cast<const NeighbourTable<T>&>(*slot);
+}
+
+
+// Cells sharing an (order-1)-cell with x0, without repeats.
+// Allocates; prefer neighbour_table in loops.
 template <typename T>
 requires (CellOfAnyOrder<T> && T::order > 0)
 std::vector<T*> get_neighbours(T* x0){
@@ -723,11 +859,15 @@ std::vector<T*> get_neighbours(T* x0){
             if (x1 != x0) retval.push_back(static_cast<T*>(x1));
         }
     }
+    std::sort(retval.begin(), retval.end());
+    retval.erase(std::unique(retval.begin(), retval.end()), retval.end());
     return retval;
 }
 
 
-template <typename T, int order>
+// Cells sharing an (order+1)-cell with x0, without repeats.
+// Allocates; prefer neighbour_table in loops.
+template <typename T>
 requires (CellOfAnyOrder<T> && T::order < 3)
 std::vector<T*> get_coneighbours(T* x0){
     std::vector<T*> retval;
@@ -736,6 +876,8 @@ std::vector<T*> get_coneighbours(T* x0){
             if (x1 != x0) retval.push_back(static_cast<T*>(x1));
         }
     }
+    std::sort(retval.begin(), retval.end());
+    retval.erase(std::unique(retval.begin(), retval.end()), retval.end());
     return retval;
 }
 
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "cell_geometry.hpp"
+#include "chain.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+namespace CellGeometry {
+
+inline uint32_t checked_u32(size_t x){
+	if (x > std::numeric_limits<uint32_t>::max()) {
+		throw std::length_error("Lattice too large for 32-bit cell indices");
+	}
+	return static_cast<uint32_t>(x);
+}
+
+
+/**
+ * The cells of one order laid out in rows sorted by lattice index J. This is
+ * the numbering shared by the file exporters: row r of order k is the r'th
+ * smallest J present in the cell map, so a pristine lattice has row == J.
+ */
+struct CellRows {
+	// Lattice index J of each row
+	std::vector<uint32_t> index;
+	std::vector<ipos_t> position;
+
+	template<typename Map>
+	explicit CellRows(const Map& cellmap){
+		std::vector<std::pair<idx_t, const GeometricObject*>> rows;
+		rows.reserve(cellmap.size());
+		for (const auto& [J, x] : cellmap) rows.emplace_back(J, x);
+		std::sort(rows.begin(), rows.end());
+		index.reserve(rows.size());
+		position.reserve(rows.size());
+		by_ptr.reserve(rows.size());
+		for (const auto& [J, x] : rows){
+			by_ptr.emplace_back(x, checked_u32(index.size()));
+			index.push_back(checked_u32(J));
+			position.push_back(x->position);
+		}
+		std::sort(by_ptr.begin(), by_ptr.end());
+	}
+
+	inline size_t size() const { return index.size(); }
+
+	// Row of a cell of this order (which must be present)
+	inline uint32_t row_of(const GeometricObject* x) const {
+		return std::lower_bound(by_ptr.begin(), by_ptr.end(),
+				std::make_pair(x, uint32_t(0)))->second;
+	}
+
+private:
+	std::vector<std::pair<const GeometricObject*, uint32_t>> by_ptr;
+};
+
+
+// Incidence between the rows of two orders, sorted by column within a row
+struct IncidenceCSR {
+	std::vector<uint32_t> row_ptr;
+	std::vector<uint32_t> col;
+	std::vector<int32_t> val;
+
+	inline size_t rows() const { return row_ptr.empty() ? 0 : row_ptr.size() - 1; }
+	inline size_t nnz() const { return col.size(); }
+};
+
+
+/**
+ * Builds the CSR of chain_of(cell) (its boundary or coboundary) for each
+ * row of `rows`, with columns numbered by `targets`.
+ *
+ *   CellRows links(lat.links), points(lat.points);
+ *   auto d1 = build_incidence(lat.links, links, points,
+ *       [](const auto& c) -> const auto& { return c.boundary; });
+ */
+template<typename Map, typename ChainOf>
+IncidenceCSR build_incidence(const Map& cellmap, const CellRows& rows,
+		const CellRows& targets, ChainOf&& chain_of)
+{
+	IncidenceCSR csr;
+	csr.row_ptr.reserve(rows.size() + 1);
+	csr.row_ptr.push_back(0);
+	std::vector<std::pair<uint32_t, int32_t>> entries;
+	for (uint32_t J : rows.index){
+		entries.clear();
+		for (const auto& [x, m] : chain_of(*cellmap.at(J))){
+			entries.emplace_back(targets.row_of(x), m);
+		}
+		std::sort(entries.begin(), entries.end());
+		for (const auto& [c, m] : entries){
+			csr.col.push_back(c);
+			csr.val.push_back(m);
+		}
+		csr.row_ptr.push_back(checked_u32(csr.col.size()));
+	}
+	return csr;
+}
+
+
+// Highest cell order of a lattice type
+template<typename Lattice>
+constexpr int max_order_of(){
+	if constexpr (requires (Lattice& l) { l.vols; }) return 3;
+	else if constexpr (requires (Lattice& l) { l.plaqs; }) return 2;
+	else if constexpr (requires (Lattice& l) { l.links; }) return 1;
+	else return 0;
+}
+
+}; // end of namespace
@@ -1,8 +1,11 @@
 #pragma once
+#include <concepts>
 #include <ios>
 #include <vector>
 #include "vec3.hpp" 
+#include "vecn.hpp"
 #include "SortedVectorMap.hpp"
+#include "alloc_stats.hpp"
 
 
 typedef vector3::vec3<int64_t> ipos_t;
@@ -10,21 +13,35 @@ typedef vector3::vec3<int64_t> ivec3_t;
 typedef vector3::mat33<int64_t> imat33_t;
 typedef unsigned int idx_t;
 
-template <int order>
+/**
+ * Cells and chains in Dim dimensions live in CellGeometry::nd: a
+ * Cell<Dim, order> exists for 0 <= order <= Dim and its position has Dim
+ * coordinates (vectorn::coords). The unqualified 3D names below, Cell<order>,
+ * Chain<order>, GeometricObject, ..., are the Dim = 3 instantiations.
+ */
+namespace CellGeometry {
+namespace nd {
+
+template<int Dim>
+using ivec = typename vectorn::coords<Dim>::vec;
+template<int Dim>
+using imat = typename vectorn::coords<Dim>::mat;
+
+template<int Dim, int order>
 struct Cell;
 
 // Implementation of an n-chain: a std::map realises a sparse vector of int
-template <int order>
-// using Chain = std::map<Cell<order>*, int>;
-// using Chain = std::unordered_map<Cell<order>*, int>;
-using Chain = SortedVectorMap<Cell<order>*, int>;
+template<int Dim, int order>
+// using Chain = std::map<Cell<Dim, order>*, int>;
+// using Chain = std::unordered_map<Cell<Dim, order>*, int>;
+using Chain = SortedVectorMap<Cell<Dim, order>*, int>;
 
 
 // using SparseMap = SortedVectorMap<Key, Tp>;
 //using SparseMap = FilteredVector<Key, Tp>;
 
-template <int order>
-inline void cleanup_chain(Chain<order>& c){
+template<int Dim, int order>
+inline void cleanup_chain(Chain<Dim, order>& c){
 	// delete any canceled cells
 	for (auto it = c.begin(); it != c.end(); ) {
 		if ( it->second == 0) {
@@ -35,8 +52,9 @@ inline void cleanup_chain(Chain<order>& c){
 	}
 }
 
-template<int order>
-inline Chain<order> operator+(const Chain<order>& c1, const Chain<order>& c2){
+template<int Dim, int order>
+inline Chain<Dim, order> operator+(const Chain<Dim, order>& c1, const Chain<Dim, order>& c2){
+	alloc_stats::Scope scope(alloc_stats::Subsystem::Chains);
 	auto retval = c1;
 	for (const auto& [cell, m] : c2){	
 		auto it = retval.find(cell);
@@ -51,8 +69,8 @@ inline Chain<order> operator+(const Chain<order>& c1, const Chain<order>& c2){
 	return retval;
 }
 
-template<int order>
-inline bool eq_superset(const Chain<order>& c1, const Chain<order>& c2){
+template<int Dim, int order>
+inline bool eq_superset(const Chain<Dim, order>& c1, const Chain<Dim, order>& c2){
 	for (const auto& [key, value] : c1){
 		if (value == 0) continue;
 		auto it = c2.find(key);
@@ -62,15 +80,16 @@ inline bool eq_superset(const Chain<order>& c1, const Chain<order>& c2){
 	return true;
 }
 
-template<int order>
-inline bool operator==(const Chain<order>& c1, const Chain<order>& c2){
+template<int Dim, int order>
+inline bool operator==(const Chain<Dim, order>& c1, const Chain<Dim, order>& c2){
 	// actually very annoying to do
 	return eq_superset(c1, c2) && eq_superset(c2, c1); 
 }
 
 
-template<int order>
-inline Chain<order> operator-(const Chain<order>& c1, const Chain<order>& c2){
+template<int Dim, int order>
+inline Chain<Dim, order> operator-(const Chain<Dim, order>& c1, const Chain<Dim, order>& c2){
+	alloc_stats::Scope scope(alloc_stats::Subsystem::Chains);
 	auto retval = c1;
 	for (const auto& cell : c2){
 		if(c1.find(cell) == c1.end()){
@@ -83,8 +102,8 @@ inline Chain<order> operator-(const Chain<order>& c1, const Chain<order>& c2){
 	return retval;
 }
 
-template<int order>
-inline Chain<order> operator+=(Chain<order>& c, const Cell<order>& cell){
+template<int Dim, int order>
+inline Chain<Dim, order> operator+=(Chain<Dim, order>& c, const Cell<Dim, order>& cell){
 	if (c.find(&cell) == c.end()){
 		c[&cell] = 1;
 	} else {
@@ -94,8 +113,8 @@ inline Chain<order> operator+=(Chain<order>& c, const Cell<order>& cell){
 	return c;
 }
 
-template<int order>
-inline Chain<order> operator-=(Chain<order>& c, const Cell<order>& cell){
+template<int Dim, int order>
+inline Chain<Dim, order> operator-=(Chain<Dim, order>& c, const Cell<Dim, order>& cell){
 	if (c.find(&cell) == c.end()){
 		c[&cell] = -1;
 	} else {
@@ -106,10 +125,11 @@ inline Chain<order> operator-=(Chain<order>& c, const Cell<order>& cell){
 	return c;
 }
 
-template<int order>
-Chain<order> operator*(int x, const Chain<order> c){
+template<int Dim, int order>
+Chain<Dim, order> operator*(int x, const Chain<Dim, order> c){
+	alloc_stats::Scope scope(alloc_stats::Subsystem::Chains);
 	if (x == 0) {
-		return Chain<order>{};
+		return Chain<Dim, order>{};
 	}
 	auto retval = c;
 	for (auto& [cell, m] : retval) {
@@ -119,8 +139,8 @@ Chain<order> operator*(int x, const Chain<order> c){
 	return retval;
 }
 
-template<int order>
-std::ostream &operator<<(std::ostream &stream, const Chain<order> &c) {
+template<int Dim, int order>
+std::ostream &operator<<(std::ostream &stream, const Chain<Dim, order> &c) {
 	for (const auto& [cell, m] : c){
 		if (m==0) continue;
 		stream<< std::showpos << m <<" "<<cell->position;
@@ -129,38 +149,45 @@ std::ostream &operator<<(std::ostream &stream, const Chain<order> &c) {
 }
 
 // Data Storage class (inherit from these for physical simulations)
-struct GeometricObject{
-	ipos_t position;
+template<int Dim>
+struct GeometricObject {
+	ivec<Dim> position;
 };
 
-// The cells over which r-chains are defined in 3D
+// The cells over which r-chains are defined in Dim dimensions
 // Boundary gives an [order-1]-chain
 // Coboundary gives an [order+1]-chain corresponding to all order+1
 // chains that this cell participates in
-template <int order_>
-struct Cell : public GeometricObject {
+template<int Dim, int order_>
+struct Cell : public GeometricObject<Dim> {
+	static_assert(order_ > 0 && order_ < Dim);
+	static const int dim = Dim;
 	static const int order = order_;
-	Chain<order - 1> boundary;
-	Chain<order + 1> coboundary;
+	Chain<Dim, order_ - 1> boundary;
+	Chain<Dim, order_ + 1> coboundary;
 };
 
-template <>
-struct Cell<0> : public GeometricObject {
+template<int Dim>
+struct Cell<Dim, 0> : public GeometricObject<Dim> {
+	static_assert(Dim > 0);
+	static const int dim = Dim;
 	static const int order = 0;
-	Chain<1> coboundary;
+	Chain<Dim, 1> coboundary;
 };
 
-template <>
-struct Cell<3> : public GeometricObject {
-	static const int order = 3;
-	Chain<2> boundary;
+template<int Dim>
+struct Cell<Dim, Dim> : public GeometricObject<Dim> {
+	static const int dim = Dim;
+	static const int order = Dim;
+	Chain<Dim, Dim - 1> boundary;
 };
 
-template <int order>
+template<int Dim, int order>
 requires (order > 0)
-Chain<order-1> d(const Chain<order>& chain) {
+Chain<Dim, order-1> d(const Chain<Dim, order>& chain) {
+	alloc_stats::Scope scope(alloc_stats::Subsystem::Chains);
 	// computes a sum over the cells
-	Chain<order-1> retval;
+	Chain<Dim, order-1> retval;
 	for (const auto& [cell, mult] : chain){
 		for (const auto& [cell_b, mult_b] : cell->boundary) {
 			retval[cell_b] += mult_b*mult;
@@ -169,10 +196,11 @@ Chain<order-1> d(const Chain<order>& chain) {
 	return retval;
 }
 
-template <int order>
-requires (order < 3)
-Chain<order+1> co_d(const Chain<order>& chain) {
-	Chain<order+1> retval;
+template<int Dim, int order>
+requires (order < Dim)
+Chain<Dim, order+1> co_d(const Chain<Dim, order>& chain) {
+	alloc_stats::Scope scope(alloc_stats::Subsystem::Chains);
+	Chain<Dim, order+1> retval;
 	for (const auto& [cell, mult] : chain){
 		for (const auto& [cell_b, mult_b] : cell->coboundary) {
 			retval[cell_b] += mult_b*mult;
@@ -184,23 +212,58 @@ Chain<order+1> co_d(const Chain<order>& chain) {
 
 // An ordered pair of an integer multiplier and a relative position
 // (pointing to the n-1 cell)
+template<int Dim>
 struct VectorSignPair {
 	int multiplier;
-	ipos_t relative_position;
+	ivec<Dim> relative_position;
 };
 
 /** Cell-specifier class: A lightweight contianer for only a position 
  * and a list of boundary members.
  * The user should avoid overriding this class.
 */
-template<int _order>
-struct CellSpecifier : public GeometricObject {
+template<int Dim, int _order>
+struct CellSpecifier : public GeometricObject<Dim> {
 	// Coordinates of the objects on the boundary relative to `position`.
 	static const int order = _order;
-	std::vector<VectorSignPair> boundary;
+	std::vector<VectorSignPair<Dim>> boundary;
 };
 
 
+template<typename T, int Dim, int order>
+concept CellLike = std::derived_from<T, Cell<Dim, order>>;
+
+}; // end of namespace nd
+}; // end of namespace
+
+
+// The 3D types
+typedef CellGeometry::nd::GeometricObject<3> GeometricObject;
+
+template<int order>
+using Cell = CellGeometry::nd::Cell<3, order>;
+
+template<int order>
+using Chain = CellGeometry::nd::Chain<3, order>;
+
+template<int order>
+requires (order > 0)
+Chain<order-1> d(const Chain<order>& chain) {
+	return CellGeometry::nd::d<3, order>(chain);
+}
+
+template<int order>
+requires (order < 3)
+Chain<order+1> co_d(const Chain<order>& chain) {
+	return CellGeometry::nd::co_d<3, order>(chain);
+}
+
+typedef CellGeometry::nd::VectorSignPair<3> VectorSignPair;
+
+template<int order>
+using CellSpecifier = CellGeometry::nd::CellSpecifier<3, order>;
+
+
 template <typename T, int order>
 concept CellLike = std::derived_from<T, Cell<order>>;
 
@@ -210,5 +273,3 @@ concept CellOfAnyOrder = CellLike<T, 0>
 	|| CellLike<T, 1> 
 	|| CellLike<T, 2> 
 	|| CellLike<T, 3>;
-
-
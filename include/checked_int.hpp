@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+/**
+ * int64_t arithmetic that throws std::overflow_error instead of wrapping.
+ *
+ * Each operation tries the __builtin_*_overflow path first; a linear
+ * combination whose products overflow but whose sum fits (a*x - b*y with
+ * large, nearly cancelling terms) is redone in __int128 where the compiler
+ * has it.
+ */
+namespace checked {
+
+[[noreturn]] inline void overflow(const char* what){
+	throw std::overflow_error(std::string("Integer overflow in ") + what);
+}
+
+inline int64_t add(int64_t a, int64_t b){
+	int64_t r;
+	if (__builtin_add_overflow(a, b, &r)) overflow("addition");
+	return r;
+}
+
+inline int64_t sub(int64_t a, int64_t b){
+	int64_t r;
+	if (__builtin_sub_overflow(a, b, &r)) overflow("subtraction");
+	return r;
+}
+
+inline int64_t mul(int64_t a, int64_t b){
+	int64_t r;
+	if (__builtin_mul_overflow(a, b, &r)) overflow("multiplication");
+	return r;
+}
+
+inline int64_t neg(int64_t a){
+	return sub(0, a);
+}
+
+// Truncating a / b and a % b; INT64_MIN / -1 throws rather than trapping.
+// b must be nonzero.
+inline int64_t div(int64_t a, int64_t b){
+	if (a == std::numeric_limits<int64_t>::min() && b == -1) overflow("division");
+	return a / b;
+}
+
+inline int64_t rem(int64_t a, int64_t b){
+	if (a == std::numeric_limits<int64_t>::min() && b == -1) overflow("remainder");
+	return a % b;
+}
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef __int128 int128_t;
+__extension__ typedef unsigned __int128 uint128_t;
+
+inline int64_t narrow(int128_t x){
+	if (x > std::numeric_limits<int64_t>::max() || x < std::numeric_limits<int64_t>::min()) {
+		overflow("narrowing");
+	}
+	return static_cast<int64_t>(x);
+}
+#endif
+
+// a*x + b*y
+inline int64_t lincomb(int64_t a, int64_t x, int64_t b, int64_t y){
+	int64_t p, q, r;
+	if (!__builtin_mul_overflow(a, x, &p) && !__builtin_mul_overflow(b, y, &q)
+			&& !__builtin_add_overflow(p, q, &r)) {
+		return r;
+	}
+#ifdef __SIZEOF_INT128__
+	return narrow(static_cast<int128_t>(a) * x + static_cast<int128_t>(b) * y);
+#else
+	overflow("linear combination");
+#endif
+}
+
+}; // end of namespace
@@ -0,0 +1,423 @@
+#pragma once
+
+#include "UnitCellSpecifier.hpp"
+#include "cell_geometry.hpp"
+#include "cell_rows.hpp"
+#include "chain.hpp"
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Disorder realisations stored as deltas against their pristine parent.
+ *
+ * A diluted lattice differs from the pristine lattice built from the same
+ * spec and supercell only by the cells it lacks. A DisorderDelta records,
+ * per order, the sorted lattice indices J of every missing cell (cascaded
+ * removals included), together with a fingerprint of the parent's index
+ * scheme so that a delta cannot be applied to the wrong lattice.
+ *
+ * On disk (.latd) a delta is a fixed Header followed, for each order, by
+ * the removed indices either as LEB128 varints of the gaps between
+ * successive indices or as a bitmap over [0, index_size), whichever is
+ * shorter. Records are self-delimiting, so any number of realisations can
+ * be concatenated in one file.
+ */
+namespace CellGeometry {
+namespace latd {
+
+constexpr char magic[8] = {'L','A','T','D','E','L','T','A'};
+constexpr uint32_t version = 1;
+constexpr uint32_t byte_order_mark = 0x01020304;
+
+enum class Encoding : uint32_t { Gaps = 0, Bitmap = 1 };
+
+struct Header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	// lattice_fingerprint of the parent
+	uint64_t parent;
+	// 3x3, row-major; informational
+	int64_t cell_vectors[9];
+	uint32_t max_order;
+	uint32_t pad;
+	uint64_t index_size[4];
+	uint64_t num_removed[4];
+	uint32_t encoding[4];
+	uint64_t payload_size[4];
+};
+
+static_assert(std::is_trivially_copyable_v<Header>);
+
+}; // end of namespace latd
+
+
+namespace detail {
+	// FNV-1a over 64-bit words
+	struct Fingerprint {
+		uint64_t h = 0xcbf29ce484222325ull;
+		void add(uint64_t x){
+			for (int b=0; b<8; b++){
+				h ^= (x >> (8*b)) & 0xff;
+				h *= 0x100000001b3ull;
+			}
+		}
+		void add(const imat33_t& m){
+			for (int i=0; i<3; i++)
+				for (int j=0; j<3; j++)
+					add(static_cast<uint64_t>(m(i,j)));
+		}
+		template<int order>
+		void add(const CellSpecifier<order>& cs){
+			for (int n=0; n<3; n++) add(static_cast<uint64_t>(cs.position[n]));
+			add(cs.boundary.size());
+			for (const auto& b : cs.boundary){
+				add(static_cast<uint64_t>(b.multiplier));
+				for (int n=0; n<3; n++) add(static_cast<uint64_t>(b.relative_position[n]));
+			}
+		}
+	};
+}
+
+
+/**
+ * 64-bit fingerprint of the index scheme of a lattice: its supercell, index
+ * cell and primitive spec. It is the same for a pristine lattice and all
+ * of its diluted realisations, and (up to hash collisions) differs between
+ * lattices whose lattice indices mean different cells.
+ */
+inline uint64_t lattice_fingerprint(const PeriodicAbstractLattice& lat){
+	detail::Fingerprint f;
+	f.add(lat.cell_vectors);
+	f.add(lat.index_cell_vectors);
+	const UnitCellSpecifier& spec = lat.primitive_spec;
+	f.add(spec.latvecs);
+	for (int k=0; k<4; k++) f.add(spec.num_sl(k));
+	for (sl_t sl=0; sl<spec.num_point_sl(); sl++) f.add(spec.point_no(sl));
+	for (sl_t sl=0; sl<spec.num_link_sl(); sl++) f.add(spec.link_no(sl));
+	for (sl_t sl=0; sl<spec.num_plaq_sl(); sl++) f.add(spec.plaq_no(sl));
+	for (sl_t sl=0; sl<spec.num_vol_sl(); sl++) f.add(spec.vol_no(sl));
+	return f.h;
+}
+
+
+struct DisorderDelta {
+	// lattice_fingerprint of the pristine parent
+	uint64_t parent = 0;
+	imat33_t cell_vectors;
+	int max_order = 0;
+	std::array<uint64_t, 4> index_size = {};
+	// Sorted lattice indices of the missing cells of each order
+	std::array<std::vector<uint32_t>, 4> removed;
+
+	inline size_t num_removed() const {
+		size_t n = 0;
+		for (const auto& r : removed) n += r.size();
+		return n;
+	}
+};
+
+
+/**
+ * The delta taking the pristine parent of `lat` to `lat`
+ */
+template<typename Lattice>
+	requires std::derived_from<Lattice, PeriodicAbstractLattice>
+DisorderDelta make_delta(const Lattice& lat){
+	constexpr int K = max_order_of<Lattice>();
+	DisorderDelta d;
+	d.parent = lattice_fingerprint(lat);
+	d.cell_vectors = lat.cell_vectors;
+	d.max_order = K;
+	std::vector<uint8_t> present;
+	[&]<int... k>(std::integer_sequence<int, k...>){
+		(..., [&]{
+			const size_t n = lat.index_size(k);
+			d.index_size[k] = n;
+			present.assign(n, 0);
+			for (const auto& [J, _] : cells_of<k>(lat)) present[J] = 1;
+			for (size_t J=0; J<n; J++){
+				if (!present[J]) d.removed[k].push_back(checked_u32(J));
+			}
+		}());
+	}(std::make_integer_sequence<int, K+1>{});
+	return d;
+}
+
+
+namespace detail {
+	// Removes the given cells of order k and, in bulk, everything above
+	// them: their cofaces (and theirs, ...) go first, then these are
+	// unhooked from their faces, dropped from the index map and deleted
+	template<int k, typename Lattice>
+	void remove_upwards(Lattice& lat, std::vector<Cell<k>*> xs){
+		std::sort(xs.begin(), xs.end());
+		xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+		if constexpr (k < max_order_of<Lattice>()) {
+			std::vector<Cell<k+1>*> above;
+			for (auto* x : xs){
+				for (const auto& [y, _] : x->coboundary) above.push_back(y);
+			}
+			if (!above.empty()) remove_upwards<k+1>(lat, std::move(above));
+		}
+		for (auto* x : xs){
+			if constexpr (k > 0) {
+				for (const auto& [f, _] : x->boundary) f->coboundary.erase(x);
+			}
+			cells_of<k>(lat).erase(cell_idx_at<k>(lat, x->position));
+			delete static_cast<cell_type_of<k, Lattice>*>(x);
+		}
+	}
+}
+
+
+/**
+ * Removes the cells listed in `delta` from `lat`, which must share the
+ * delta's parent (normally a freshly built pristine lattice). The result is
+ * what the equivalent erase_* calls produce, but cells are removed in bulk,
+ * one pass per order from the top down: the listed cells of an order are
+ * found by lattice index, unhooked from their faces, dropped from the index
+ * map and deleted, with no cascade to walk since everything above them is
+ * already gone. A delta that is not closed upwards leaves unlisted cofaces
+ * above a listed cell; those are gathered per order and removed in bulk
+ * first, as erase_* would (make_delta's deltas never need this).
+ *
+ * Cells of the delta already absent from `lat` are ignored. The neighbour
+ * cache is cleared.
+ */
+template<typename Lattice>
+	requires std::derived_from<Lattice, PeriodicAbstractLattice>
+void apply_delta(Lattice& lat, const DisorderDelta& delta){
+	constexpr int K = max_order_of<Lattice>();
+	if (delta.parent != lattice_fingerprint(lat)) {
+		throw std::invalid_argument("Disorder delta belongs to a different lattice");
+	}
+	if (delta.max_order > K) {
+		throw std::invalid_argument("Disorder delta has cells of a higher order than the lattice");
+	}
+	for (int k=0; k<=delta.max_order; k++){
+		for (uint32_t J : delta.removed[k]){
+			if (J >= lat.index_size(k)) {
+				throw std::out_of_range("Disorder delta index out of range");
+			}
+		}
+	}
+
+	[&]<int... i>(std::integer_sequence<int, i...>){
+		(..., [&]{
+			constexpr int k = K - i;
+			auto& cells = cells_of<k>(lat);
+			auto remove = [&](auto it){
+				auto* x = it->second;
+				if constexpr (k > 0) {
+					for (const auto& [f, _] : x->boundary) f->coboundary.erase(x);
+				}
+				cells.erase(it);
+				delete x;
+			};
+			// listed cells still carrying unlisted cofaces wait for those
+			std::vector<typename std::remove_cvref_t<decltype(cells)>::iterator> pending;
+			std::vector<Cell<std::min(k+1, K)>*> unlisted;
+			for (uint32_t J : delta.removed[k]){
+				auto it = cells.find(J);
+				if (it == cells.end()) continue;
+				if constexpr (k < K) {
+					if (!it->second->coboundary.empty()) {
+						for (const auto& [y, _] : it->second->coboundary) unlisted.push_back(y);
+						pending.push_back(it);
+						continue;
+					}
+				}
+				remove(it);
+			}
+			if constexpr (k < K) {
+				if (!unlisted.empty()) detail::remove_upwards<k+1>(lat, std::move(unlisted));
+			}
+			for (auto it : pending) remove(it);
+		}());
+	}(std::make_integer_sequence<int, K+1>{});
+
+	lat.neighbour_cache.clear();
+}
+
+
+namespace detail {
+	inline void put_varint(std::vector<uint8_t>& out, uint64_t x){
+		while (x >= 0x80) {
+			out.push_back(static_cast<uint8_t>(x) | 0x80);
+			x >>= 7;
+		}
+		out.push_back(static_cast<uint8_t>(x));
+	}
+
+	inline uint64_t get_varint(const uint8_t*& p, const uint8_t* end){
+		uint64_t x = 0;
+		for (int shift=0; shift<64; shift+=7){
+			if (p == end) throw std::runtime_error("Truncated disorder delta");
+			const uint8_t b = *p++;
+			x |= uint64_t(b & 0x7f) << shift;
+			if (!(b & 0x80)) return x;
+		}
+		throw std::runtime_error("Corrupt disorder delta");
+	}
+
+	// The shorter of the two encodings of a sorted index list
+	inline latd::Encoding encode_removed(const std::vector<uint32_t>& removed,
+			uint64_t index_size, std::vector<uint8_t>& out)
+	{
+		out.clear();
+		int64_t prev = -1;
+		for (uint32_t J : removed){
+			put_varint(out, J - prev - 1);
+			prev = J;
+		}
+		const uint64_t bitmap_size = (index_size + 7) / 8;
+		if (out.size() <= bitmap_size) return latd::Encoding::Gaps;
+
+		out.assign(bitmap_size, 0);
+		for (uint32_t J : removed) out[J / 8] |= uint8_t(1) << (J % 8);
+		return latd::Encoding::Bitmap;
+	}
+
+	inline void decode_removed(latd::Encoding enc, const std::vector<uint8_t>& in,
+			uint64_t index_size, uint64_t count, std::vector<uint32_t>& removed)
+	{
+		removed.clear();
+		removed.reserve(count);
+		if (enc == latd::Encoding::Gaps) {
+			const uint8_t* p = in.data();
+			const uint8_t* end = p + in.size();
+			uint64_t J = 0;
+			for (uint64_t i=0; i<count; i++){
+				J += get_varint(p, end) + (i > 0);
+				if (J >= index_size) throw std::runtime_error("Corrupt disorder delta");
+				removed.push_back(static_cast<uint32_t>(J));
+			}
+			if (p != end) throw std::runtime_error("Corrupt disorder delta");
+		} else if (enc == latd::Encoding::Bitmap) {
+			if (in.size() != (index_size + 7) / 8) {
+				throw std::runtime_error("Corrupt disorder delta");
+			}
+			for (uint64_t J=0; J<index_size; J++){
+				if (in[J / 8] >> (J % 8) & 1) removed.push_back(static_cast<uint32_t>(J));
+			}
+			if (removed.size() != count) throw std::runtime_error("Corrupt disorder delta");
+		} else {
+			throw std::runtime_error("Unknown disorder delta encoding");
+		}
+	}
+}
+
+
+// Appends one delta record to `os`
+inline void write_delta(std::ostream& os, const DisorderDelta& d){
+	latd::Header h = {};
+	std::memcpy(h.magic, latd::magic, sizeof(h.magic));
+	h.version = latd::version;
+	h.byte_order = latd::byte_order_mark;
+	h.parent = d.parent;
+	for (int i=0; i<3; i++)
+		for (int j=0; j<3; j++)
+			h.cell_vectors[3*i + j] = d.cell_vectors(i,j);
+	h.max_order = d.max_order;
+
+	std::array<std::vector<uint8_t>, 4> payload;
+	for (int k=0; k<=d.max_order; k++){
+		h.index_size[k] = d.index_size[k];
+		h.num_removed[k] = d.removed[k].size();
+		h.encoding[k] = static_cast<uint32_t>(
+				detail::encode_removed(d.removed[k], d.index_size[k], payload[k]));
+		h.payload_size[k] = payload[k].size();
+	}
+	os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	for (const auto& p : payload){
+		os.write(reinterpret_cast<const char*>(p.data()), p.size());
+	}
+	if (!os) throw std::runtime_error("Failed to write disorder delta");
+}
+
+
+/**
+ * Reads the next delta record from `is` into `d`. Returns false if the
+ * stream was already at its end, and throws on anything malformed.
+ */
+inline bool read_delta(std::istream& is, DisorderDelta& d){
+	latd::Header h;
+	is.read(reinterpret_cast<char*>(&h), sizeof(h));
+	if (is.gcount() == 0 && is.eof()) return false;
+	if (is.gcount() != sizeof(h)) throw std::runtime_error("Truncated disorder delta");
+	if (std::memcmp(h.magic, latd::magic, sizeof(h.magic)) != 0) {
+		throw std::runtime_error("Not a disorder delta");
+	}
+	if (h.byte_order != latd::byte_order_mark) {
+		throw std::runtime_error("Disorder delta written with a different byte order");
+	}
+	if (h.version != latd::version) {
+		throw std::runtime_error("Unsupported disorder delta version "
+				+ std::to_string(h.version));
+	}
+	if (h.max_order > 3) throw std::runtime_error("Corrupt disorder delta");
+
+	d = DisorderDelta();
+	d.parent = h.parent;
+	for (int i=0; i<3; i++)
+		for (int j=0; j<3; j++)
+			d.cell_vectors(i,j) = h.cell_vectors[3*i + j];
+	d.max_order = h.max_order;
+
+	std::vector<uint8_t> payload;
+	for (int k=0; k<=d.max_order; k++){
+		d.index_size[k] = h.index_size[k];
+		// bound allocations by what the encodings can produce
+		if (h.num_removed[k] > h.index_size[k] || h.index_size[k] > (uint64_t(1) << 32)
+				|| h.payload_size[k] > std::max((h.index_size[k] + 7) / 8, 5 * h.num_removed[k])) {
+			throw std::runtime_error("Corrupt disorder delta");
+		}
+		payload.resize(h.payload_size[k]);
+		is.read(reinterpret_cast<char*>(payload.data()), payload.size());
+		if (static_cast<uint64_t>(is.gcount()) != payload.size()) {
+			throw std::runtime_error("Truncated disorder delta");
+		}
+		detail::decode_removed(static_cast<latd::Encoding>(h.encoding[k]), payload,
+				h.index_size[k], h.num_removed[k], d.removed[k]);
+	}
+	return true;
+}
+
+
+// Writes a single delta to `path`; returns false if it cannot be opened
+inline bool save_delta(const DisorderDelta& d, const std::filesystem::path& path){
+	alloc_stats::Scope scope(alloc_stats::Subsystem::IO);
+	trace::Scope phase("save_delta", "io");
+	std::ofstream os(path, std::ios::binary);
+	if (!os.is_open()) return false;
+	write_delta(os, d);
+	return true;
+}
+
+// Reads every delta in the file at `path`
+inline std::vector<DisorderDelta> load_deltas(const std::filesystem::path& path){
+	alloc_stats::Scope scope(alloc_stats::Subsystem::IO);
+	trace::Scope phase("load_deltas", "io");
+	std::ifstream is(path, std::ios::binary);
+	if (!is.is_open()) throw std::runtime_error("Cannot open " + path.string());
+	std::vector<DisorderDelta> res;
+	DisorderDelta d;
+	while (read_delta(is, d)) res.push_back(std::move(d));
+	return res;
+}
+
+}; // end of namespace
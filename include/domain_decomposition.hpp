@@ -0,0 +1,424 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "cell_geometry.hpp"
+#include "modulus.hpp"
+
+
+namespace CellGeometry {
+
+/**
+ * How many primitive cells (per axis) a single incidence step can cross:
+ * the largest |I(r + dr) - I(r)| over every cell spec at r and every
+ * boundary offset dr. A cell is adjacent to something at most this many
+ * primitive cells away, in either direction.
+ */
+inline idx3_t halo_reach(const UnitCellSpecifier& spec){
+	auto cell_of = [&spec](const ipos_t& R){
+		ipos_t x = spec.latvecs_unnormed_inverse * R;
+		idx3_t I;
+		for (int n=0; n<3; n++) I[n] = moddiv(x[n], spec.abs_det_latvecs).quot;
+		return I;
+	};
+	idx3_t w = {0,0,0};
+	auto update = [&](const auto& cellspec){
+		const idx3_t I0 = cell_of(cellspec.position);
+		for (const auto& b : cellspec.boundary){
+			const idx3_t I1 = cell_of(cellspec.position + b.relative_position);
+			for (int n=0; n<3; n++) w[n] = std::max<int64_t>(w[n], std::abs(I1[n] - I0[n]));
+		}
+	};
+	for (sl_t sl=0; sl<spec.num_link_sl(); sl++) update(spec.link_no(sl));
+	for (sl_t sl=0; sl<spec.num_plaq_sl(); sl++) update(spec.plaq_no(sl));
+	for (sl_t sl=0; sl<spec.num_vol_sl(); sl++) update(spec.vol_no(sl));
+	return w;
+}
+
+
+// The owned-to-ghost traffic between one block and one of its peers, as
+// local indices into the block's field array. The n'th entry of a block's
+// send list for a peer matches the n'th entry of the peer's recv list.
+struct HaloLink {
+	int peer;
+	std::vector<idx_t> local;
+};
+
+
+/**
+ * One rank's share of the lattice: the primitive cells [lo, hi) and every
+ * cell of every order sitting in them, plus ghost copies of the cells in
+ * the surrounding halo.
+ *
+ * Per-cell fields are stored in a local array of size local_size(order):
+ * owned cells come first, then ghosts, each group sorted by lattice index J.
+ */
+struct DomainBlock {
+	int rank;
+	idx3_t lo;
+	idx3_t hi;
+
+	// Local index -> lattice index J
+	std::array<std::vector<idx_t>, 4> cells;
+	std::array<size_t, 4> n_owned = {0,0,0,0};
+
+	std::array<std::vector<HaloLink>, 4> sends;
+	std::array<std::vector<HaloLink>, 4> recvs;
+
+	inline size_t local_size(int order) const { return cells[order].size(); }
+	inline size_t n_ghost(int order) const { return cells[order].size() - n_owned[order]; }
+
+	inline std::span<const idx_t> owned(int order) const {
+		return {cells[order].data(), n_owned[order]};
+	}
+	inline std::span<const idx_t> ghosts(int order) const {
+		return {cells[order].data() + n_owned[order], n_ghost(order)};
+	}
+
+	// Local index of lattice index J, or local_size(order) if J is neither
+	// owned nor a ghost here
+	inline size_t local_index(int order, idx_t J) const {
+		const auto& c = cells[order];
+		auto mid = c.begin() + n_owned[order];
+		auto it = std::lower_bound(c.begin(), mid, J);
+		if (it != mid && *it == J) return it - c.begin();
+		it = std::lower_bound(mid, c.end(), J);
+		if (it != c.end() && *it == J) return it - c.begin();
+		return c.size();
+	}
+};
+
+
+/**
+ * Splits the primitive-cell grid of a lattice into n_blocks[0] x n_blocks[1]
+ * x n_blocks[2] near-equal boxes, one per rank (rank = (b2*n1 + b1)*n0 + b0).
+ * Ghost layers are `layers` times the halo reach of the primitive spec deep,
+ * so with layers=1 every boundary and coboundary neighbour of an owned cell
+ * is either owned or a ghost.
+ *
+ * The decomposition lives in lattice-index space, so it is the same for
+ * every rank and needs none of the cell maps; erased cells simply keep a
+ * slot in the field arrays that is never read.
+ */
+struct DomainDecomposition {
+	DomainDecomposition(const PeriodicAbstractLattice& lat, const idx3_t& n_blocks,
+			int layers = 1) :
+		D(lat.size()),
+		num_primitive(lat.num_primitive),
+		grid(n_blocks)
+	{
+		if (layers < 0) {
+			throw std::invalid_argument("Number of ghost layers must be non-negative");
+		}
+		for (int n=0; n<3; n++){
+			if (grid[n] < 1 || grid[n] > D[n]) {
+				throw std::invalid_argument(
+						"Blocks per axis must lie in [1, lattice size along that axis]");
+			}
+			splits[n].resize(grid[n] + 1);
+			for (int b=0; b<=grid[n]; b++) splits[n][b] = (b * D[n]) / grid[n];
+		}
+		width = layers * halo_reach(lat.primitive_spec);
+		for (int order=0; order<4; order++){
+			num_sl[order] = lat.primitive_spec.num_sl(order);
+		}
+
+		blocks.resize(grid[0]*grid[1]*grid[2]);
+		for (int r=0; r<num_ranks(); r++) build_block(r);
+		for (int order=0; order<4; order++) build_plan(order);
+	}
+
+	// Slabs of near-equal thickness along one axis of the primitive grid
+	static DomainDecomposition slabs(const PeriodicAbstractLattice& lat, int n_slabs,
+			int axis = 2, int layers = 1){
+		if (axis < 0 || axis > 2) throw std::out_of_range("Axis must be in [0,2]");
+		idx3_t n = {1,1,1};
+		n[axis] = n_slabs;
+		return DomainDecomposition(lat, n, layers);
+	}
+
+	inline int num_ranks() const { return static_cast<int>(blocks.size()); }
+	inline const DomainBlock& block(int rank) const { return blocks.at(rank); }
+
+	// Ghost depth in primitive cells, per axis
+	inline const idx3_t& ghost_width() const { return width; }
+
+	// Rank owning the primitive cell I (I within the lattice)
+	int owner_of(const idx3_t& I) const {
+		idx3_t b;
+		for (int n=0; n<3; n++){
+			b[n] = std::upper_bound(splits[n].begin(), splits[n].end(), I[n])
+				- splits[n].begin() - 1;
+		}
+		return (b[2]*grid[1] + b[1])*grid[0] + b[0];
+	}
+
+	// Rank owning the cell with lattice index J
+	inline int owner_of_idx(idx_t J) const { return owner_of(idx3_of(J)); }
+
+private:
+	const idx3_t D;
+	const int num_primitive;
+	const idx3_t grid;
+	std::array<std::vector<int64_t>, 3> splits;
+	idx3_t width;
+	std::array<sl_t, 4> num_sl;
+	std::vector<DomainBlock> blocks;
+
+	inline idx3_t idx3_of(idx_t J) const {
+		const int64_t f = J % num_primitive;
+		return {f % D[0], (f / D[0]) % D[1], f / (D[0]*D[1])};
+	}
+	inline idx_t idx_of(const idx3_t& I, sl_t sl) const {
+		return (I[2]*D[1] + I[1])*D[0] + I[0] + sl*num_primitive;
+	}
+
+	void build_block(int r){
+		DomainBlock& blk = blocks[r];
+		blk.rank = r;
+		const idx3_t b = {r % grid[0], (r / grid[0]) % grid[1], r / (grid[0]*grid[1])};
+		for (int n=0; n<3; n++){
+			blk.lo[n] = splits[n][b[n]];
+			blk.hi[n] = splits[n][b[n]+1];
+		}
+
+		// the halo box, clipped so that it never wraps past a full period
+		idx3_t glo, ghi;
+		for (int n=0; n<3; n++){
+			const int64_t extent = std::min(blk.hi[n] - blk.lo[n] + 2*width[n], D[n]);
+			glo[n] = blk.lo[n] - (extent - (blk.hi[n] - blk.lo[n])) / 2;
+			ghi[n] = glo[n] + extent;
+		}
+
+		for (int order=0; order<4; order++){
+			auto& cells = blk.cells[order];
+			std::vector<idx_t> ghost;
+			idx3_t I;
+			for (sl_t sl=0; sl<num_sl[order]; sl++){
+				for (I[2]=blk.lo[2]; I[2]<blk.hi[2]; I[2]++){
+				for (I[1]=blk.lo[1]; I[1]<blk.hi[1]; I[1]++){
+				for (I[0]=blk.lo[0]; I[0]<blk.hi[0]; I[0]++){
+					cells.push_back(idx_of(I, sl));
+				}}}
+				idx3_t G;
+				for (G[2]=glo[2]; G[2]<ghi[2]; G[2]++){
+				for (G[1]=glo[1]; G[1]<ghi[1]; G[1]++){
+				for (G[0]=glo[0]; G[0]<ghi[0]; G[0]++){
+					bool inside = true;
+					for (int n=0; n<3; n++) inside &= (G[n] >= blk.lo[n] && G[n] < blk.hi[n]);
+					if (inside) continue;
+					ghost.push_back(idx_of(mod(G, D), sl));
+				}}}
+			}
+			// idx_of is increasing in (sl, I2, I1, I0), so owned cells are sorted
+			std::sort(ghost.begin(), ghost.end());
+			ghost.erase(std::unique(ghost.begin(), ghost.end()), ghost.end());
+			blk.n_owned[order] = cells.size();
+			cells.insert(cells.end(), ghost.begin(), ghost.end());
+		}
+	}
+
+	void build_plan(int order){
+		// recv lists first, grouped by owner; ghosts are sorted by J, so each
+		// group is too, and the owner finds the same cells in the same order
+		for (auto& blk : blocks){
+			std::map<int, std::vector<idx_t>> by_peer;
+			for (size_t i=blk.n_owned[order]; i<blk.local_size(order); i++){
+				by_peer[owner_of_idx(blk.cells[order][i])].push_back(i);
+			}
+			for (auto& [peer, local] : by_peer){
+				DomainBlock& owner = blocks[peer];
+				std::vector<idx_t> send;
+				send.reserve(local.size());
+				for (idx_t i : local){
+					send.push_back(owner.local_index(order, blk.cells[order][i]));
+				}
+				owner.sends[order].push_back({blk.rank, std::move(send)});
+				blk.recvs[order].push_back({peer, std::move(local)});
+			}
+		}
+	}
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////// TRANSPORT
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Point-to-point messaging between the ranks of a decomposition.
+ * Implementations must buffer sends, so that exchanges where every rank
+ * sends everything before receiving cannot deadlock.
+ */
+struct HaloTransport {
+	virtual ~HaloTransport() = default;
+	virtual int rank() const = 0;
+	virtual int size() const = 0;
+	// Returns once `data` may be reused
+	virtual void send(int dest, int tag, std::span<const std::byte> data) = 0;
+	// Blocks until the next message from src with this tag arrives;
+	// its length must equal data.size()
+	virtual void recv(int src, int tag, std::span<std::byte> data) = 0;
+	virtual void barrier() = 0;
+};
+
+
+// Mailboxes shared by the ranks of a single process
+class SharedMemoryHub {
+public:
+	explicit SharedMemoryHub(int n_ranks) : n_ranks(n_ranks) {
+		if (n_ranks < 1) throw std::invalid_argument("Need at least one rank");
+	}
+
+	inline int size() const { return n_ranks; }
+
+	void post(int src, int dest, int tag, std::span<const std::byte> data){
+		{
+			std::lock_guard lock(mtx);
+			mail[{src, dest, tag}].emplace_back(data.begin(), data.end());
+		}
+		cv.notify_all();
+	}
+
+	void take(int src, int dest, int tag, std::span<std::byte> data){
+		std::unique_lock lock(mtx);
+		auto& box = mail[{src, dest, tag}];
+		cv.wait(lock, [&]{ return aborted || !box.empty(); });
+		if (aborted) throw std::runtime_error("Halo exchange aborted by another rank");
+		if (box.front().size() != data.size()) {
+			throw std::length_error("Halo message length does not match receive buffer");
+		}
+		std::memcpy(data.data(), box.front().data(), data.size());
+		box.pop_front();
+	}
+
+	void barrier(){
+		std::unique_lock lock(mtx);
+		const size_t gen = generation;
+		if (++arrived == n_ranks) {
+			arrived = 0;
+			generation++;
+			cv.notify_all();
+			return;
+		}
+		cv.wait(lock, [&]{ return aborted || generation != gen; });
+		if (aborted) throw std::runtime_error("Halo exchange aborted by another rank");
+	}
+
+	// Wakes every blocked rank with an exception, e.g. after one has failed
+	void abort(){
+		{
+			std::lock_guard lock(mtx);
+			aborted = true;
+		}
+		cv.notify_all();
+	}
+
+private:
+	const int n_ranks;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::map<std::tuple<int,int,int>, std::deque<std::vector<std::byte>>> mail;
+	int arrived = 0;
+	size_t generation = 0;
+	bool aborted = false;
+};
+
+
+// "Ranks as threads": one endpoint of a SharedMemoryHub
+struct ThreadTransport : public HaloTransport {
+	ThreadTransport(SharedMemoryHub& hub, int rank) : hub(hub), my_rank(rank) {}
+
+	int rank() const override { return my_rank; }
+	int size() const override { return hub.size(); }
+	void send(int dest, int tag, std::span<const std::byte> data) override {
+		hub.post(my_rank, dest, tag, data);
+	}
+	void recv(int src, int tag, std::span<std::byte> data) override {
+		hub.take(src, my_rank, tag, data);
+	}
+	void barrier() override { hub.barrier(); }
+
+private:
+	SharedMemoryHub& hub;
+	const int my_rank;
+};
+
+
+/**
+ * Runs fn(HaloTransport&) once per rank, each on its own thread, and waits
+ * for all of them. If any rank throws, the others are woken and the first
+ * exception is rethrown here.
+ */
+template<typename F>
+void run_ranks_as_threads(int n_ranks, F&& fn){
+	SharedMemoryHub hub(n_ranks);
+	std::vector<std::exception_ptr> errors(n_ranks);
+	std::vector<std::thread> pool;
+	pool.reserve(n_ranks);
+	for (int r=0; r<n_ranks; r++){
+		pool.emplace_back([&, r](){
+			ThreadTransport comm(hub, r);
+			try {
+				fn(static_cast<HaloTransport&>(comm));
+			} catch (...) {
+				errors[r] = std::current_exception();
+				hub.abort();
+			}
+		});
+	}
+	for (auto& t : pool) t.join();
+	for (auto& e : errors){
+		if (e) std::rethrow_exception(e);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////// HALO EXCHANGE
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Refreshes the ghost entries of `field` (this rank's local array for cells
+ * of the given order) from their owners. Collective: every rank of the
+ * decomposition must call it with the same order.
+ */
+template<typename T>
+requires std::is_trivially_copyable_v<T>
+void exchange_halo(const DomainDecomposition& dd, int order,
+		HaloTransport& comm, std::span<T> field)
+{
+	const DomainBlock& blk = dd.block(comm.rank());
+	if (field.size() != blk.local_size(order)) {
+		throw std::length_error("Field size does not match the local block");
+	}
+
+	std::vector<T> buf;
+	for (const auto& s : blk.sends[order]){
+		buf.resize(s.local.size());
+		for (size_t i=0; i<buf.size(); i++) buf[i] = field[s.local[i]];
+		comm.send(s.peer, order, std::as_bytes(std::span<const T>(buf)));
+	}
+	for (const auto& r : blk.recvs[order]){
+		buf.resize(r.local.size());
+		comm.recv(r.peer, order, std::as_writable_bytes(std::span<T>(buf)));
+		for (size_t i=0; i<buf.size(); i++) field[r.local[i]] = buf[i];
+	}
+}
+
+}; // end of namespace
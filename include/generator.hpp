@@ -0,0 +1,93 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Minimal lazy generator (a stand-in for C++23 std::generator).
+ * Yielded values are passed by address, so yielding an lvalue living in the
+ * coroutine frame costs nothing; the reference is valid until the next
+ * increment.
+ *
+ *   Generator<const Foo&> gen(){ Foo f; while (...) co_yield f; }
+ *   for (const Foo& f : gen()) ...
+ */
+template<typename T>
+class Generator {
+	using value_t = std::remove_cvref_t<T>;
+	using ref_t = std::conditional_t<std::is_reference_v<T>, T, const T&>;
+public:
+	struct promise_type {
+		const value_t* current = nullptr;
+		std::exception_ptr error;
+
+		Generator get_return_object() {
+			return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		std::suspend_always yield_value(const value_t& v) noexcept {
+			current = std::addressof(v);
+			return {};
+		}
+		void return_void() noexcept {}
+		void unhandled_exception() { error = std::current_exception(); }
+	};
+
+	using handle_t = std::coroutine_handle<promise_type>;
+
+	struct sentinel {};
+
+	class iterator {
+	public:
+		using value_type = value_t;
+		using difference_type = std::ptrdiff_t;
+
+		iterator() = default;
+		explicit iterator(handle_t h) : h_(h) {}
+
+		ref_t operator*() const { return *h_.promise().current; }
+
+		iterator& operator++() {
+			h_.resume();
+			rethrow(h_);
+			return *this;
+		}
+		void operator++(int) { ++*this; }
+
+		friend bool operator==(const iterator& it, sentinel) { return it.h_.done(); }
+	private:
+		handle_t h_ = nullptr;
+	};
+
+	explicit Generator(handle_t h) : h_(h) {}
+	Generator(Generator&& other) noexcept : h_(std::exchange(other.h_, nullptr)) {}
+	Generator& operator=(Generator&& other) noexcept {
+		if (this != &other) {
+			if (h_) h_.destroy();
+			h_ = std::exchange(other.h_, nullptr);
+		}
+		return *this;
+	}
+	Generator(const Generator&) = delete;
+	Generator& operator=(const Generator&) = delete;
+	~Generator() { if (h_) h_.destroy(); }
+
+	// Single pass: begin() starts the coroutine
+	iterator begin() {
+		h_.resume();
+		rethrow(h_);
+		return iterator(h_);
+	}
+	sentinel end() { return {}; }
+
+private:
+	static void rethrow(handle_t h) {
+		if (h.promise().error) std::rethrow_exception(h.promise().error);
+	}
+	handle_t h_;
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "cell_geometry.hpp"
+#include "neighbour_table.hpp"
+#include "parallel.hpp"
+
+
+namespace CellGeometry {
+
+struct BFSOptions {
+	// Workers of the pool to use (0 = all of them)
+	unsigned n_threads = 1;
+	// Pool to run on (nullptr = ThreadPool::global())
+	ThreadPool* pool = nullptr;
+	// Cells per scheduled chunk; levels smaller than this run serially
+	size_t grain = 4096;
+	// Cells further than this are left unreached
+	uint32_t max_distance = std::numeric_limits<uint32_t>::max() - 1;
+	// If non-empty, stop as soon as all of these have been reached
+	std::span<const idx_t> targets = {};
+	// Store a BFS parent per cell, for path reconstruction
+	bool record_parents = false;
+	// Switch between top-down and bottom-up steps (Beamer et al. 2012).
+	// Go bottom-up once the frontier's edges exceed 1/alpha of the unexplored
+	// edges; return top-down once the frontier holds fewer than 1/beta cells
+	bool direction_optimising = true;
+	double alpha = 14;
+	double beta = 24;
+};
+
+
+struct BFSResult {
+	static constexpr uint32_t unreached = std::numeric_limits<uint32_t>::max();
+
+	// Graph distance to the nearest source, per lattice index J
+	std::vector<uint32_t> dist;
+	// BFS tree parent per J (sources are their own parent); empty unless
+	// BFSOptions::record_parents was set
+	std::vector<idx_t> parent;
+
+	inline bool reached(idx_t J) const { return dist[J] != unreached; }
+
+	// A shortest path from the nearest source to J, source first.
+	// Empty if J was not reached.
+	std::vector<idx_t> path_to(idx_t J) const {
+		if (parent.empty()) {
+			throw std::logic_error("path_to requires BFSOptions::record_parents");
+		}
+		std::vector<idx_t> path;
+		if (!reached(J)) return path;
+		path.reserve(dist[J] + 1);
+		path.push_back(J);
+		while (parent[J] != J) {
+			J = parent[J];
+			path.push_back(J);
+		}
+		std::reverse(path.begin(), path.end());
+		return path;
+	}
+};
+
+
+/**
+ * Multi-source breadth-first search over a (symmetric) neighbour table,
+ * e.g. neighbour_table<0, NeighbourRelation::Coboundary>(lat) for the
+ * point-link graph. Returns dense distances indexed by lattice index.
+ */
+inline BFSResult bfs(const NeighbourTableBase& nbrs,
+		std::span<const idx_t> sources, const BFSOptions& opts = {})
+{
+	typedef std::atomic_ref<uint32_t> aref;
+	const uint32_t U = BFSResult::unreached;
+	const size_t n = nbrs.size();
+
+	ThreadPool& pool = opts.pool ? *opts.pool : ThreadPool::global();
+
+	BFSResult res;
+	res.dist.assign(n, U);
+	if (opts.record_parents) res.parent.assign(n, 0);
+
+	std::vector<idx_t> frontier;
+	size_t unexplored_edges = 0;
+	for (size_t J=0; J<n; J++) unexplored_edges += nbrs[J].size();
+	for (idx_t J : sources) {
+		if (res.dist[J] == 0) continue;
+		res.dist[J] = 0;
+		if (opts.record_parents) res.parent[J] = J;
+		frontier.push_back(J);
+		unexplored_edges -= nbrs[J].size();
+	}
+
+	size_t targets_left = opts.targets.size();
+	auto all_targets_reached = [&](){
+		if (opts.targets.empty()) return false;
+		while (targets_left > 0 && res.reached(opts.targets[targets_left-1])) {
+			targets_left--;
+		}
+		return targets_left == 0;
+	};
+
+	std::vector<std::vector<idx_t>> local_next(pool.size());
+	bool bottom_up = false;
+	for (uint32_t level = 0; !frontier.empty() && level < opts.max_distance; level++){
+		if (all_targets_reached()) break;
+
+		if (opts.direction_optimising) {
+			size_t frontier_edges = 0;
+			for (idx_t J : frontier) frontier_edges += nbrs[J].size();
+			if (!bottom_up && frontier_edges > unexplored_edges / opts.alpha) {
+				bottom_up = true;
+			} else if (bottom_up && frontier.size() < n / opts.beta) {
+				bottom_up = false;
+			}
+		}
+
+		for (auto& v : local_next) v.clear();
+		if (bottom_up) {
+			// every unreached cell looks for a parent in the frontier;
+			// each dist[J] is written by its owner thread only
+			pool.parallel_for(n, opts.grain, [&](size_t b, size_t e, unsigned t){
+				for (size_t J=b; J<e; J++){
+					if (aref(res.dist[J]).load(std::memory_order_relaxed) != U) continue;
+					for (idx_t J1 : nbrs[J]) {
+						if (aref(res.dist[J1]).load(std::memory_order_relaxed) != level) continue;
+						aref(res.dist[J]).store(level + 1, std::memory_order_relaxed);
+						if (opts.record_parents) res.parent[J] = J1;
+						local_next[t].push_back(J);
+						break;
+					}
+				}
+			}, opts.n_threads);
+		} else {
+			// frontier cells claim their unreached neighbours
+			pool.parallel_for(frontier.size(), opts.grain,
+					[&](size_t b, size_t e, unsigned t){
+				for (size_t i=b; i<e; i++){
+					idx_t J = frontier[i];
+					for (idx_t J1 : nbrs[J]) {
+						uint32_t expected = U;
+						if (aref(res.dist[J1]).load(std::memory_order_relaxed) != U) continue;
+						if (!aref(res.dist[J1]).compare_exchange_strong(expected, level + 1,
+									std::memory_order_relaxed)) continue;
+						if (opts.record_parents) res.parent[J1] = J;
+						local_next[t].push_back(J1);
+					}
+				}
+			}, opts.n_threads);
+		}
+
+		frontier.clear();
+		for (const auto& v : local_next) frontier.insert(frontier.end(), v.begin(), v.end());
+		for (idx_t J : frontier) unexplored_edges -= nbrs[J].size();
+	}
+	return res;
+}
+
+inline BFSResult bfs(const NeighbourTableBase& nbrs, idx_t source,
+		const BFSOptions& opts = {})
+{
+	return bfs(nbrs, std::span<const idx_t>(&source, 1), opts);
+}
+
+
+// Distances on the graph of order-`order` cells adjacent through `rel`,
+// e.g. cell_distances<0, NeighbourRelation::Coboundary>(lat, {J0, J1})
+template<int order, NeighbourRelation rel, typename Lattice>
+BFSResult cell_distances(Lattice& lat, std::span<const idx_t> sources,
+		const BFSOptions& opts = {})
+{
+	return bfs(neighbour_table<order, rel>(lat), sources, opts);
+}
+
+
+// Graph distance between two cells, stopping as soon as `b` is reached.
+// Returns BFSResult::unreached if they are disconnected.
+inline uint32_t graph_distance(const NeighbourTableBase& nbrs, idx_t a, idx_t b,
+		BFSOptions opts = {})
+{
+	opts.targets = std::span<const idx_t>(&b, 1);
+	return bfs(nbrs, a, opts).dist[b];
+}
+
+// A shortest path from `a` to `b` as lattice indices (empty if disconnected)
+inline std::vector<idx_t> shortest_path(const NeighbourTableBase& nbrs,
+		idx_t a, idx_t b, BFSOptions opts = {})
+{
+	opts.targets = std::span<const idx_t>(&b, 1);
+	opts.record_parents = true;
+	return bfs(nbrs, a, opts).path_to(b);
+}
+
+}; // end of namespace
@@ -1,93 +1,422 @@
 #pragma once
 
 #include "cell_geometry.hpp"
+#include "cell_rows.hpp"
+#include <array>
 #include <concepts>
+#include <cstdint>
 #include <filesystem>
-#include <highfive/highfive.hpp>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include <hdf5.h>
 
 
+/**
+ * HDF5 lattice files (enable with -Denable-hdf5=true).
+ *
+ * Layout, with cells of each order in rows sorted by lattice index J
+ * (see CellRows):
+ *
+ *   /geometry                 attributes: version, cell_vectors,
+ *                             index_cell_vectors, primitive_cell_vectors,
+ *                             smith_L, smith_Linv, smith_D, smith_R,
+ *                             smith_Rinv, num_primitive, max_order
+ *   /geometry/spec/<cells>    attributes: position [n_sl,3],
+ *                             boundary_ptr [n_sl+1], boundary_offset [nnz,3],
+ *                             boundary_multiplier [nnz]
+ *   /geometry/<cells>         datasets:   index [N], position [N,3]
+ *                             and for order > 0 the boundary CSR
+ *                             boundary_ptr [N+1], boundary_index [nnz],
+ *                             boundary_multiplier [nnz]
+ *
+ * with <cells> one of points, links, plaqs, vols. boundary_index holds rows
+ * of the order below. Datasets are chunked along rows (and optionally
+ * deflated), so a slice such as h5py's f["geometry/links/position"][a:b]
+ * reads only the chunks it touches.
+ */
+namespace CellGeometry {
+
+struct H5WriteOptions {
+	// Rows per chunk
+	hsize_t chunk_rows = 1 << 16;
+	// Deflate level, 0 for no compression
+	unsigned compression = 4;
+	// Byte-shuffle before deflating (helps on small integers)
+	bool shuffle = true;
+};
 
 
+namespace h5 {
 
-namespace CellGeometry {
-	template<typename lat_t>
-		requires std::derived_from<lat_t, PeriodicAbstractLattice>
-	inline herr_t save(const lat_t& lat, const std::filesystem::path& out_path){
-		using namespace HighFive;
-		File file(out_path, File::Truncate);
-		write_data(lat, file);
-	}
-
-	inline void write_data(const PeriodicAbstractLattice& lat, HighFive::File& file){
-		auto g = file.createGroup("/geometry");
-		g.createAttribute<std::vector<int>>("version",{1,0});
-
-		auto dset = file.createDataSet<int64_t>(
-				"/geometry/cell_vectors", HighFive::DataSpace(3,3));
-		int64_t data[3][3];
-		for (int i=0; i<3; i++){ for (int j=0; j<3; j++) {
-			data[i][j] = lat.cell_vectors(i,j);
-		}}
-		dset.write(data);
-	}
-
-	template<CellLike<0> Point>
-	inline void write_data(const PeriodicPointLattice<Point>& lat, HighFive::File& file){
-		write_data(static_cast<const PeriodicAbstractLattice&>(lat), file);
-
-		size_t num_points = lat.points.size();
-		auto loc_dset = file.createDataSet<int64_t>(
-				"/geometry/point_loc", HighFive::DataSpace(num_points,3)
-				);
-
-		auto data = new int64_t[num_points][3];
-		for (size_t row=0; row<num_points; row++) {
-			for (size_t j=0; j<3; j++) {
-				data[row][j] = lat.points[row].position[j];
-			}
+constexpr int version[2] = {2, 0};
+constexpr const char* cell_names[4] = {"points", "links", "plaqs", "vols"};
+
+inline hid_t check(hid_t id, const std::string& what){
+	if (id < 0) throw std::runtime_error("HDF5 error: " + what);
+	return id;
+}
+
+// Owns an HDF5 identifier
+class Handle {
+public:
+	Handle(hid_t id, herr_t (*closer)(hid_t), const std::string& what) :
+		id(check(id, what)), closer(closer) {}
+	Handle(Handle&& other) noexcept :
+		id(std::exchange(other.id, H5I_INVALID_HID)), closer(other.closer) {}
+	Handle(const Handle&) = delete;
+	Handle& operator=(const Handle&) = delete;
+	~Handle(){ if (id >= 0) closer(id); }
+	inline operator hid_t() const { return id; }
+private:
+	hid_t id;
+	herr_t (*closer)(hid_t);
+};
+
+template<typename T> hid_t native_type();
+template<> inline hid_t native_type<int64_t>() { return H5T_NATIVE_INT64; }
+template<> inline hid_t native_type<int32_t>() { return H5T_NATIVE_INT32; }
+template<> inline hid_t native_type<uint32_t>() { return H5T_NATIVE_UINT32; }
+template<> inline hid_t native_type<uint64_t>() { return H5T_NATIVE_UINT64; }
+
+inline Handle make_space(const std::vector<hsize_t>& dims,
+		const std::vector<hsize_t>& maxdims = {})
+{
+	// attributes cannot have zero-sized dimensions
+	for (auto d : dims) {
+		if (d == 0 && maxdims.empty()) return Handle(H5Screate(H5S_NULL), H5Sclose, "dataspace");
+	}
+	return Handle(H5Screate_simple(dims.size(), dims.data(),
+				maxdims.empty() ? nullptr : maxdims.data()), H5Sclose, "dataspace");
+}
+
+template<typename T>
+void write_attribute(hid_t obj, const char* name, const T* data,
+		const std::vector<hsize_t>& dims)
+{
+	Handle space = make_space(dims);
+	Handle attr(H5Acreate2(obj, name, native_type<T>(), space, H5P_DEFAULT, H5P_DEFAULT),
+			H5Aclose, std::string("creating attribute ") + name);
+	if (H5Sget_simple_extent_type(space) == H5S_NULL) return;
+	check(H5Awrite(attr, native_type<T>(), data), std::string("writing attribute ") + name);
+}
+
+template<typename T>
+std::vector<T> read_attribute(hid_t obj, const char* name){
+	Handle attr(H5Aopen(obj, name, H5P_DEFAULT), H5Aclose,
+			std::string("opening attribute ") + name);
+	Handle space(H5Aget_space(attr), H5Sclose, "attribute dataspace");
+	std::vector<T> out(H5Sget_simple_extent_npoints(space));
+	if (!out.empty()) {
+		check(H5Aread(attr, native_type<T>(), out.data()),
+				std::string("reading attribute ") + name);
+	}
+	return out;
+}
+
+// Writes `data` as a dataset of shape [rows, cols], chunked along rows
+template<typename T>
+void write_rows(hid_t group, const char* name, const T* data,
+		hsize_t rows, hsize_t cols, const H5WriteOptions& opts)
+{
+	std::vector<hsize_t> dims = {rows}, maxdims = {H5S_UNLIMITED}, chunk;
+	chunk.push_back(std::max<hsize_t>(1, std::min(rows, opts.chunk_rows)));
+	if (cols > 1) {
+		dims.push_back(cols);
+		maxdims.push_back(cols);
+		chunk.push_back(cols);
+	}
+	Handle space = make_space(dims, maxdims);
+	Handle props(H5Pcreate(H5P_DATASET_CREATE), H5Pclose, "dataset properties");
+	check(H5Pset_chunk(props, chunk.size(), chunk.data()), "setting chunk size");
+	if (opts.compression > 0) {
+		if (opts.shuffle) check(H5Pset_shuffle(props), "enabling shuffle");
+		check(H5Pset_deflate(props, opts.compression), "enabling deflate");
+	}
+	Handle dset(H5Dcreate2(group, name, native_type<T>(), space,
+				H5P_DEFAULT, props, H5P_DEFAULT), H5Dclose,
+			std::string("creating dataset ") + name);
+	if (rows > 0) {
+		check(H5Dwrite(dset, native_type<T>(), H5S_ALL, H5S_ALL, H5P_DEFAULT, data),
+				std::string("writing dataset ") + name);
+	}
+}
+
+inline hsize_t num_rows(hid_t group, const char* name){
+	Handle dset(H5Dopen2(group, name, H5P_DEFAULT), H5Dclose,
+			std::string("opening dataset ") + name);
+	Handle space(H5Dget_space(dset), H5Sclose, "dataset dataspace");
+	hsize_t dims[2] = {0, 0};
+	check(H5Sget_simple_extent_dims(space, dims, nullptr), "reading dataset shape");
+	return dims[0];
+}
+
+// Reads rows [begin, begin + count) of a dataset as a hyperslab
+template<typename T>
+std::vector<T> read_rows(hid_t group, const char* name, hsize_t begin, hsize_t count){
+	Handle dset(H5Dopen2(group, name, H5P_DEFAULT), H5Dclose,
+			std::string("opening dataset ") + name);
+	Handle space(H5Dget_space(dset), H5Sclose, "dataset dataspace");
+	const int rank = H5Sget_simple_extent_ndims(space);
+	hsize_t dims[2] = {0, 1};
+	check(H5Sget_simple_extent_dims(space, dims, nullptr), "reading dataset shape");
+	if (begin > dims[0] || count > dims[0] - begin) {
+		throw std::out_of_range(std::string("rows out of range in dataset ") + name);
+	}
+	std::vector<T> out(count * (rank > 1 ? dims[1] : 1));
+	if (out.empty()) return out;
+
+	hsize_t start[2] = {begin, 0};
+	hsize_t extent[2] = {count, dims[1]};
+	check(H5Sselect_hyperslab(space, H5S_SELECT_SET, start, nullptr, extent, nullptr),
+			"selecting hyperslab");
+	Handle memspace(H5Screate_simple(rank, extent, nullptr), H5Sclose, "memory dataspace");
+	check(H5Dread(dset, native_type<T>(), memspace, space, H5P_DEFAULT, out.data()),
+			std::string("reading dataset ") + name);
+	return out;
+}
+
+template<typename T>
+inline void store_mat(hid_t obj, const char* name, const vector3::mat33<T>& m){
+	int64_t data[9];
+	for (int i=0; i<3; i++)
+		for (int j=0; j<3; j++)
+			data[3*i + j] = m(i,j);
+	write_attribute(obj, name, data, {3, 3});
+}
+
+inline imat33_t load_mat(hid_t obj, const char* name){
+	auto data = read_attribute<int64_t>(obj, name);
+	if (data.size() != 9) throw std::runtime_error(std::string("bad shape for ") + name);
+	imat33_t m;
+	for (int i=0; i<3; i++)
+		for (int j=0; j<3; j++)
+			m(i,j) = data[3*i + j];
+	return m;
+}
+
+inline Handle create_group(hid_t parent, const char* name){
+	return Handle(H5Gcreate2(parent, name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT),
+			H5Gclose, std::string("creating group ") + name);
+}
+
+inline Handle open_group(hid_t parent, const std::string& name){
+	return Handle(H5Gopen2(parent, name.c_str(), H5P_DEFAULT), H5Gclose,
+			"opening group " + name);
+}
+
+// One sublattice family of the primitive spec as attributes of a group
+template<typename Spec>
+void write_spec(hid_t parent, const char* name, const std::vector<const Spec*>& specs){
+	Handle g = create_group(parent, name);
+	std::vector<int64_t> position, offset;
+	std::vector<uint32_t> ptr = {0};
+	std::vector<int32_t> mult;
+	for (const Spec* s : specs){
+		for (int n=0; n<3; n++) position.push_back(s->position[n]);
+		for (const auto& b : s->boundary){
+			for (int n=0; n<3; n++) offset.push_back(b.relative_position[n]);
+			mult.push_back(b.multiplier);
+		}
+		ptr.push_back(checked_u32(mult.size()));
+	}
+	write_attribute(g, "position", position.data(), {specs.size(), 3});
+	write_attribute(g, "boundary_ptr", ptr.data(), {ptr.size()});
+	write_attribute(g, "boundary_offset", offset.data(), {mult.size(), 3});
+	write_attribute(g, "boundary_multiplier", mult.data(), {mult.size()});
+}
+
+}; // end of namespace h5
+
+
+/**
+ * Writes the lattice to an HDF5 file (see the layout above), replacing any
+ * existing file. Returns false if the file could not be created; other
+ * HDF5 failures throw std::runtime_error.
+ */
+template<typename lat_t>
+	requires std::derived_from<lat_t, PeriodicAbstractLattice>
+bool save_h5(const lat_t& lat, const std::filesystem::path& out_path,
+		const H5WriteOptions& opts = {})
+{
+	alloc_stats::Scope scope(alloc_stats::Subsystem::IO);
+	trace::Scope phase("save_h5", "io");
+	using h5::Handle;
+	constexpr int K = max_order_of<lat_t>();
+
+	hid_t fid = H5Fcreate(out_path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+	if (fid < 0) return false;
+	Handle file(fid, H5Fclose, "creating file");
+	Handle geom = h5::create_group(file, "geometry");
+
+	const auto& LDW = lat.smith_decomposition();
+	h5::write_attribute(geom, "version", h5::version, {2});
+	h5::store_mat(geom, "cell_vectors", lat.cell_vectors);
+	h5::store_mat(geom, "index_cell_vectors", lat.index_cell_vectors);
+	h5::store_mat(geom, "primitive_cell_vectors", lat.primitive_spec.latvecs);
+	h5::store_mat(geom, "smith_L", LDW.L);
+	h5::store_mat(geom, "smith_Linv", LDW.Linv);
+	h5::store_mat(geom, "smith_R", LDW.R);
+	h5::store_mat(geom, "smith_Rinv", LDW.Rinv);
+	const int64_t D[3] = {LDW.D[0], LDW.D[1], LDW.D[2]};
+	h5::write_attribute(geom, "smith_D", D, {3});
+	const int64_t num_primitive = lat.num_primitive;
+	h5::write_attribute(geom, "num_primitive", &num_primitive, {1});
+	const int32_t max_order = K;
+	h5::write_attribute(geom, "max_order", &max_order, {1});
+
+	{
+		const UnitCellSpecifier& spec = lat.primitive_spec;
+		Handle g = h5::create_group(geom, "spec");
+		auto collect = [](sl_t n, auto get){
+			std::vector<std::remove_cvref_t<decltype(&get(0))>> out;
+			for (sl_t sl=0; sl<n; sl++) out.push_back(&get(sl));
+			return out;
+		};
+		h5::write_spec(g, "points", collect(spec.num_point_sl(),
+					[&](sl_t sl) -> const PointSpec& { return spec.point_no(sl); }));
+		h5::write_spec(g, "links", collect(spec.num_link_sl(),
+					[&](sl_t sl) -> const LinkSpec& { return spec.link_no(sl); }));
+		h5::write_spec(g, "plaqs", collect(spec.num_plaq_sl(),
+					[&](sl_t sl) -> const PlaqSpec& { return spec.plaq_no(sl); }));
+		h5::write_spec(g, "vols", collect(spec.num_vol_sl(),
+					[&](sl_t sl) -> const VolSpec& { return spec.vol_no(sl); }));
+	}
+
+	std::vector<CellRows> rows;
+	rows.reserve(K+1);
+	auto write_order = [&]<int k>(){
+		rows.emplace_back(cells_of<k>(lat));
+		const CellRows& r = rows[k];
+		Handle g = h5::create_group(geom, h5::cell_names[k]);
+		const uint64_t count = r.size();
+		h5::write_attribute(g, "count", &count, {1});
+		h5::write_rows(g, "index", r.index.data(), r.size(), 1, opts);
+
+		std::vector<int64_t> pos;
+		pos.reserve(3 * r.size());
+		for (const auto& x : r.position){
+			for (int n=0; n<3; n++) pos.push_back(x[n]);
 		}
-		loc_dset.write(data);
-		delete[] data;
-	}
-
-template<
-	CellLike<0> Point,
-	CellLike<1> Link
-	>
-	inline void write_data(const PeriodicLinkLattice<Point, Link>& lat, HighFive::File& file){
-		write_data(static_cast<const PeriodicPointLattice<Point>&>(lat), file);
-
-		size_t num_links = lat.links.size();
-
-		auto loc_dset = file.createDataSet<int64_t>(
-				"/geometry/link_loc", HighFive::DataSpace(num_links,3)
-				);
-		
-		size_t max_boundary_size = 0;
-		for (const auto& l : lat.links) {
-			max_boundary_size = max(l.boundary.size(), max_boundary_size);
+		h5::write_rows(g, "position", pos.data(), r.size(), 3, opts);
+
+		if constexpr (k > 0) {
+			auto csr = build_incidence(cells_of<k>(lat), r, rows[k-1],
+					[](const auto& c) -> const auto& { return c.boundary; });
+			h5::write_rows(g, "boundary_ptr", csr.row_ptr.data(), csr.row_ptr.size(), 1, opts);
+			h5::write_rows(g, "boundary_index", csr.col.data(), csr.nnz(), 1, opts);
+			h5::write_rows(g, "boundary_multiplier", csr.val.data(), csr.nnz(), 1, opts);
+		}
+	};
+	write_order.template operator()<0>();
+	if constexpr (K >= 1) write_order.template operator()<1>();
+	if constexpr (K >= 2) write_order.template operator()<2>();
+	if constexpr (K >= 3) write_order.template operator()<3>();
+	return true;
+}
+
+
+/**
+ * Reads lattices written by save_h5, in whole or by row ranges. Rows are
+ * the CellRows numbering; only the requested rows are read from disk.
+ *
+ *   H5LatticeReader f("big.h5");
+ *   auto pos = f.positions(1, 1000, 500);  // links 1000..1499
+ */
+class H5LatticeReader {
+public:
+	static constexpr size_t all = std::numeric_limits<size_t>::max();
+
+	explicit H5LatticeReader(const std::filesystem::path& path) :
+		file(open_file(path), H5Fclose, "opening " + path.string()),
+		geom(h5::open_group(file, "geometry"))
+	{
+		auto v = h5::read_attribute<int32_t>(geom, "version");
+		if (v.size() != 2 || v[0] != h5::version[0]) {
+			throw std::runtime_error(path.string() + ": unsupported lattice file version");
+		}
+		max_ord = h5::read_attribute<int32_t>(geom, "max_order").at(0);
+		if (max_ord < 0 || max_ord > 3) {
+			throw std::runtime_error(path.string() + ": corrupt max_order");
+		}
+	}
+
+	inline int max_order() const { return max_ord; }
+
+	imat33_t cell_vectors() const { return h5::load_mat(geom, "cell_vectors"); }
+	imat33_t index_cell_vectors() const { return h5::load_mat(geom, "index_cell_vectors"); }
+	imat33_t primitive_cell_vectors() const {
+		return h5::load_mat(geom, "primitive_cell_vectors");
+	}
+	ivec3_t size() const {
+		auto D = h5::read_attribute<int64_t>(geom, "smith_D");
+		return {D.at(0), D.at(1), D.at(2)};
+	}
+
+	size_t num_cells(int order) const {
+		return h5::num_rows(group(order), "index");
+	}
+
+	// Lattice index J of rows [begin, begin + count)
+	std::vector<uint32_t> indices(int order, size_t begin = 0, size_t count = all) const {
+		auto g = group(order);
+		return h5::read_rows<uint32_t>(g, "index", begin, clip(g, "index", begin, count));
+	}
+
+	std::vector<ipos_t> positions(int order, size_t begin = 0, size_t count = all) const {
+		auto g = group(order);
+		auto flat = h5::read_rows<int64_t>(g, "position", begin,
+				clip(g, "position", begin, count));
+		std::vector<ipos_t> out(flat.size() / 3);
+		for (size_t i=0; i<out.size(); i++){
+			out[i] = ipos_t(flat[3*i], flat[3*i+1], flat[3*i+2]);
 		}
+		return out;
+	}
 
-		auto boundary_dset = file.createDataSet<int64_t>(
-				"/geometry/link_boundary", HighFive::DataSpace(num_links,2,3)
-				);
+	// Boundary CSR of rows [begin, begin + count), with row_ptr rebased to
+	// start at 0. Columns are rows of order-1.
+	IncidenceCSR boundary(int order, size_t begin = 0, size_t count = all) const {
+		if (order == 0) throw std::out_of_range("Points have no boundary");
+		auto g = group(order);
+		count = clip(g, "index", begin, count);
+		IncidenceCSR csr;
+		csr.row_ptr = h5::read_rows<uint32_t>(g, "boundary_ptr", begin, count + 1);
+		const uint32_t first = csr.row_ptr.front();
+		const uint32_t nnz = csr.row_ptr.back() - first;
+		csr.col = h5::read_rows<uint32_t>(g, "boundary_index", first, nnz);
+		csr.val = h5::read_rows<int32_t>(g, "boundary_multiplier", first, nnz);
+		for (auto& p : csr.row_ptr) p -= first;
+		return csr;
+	}
 
+private:
+	h5::Handle file;
+	h5::Handle geom;
+	int max_ord;
 
-		auto data = new int64_t[num_links][3];
-		auto boundary = new int64_t[num_links][3];
-		for (size_t row=0; row<num_links; row++) {
-			auto l = lat.links[row];
-			for (int j=0; j<3; j++) {
-				data[row][j] = l.position[j];
-				for (auto& [point_ptr, mult] : lat){
-				}
-			}
+	static hid_t open_file(const std::filesystem::path& path){
+		if (!std::filesystem::exists(path)) {
+			throw std::runtime_error("No such file: " + path.string());
 		}
-		loc_dset.write(data);
-		delete[] data;
-		delete[] boundary;
+		return H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
 	}
 
+	h5::Handle group(int order) const {
+		if (order < 0 || order > max_ord) {
+			throw std::out_of_range("No cells of order " + std::to_string(order));
+		}
+		return h5::open_group(geom, h5::cell_names[order]);
+	}
 
+	static size_t clip(hid_t g, const char* name, size_t begin, size_t count){
+		const size_t n = h5::num_rows(g, name);
+		if (begin > n) throw std::out_of_range("Row range out of bounds");
+		return std::min(count, n - begin);
+	}
 };
+
+}; // end of namespace
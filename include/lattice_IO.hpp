@@ -3,28 +3,37 @@
 #include "UnitCellSpecifier.hpp"
 #include "cell_geometry.hpp"
 #include "chain.hpp"
+#include "cell_rows.hpp"
 #include "nlohmann/json_fwd.hpp"
+#include "parallel.hpp"
+#include <charconv>
 #include <concepts>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <limits>
+#include <memory>
 #include <nlohmann/json.hpp>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 namespace CellGeometry {
-	template<typename lat_t>
-		requires std::derived_from<lat_t, PeriodicAbstractLattice>
-	inline bool save(const lat_t& lat, const std::filesystem::path& out_path){
-		using namespace nlohmann;
-		json j = {};
-		write_data(lat, j);
-		std::ofstream of(out_path);
-		if (of.is_open()){
-			of << j;
-			of.close();
-			return true;
-		}
-		return false;
-	}
+	/////////////////////////////////////////////////////////////////////////
+	// DOM writers: build the whole document as nlohmann::json. Fine for small
+	// lattices or for embedding in other documents; save() streams instead.
+	/////////////////////////////////////////////////////////////////////////
 
 	inline void write_data(const PeriodicAbstractLattice& lat, nlohmann::json& j){
 		j["cell_vectors"] = lat.cell_vectors;
@@ -116,4 +125,860 @@ namespace CellGeometry {
 	}
 
 
+	/////////////////////////////////////////////////////////////////////////
+	// Streaming writer for the same .lat.json schema
+	/////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * A minimal SAX-style JSON emitter appending compact JSON to a string.
+	 * It only tracks where commas go; keys and values are written in the
+	 * order they are emitted.
+	 */
+	class JsonEmitter {
+	public:
+		explicit JsonEmitter(std::string& out) : out(out) {}
+
+		void begin_object(){ separate(); out += '{'; push(); }
+		void end_object(){ pop(); out += '}'; }
+		void begin_array(){ separate(); out += '['; push(); }
+		void end_array(){ pop(); out += ']'; }
+
+		// Keys are written verbatim, so must not need escaping
+		void key(std::string_view k){
+			separate();
+			out += '"';
+			out += k;
+			out += "\":";
+			after_key = true;
+		}
+
+		void value(int64_t x){
+			separate();
+			char buf[24];
+			auto res = std::to_chars(buf, buf + sizeof(buf), x);
+			out.append(buf, res.ptr);
+		}
+		void null(){ separate(); out += "null"; }
+		// Strings are written verbatim, so must not need escaping
+		void value(std::string_view str){
+			separate();
+			out += '"';
+			out += str;
+			out += '"';
+		}
+
+		template<typename T>
+		void value(const vector3::vec3<T>& v){
+			begin_array();
+			value(v[0]); value(v[1]); value(v[2]);
+			end_array();
+		}
+
+		template<typename T>
+		void value(const vector3::mat33<T>& M){
+			begin_array();
+			for (int i=0; i<3; i++){
+				begin_array();
+				value(M(i,0)); value(M(i,1)); value(M(i,2));
+				end_array();
+			}
+			end_array();
+		}
+
+		// Emits elements of a container whose bracket is written elsewhere
+		void enter_container(){ push(); }
+
+		// Raw output of at most max_size bytes forming one value: write it
+		// from the returned pointer, then pass the end to commit()
+		char* reserve_value(size_t max_size){
+			separate();
+			const size_t n = out.size();
+			out.resize(n + max_size);
+			return out.data() + n;
+		}
+		void commit(const char* end){ out.resize(end - out.data()); }
+
+	private:
+		std::string& out;
+		std::vector<bool> first;
+		bool after_key = false;
+
+		void push(){ first.push_back(true); }
+		void pop(){ first.pop_back(); }
+		void separate(){
+			if (after_key) { after_key = false; return; }
+			if (!first.empty()) {
+				if (!first.back()) out += ',';
+				first.back() = false;
+			}
+		}
+	};
+
+
+	// Where the streaming writer sends its buffer
+	class JsonSink {
+	public:
+		explicit JsonSink(std::ostream& os) : os(&os) {}
+		explicit JsonSink(int fd) : fd(fd) {}
+
+		void write(std::string_view data){
+			if (os) {
+				os->write(data.data(), data.size());
+				if (!*os) throw std::runtime_error("Failed to write lattice JSON");
+				return;
+			}
+			while (!data.empty()) {
+				ssize_t n = ::write(fd, data.data(), data.size());
+				if (n < 0) {
+					if (errno == EINTR) continue;
+					throw std::system_error(errno, std::generic_category(),
+							"Failed to write lattice JSON");
+				}
+				data.remove_prefix(n);
+			}
+		}
+
+	private:
+		std::ostream* os = nullptr;
+		int fd = -1;
+	};
+
+
+	/**
+	 * Full: the original layout, one object per cell with (co)boundaries
+	 *   as [[x,y,z], multiplier] pairs.
+	 * Compact: "format": "lat.json/compact", version 2. Each order is an
+	 *   object of flat arrays, rows sorted by lattice index:
+	 *     index            lattice index J of each cell
+	 *     pos              x,y,z of each cell, concatenated
+	 *     boundary_ptr     CSR row offsets (rows + 1 entries)
+	 *     boundary         lattice indices of the boundary cells
+	 *     boundary_mult    their multipliers
+	 *   and likewise coboundary_* unless coboundaries are dropped.
+	 */
+	enum class JsonSchema { Full, Compact };
+
+	struct JsonWriteOptions {
+		// Bytes buffered before each write to the sink
+		size_t buffer_size = 1 << 20;
+		// Threads rendering cells (1 = serial, in map order; Full only)
+		unsigned n_threads = 1;
+		// Hash buckets per rendered chunk when threaded
+		size_t grain = 1 << 12;
+		JsonSchema schema = JsonSchema::Full;
+		// Compact only: write coboundaries, which readers can rebuild
+		bool coboundaries = true;
+	};
+
+
+	namespace detail {
+		// Fixed-layout pieces of a cell, formatted straight into a buffer
+		inline char* put_int(char* p, int64_t x){
+			return std::to_chars(p, p + 20, x).ptr;
+		}
+
+		inline char* put_pos(char* p, const ipos_t& x){
+			*p++ = '[';
+			p = put_int(p, x[0]); *p++ = ',';
+			p = put_int(p, x[1]); *p++ = ',';
+			p = put_int(p, x[2]);
+			*p++ = ']';
+			return p;
+		}
+
+		template<int order>
+		inline char* put_chain(char* p, const Chain<order>& chain){
+			// matches the DOM writer, which leaves empty chains as null
+			if (chain.size() == 0) {
+				std::memcpy(p, "null", 4);
+				return p + 4;
+			}
+			*p++ = '[';
+			bool first = true;
+			for (const auto& [cellptr, mult] : chain){
+				if (!first) *p++ = ',';
+				first = false;
+				*p++ = '[';
+				p = put_pos(p, cellptr->position);
+				*p++ = ',';
+				p = put_int(p, mult);
+				*p++ = ']';
+			}
+			*p++ = ']';
+			return p;
+		}
+
+		// One cell, with keys in the (sorted) order the DOM writer produces
+		template<int order, typename T>
+		inline void emit_cell(JsonEmitter& e, const T& x){
+			// 20 digits and sign per number, plus brackets and commas
+			constexpr size_t per_pos = 3*21 + 4, per_entry = per_pos + 21 + 3;
+			size_t bound = 48 + per_pos;
+			if constexpr (order > 0) bound += x.boundary.size() * per_entry;
+			if constexpr (order < 3) bound += x.coboundary.size() * per_entry;
+
+			char* p = e.reserve_value(bound);
+			*p++ = '{';
+			if constexpr (order > 0) {
+				std::memcpy(p, "\"boundary\":", 11); p += 11;
+				p = put_chain(p, x.boundary);
+				*p++ = ',';
+			}
+			if constexpr (order < 3) {
+				std::memcpy(p, "\"coboundary\":", 13); p += 13;
+				p = put_chain(p, x.coboundary);
+				*p++ = ',';
+			}
+			std::memcpy(p, "\"pos\":", 6); p += 6;
+			p = put_pos(p, x.position);
+			*p++ = '}';
+			e.commit(p);
+		}
+
+		// The array of cells of one order
+		template<int order, typename Map>
+		void emit_cells(JsonEmitter& e, const Map& cellmap, std::string& buf,
+				JsonSink& sink, const JsonWriteOptions& opts)
+		{
+			// matches the DOM writer, which leaves an empty order as null
+			if (cellmap.empty()) { e.null(); return; }
+			e.begin_array();
+			if (opts.n_threads <= 1) {
+				for (const auto& [_, x] : cellmap){
+					emit_cell<order>(e, *x);
+					if (buf.size() >= opts.buffer_size) { sink.write(buf); buf.clear(); }
+				}
+				e.end_array();
+				return;
+			}
+
+			// Render batches of bucket ranges in parallel, then write them
+			// out in order; memory is bounded by the batch size
+			ParallelOptions popts;
+			popts.n_threads = opts.n_threads;
+			ThreadPool& pool = popts.get_pool();
+			const size_t n_buckets = cellmap.bucket_count();
+			std::vector<std::string> parts(2 * pool.size());
+			const size_t batch = std::max<size_t>(opts.grain, 1) * parts.size();
+			bool any = false;
+			for (size_t b0=0; b0<n_buckets; b0+=batch){
+				const size_t b1 = std::min(n_buckets, b0 + batch);
+				const size_t per_part = (b1 - b0 + parts.size() - 1) / parts.size();
+				pool.parallel_for(parts.size(), 1, [&](size_t p0, size_t p1, unsigned){
+					for (size_t p=p0; p<p1; p++){
+						parts[p].clear();
+						JsonEmitter pe(parts[p]);
+						pe.enter_container();
+						const size_t lo = std::min(b1, b0 + p*per_part);
+						const size_t hi = std::min(b1, lo + per_part);
+						for (size_t b=lo; b<hi; b++){
+							for (auto it = cellmap.begin(b); it != cellmap.end(b); ++it){
+								emit_cell<order>(pe, *it->second);
+							}
+						}
+					}
+				}, opts.n_threads);
+				for (const auto& p : parts){
+					if (p.empty()) continue;
+					if (any) buf += ',';
+					buf += p;
+					any = true;
+					if (buf.size() >= opts.buffer_size) { sink.write(buf); buf.clear(); }
+				}
+			}
+			e.end_array();
+		}
+	}
+
+
+	namespace detail {
+		// A flat array of get(0) .. get(n-1), flushed as it grows
+		template<typename F>
+		void emit_ints(JsonEmitter& e, size_t n, F&& get, std::string& buf,
+				JsonSink& sink, const JsonWriteOptions& opts)
+		{
+			e.begin_array();
+			char tmp[24];
+			for (size_t i=0; i<n; i++){
+				if (i > 0) buf += ',';
+				buf.append(tmp, std::to_chars(tmp, tmp + sizeof(tmp),
+							static_cast<int64_t>(get(i))).ptr);
+				if (buf.size() >= opts.buffer_size) { sink.write(buf); buf.clear(); }
+			}
+			e.end_array();
+		}
+
+		// <name>, <name>_mult, <name>_ptr of a CSR, columns as lattice indices
+		inline void emit_incidence(JsonEmitter& e, const std::string& name,
+				const IncidenceCSR& csr, const CellRows& targets,
+				std::string& buf, JsonSink& sink, const JsonWriteOptions& opts)
+		{
+			e.key(name);
+			emit_ints(e, csr.nnz(), [&](size_t i){ return targets.index[csr.col[i]]; },
+					buf, sink, opts);
+			e.key(name + "_mult");
+			emit_ints(e, csr.nnz(), [&](size_t i){ return csr.val[i]; }, buf, sink, opts);
+			e.key(name + "_ptr");
+			emit_ints(e, csr.row_ptr.size(), [&](size_t i){ return csr.row_ptr[i]; },
+					buf, sink, opts);
+		}
+
+		template<int order, typename lat_t>
+		void emit_compact_cells(JsonEmitter& e, const lat_t& lat,
+				const std::vector<CellRows>& rows, std::string& buf,
+				JsonSink& sink, const JsonWriteOptions& opts)
+		{
+			constexpr int K = max_order_of<lat_t>();
+			const CellRows& r = rows[order];
+			e.begin_object();
+			if constexpr (order > 0) {
+				auto d = build_incidence(cells_of<order>(lat), r, rows[order-1],
+						[](const auto& c) -> const auto& { return c.boundary; });
+				emit_incidence(e, "boundary", d, rows[order-1], buf, sink, opts);
+			}
+			if constexpr (order < K) {
+				if (opts.coboundaries) {
+					auto d = build_incidence(cells_of<order>(lat), r, rows[order+1],
+							[](const auto& c) -> const auto& { return c.coboundary; });
+					emit_incidence(e, "coboundary", d, rows[order+1], buf, sink, opts);
+				}
+			}
+			e.key("index");
+			emit_ints(e, r.size(), [&](size_t i){ return r.index[i]; }, buf, sink, opts);
+			e.key("pos");
+			emit_ints(e, 3 * r.size(), [&](size_t i){ return r.position[i/3][i%3]; },
+					buf, sink, opts);
+			e.end_object();
+		}
+
+		template<typename lat_t>
+		void write_compact_json(const lat_t& lat, JsonSink& sink, const JsonWriteOptions& opts){
+			constexpr int K = max_order_of<lat_t>();
+			std::vector<CellRows> rows;
+			rows.emplace_back(lat.points);
+			if constexpr (K >= 1) rows.emplace_back(lat.links);
+			if constexpr (K >= 2) rows.emplace_back(lat.plaqs);
+			if constexpr (K >= 3) rows.emplace_back(lat.vols);
+
+			std::string buf;
+			buf.reserve(opts.buffer_size + 4096);
+			JsonEmitter e(buf);
+			e.begin_object();
+			e.key("cell_vectors"); e.value(lat.cell_vectors);
+			e.key("format"); e.value("lat.json/compact");
+			e.key("index_cell_vectors"); e.value(lat.index_cell_vectors);
+			if constexpr (K >= 1) { e.key("links"); emit_compact_cells<1>(e, lat, rows, buf, sink, opts); }
+			if constexpr (K >= 2) { e.key("plaqs"); emit_compact_cells<2>(e, lat, rows, buf, sink, opts); }
+			e.key("points"); emit_compact_cells<0>(e, lat, rows, buf, sink, opts);
+			e.key("primitive_cell_vectors"); e.value(lat.primitive_spec.latvecs);
+			e.key("version"); e.value(int64_t(2));
+			if constexpr (K >= 3) { e.key("vols"); emit_compact_cells<3>(e, lat, rows, buf, sink, opts); }
+			e.end_object();
+			sink.write(buf);
+		}
+	}
+
+
+	/**
+	 * Streams the lattice as .lat.json (the schema of write_data) to `sink`,
+	 * one cell at a time; memory use does not grow with the lattice. In
+	 * serial mode the output is byte-for-byte what the DOM writers produce.
+	 *
+	 * With JsonSchema::Compact the row tables of every order are built
+	 * first (a few words per cell and incidence), then streamed.
+	 */
+	template<typename lat_t>
+		requires std::derived_from<lat_t, PeriodicAbstractLattice>
+	void write_json(const lat_t& lat, JsonSink sink, const JsonWriteOptions& opts = {}){
+		alloc_stats::Scope scope(alloc_stats::Subsystem::IO);
+		trace::Scope phase("write_json", "io");
+		if (opts.schema == JsonSchema::Compact) {
+			detail::write_compact_json(lat, sink, opts);
+			return;
+		}
+		constexpr int K = max_order_of<lat_t>();
+		std::string buf;
+		buf.reserve(opts.buffer_size + 4096);
+		JsonEmitter e(buf);
+
+		// keys in sorted order, as nlohmann::json stores them
+		e.begin_object();
+		e.key("cell_vectors"); e.value(lat.cell_vectors);
+		e.key("index_cell_vectors"); e.value(lat.index_cell_vectors);
+		if constexpr (K >= 1) { e.key("links"); detail::emit_cells<1>(e, lat.links, buf, sink, opts); }
+		if constexpr (K >= 2) { e.key("plaqs"); detail::emit_cells<2>(e, lat.plaqs, buf, sink, opts); }
+		e.key("points"); detail::emit_cells<0>(e, lat.points, buf, sink, opts);
+		e.key("primitive_cell_vectors"); e.value(lat.primitive_spec.latvecs);
+		if constexpr (K >= 3) { e.key("vols"); detail::emit_cells<3>(e, lat.vols, buf, sink, opts); }
+		e.end_object();
+		sink.write(buf);
+	}
+
+	template<typename lat_t>
+		requires std::derived_from<lat_t, PeriodicAbstractLattice>
+	inline bool save(const lat_t& lat, const std::filesystem::path& out_path,
+			const JsonWriteOptions& opts = {})
+	{
+		std::ofstream of(out_path);
+		if (!of.is_open()) return false;
+		write_json(lat, JsonSink(of), opts);
+		of.close();
+		return !of.fail();
+	}
+
+
+
+	/////////////////////////////////////////////////////////////////////////
+	// Loader for .lat.json
+	/////////////////////////////////////////////////////////////////////////
+
+	namespace detail {
+		// The cells of one order as read from file. The boundary of cell i
+		// is entries bdry_off[i] .. bdry_off[i+1] of bdry_pos / bdry_mult;
+		// coboundaries are not kept, they follow from the boundaries.
+		struct JsonCellRecords {
+			std::vector<ipos_t> pos;
+			std::vector<uint32_t> bdry_off = {0};
+			std::vector<ipos_t> bdry_pos;
+			std::vector<int> bdry_mult;
+		};
+
+		// One order of the compact schema, as the arrays it stores
+		struct JsonCompactRecords {
+			bool present = false;
+			std::vector<int64_t> index;
+			std::vector<int64_t> pos;
+			std::vector<int64_t> boundary;
+			std::vector<int64_t> boundary_mult;
+			std::vector<int64_t> boundary_ptr;
+		};
+
+		struct JsonLatticeRecords {
+			imat33_t cell_vectors;
+			imat33_t primitive_cell_vectors;
+			bool has_cell_vectors = false;
+			bool has_primitive_cell_vectors = false;
+			JsonCellRecords cells[4];
+			JsonCompactRecords compact[4];
+		};
+
+		// Resolves the lattice indices of compact orders into positions,
+		// filling cells[] as the full schema would
+		inline void expand_compact(JsonLatticeRecords& rec){
+			std::vector<std::pair<int64_t, uint32_t>> face_rows;
+			for (int k=0; k<4; k++){
+				JsonCompactRecords& c = rec.compact[k];
+				if (!c.present) continue;
+				const size_t n = c.index.size();
+				if (c.pos.size() != 3*n) {
+					throw std::runtime_error("Bad lattice JSON: pos must hold 3 entries per cell");
+				}
+				JsonCellRecords& out = rec.cells[k];
+				out.pos.resize(n);
+				for (size_t i=0; i<n; i++){
+					out.pos[i] = {c.pos[3*i], c.pos[3*i+1], c.pos[3*i+2]};
+				}
+				out.bdry_off.assign(n + 1, 0);
+
+				if (k > 0 && !c.boundary_ptr.empty()) {
+					const JsonCompactRecords& f = rec.compact[k-1];
+					if (!f.present) {
+						throw std::runtime_error("Bad lattice JSON: compact boundaries "
+								"refer to an order stored in another schema");
+					}
+					if (c.boundary_ptr.size() != n + 1 || c.boundary_ptr[0] != 0
+							|| static_cast<size_t>(c.boundary_ptr[n]) != c.boundary.size()
+							|| c.boundary_mult.size() != c.boundary.size()
+							|| !std::is_sorted(c.boundary_ptr.begin(), c.boundary_ptr.end())) {
+						throw std::runtime_error("Bad lattice JSON: inconsistent boundary arrays");
+					}
+					face_rows.clear();
+					for (size_t r=0; r<f.index.size(); r++) face_rows.emplace_back(f.index[r], r);
+					std::sort(face_rows.begin(), face_rows.end());
+
+					out.bdry_pos.reserve(c.boundary.size());
+					out.bdry_mult.reserve(c.boundary.size());
+					for (size_t i=0; i<n; i++){
+						for (int64_t e=c.boundary_ptr[i]; e<c.boundary_ptr[i+1]; e++){
+							auto it = std::lower_bound(face_rows.begin(), face_rows.end(),
+									std::make_pair(c.boundary[e], uint32_t(0)));
+							if (it == face_rows.end() || it->first != c.boundary[e]) {
+								throw std::runtime_error("Bad lattice JSON: boundary of a "
+										+ std::to_string(k) + "-cell refers to a missing cell");
+							}
+							out.bdry_pos.push_back(rec.cells[k-1].pos[it->second]);
+							out.bdry_mult.push_back(static_cast<int>(c.boundary_mult[e]));
+						}
+						out.bdry_off[i+1] = checked_u32(out.bdry_pos.size());
+					}
+				}
+			}
+			for (int k=0; k<4; k++) rec.compact[k] = JsonCompactRecords();
+		}
+
+		/**
+		 * SAX handler filling JsonLatticeRecords without building a DOM.
+		 * Values are routed by depth: 1 is the top-level object, cells sit
+		 * at 3 inside the array of their order, "pos" is at 4 and boundary
+		 * terms [[x,y,z],m] span 5-6. In the compact schema an order is an
+		 * object at 2 whose flat arrays hold integers at 3. Unknown keys are
+		 * skipped.
+		 */
+		class JsonLatticeSax : public nlohmann::json_sax<nlohmann::json> {
+		public:
+			explicit JsonLatticeSax(JsonLatticeRecords& rec) : rec(rec) {}
+
+			bool null() override { return scalar(); }
+			bool boolean(bool) override { return scalar(); }
+			bool number_float(number_float_t, const string_t&) override { return scalar(); }
+			bool string(string_t&) override { return scalar(); }
+			bool binary(binary_t&) override { return scalar(); }
+
+			bool number_integer(number_integer_t x) override { return number(x); }
+			bool number_unsigned(number_unsigned_t x) override {
+				if (x > static_cast<number_unsigned_t>(std::numeric_limits<int64_t>::max())) {
+					return scalar();
+				}
+				return number(static_cast<int64_t>(x));
+			}
+
+			bool start_object(std::size_t) override {
+				depth++;
+				if (section == Section::Cells && depth == 2) {
+					section = Section::Compact;
+					rec.compact[order].present = true;
+				} else if (section == Section::Cells && depth == 3) {
+					field = Field::Other;
+					n_pos = 0;
+				} else if (routed()) {
+					fail("unexpected object");
+				}
+				return true;
+			}
+
+			bool end_object() override {
+				if (section == Section::Cells && depth == 3) {
+					JsonCellRecords& c = rec.cells[order];
+					if (n_pos != 3) fail("cell without a position");
+					c.pos.push_back(pos);
+					c.bdry_off.push_back(checked_u32(c.bdry_pos.size()));
+					field = Field::None;
+				}
+				depth--;
+				return true;
+			}
+
+			bool key(string_t& k) override {
+				if (depth == 1) {
+					field = Field::None;
+					target = nullptr;
+					section = Section::Skip;
+					if (k == "cell_vectors") section = Section::CellVectors;
+					else if (k == "primitive_cell_vectors") section = Section::PrimitiveCellVectors;
+					else if (k == "points") { section = Section::Cells; order = 0; }
+					else if (k == "links") { section = Section::Cells; order = 1; }
+					else if (k == "plaqs") { section = Section::Cells; order = 2; }
+					else if (k == "vols") { section = Section::Cells; order = 3; }
+					n_nums = 0;
+				} else if (section == Section::Compact && depth == 2) {
+					JsonCompactRecords& c = rec.compact[order];
+					if (k == "index") target = &c.index;
+					else if (k == "pos") target = &c.pos;
+					else if (k == "boundary") target = &c.boundary;
+					else if (k == "boundary_mult") target = &c.boundary_mult;
+					else if (k == "boundary_ptr") target = &c.boundary_ptr;
+					else target = nullptr;
+				} else if (section == Section::Cells && depth == 3) {
+					if (k == "pos") field = Field::Pos;
+					else if (k == "boundary") field = Field::Boundary;
+					else field = Field::Other;
+				}
+				return true;
+			}
+
+			bool start_array(std::size_t) override {
+				depth++;
+				if (field == Field::Pos && depth == 4) n_pos = 0;
+				if (field == Field::Boundary && depth == 5) n_nums = 0;
+				return true;
+			}
+
+			bool end_array() override {
+				if (field == Field::Pos && depth == 4 && n_pos != 3) {
+					fail("cell position must have 3 components");
+				}
+				if (field == Field::Boundary && depth == 5) {
+					if (n_nums != 4) fail("boundary terms must be [[x,y,z], multiplier]");
+					JsonCellRecords& c = rec.cells[order];
+					c.bdry_pos.push_back({nums[0], nums[1], nums[2]});
+					c.bdry_mult.push_back(static_cast<int>(nums[3]));
+				}
+				if (depth == 2 && (section == Section::CellVectors
+							|| section == Section::PrimitiveCellVectors)) {
+					if (n_nums != 9) fail("cell vectors must be 3x3");
+					imat33_t M;
+					for (int i=0; i<3; i++)
+						for (int j=0; j<3; j++)
+							M(i,j) = nums[3*i + j];
+					if (section == Section::CellVectors) {
+						rec.cell_vectors = M;
+						rec.has_cell_vectors = true;
+					} else {
+						rec.primitive_cell_vectors = M;
+						rec.has_primitive_cell_vectors = true;
+					}
+				}
+				depth--;
+				return true;
+			}
+
+			bool parse_error(std::size_t position, const std::string&,
+					const nlohmann::detail::exception& ex) override {
+				throw std::runtime_error("Malformed lattice JSON at byte "
+						+ std::to_string(position) + ": " + ex.what());
+			}
+
+		private:
+			enum class Section { None, Skip, CellVectors, PrimitiveCellVectors, Cells, Compact };
+			enum class Field { None, Other, Pos, Boundary };
+
+			JsonLatticeRecords& rec;
+			int depth = 0;
+			Section section = Section::None;
+			Field field = Field::None;
+			int order = 0;
+			// compact array being read
+			std::vector<int64_t>* target = nullptr;
+
+			ipos_t pos;
+			int n_pos = 0;
+			int64_t nums[9];
+			int n_nums = 0;
+
+			// True where the schema expects an integer
+			bool routed() const {
+				switch (section) {
+					case Section::CellVectors:
+					case Section::PrimitiveCellVectors:
+						return depth >= 2;
+					case Section::Cells:
+						return depth == 2 || field == Field::Pos
+							|| (field == Field::Boundary && depth >= 4);
+					case Section::Compact:
+						return target != nullptr && depth >= 3;
+					default:
+						return false;
+				}
+			}
+
+			[[noreturn]] void fail(const char* what) const {
+				throw std::runtime_error(std::string("Bad lattice JSON: ") + what);
+			}
+
+			// Anything but an integer is fine only where values are skipped
+			// (which includes the nulls standing for an empty order or an
+			// empty boundary)
+			bool scalar(){
+				if (routed()) fail("expected an integer");
+				return true;
+			}
+
+			bool number(int64_t x){
+				if (section == Section::CellVectors || section == Section::PrimitiveCellVectors) {
+					if (depth != 3 || n_nums == 9) fail("cell vectors must be 3x3");
+					nums[n_nums++] = x;
+				} else if (section == Section::Cells) {
+					if (field == Field::Pos && depth == 4) {
+						if (n_pos == 3) fail("cell position must have 3 components");
+						pos[n_pos++] = x;
+					} else if (field == Field::Boundary && (depth == 5 || depth == 6)) {
+						// [x,y,z] at depth 6, then the multiplier at depth 5
+						if ((depth == 6) != (n_nums < 3) || n_nums == 4) {
+							fail("boundary terms must be [[x,y,z], multiplier]");
+						}
+						nums[n_nums++] = x;
+					} else if (routed()) {
+						fail("unexpected integer");
+					}
+				} else if (section == Section::Compact && target) {
+					if (depth != 3) fail("compact arrays must be flat");
+					target->push_back(x);
+				}
+				return true;
+			}
+		};
+
+		// Finds or adds the sublattice of cell i to spec, taking boundary
+		// offsets from the cell as the nearest periodic image
+		template<int order>
+		void add_sublattice(UnitCellSpecifier& spec, const UnitCellSpecifier& period,
+				const JsonCellRecords& c, size_t i)
+		{
+			const ipos_t w = spec.wrap_copy(c.pos[i]);
+			if constexpr (order == 0) { if (spec.is_point(w)) return; }
+			else if constexpr (order == 1) { if (spec.is_link(w)) return; }
+			else if constexpr (order == 2) { if (spec.is_plaq(w)) return; }
+			else { if (spec.is_vol(w)) return; }
+
+			CellSpecifier<order> cs;
+			cs.position = c.pos[i];
+			const int64_t det = period.abs_det_latvecs;
+			for (uint32_t k=c.bdry_off[i]; k<c.bdry_off[i+1]; k++){
+				ipos_t d = c.bdry_pos[k] - c.pos[i];
+				// round the fractional coordinates det^-1 * adj(A) d
+				ipos_t n = period.latvecs_unnormed_inverse * d;
+				for (int m=0; m<3; m++){
+					n[m] = moddiv(2*n[m] + det, 2*det).quot;
+				}
+				cs.boundary.push_back({c.bdry_mult[k], d - period.latvecs * n});
+			}
+			if constexpr (order == 0) spec.add_point(cs);
+			else if constexpr (order == 1) spec.add_link(cs);
+			else if constexpr (order == 2) spec.add_plaq(cs);
+			else spec.add_vol(cs);
+		}
+
+		template<int order, typename Lattice>
+		void insert_cells(Lattice& lat, const JsonCellRecords& c){
+			typedef cell_type_of<order, Lattice> T;
+			auto& cells = cells_of<order>(lat);
+			{
+				alloc_stats::Scope scope(alloc_stats::Subsystem::IndexMaps);
+				cells.reserve(c.pos.size());
+			}
+			for (size_t i=0; i<c.pos.size(); i++){
+				T* x = new_cell<T>();
+				x->position = c.pos[i];
+				{
+					alloc_stats::Scope scope(alloc_stats::Subsystem::IndexMaps);
+					if (!cells.emplace(cell_idx_at<order>(lat, x->position), x).second) {
+						delete x;
+						throw std::runtime_error("Bad lattice JSON: two cells of order "
+								+ std::to_string(order) + " share a lattice index");
+					}
+				}
+				if constexpr (order > 0) {
+					alloc_stats::Scope scope(alloc_stats::Subsystem::Chains);
+					auto& faces = cells_of<order-1>(lat);
+					for (uint32_t k=c.bdry_off[i]; k<c.bdry_off[i+1]; k++){
+						auto it = faces.find(cell_idx_at<order-1>(lat, c.bdry_pos[k]));
+						if (it == faces.end()) {
+							throw std::runtime_error("Bad lattice JSON: boundary of a "
+									+ std::to_string(order) + "-cell refers to a missing cell");
+						}
+						x->boundary[it->second] = c.bdry_mult[k];
+						it->second->coboundary[x] = c.bdry_mult[k];
+					}
+				}
+			}
+		}
+
+		template<typename Lattice>
+		std::unique_ptr<Lattice> build_lattice(JsonLatticeRecords& rec){
+			constexpr int K = max_order_of<Lattice>();
+			trace::Scope phase("build_lattice", "io");
+			expand_compact(rec);
+			if (!rec.has_cell_vectors || !rec.has_primitive_cell_vectors) {
+				throw std::runtime_error("Bad lattice JSON: missing cell vectors");
+			}
+
+			// The saved primitive cell becomes the unit cell, with one
+			// sublattice per distinct wrapped cell position
+			UnitCellSpecifier spec(rec.primitive_cell_vectors);
+			const UnitCellSpecifier period(rec.cell_vectors);
+			if (period.abs_det_latvecs == 0 || spec.abs_det_latvecs == 0) {
+				throw std::runtime_error("Bad lattice JSON: degenerate cell vectors");
+			}
+			imat33_t supercell = spec.latvecs_unnormed_inverse * rec.cell_vectors;
+			for (int i=0; i<3; i++){
+				for (int j=0; j<3; j++){
+					if (supercell(i,j) % spec.abs_det_latvecs != 0) {
+						throw std::runtime_error("Bad lattice JSON: cell_vectors are not "
+								"a supercell of primitive_cell_vectors");
+					}
+					supercell(i,j) /= spec.abs_det_latvecs;
+				}
+			}
+
+			[&]<int... k>(std::integer_sequence<int, k...>){
+				(..., [&]{
+					for (size_t i=0; i<rec.cells[k].pos.size(); i++){
+						add_sublattice<k>(spec, period, rec.cells[k], i);
+					}
+				}());
+			}(std::make_integer_sequence<int, K+1>{});
+
+			auto lat = std::make_unique<Lattice>(spec, supercell, empty_lattice);
+			[&]<int... k>(std::integer_sequence<int, k...>){
+				(..., insert_cells<k>(*lat, rec.cells[k]));
+			}(std::make_integer_sequence<int, K+1>{});
+			return lat;
+		}
+	}
+
+
+	/**
+	 * Rebuilds a lattice from .lat.json text (either JsonSchema) without
+	 * re-running construction: the file is parsed with a SAX handler into
+	 * flat per-order arrays, the unit cell is recovered from the saved
+	 * primitive cell and the cell positions, and every saved cell is placed
+	 * at its lattice index. Boundaries are resolved through the index scheme
+	 * and coboundaries rebuilt from them, so diluted lattices load as saved.
+	 *
+	 * Lattice indices are those of the rebuilt unit cell, which need not
+	 * match the lattice that was saved. Orders above those of Lattice are
+	 * ignored.
+	 */
+	template<typename Lattice = PeriodicVolLattice<Cell<0>, Cell<1>, Cell<2>, Cell<3>>>
+		requires std::derived_from<Lattice, PeriodicAbstractLattice>
+	std::unique_ptr<Lattice> read_json(std::string_view text){
+		alloc_stats::Scope scope(alloc_stats::Subsystem::IO);
+		trace::Scope phase("read_json", "io");
+		detail::JsonLatticeRecords rec;
+		detail::JsonLatticeSax handler(rec);
+		nlohmann::json::sax_parse(text.begin(), text.end(), &handler);
+		return detail::build_lattice<Lattice>(rec);
+	}
+
+	template<typename Lattice = PeriodicVolLattice<Cell<0>, Cell<1>, Cell<2>, Cell<3>>>
+		requires std::derived_from<Lattice, PeriodicAbstractLattice>
+	std::unique_ptr<Lattice> read_json(std::istream& is){
+		alloc_stats::Scope scope(alloc_stats::Subsystem::IO);
+		trace::Scope phase("read_json", "io");
+		detail::JsonLatticeRecords rec;
+		detail::JsonLatticeSax handler(rec);
+		nlohmann::json::sax_parse(is, &handler);
+		return detail::build_lattice<Lattice>(rec);
+	}
+
+	// Loads a file written by save(); the file is mapped rather than read
+	template<typename Lattice = PeriodicVolLattice<Cell<0>, Cell<1>, Cell<2>, Cell<3>>>
+		requires std::derived_from<Lattice, PeriodicAbstractLattice>
+	std::unique_ptr<Lattice> load(const std::filesystem::path& path){
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) throw std::runtime_error("Cannot open " + path.string());
+		struct stat st;
+		if (::fstat(fd, &st) != 0) {
+			::close(fd);
+			throw std::runtime_error("Cannot stat " + path.string());
+		}
+		const size_t length = st.st_size;
+		if (length == 0) {
+			::close(fd);
+			throw std::runtime_error(path.string() + " is empty");
+		}
+		void* p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED) throw std::runtime_error("Cannot mmap " + path.string());
+		::madvise(p, length, MADV_SEQUENTIAL);
+		try {
+			auto lat = read_json<Lattice>(std::string_view(static_cast<const char*>(p), length));
+			::munmap(p, length);
+			return lat;
+		} catch (const std::runtime_error& e) {
+			::munmap(p, length);
+			throw std::runtime_error(path.string() + ": " + e.what());
+		}
+	}
+
 };
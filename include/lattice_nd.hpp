@@ -0,0 +1,108 @@
+#pragma once
+
+#include "cell_geometry.hpp"
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Periodic lattices in Dim dimensions.
+ *
+ * PeriodicLattice<Dim, Cells...> holds the cells of orders 0, 1, ..., each
+ * type derived from nd::Cell<Dim, order>, up to order Dim. Indexing,
+ * construction and erasure are PeriodicAbstractLattice<Dim>'s, the same
+ * code the Periodic*Lattice types run at Dim = 3, so in three dimensions
+ * its cells and indices are theirs.
+ *
+ *   // 3+1D hypercubic lattice with links and plaquettes
+ *   typedef nd::PeriodicLattice<4, nd::Cell<4,0>, nd::Cell<4,1>, nd::Cell<4,2>> Lat;
+ *   Lat lat(nd::PrimitiveSpecifiers::HypercubicSpec<4>(), 4 * imat<4>::identity());
+ *   auto& U = lat.get_at<1>({1, 0, 0, 0});
+ *
+ * Positions and chains take Dim coordinates, so a 2D lattice carries no
+ * third one. Access goes by order: cells<k>(), get_at<k>(R),
+ * get_idx_at<k>(R), erase<k>(x). As with the 3D types, the cells are not
+ * deleted with the lattice.
+ */
+namespace CellGeometry {
+namespace nd {
+
+template<int Dim, typename... Cells>
+requires (sizeof...(Cells) >= 1 && sizeof...(Cells) <= Dim + 1)
+struct PeriodicLattice : public PeriodicAbstractLattice<Dim> {
+	static constexpr int dim = Dim;
+	static constexpr int max_order = sizeof...(Cells) - 1;
+
+	template<int order>
+	using cell_type = std::tuple_element_t<order, std::tuple<Cells...>>;
+
+	static_assert([]<int... k>(std::integer_sequence<int, k...>){
+		return (... && CellLike<cell_type<k>, Dim, k>);
+	}(std::make_integer_sequence<int, sizeof...(Cells)>{}),
+	"the k'th cell type must derive from nd::Cell<Dim, k>");
+
+	PeriodicLattice(const UnitCellSpecifier<Dim>& specified_primitive,
+			const imat<Dim>& supercell) :
+		PeriodicAbstractLattice<Dim>(specified_primitive, supercell)
+	{
+		[&]<int... k>(std::integer_sequence<int, k...>){
+			(..., [&]{
+				this->template initialise_cells<k>(cells<k>());
+				if constexpr (k > 0) {
+					this->template connect_boundaries<k>(cells<k>(), cells<k-1>());
+				}
+			}());
+		}(std::make_integer_sequence<int, max_order+1>{});
+	}
+
+	PeriodicLattice(const UnitCellSpecifier<Dim>& specified_primitive,
+			const imat<Dim>& supercell, empty_lattice_t) :
+		PeriodicAbstractLattice<Dim>(specified_primitive, supercell)
+	{}
+
+	template<int order>
+	inline cell_type<order>& get_at(const ivec<Dim>& R){
+		return *cells<order>().at(this->template get_idx_at<order>(R));
+	}
+	template<int order>
+	inline const cell_type<order>& get_at(const ivec<Dim>& R) const {
+		return *cells<order>().at(this->template get_idx_at<order>(R));
+	}
+
+	// The J -> cell map of the given order
+	template<int order>
+	inline auto& cells(){ return std::get<order>(cellmaps); }
+	template<int order>
+	inline const auto& cells() const { return std::get<order>(cellmaps); }
+
+	// Deletes a cell, the cells of higher order it bounds (recursively) and
+	// every reference to them
+	template<int order>
+	void erase(cell_type<order>* x){
+		this->template erase_cascade<order>(
+				std::apply([](auto&... m){ return std::tie(m...); }, cellmaps), x);
+	}
+
+private:
+	std::tuple<SparseMap<sl_t, Cells*>...> cellmaps;
+};
+
+
+namespace detail {
+	template<int Dim, typename Orders>
+	struct standard_lattice;
+
+	template<int Dim, int... k>
+	struct standard_lattice<Dim, std::integer_sequence<int, k...>> {
+		typedef PeriodicLattice<Dim, Cell<Dim, k>...> type;
+	};
+}
+
+// Orders 0 to K with the plain cell types
+template<int Dim, int K = Dim>
+using StandardLattice = typename detail::standard_lattice<Dim,
+	  std::make_integer_sequence<int, K+1>>::type;
+
+}; // end of namespace nd
+}; // end of namespace
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "UnitCellSpecifier.hpp"
+#include "cell_geometry.hpp"
+#include "cell_rows.hpp"
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+
+/**
+ * Memory footprint of a lattice.
+ *
+ * memory_usage(lat) adds up what a built lattice holds on the heap;
+ * estimate_memory<Lattice>(spec, supercell) predicts the same breakdown for
+ * a pristine lattice from the unit cell alone, before anything is
+ * allocated, so that a job can be refused up front:
+ *
+ *   auto est = estimate_memory<Lattice>(spec, supercell);
+ *   if (est.total() > available_memory()) throw ...;
+ *
+ * Both count heap blocks as glibc malloc sizes them (a word of header,
+ * rounded to 16 bytes, at least 32), per order:
+ *   positions   the cells' positions
+ *   cells       the rest of each cell object: chain headers, user fields
+ *               and allocator overhead
+ *   chains      boundary and coboundary storage
+ *   index_map   the J -> cell map: buckets and nodes
+ * Chains grow by doubling as connect_* fills them, and the maps grow
+ * without a reserve, so the estimate rounds both up to powers of two; it
+ * is within a few percent of memory_usage() for the presets. Neighbour
+ * tables built later (neighbour_table.hpp) are not included.
+ */
+namespace CellGeometry {
+
+struct MemoryUsage {
+	struct Order {
+		size_t num_cells = 0;
+		size_t positions = 0;
+		size_t cells = 0;
+		size_t chains = 0;
+		size_t index_map = 0;
+
+		inline size_t total() const { return positions + cells + chains + index_map; }
+	};
+
+	int max_order = -1;
+	std::array<Order, 4> by_order = {};
+
+	inline size_t positions() const { return sum(&Order::positions); }
+	inline size_t cells() const { return sum(&Order::cells); }
+	inline size_t chains() const { return sum(&Order::chains); }
+	inline size_t index_maps() const { return sum(&Order::index_map); }
+	inline size_t total() const { return positions() + cells() + chains() + index_maps(); }
+
+private:
+	size_t sum(size_t Order::* field) const {
+		size_t s = 0;
+		for (const auto& o : by_order) s += o.*field;
+		return s;
+	}
+};
+
+
+namespace detail {
+	// Bytes malloc takes for a request of n
+	inline constexpr size_t heap_block(size_t n){
+		if (n == 0) return 0;
+		return std::max<size_t>(32, (n + 8 + 15) & ~size_t(15));
+	}
+
+	// A std::unordered_map node holding one value (integer keys don't
+	// cache their hash)
+	template<typename Map>
+	inline constexpr size_t map_node_bytes(){
+		return heap_block(sizeof(void*) + sizeof(typename Map::value_type));
+	}
+
+	template<typename Map>
+	inline size_t index_map_bytes(size_t buckets, size_t n){
+		// a single bucket lives inside the map
+		return (buckets > 1 ? heap_block(buckets * sizeof(void*)) : 0)
+			+ n * map_node_bytes<Map>();
+	}
+
+	template<typename C>
+	inline size_t chain_bytes(const C& chain){
+		return heap_block(chain.capacity() * sizeof(typename C::value_type));
+	}
+
+	template<int order>
+	const CellSpecifier<order>& spec_cell(const UnitCellSpecifier& spec, sl_t sl){
+		if constexpr (order == 0) return spec.point_no(sl);
+		else if constexpr (order == 1) return spec.link_no(sl);
+		else if constexpr (order == 2) return spec.plaq_no(sl);
+		else return spec.vol_no(sl);
+	}
+
+	template<int order>
+	sl_t sl_of(const UnitCellSpecifier& spec, const ipos_t& R){
+		if constexpr (order == 0) return spec.sl_of_point(R);
+		else if constexpr (order == 1) return spec.sl_of_link(R);
+		else if constexpr (order == 2) return spec.sl_of_plaq(R);
+		else return spec.sl_of_vol(R);
+	}
+
+	template<int k, typename Lattice>
+	void add_memory_usage(const Lattice& lat, MemoryUsage& m){
+		typedef cell_type_of<k, Lattice> T;
+		constexpr int K = max_order_of<Lattice>();
+		const auto& cellmap = cells_of<k>(lat);
+		auto& o = m.by_order[k];
+		o.num_cells = cellmap.size();
+		o.positions = o.num_cells * sizeof(ipos_t);
+		o.cells = o.num_cells * heap_block(sizeof(T)) - o.positions;
+		for (const auto& [_, x] : cellmap){
+			if constexpr (k > 0) o.chains += chain_bytes(x->boundary);
+			if constexpr (k < K) o.chains += chain_bytes(x->coboundary);
+		}
+		o.index_map = index_map_bytes<std::remove_cvref_t<decltype(cellmap)>>(
+				cellmap.bucket_count(), cellmap.size());
+	}
+
+	// Capacity of a vector filled one element at a time
+	inline size_t grown_capacity(size_t n){
+		return n == 0 ? 0 : std::bit_ceil(n);
+	}
+
+	template<int k, typename Lattice>
+	void add_memory_estimate(const UnitCellSpecifier& spec, size_t num_primitive, MemoryUsage& m){
+		typedef cell_type_of<k, Lattice> T;
+		constexpr int K = max_order_of<Lattice>();
+		auto& o = m.by_order[k];
+		const sl_t n_sl = spec.num_sl(k);
+		o.num_cells = n_sl * num_primitive;
+		o.positions = o.num_cells * sizeof(ipos_t);
+		o.cells = o.num_cells * heap_block(sizeof(T)) - o.positions;
+
+		// every cell of a sublattice has the same (co)boundary size
+		for (sl_t s=0; s<n_sl; s++){
+			if constexpr (k > 0) {
+				const size_t n = spec_cell<k>(spec, s).boundary.size();
+				o.chains += num_primitive * heap_block(grown_capacity(n)
+						* sizeof(typename Chain<k-1>::value_type));
+			}
+		}
+		if constexpr (k < K) {
+			std::vector<size_t> cob(n_sl, 0);
+			for (sl_t s=0; s<spec.num_sl(k+1); s++){
+				const auto& up = spec_cell<k+1>(spec, s);
+				for (const auto& bp : up.boundary){
+					cob.at(sl_of<k>(spec, up.position + bp.relative_position))++;
+				}
+			}
+			for (size_t n : cob){
+				o.chains += num_primitive * heap_block(grown_capacity(n)
+						* sizeof(typename Chain<k+1>::value_type));
+			}
+		}
+		typedef std::remove_cvref_t<decltype(cells_of<k>(std::declval<Lattice&>()))> Map;
+		o.index_map = index_map_bytes<Map>(grown_capacity(o.num_cells), o.num_cells);
+	}
+}
+
+
+/**
+ * What the lattice's cells, chains and index maps hold on the heap.
+ */
+template<typename Lattice>
+	requires std::derived_from<Lattice, PeriodicAbstractLattice>
+MemoryUsage memory_usage(const Lattice& lat){
+	constexpr int K = max_order_of<Lattice>();
+	MemoryUsage m;
+	m.max_order = K;
+	[&]<int... k>(std::integer_sequence<int, k...>){
+		(..., detail::add_memory_usage<k>(lat, m));
+	}(std::make_integer_sequence<int, K+1>{});
+	return m;
+}
+
+
+/**
+ * Predicts memory_usage() of a pristine Lattice(spec, supercell) without
+ * building it. The cell sizes are those of Lattice's cell types.
+ * Throws std::invalid_argument for a singular supercell.
+ */
+template<typename Lattice = PeriodicVolLattice<Cell<0>, Cell<1>, Cell<2>, Cell<3>>>
+	requires std::derived_from<Lattice, PeriodicAbstractLattice>
+MemoryUsage estimate_memory(const UnitCellSpecifier& spec, const imat33_t& supercell){
+	constexpr int K = max_order_of<Lattice>();
+	const int64_t det = vector3::det(supercell);
+	if (det == 0) throw std::invalid_argument("Supercell is singular");
+	const size_t num_primitive = static_cast<size_t>(det < 0 ? -det : det);
+	MemoryUsage m;
+	m.max_order = K;
+	[&]<int... k>(std::integer_sequence<int, k...>){
+		(..., detail::add_memory_estimate<k, Lattice>(spec, num_primitive, m));
+	}(std::make_integer_sequence<int, K+1>{});
+	return m;
+}
+
+
+// Memory the system could give us now (MemAvailable), or all of RAM if
+// that can't be read
+inline size_t available_memory(){
+	std::ifstream meminfo("/proc/meminfo");
+	std::string line;
+	while (std::getline(meminfo, line)) {
+		size_t kb;
+		if (std::sscanf(line.c_str(), "MemAvailable: %zu kB", &kb) == 1) return kb * 1024;
+	}
+	return size_t(sysconf(_SC_PHYS_PAGES)) * size_t(sysconf(_SC_PAGESIZE));
+}
+
+
+inline std::ostream& operator<<(std::ostream& os, const MemoryUsage& m){
+	auto mib = [](size_t b){
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), "%.1f MiB", b / 1048576.0);
+		return std::string(buf);
+	};
+	for (int k=0; k<=m.max_order; k++){
+		const auto& o = m.by_order[k];
+		os << "order " << k << ": " << o.num_cells << " cells, " << mib(o.total())
+			<< " (positions " << mib(o.positions) << ", cells " << mib(o.cells)
+			<< ", chains " << mib(o.chains) << ", index map " << mib(o.index_map) << ")\n";
+	}
+	os << "total: " << mib(m.total()) << "\n";
+	return os;
+}
+
+}; // end of namespace
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "chain.hpp"
+
+
+namespace CellGeometry {
+
+// Which incidence relation two cells of the same order are adjacent through
+//   Boundary:   they share an (order-1)-cell, e.g. two links meeting at a point
+//   Coboundary: they share an (order+1)-cell, e.g. two links on one plaquette
+enum class NeighbourRelation { Boundary = 0, Coboundary = 1 };
+
+
+/**
+ * CSR adjacency between the cells of a single order, indexed by the lattice
+ * index J (i.e. the key of lat.points, lat.links, ...).
+ *
+ * Each row is sorted and free of duplicates, even when two cells share
+ * several faces. If built weighted, the weight of the pair (x0, x1) is
+ *   Boundary:   sum_f  [x0 : f] [x1 : f]     (f an (order-1)-cell)
+ *   Coboundary: sum_F  [F : x0] [F : x1]     (F an (order+1)-cell)
+ * where [a : b] is the incidence number stored in the chains.
+ *
+ * Rows keep their capacity when cells are erased, so that deletions can be
+ * patched in place without re-laying out the table.
+ */
+struct NeighbourTableBase {
+	// Neighbours of the cell with lattice index J
+	inline std::span<const idx_t> operator[](idx_t J) const {
+		return {col.data() + row_start[J], row_len[J]};
+	}
+
+	// Weights matching operator[](J); empty if the table is unweighted
+	inline std::span<const int> weights(idx_t J) const {
+		if (!is_weighted) return {};
+		return {wt.data() + row_start[J], row_len[J]};
+	}
+
+	// Size of the index space (not the number of live cells)
+	inline size_t size() const { return row_len.size(); }
+
+	inline bool weighted() const { return is_weighted; }
+
+	inline bool contains(idx_t J) const {
+		return J < cells.size() && cells[J] != nullptr;
+	}
+
+	// Removes J from the table, dropping it from the rows of its neighbours
+	void erase(idx_t J){
+		if (!contains(J)) return;
+		for (idx_t J1 : (*this)[J]) {
+			auto* first = col.data() + row_start[J1];
+			auto* last = first + row_len[J1];
+			auto it = std::lower_bound(first, last, J);
+			if (it == last || *it != J) continue;
+			auto k = it - col.data();
+			std::copy(it + 1, last, it);
+			if (is_weighted) {
+				std::copy(wt.begin() + k + 1, wt.begin() + (last - col.data()),
+						wt.begin() + k);
+			}
+			row_len[J1]--;
+		}
+		row_len[J] = 0;
+		cells[J] = nullptr;
+	}
+
+	virtual ~NeighbourTableBase() = default;
+
+protected:
+	std::vector<idx_t> row_start;
+	std::vector<idx_t> row_len;
+	std::vector<idx_t> col;
+	std::vector<int> wt;
+	// J -> cell, nullptr where no cell exists
+	std::vector<GeometricObject*> cells;
+	bool is_weighted = false;
+};
+
+
+template<CellOfAnyOrder T>
+struct NeighbourTable : public NeighbourTableBase {
+	/**
+	 * Builds the table from a cell map (J -> T*).
+	 * @param cellmap    -> e.g. lat.links
+	 * @param n_index    -> size of the index space, num_sl * num_primitive
+	 * @param rel        -> the relation defining adjacency
+	 * @param weighted   -> whether to also store summed incidence products
+	 */
+	template<typename Map>
+	NeighbourTable(const Map& cellmap, size_t n_index,
+			NeighbourRelation rel, bool weighted)
+	{
+		is_weighted = weighted;
+		cells.assign(n_index, nullptr);
+		row_start.assign(n_index + 1, 0);
+		row_len.assign(n_index, 0);
+
+		// pointer -> J lookup for the far end of each incidence
+		std::vector<std::pair<const GeometricObject*, idx_t>> index;
+		index.reserve(cellmap.size());
+		for (const auto& [J, x] : cellmap) {
+			cells[J] = x;
+			index.emplace_back(x, J);
+		}
+		std::sort(index.begin(), index.end());
+		auto index_of = [&index](const GeometricObject* x){
+			return std::lower_bound(index.begin(), index.end(),
+					std::make_pair(x, idx_t(0)))->second;
+		};
+
+		std::vector<std::pair<idx_t, int>> row;
+		for (size_t J = 0; J < n_index; J++) {
+			row_start[J] = col.size();
+			if (cells[J] == nullptr) continue;
+			row.clear();
+			auto* x0 = static_cast<const T*>(cells[J]);
+			if (rel == NeighbourRelation::Boundary) {
+				if constexpr (T::order > 0) {
+					for (const auto& [f, m0] : x0->boundary) {
+						for (const auto& [x1, m1] : f->coboundary) {
+							if (x1 != x0) row.emplace_back(index_of(x1), m0*m1);
+						}
+					}
+				}
+			} else {
+				if constexpr (T::order < 3) {
+					for (const auto& [F, m0] : x0->coboundary) {
+						for (const auto& [x1, m1] : F->boundary) {
+							if (x1 != x0) row.emplace_back(index_of(x1), m0*m1);
+						}
+					}
+				}
+			}
+			std::sort(row.begin(), row.end());
+			for (size_t i = 0; i < row.size(); i++) {
+				if (i > 0 && row[i].first == row[i-1].first) {
+					if (weighted) wt.back() += row[i].second;
+					continue;
+				}
+				col.push_back(row[i].first);
+				if (weighted) wt.push_back(row[i].second);
+			}
+			row_len[J] = col.size() - row_start[J];
+		}
+		row_start[n_index] = col.size();
+	}
+
+	inline T& cell(idx_t J) const { return *static_cast<T*>(cells[J]); }
+};
+
+
+// Lazily built neighbour tables, one per (order, relation).
+// Copies start empty, since the tables hold pointers into their lattice.
+struct NeighbourCache {
+	NeighbourCache() = default;
+	NeighbourCache(const NeighbourCache&) {}
+	NeighbourCache& operator=(const NeighbourCache&) { clear(); return *this; }
+
+	std::unique_ptr<NeighbourTableBase>& slot(int order, NeighbourRelation rel){
+		return tables[2*order + static_cast<int>(rel)];
+	}
+
+	void clear(){
+		for (auto& t : tables) t.reset();
+	}
+
+	// Keeps the cache consistent with the deletion of cell J of `order`.
+	// Tables over `order` itself are patched. Tables adjacent through `order`
+	// (points via links, links via plaqs, ...) are dropped and rebuilt on
+	// next use, since losing a shared cell may or may not disconnect the
+	// pair. Tables over order+1 via Boundary need nothing: the erase_*
+	// cascade has already removed every (order+1)-cell containing J.
+	void on_erase(int order, idx_t J){
+		if (order < num_orders) {
+			for (auto rel : {NeighbourRelation::Boundary, NeighbourRelation::Coboundary}){
+				if (auto& t = slot(order, rel)) t->erase(J);
+			}
+		}
+		if (order > 0 && order <= num_orders) {
+			slot(order-1, NeighbourRelation::Coboundary).reset();
+		}
+	}
+
+private:
+	// Tables are kept for orders 0 to 3; the cells of higher order in
+	// lattice_nd.hpp lattices have none
+	static constexpr int num_orders = 4;
+	std::array<std::unique_ptr<NeighbourTableBase>, 2*num_orders> tables;
+};
+
+}; // end of namespace
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "UnitCellSpecifier.hpp"
+#include "chain.hpp"
+#include <cstddef>
+
+/**
+ * Smith and Hermite normal forms of 3x3 integer matrices, worked directly on
+ * imat33_t.
+ *
+ * Every intermediate goes through checked_int.hpp, so a supercell whose
+ * reduction would leave int64_t throws std::overflow_error rather than
+ * producing a wrong index scheme. The inverses of the transforms are
+ * accumulated alongside them, so nothing is inverted afterwards. The
+ * reduction is the dimension-generic one of normal_forms_nd.hpp, taken at 3.
+ *
+ * PeriodicAbstractLattice decomposes its supercell through
+ * cached_smith_normal_form, which remembers the result per supercell: an
+ * ensemble building the same lattice many times pays for it once.
+ */
+namespace CellGeometry {
+
+/**
+ * L A R = diag(D), with L and R unimodular, D[0] | D[1] | D[2] and D >= 0.
+ * Throws std::overflow_error if the reduction, or D[0]*D[1]*D[2], does not
+ * fit in int64_t.
+ */
+SNF_decomp smith_normal_form(const imat33_t& A);
+
+
+// A U = H
+struct HNF_decomp {
+	// lower triangular, 0 <= H(i,j) < H(i,i) for j < i
+	imat33_t H;
+	// unimodular
+	imat33_t U;
+	imat33_t Uinv;
+};
+
+/**
+ * Column-style Hermite normal form: H spans the same lattice as the columns
+ * of A, and is the same for any two bases of that lattice. Throws
+ * std::invalid_argument for a singular A and std::overflow_error as above.
+ */
+HNF_decomp hermite_normal_form(const imat33_t& A);
+
+
+/**
+ * smith_normal_form(A), remembered for each A in a process-wide cache.
+ * Safe to call from several threads. Failures are not cached.
+ */
+SNF_decomp cached_smith_normal_form(const imat33_t& A);
+
+struct SNFCacheStats {
+	size_t hits = 0;
+	size_t misses = 0;
+	size_t entries = 0;
+};
+
+SNFCacheStats snf_cache_stats();
+
+// Empties the cache and zeroes the statistics
+void clear_snf_cache();
+
+}; // end of namespace
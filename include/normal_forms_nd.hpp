@@ -0,0 +1,263 @@
+#pragma once
+
+#include "checked_int.hpp"
+#include "vecn.hpp"
+#include <stdexcept>
+#include <utility>
+
+/**
+ * Smith and Hermite normal forms of N x N integer matrices.
+ *
+ * This is the reduction behind normal_forms.hpp for any dimension: the 3x3
+ * functions there convert to imat<3> and call these. It works on the
+ * vectorn types in every dimension, including three; the lattices of other
+ * dimensions index by it directly. All arithmetic is checked as described
+ * there.
+ */
+namespace CellGeometry {
+namespace nd {
+
+// L A R = diag(D), with L and R unimodular, D[0] | D[1] | ... and D >= 0
+template<int Dim>
+struct SNF_decomp {
+	vectorn::imat<Dim> L;
+	vectorn::imat<Dim> Linv;
+	vectorn::ivec<Dim> D;
+	vectorn::imat<Dim> R;
+	vectorn::imat<Dim> Rinv;
+};
+
+// A U = H
+template<int Dim>
+struct HNF_decomp {
+	// lower triangular, 0 <= H(i,j) < H(i,i) for j < i
+	vectorn::imat<Dim> H;
+	// unimodular
+	vectorn::imat<Dim> U;
+	vectorn::imat<Dim> Uinv;
+};
+
+
+namespace detail {
+
+inline int64_t abs_checked(int64_t x){
+	return x < 0 ? checked::neg(x) : x;
+}
+
+// g = x a + y b with g = gcd(a, b) > 0, for a, b not both zero
+struct ExtGcd {
+	int64_t g, x, y;
+};
+
+inline ExtGcd ext_gcd(int64_t a, int64_t b){
+	int64_t r0 = a, r1 = b, s0 = 1, s1 = 0, t0 = 0, t1 = 1;
+	while (r1 != 0) {
+		const int64_t q = checked::div(r0, r1);
+		r0 = checked::sub(r0, checked::mul(q, r1)); std::swap(r0, r1);
+		s0 = checked::sub(s0, checked::mul(q, s1)); std::swap(s0, s1);
+		t0 = checked::sub(t0, checked::mul(q, t1)); std::swap(t0, t1);
+	}
+	if (r0 < 0) return {checked::neg(r0), checked::neg(s0), checked::neg(t0)};
+	return {r0, s0, t0};
+}
+
+// |x|, which fits for every x including INT64_MIN
+inline uint64_t magnitude(int64_t x){
+	return x < 0 ? uint64_t(0) - static_cast<uint64_t>(x) : static_cast<uint64_t>(x);
+}
+
+inline int64_t floor_div(int64_t a, int64_t b){
+	const int64_t q = checked::div(a, b);
+	return (checked::rem(a, b) != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
+}
+
+// q such that |a - q b| <= |b|/2
+inline int64_t balanced_quotient(int64_t a, int64_t b){
+	const int64_t q = checked::div(a, b), r = checked::rem(a, b);
+	if (r != 0 && magnitude(r) > magnitude(b) / 2) {
+		return ((r < 0) == (b < 0)) ? q + 1 : q - 1;
+	}
+	return q;
+}
+
+/*
+ * A with the unimodular row transform L and column transform R applied so
+ * far (A = L A0 R), and their inverses. Each operation mixes two rows (or
+ * columns) p, q by the 2x2 matrix [[a, b], [c, d]] of determinant +-1.
+ */
+template<int Dim>
+struct Reduction {
+	vectorn::imat<Dim> A;
+	vectorn::imat<Dim> L = vectorn::imat<Dim>::identity(), Linv = vectorn::imat<Dim>::identity();
+	vectorn::imat<Dim> R = vectorn::imat<Dim>::identity(), Rinv = vectorn::imat<Dim>::identity();
+
+	explicit Reduction(const vectorn::imat<Dim>& A0) : A(A0) {}
+
+	// row_p <- a row_p + b row_q, row_q <- c row_p + d row_q
+	void rows(int p, int q, int64_t a, int64_t b, int64_t c, int64_t d){
+		mix_rows(A, p, q, a, b, c, d);
+		mix_rows(L, p, q, a, b, c, d);
+		// Linv <- Linv M^-1, M^-1 = det M [[d, -b], [-c, a]]
+		const int64_t s = checked::lincomb(a, d, checked::neg(b), c);
+		mix_cols(Linv, p, q, checked::mul(s, d), checked::mul(-s, b),
+				checked::mul(-s, c), checked::mul(s, a));
+	}
+
+	// col_p <- a col_p + c col_q, col_q <- b col_p + d col_q
+	void cols(int p, int q, int64_t a, int64_t b, int64_t c, int64_t d){
+		mix_cols(A, p, q, a, b, c, d);
+		mix_cols(R, p, q, a, b, c, d);
+		const int64_t s = checked::lincomb(a, d, checked::neg(b), c);
+		mix_rows(Rinv, p, q, checked::mul(s, d), checked::mul(-s, b),
+				checked::mul(-s, c), checked::mul(s, a));
+	}
+
+	void negate_row(int p){
+		for (int j=0; j<Dim; j++){
+			A(p,j) = checked::neg(A(p,j));
+			L(p,j) = checked::neg(L(p,j));
+			Linv(j,p) = checked::neg(Linv(j,p));
+		}
+	}
+
+	void negate_col(int p){
+		for (int i=0; i<Dim; i++){
+			A(i,p) = checked::neg(A(i,p));
+			R(i,p) = checked::neg(R(i,p));
+			Rinv(p,i) = checked::neg(Rinv(p,i));
+		}
+	}
+
+	// Reduces A(i,t) to its balanced remainder mod the pivot A(t,t) != 0 by
+	// a row operation; true if that clears it
+	bool reduce_below(int t, int i){
+		const int64_t q = balanced_quotient(A(i,t), A(t,t));
+		if (q != 0) rows(t, i, 1, 0, checked::neg(q), 1);
+		return A(i,t) == 0;
+	}
+
+	// The same for A(t,j), by a column operation
+	bool reduce_right(int t, int j){
+		const int64_t q = balanced_quotient(A(t,j), A(t,t));
+		if (q != 0) cols(t, j, 1, checked::neg(q), 0, 1);
+		return A(t,j) == 0;
+	}
+
+	// Clears A(t,j) against the pivot A(t,t) != 0 by column operations
+	void clear_right(int t, int j){
+		const int64_t a = A(t,t), b = A(t,j);
+		if (b == 0) return;
+		if (checked::rem(b, a) == 0) {
+			cols(t, j, 1, checked::neg(checked::div(b, a)), 0, 1);
+		} else {
+			const auto e = ext_gcd(a, b);
+			cols(t, j, e.x, checked::neg(checked::div(b, e.g)), e.y, checked::div(a, e.g));
+		}
+	}
+
+private:
+	static void mix_rows(vectorn::imat<Dim>& M, int p, int q, int64_t a, int64_t b, int64_t c, int64_t d){
+		for (int j=0; j<Dim; j++){
+			const int64_t mp = M(p,j), mq = M(q,j);
+			M(p,j) = checked::lincomb(a, mp, b, mq);
+			M(q,j) = checked::lincomb(c, mp, d, mq);
+		}
+	}
+
+	static void mix_cols(vectorn::imat<Dim>& M, int p, int q, int64_t a, int64_t b, int64_t c, int64_t d){
+		for (int i=0; i<Dim; i++){
+			const int64_t mp = M(i,p), mq = M(i,q);
+			M(i,p) = checked::lincomb(a, mp, c, mq);
+			M(i,q) = checked::lincomb(b, mp, d, mq);
+		}
+	}
+};
+
+} // namespace detail
+
+
+/**
+ * L A R = diag(D). Throws std::overflow_error if the reduction, or the
+ * product of the D[n], does not fit in int64_t.
+ */
+template<int Dim>
+SNF_decomp<Dim> smith_normal_form(const vectorn::imat<Dim>& A0){
+	detail::Reduction<Dim> r(A0);
+	auto& A = r.A;
+	for (int t=0; t<Dim; t++){
+		while (true) {
+			// smallest nonzero entry of the trailing block to (t,t)
+			int pi = -1, pj = -1;
+			for (int i=t; i<Dim; i++){
+				for (int j=t; j<Dim; j++){
+					if (A(i,j) != 0 && (pi < 0 || detail::abs_checked(A(i,j))
+								< detail::abs_checked(A(pi,pj)))) {
+						pi = i; pj = j;
+					}
+				}
+			}
+			if (pi < 0) break; // the rest is zero
+			if (pi != t) r.rows(t, pi, 0, 1, 1, 0);
+			if (pj != t) r.cols(t, pj, 0, 1, 1, 0);
+
+			// reduce the pivot's row and column to remainders; a nonzero
+			// one is smaller than the pivot and becomes the next
+			bool clean = true;
+			for (int i=t+1; i<Dim; i++) clean = r.reduce_below(t, i) && clean;
+			for (int j=t+1; j<Dim; j++) clean = r.reduce_right(t, j) && clean;
+			if (!clean) continue;
+
+			// the pivot must divide the rest, or it isn't the first invariant
+			int bad = -1;
+			for (int i=t+1; i<Dim && bad < 0; i++){
+				for (int j=t+1; j<Dim; j++){
+					if (checked::rem(A(i,j), A(t,t)) != 0) { bad = i; break; }
+				}
+			}
+			if (bad < 0) break;
+			r.rows(t, bad, 1, 1, 0, 1);
+		}
+		if (A(t,t) < 0) r.negate_row(t);
+	}
+
+	SNF_decomp<Dim> s{r.L, r.Linv, {}, r.R, r.Rinv};
+	int64_t vol = 1;
+	for (int n=0; n<Dim; n++){
+		s.D[n] = A(n,n);
+		vol = checked::mul(vol, s.D[n]);
+	}
+	return s;
+}
+
+
+/**
+ * Column-style Hermite normal form: H spans the same lattice as the columns
+ * of A. Throws std::invalid_argument for a singular A.
+ */
+template<int Dim>
+HNF_decomp<Dim> hermite_normal_form(const vectorn::imat<Dim>& A0){
+	detail::Reduction<Dim> r(A0);
+	auto& A = r.A;
+	for (int i=0; i<Dim; i++){
+		// gather row i's gcd into column i
+		for (int j=i+1; j<Dim; j++){
+			if (A(i,j) == 0) continue;
+			if (A(i,i) == 0) {
+				r.cols(i, j, 0, 1, 1, 0);
+			} else {
+				r.clear_right(i, j);
+			}
+		}
+		if (A(i,i) == 0) throw std::invalid_argument("Hermite normal form of a singular matrix");
+		if (A(i,i) < 0) r.negate_col(i);
+		// reduce what is left of the pivot into [0, H(i,i))
+		for (int j=0; j<i; j++){
+			const int64_t q = detail::floor_div(A(i,j), A(i,i));
+			if (q != 0) r.cols(j, i, 1, 0, checked::neg(q), 1);
+		}
+	}
+	return {r.A, r.R, r.Rinv};
+}
+
+}; // end of namespace nd
+}; // end of namespace
@@ -0,0 +1,314 @@
+#pragma once
+
+#include "cell_geometry.hpp"
+#include "cell_rows.hpp"
+#include "sparse_export.hpp"
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+/**
+ * NumPy .npy / .npz output.
+ *
+ * save_npy_dir() writes one .npy per array into a directory, for
+ * np.load(path, mmap_mode='r'); save_npz() bundles the same arrays into an
+ * uncompressed .npz. The arrays of a lattice are
+ *
+ *   cell_vectors, primitive_cell_vectors   int64 [3,3], columns are the vectors
+ *   index<k>      uint32 [N_k]     lattice index J of each row of order k
+ *   pos<k>        int64 [N_k,3]    positions, by row
+ *   d<k>_indptr, d<k>_indices, d<k>_data
+ *                 uint32, uint32, int32: the boundary operator d_k as CSR,
+ *                 rows (k-1)-cells, columns k-cells (see sparse_export.hpp)
+ *   <name>        float64 [N_k]    each NpyCellArray, by row of its order
+ *
+ * All rows are numbered by CellRows, so every array of order k lines up.
+ */
+namespace CellGeometry {
+
+namespace npy {
+
+	// A named array ready to write: the .npy header, and the data it
+	// describes (not owned)
+	struct Array {
+		std::string name;
+		std::string header;
+		const void* data;
+		size_t bytes;
+	};
+
+	template<typename T>
+	std::string descr(){
+		static_assert(std::is_arithmetic_v<T>);
+		const char endian = sizeof(T) == 1 ? '|'
+			: (std::endian::native == std::endian::little ? '<' : '>');
+		const char kind = std::is_floating_point_v<T> ? 'f'
+			: (std::is_signed_v<T> ? 'i' : 'u');
+		return std::string{endian, kind} + std::to_string(sizeof(T));
+	}
+
+	// Format 1.0 header, padded so the data starts on a 64 byte boundary
+	inline std::string header(const std::string& descr, const std::vector<size_t>& shape){
+		std::string dict = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': (";
+		for (size_t s : shape) dict += std::to_string(s) + ", ";
+		// numpy's own spelling: (n,) and (n, m)
+		if (shape.size() == 1) dict.pop_back();
+		else if (shape.size() > 1) dict.resize(dict.size() - 2);
+		dict += "), }";
+		const size_t unpadded = 10 + dict.size() + 1;
+		dict.append((64 - unpadded % 64) % 64, ' ');
+		dict.push_back('\n');
+		if (dict.size() > 0xffff) throw std::length_error("npy header too long");
+
+		std::string h("\x93NUMPY\x01\x00", 8);
+		h.push_back(char(dict.size() & 0xff));
+		h.push_back(char(dict.size() >> 8));
+		return h + dict;
+	}
+
+	template<typename T>
+	Array array(std::string name, const T* data, const std::vector<size_t>& shape){
+		size_t n = 1;
+		for (size_t s : shape) n *= s;
+		return {std::move(name), header(descr<T>(), shape), data, n * sizeof(T)};
+	}
+
+	template<typename T>
+	Array array(std::string name, const std::vector<T>& v){
+		return array(std::move(name), v.data(), {v.size()});
+	}
+
+	inline uint32_t crc32(const void* data, size_t n, uint32_t crc = 0){
+		static const auto table = []{
+			std::array<uint32_t, 256> t;
+			for (uint32_t i=0; i<256; i++){
+				uint32_t c = i;
+				for (int k=0; k<8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				t[i] = c;
+			}
+			return t;
+		}();
+		const auto* p = static_cast<const uint8_t*>(data);
+		crc = ~crc;
+		for (size_t i=0; i<n; i++) crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	inline void write(std::ostream& os, const Array& a){
+		os.write(a.header.data(), a.header.size());
+		os.write(static_cast<const char*>(a.data), a.bytes);
+	}
+
+	namespace detail {
+		// little-endian zip fields
+		inline void put16(std::string& s, uint16_t x){
+			s.push_back(char(x)); s.push_back(char(x >> 8));
+		}
+		inline void put32(std::string& s, uint32_t x){
+			put16(s, uint16_t(x)); put16(s, uint16_t(x >> 16));
+		}
+	}
+
+	/**
+	 * Writes the arrays as a stored (uncompressed) zip, which np.load reads
+	 * as an NpzFile with one member per array. Members over 4 GiB would need
+	 * zip64 and are refused; use one .npy per array for those.
+	 */
+	inline void write_npz(std::ostream& os, std::span<const Array> arrays){
+		using detail::put16, detail::put32;
+		std::string central;
+		uint64_t offset = 0;
+		for (const auto& a : arrays){
+			const std::string fname = a.name + ".npy";
+			const uint64_t size = a.header.size() + a.bytes;
+			if (size > 0xffffffffu || offset > 0xffffffffu) {
+				throw std::length_error("npz member '" + a.name + "' needs zip64");
+			}
+			const uint32_t crc = crc32(a.data, a.bytes, crc32(a.header.data(), a.header.size()));
+
+			// fields common to the local and central headers
+			std::string common;
+			put16(common, 20);          // version needed: 2.0
+			put16(common, 0);           // flags
+			put16(common, 0);           // stored
+			put16(common, 0);           // time
+			put16(common, 0x21);        // date: 1980-01-01
+			put32(common, crc);
+			put32(common, uint32_t(size));
+			put32(common, uint32_t(size));
+			put16(common, uint16_t(fname.size()));
+			put16(common, 0);           // extra length
+
+			std::string local;
+			put32(local, 0x04034b50);
+			local += common;
+			local += fname;
+			os.write(local.data(), local.size());
+			write(os, a);
+
+			put32(central, 0x02014b50);
+			put16(central, 20);         // made by
+			central += common;
+			put16(central, 0);          // comment length
+			put16(central, 0);          // disk
+			put16(central, 0);          // internal attributes
+			put32(central, 0);          // external attributes
+			put32(central, uint32_t(offset));
+			central += fname;
+			offset += local.size() + size;
+		}
+		if (offset > 0xffffffffu || arrays.size() > 0xffff) {
+			throw std::length_error("npz archive needs zip64");
+		}
+		std::string end;
+		put32(end, 0x06054b50);
+		put16(end, 0);
+		put16(end, 0);
+		put16(end, uint16_t(arrays.size()));
+		put16(end, uint16_t(arrays.size()));
+		put32(end, uint32_t(central.size()));
+		put32(end, uint32_t(offset));
+		put16(end, 0);
+		os.write(central.data(), central.size());
+		os.write(end.data(), end.size());
+		if (!os) throw std::runtime_error("Failed to write npz");
+	}
+}; // end of namespace npy
+
+
+static_assert(sizeof(ipos_t) == 3*sizeof(int64_t), "positions are written as int64 [N,3]");
+
+
+// A per-cell value array: values[J] for the cell of `order` with lattice index J
+struct NpyCellArray {
+	std::string name;
+	int order;
+	std::span<const double> values;
+};
+
+struct NpyExportOptions {
+	// Include the boundary operators d<k>_*
+	bool incidence = true;
+	std::vector<NpyCellArray> cell_data;
+	ParallelOptions parallel;
+};
+
+
+/**
+ * The arrays of a lattice, laid out as described at the top of this file.
+ * Owns the storage that `arrays` points into.
+ */
+struct NpyLatticeArrays {
+	std::array<int64_t, 9> cell_vectors;
+	std::array<int64_t, 9> primitive_cell_vectors;
+	BoundaryOperators ops;
+	std::vector<std::vector<double>> cell_data;
+	std::vector<npy::Array> arrays;
+
+	NpyLatticeArrays() = default;
+	NpyLatticeArrays(const NpyLatticeArrays&) = delete;
+	NpyLatticeArrays& operator=(const NpyLatticeArrays&) = delete;
+};
+
+template<typename Lattice>
+	requires std::derived_from<Lattice, PeriodicAbstractLattice>
+void collect_npy_arrays(const Lattice& lat, NpyLatticeArrays& out, const NpyExportOptions& opts = {}){
+	constexpr int K = max_order_of<Lattice>();
+	for (int i=0; i<3; i++){
+		for (int j=0; j<3; j++){
+			out.cell_vectors[3*i + j] = lat.cell_vectors(i, j);
+			out.primitive_cell_vectors[3*i + j] = lat.primitive_spec.latvecs(i, j);
+		}
+	}
+	out.ops = boundary_operators(lat, opts.parallel);
+	const auto& ops = out.ops;
+
+	out.arrays.clear();
+	out.arrays.push_back(npy::array("cell_vectors", out.cell_vectors.data(), {3, 3}));
+	out.arrays.push_back(npy::array("primitive_cell_vectors",
+				out.primitive_cell_vectors.data(), {3, 3}));
+	for (int k=0; k<=K; k++){
+		const std::string ks = std::to_string(k);
+		out.arrays.push_back(npy::array("index" + ks, ops.rows[k].index));
+		out.arrays.push_back(npy::array("pos" + ks,
+					reinterpret_cast<const int64_t*>(ops.rows[k].position.data()),
+					{ops.num_cells(k), 3}));
+		if (k > 0 && opts.incidence) {
+			out.arrays.push_back(npy::array("d" + ks + "_indptr", ops.d[k].row_ptr));
+			out.arrays.push_back(npy::array("d" + ks + "_indices", ops.d[k].col));
+			out.arrays.push_back(npy::array("d" + ks + "_data", ops.d[k].val));
+		}
+	}
+
+	out.cell_data.assign(opts.cell_data.size(), {});
+	for (size_t a=0; a<opts.cell_data.size(); a++){
+		const auto& arr = opts.cell_data[a];
+		if (arr.order < 0 || arr.order > K) {
+			throw std::invalid_argument("Cell array '" + arr.name + "' has no cells of its order");
+		}
+		const auto& index = ops.rows[arr.order].index;
+		if (arr.values.size() < lat.index_size(arr.order)) {
+			throw std::invalid_argument("Cell array '" + arr.name
+					+ "' is shorter than the lattice index range");
+		}
+		auto& v = out.cell_data[a];
+		v.reserve(index.size());
+		for (uint32_t J : index) v.push_back(arr.values[J]);
+		out.arrays.push_back(npy::array(arr.name, v));
+	}
+}
+
+
+/**
+ * Writes the lattice's arrays as <dir>/<name>.npy. Returns false if a
+ * file could not be opened.
+ */
+template<typename Lattice>
+	requires std::derived_from<Lattice, PeriodicAbstractLattice>
+bool save_npy_dir(const Lattice& lat, const std::filesystem::path& dir,
+		const NpyExportOptions& opts = {})
+{
+	alloc_stats::Scope scope(alloc_stats::Subsystem::IO);
+	trace::Scope phase("save_npy_dir", "io");
+	NpyLatticeArrays a;
+	collect_npy_arrays(lat, a, opts);
+	std::filesystem::create_directories(dir);
+	for (const auto& x : a.arrays){
+		std::ofstream of(dir / (x.name + ".npy"), std::ios::binary | std::ios::trunc);
+		if (!of.is_open()) return false;
+		npy::write(of, x);
+		if (!of) return false;
+	}
+	return true;
+}
+
+/**
+ * Writes the lattice's arrays to a single .npz. Returns false if the file
+ * could not be opened.
+ */
+template<typename Lattice>
+	requires std::derived_from<Lattice, PeriodicAbstractLattice>
+bool save_npz(const Lattice& lat, const std::filesystem::path& out_path,
+		const NpyExportOptions& opts = {})
+{
+	alloc_stats::Scope scope(alloc_stats::Subsystem::IO);
+	trace::Scope phase("save_npz", "io");
+	NpyLatticeArrays a;
+	collect_npy_arrays(lat, a, opts);
+	std::ofstream of(out_path, std::ios::binary | std::ios::trunc);
+	if (!of.is_open()) return false;
+	npy::write_npz(of, a.arrays);
+	return true;
+}
+
+}; // end of namespace
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cell_geometry.hpp"
+
+
+namespace CellGeometry {
+
+/**
+ * A fixed pool of worker threads running one data-parallel loop at a time.
+ * The calling thread joins in as worker 0, so a pool of size 1 has no
+ * threads of its own and runs everything inline.
+ *
+ * Loops are scheduled by range stealing: the chunks of [0, n) are dealt out
+ * to the workers as contiguous runs, each worker eats its run from the
+ * front (in index order, for locality), and idle workers steal the back
+ * half of someone else's remaining run. This keeps uneven work (diluted
+ * lattices, variable coboundary sizes) balanced without a shared queue.
+ */
+class ThreadPool {
+public:
+	// n_threads = 0 uses the hardware concurrency
+	explicit ThreadPool(unsigned n_threads = 0){
+		if (n_threads == 0) n_threads = std::thread::hardware_concurrency();
+		n_workers = std::max(1u, n_threads);
+		slots = std::make_unique<Slot[]>(n_workers);
+		for (unsigned w=1; w<n_workers; w++){
+			threads.emplace_back([this, w](){ worker_loop(w); });
+		}
+	}
+
+	~ThreadPool(){
+		{
+			std::lock_guard lock(mtx);
+			shutting_down = true;
+		}
+		wake.notify_all();
+		for (auto& t : threads) t.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	inline unsigned size() const { return n_workers; }
+
+	// Shared pool sized to the machine, created on first use
+	static ThreadPool& global(){
+		static ThreadPool pool;
+		return pool;
+	}
+
+	/**
+	 * Calls body(begin, end, worker) on chunks of at most `grain` indices
+	 * covering [0, n), using up to max_workers workers (0 = all).
+	 * `worker` is in [0, size()) and no two chunks with the same worker run
+	 * at once, so it can index per-call scratch space. Blocks until every
+	 * chunk is done; the first exception thrown by body is rethrown here.
+	 *
+	 * Nested calls (from inside body) run serially on the calling worker.
+	 */
+	template<typename F>
+	void parallel_for(size_t n, size_t grain, F&& body, unsigned max_workers = 0){
+		if (n == 0) return;
+		grain = std::max<size_t>(grain, 1);
+		const size_t n_chunks = (n + grain - 1) / grain;
+		unsigned active = max_workers == 0 ? n_workers : std::min(max_workers, n_workers);
+		active = static_cast<unsigned>(std::min<size_t>(active, n_chunks));
+		if (current_worker() >= 0) active = 1;
+		note_workers(std::max(active, 1u));
+
+		if (active <= 1) {
+			body(size_t(0), n, 0u);
+			return;
+		}
+
+		std::lock_guard run_lock(run_mtx);
+		for (unsigned w=0; w<active; w++){
+			slots[w].begin = (w * n_chunks) / active;
+			slots[w].end = ((w+1) * n_chunks) / active;
+		}
+		error = nullptr;
+		failed = false;
+		job_active = active;
+		// workers allocate on behalf of the caller
+		const auto tag = alloc_stats::current();
+		job = [&, tag](unsigned w){
+			alloc_stats::Scope scope(tag);
+			size_t c0, c1;
+			while (next_run(w, c0, c1)) {
+				for (size_t c=c0; c<c1 && !failed.load(std::memory_order_relaxed); c++){
+					body(c * grain, std::min(n, (c+1) * grain), w);
+				}
+			}
+		};
+
+		{
+			std::lock_guard lock(mtx);
+			n_running = active - 1;
+			generation++;
+		}
+		wake.notify_all();
+		run_job(0);
+		{
+			std::unique_lock lock(mtx);
+			done.wait(lock, [this]{ return n_running == 0; });
+		}
+		job = nullptr;
+		if (error) std::rethrow_exception(error);
+	}
+
+	// Index of the pool worker running the current thread, or -1
+	static int current_worker(){ return worker_id(); }
+
+	// Most workers any parallel_for has been spread over (a serial loop
+	// counts as one) since construction or the last reset_peak_workers()
+	inline unsigned peak_workers() const { return peak_active.load(); }
+	inline void reset_peak_workers(){ peak_active = 0; }
+
+private:
+	// A worker's remaining run of chunk indices [begin, end)
+	struct alignas(64) Slot {
+		std::mutex m;
+		size_t begin = 0;
+		size_t end = 0;
+	};
+
+	unsigned n_workers;
+	std::unique_ptr<Slot[]> slots;
+	std::vector<std::thread> threads;
+
+	std::mutex run_mtx; // one loop at a time
+	std::mutex mtx;
+	std::condition_variable wake;
+	std::condition_variable done;
+	size_t generation = 0;
+	unsigned n_running = 0;
+	bool shutting_down = false;
+
+	std::function<void(unsigned)> job;
+	unsigned job_active = 0;
+	std::exception_ptr error;
+	std::atomic<bool> failed = false;
+	std::mutex error_mtx;
+	std::atomic<unsigned> peak_active = 0;
+
+	void note_workers(unsigned active){
+		unsigned peak = peak_active.load();
+		while (active > peak && !peak_active.compare_exchange_weak(peak, active)) {}
+	}
+
+	static int& worker_id(){
+		thread_local int id = -1;
+		return id;
+	}
+
+	// Claims the next chunk from our own run; failing that, steals the back
+	// half of the next non-empty run of another worker
+	bool next_run(unsigned w, size_t& c0, size_t& c1){
+		{
+			std::lock_guard lock(slots[w].m);
+			if (slots[w].begin < slots[w].end) {
+				c0 = slots[w].begin++;
+				c1 = c0 + 1;
+				return true;
+			}
+		}
+		for (unsigned k=1; k<job_active; k++){
+			Slot& victim = slots[(w + k) % job_active];
+			{
+				std::lock_guard lock(victim.m);
+				const size_t left = victim.end - victim.begin;
+				if (left == 0) continue;
+				c0 = victim.begin + left / 2;
+				c1 = victim.end;
+				victim.end = c0;
+			}
+			// keep the first stolen chunk, publish the rest as our own run
+			// (never holding two slot locks at once)
+			std::lock_guard own(slots[w].m);
+			slots[w].begin = c0 + 1;
+			slots[w].end = c1;
+			c1 = c0 + 1;
+			return true;
+		}
+		return false;
+	}
+
+	void run_job(unsigned w){
+		const int prev = worker_id();
+		worker_id() = static_cast<int>(w);
+		try {
+			job(w);
+		} catch (...) {
+			std::lock_guard lock(error_mtx);
+			if (!error) error = std::current_exception();
+			failed = true;
+		}
+		worker_id() = prev;
+	}
+
+	void worker_loop(unsigned w){
+		size_t seen = 0;
+		while (true) {
+			unsigned active;
+			{
+				std::unique_lock lock(mtx);
+				wake.wait(lock, [&]{ return shutting_down || generation != seen; });
+				if (shutting_down) return;
+				seen = generation;
+				active = job_active;
+			}
+			if (w >= active) continue;
+			run_job(w);
+			{
+				std::lock_guard lock(mtx);
+				n_running--;
+			}
+			done.notify_one();
+		}
+	}
+};
+
+
+struct ParallelOptions {
+	// Workers to use (0 = the whole pool)
+	unsigned n_threads = 0;
+	// Indices per scheduled chunk
+	size_t grain = 1024;
+	// Pool to run on (nullptr = ThreadPool::global())
+	ThreadPool* pool = nullptr;
+
+	inline ThreadPool& get_pool() const {
+		return pool ? *pool : ThreadPool::global();
+	}
+};
+
+
+namespace detail {
+	// Calls fn(J, cell) or fn(cell), whichever it accepts
+	template<typename F, typename Cell>
+	inline decltype(auto) invoke_cell(F& fn, idx_t J, Cell& c){
+		if constexpr (std::is_invocable_v<F&, idx_t, Cell&>) return fn(J, c);
+		else return fn(c);
+	}
+
+	// Splits the buckets of a SparseMap (an unordered_map) across the pool.
+	// Integer keys hash to themselves, so bucket order follows the lattice
+	// index and each chunk touches a compact range of J.
+	template<typename Map, typename F>
+	void parallel_buckets(Map& cellmap, const ParallelOptions& opts, F&& fn){
+		opts.get_pool().parallel_for(cellmap.bucket_count(), opts.grain,
+				[&](size_t b0, size_t b1, unsigned w){
+			for (size_t b=b0; b<b1; b++){
+				for (auto it = cellmap.begin(b); it != cellmap.end(b); ++it){
+					fn(it->first, *it->second, w);
+				}
+			}
+		}, opts.n_threads);
+	}
+}
+
+
+/**
+ * Calls fn(cell) or fn(J, cell) for every cell of the given order, in
+ * parallel. fn must be safe to call concurrently on distinct cells.
+ *
+ *   parallel_for_each<1>(lat, [](Link& l){ ... });
+ */
+template<int order, typename Lattice, typename F>
+void parallel_for_each(Lattice& lat, F&& fn, const ParallelOptions& opts = {}){
+	detail::parallel_buckets(cells_of<order>(lat), opts,
+			[&fn](idx_t J, auto& c, unsigned){ detail::invoke_cell(fn, J, c); });
+}
+
+// Runtime-order version; fn must accept the cell type of every order
+// (e.g. a generic lambda taking auto&)
+template<typename Lattice, typename F>
+void parallel_for_each(Lattice& lat, int order, F&& fn, const ParallelOptions& opts = {}){
+	switch (order) {
+		case 0: parallel_for_each<0>(lat, fn, opts); break;
+		case 1: parallel_for_each<1>(lat, fn, opts); break;
+		case 2: parallel_for_each<2>(lat, fn, opts); break;
+		case 3: parallel_for_each<3>(lat, fn, opts); break;
+		default: throw std::out_of_range("Cell order must be in [0,3]");
+	}
+}
+
+
+/**
+ * Folds map(cell) (or map(J, cell)) over every cell of the given order with
+ * the associative operation reduce(T, T) -> T, starting from `init`
+ * (which must be an identity of reduce). Each worker folds its own
+ * partial result; partials are combined in worker order, so results
+ * involving non-associative floating point may vary between runs.
+ */
+template<int order, typename Lattice, typename T, typename Map, typename Reduce>
+T parallel_reduce(Lattice& lat, T init, Map&& map, Reduce&& reduce,
+		const ParallelOptions& opts = {})
+{
+	ThreadPool& pool = opts.get_pool();
+	struct alignas(64) Partial { T value; };
+	std::vector<Partial> partial(pool.size(), Partial{init});
+	detail::parallel_buckets(cells_of<order>(lat), opts,
+			[&](idx_t J, auto& c, unsigned w){
+		partial[w].value = reduce(std::move(partial[w].value),
+				detail::invoke_cell(map, J, c));
+	});
+	T res = init;
+	for (auto& p : partial) res = reduce(std::move(res), std::move(p.value));
+	return res;
+}
+
+template<typename Lattice, typename T, typename Map, typename Reduce>
+T parallel_reduce(Lattice& lat, int order, T init, Map&& map, Reduce&& reduce,
+		const ParallelOptions& opts = {})
+{
+	switch (order) {
+		case 0: return parallel_reduce<0>(lat, init, map, reduce, opts);
+		case 1: return parallel_reduce<1>(lat, init, map, reduce, opts);
+		case 2: return parallel_reduce<2>(lat, init, map, reduce, opts);
+		case 3: return parallel_reduce<3>(lat, init, map, reduce, opts);
+		default: throw std::out_of_range("Cell order must be in [0,3]");
+	}
+}
+
+}; // end of namespace
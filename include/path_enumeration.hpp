@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "cell_geometry.hpp"
+#include "chain.hpp"
+#include "generator.hpp"
+
+
+namespace CellGeometry {
+
+// One end of a link as seen from a point: following `link` leads to `point`.
+// `sign` is the coefficient the link takes in a path traversing it in this
+// direction, i.e. +1 if the traversal follows the link's orientation.
+struct LinkGraphEdge {
+	idx_t link;
+	idx_t point;
+	int sign;
+};
+
+
+/**
+ * Point-link incidence of a lattice as a CSR table over the point index J.
+ * Only links with exactly two distinct boundary points become edges.
+ * This is a snapshot: rebuild it after erasing cells.
+ */
+struct LinkGraph {
+	template<typename Lattice>
+	requires std::derived_from<Lattice, PeriodicAbstractLattice>
+	explicit LinkGraph(const Lattice& lat) :
+		row_start(lat.index_size(0) + 1, 0),
+		point_ptr(lat.index_size(0), nullptr),
+		link_ptr(lat.index_size(1), nullptr)
+	{
+		for (const auto& [J, p] : lat.points) { point_ptr[J] = p; }
+
+		// gather (point, edge) pairs, then counting-sort into rows
+		std::vector<std::pair<idx_t, LinkGraphEdge>> ends;
+		ends.reserve(2*lat.links.size());
+		for (const auto& [J, l] : lat.links) {
+			link_ptr[J] = l;
+			if (l->boundary.size() != 2) continue;
+			auto it = l->boundary.begin();
+			const auto& [p0, m0] = *it++;
+			const auto& [p1, m1] = *it;
+			idx_t J0 = lat.get_point_idx_at(p0->position);
+			idx_t J1 = lat.get_point_idx_at(p1->position);
+			// leaving a point with coefficient m in d(link) contributes -m
+			ends.push_back({J0, {static_cast<idx_t>(J), J1, -m0}});
+			ends.push_back({J1, {static_cast<idx_t>(J), J0, -m1}});
+		}
+		for (const auto& [J, _] : ends) { row_start[J+1]++; }
+		for (size_t J=0; J+1<row_start.size(); J++) { row_start[J+1] += row_start[J]; }
+		adj.resize(ends.size());
+		std::vector<idx_t> fill(row_start.begin(), row_start.end()-1);
+		for (const auto& [J, e] : ends) { adj[fill[J]++] = e; }
+	}
+
+	inline std::span<const LinkGraphEdge> edges(idx_t J) const {
+		return {adj.data() + row_start[J], adj.data() + row_start[J+1]};
+	}
+
+	// Sizes of the point and link index spaces
+	inline size_t num_points() const { return point_ptr.size(); }
+	inline size_t num_links() const { return link_ptr.size(); }
+
+	// The (point, edge) pairs are numbered row by row; pair e is
+	// edges(J)[e - first_edge(J)] for J = edge_point(e)
+	inline size_t num_edges() const { return adj.size(); }
+	inline size_t first_edge(idx_t J) const { return row_start[J]; }
+	inline idx_t edge_point(size_t e) const {
+		return std::upper_bound(row_start.begin(), row_start.end(), e) - row_start.begin() - 1;
+	}
+
+	inline Cell<0>* point(idx_t J) const { return point_ptr[J]; }
+	inline Cell<1>* link(idx_t J) const { return link_ptr[J]; }
+
+private:
+	std::vector<idx_t> row_start;
+	std::vector<LinkGraphEdge> adj;
+	std::vector<Cell<0>*> point_ptr;
+	std::vector<Cell<1>*> link_ptr;
+};
+
+
+// A path found by the enumerator. Spans point into the search state and
+// are only valid until the search advances.
+struct PathView {
+	std::span<const idx_t> points; // len+1 point indices, origin first
+	std::span<const idx_t> links;  // len link indices
+	std::span<const int> signs;    // coefficient of each link in the path
+};
+
+// The path as a 1-chain, satisfying d(chain) = finish - origin
+inline Chain<1> to_chain(const LinkGraph& g, const PathView& path){
+	Chain<1> c;
+	for (size_t i=0; i<path.links.size(); i++){
+		c[g.link(path.links[i])] += path.signs[i];
+	}
+	return c;
+}
+
+
+/**
+ * Depth-first enumerator of self-avoiding paths of fixed length, written as
+ * a resumable state machine: next() advances to the following hit.
+ * The stack holds indices and adjacency cursors only, visited points are a
+ * bitset, and branches that cannot reach the target in the remaining number
+ * of steps are cut using a radius-bounded BFS from the target.
+ *
+ * Loops (origin == finish) are reported once, in the orientation whose first
+ * link index is smaller than its last.
+ */
+class PathSearch {
+public:
+	static constexpr uint32_t unreached = std::numeric_limits<uint32_t>::max();
+
+	explicit PathSearch(const LinkGraph& g) :
+		g(g),
+		visited((g.num_points() + 63) / 64, 0),
+		dist(g.num_points(), unreached)
+	{}
+
+	/**
+	 * Prepares a search.
+	 * @param min_point  -> points with smaller index are never entered; used to
+	 *                      enumerate each lattice loop from its lowest point
+	 * @param first_*    -> restricts the first step to edges(origin)[first_begin,
+	 *                      first_end), for splitting work between threads
+	 */
+	void start(idx_t origin_, idx_t finish_, unsigned len_, idx_t min_point_=0,
+			size_t first_begin=0, size_t first_end=std::numeric_limits<size_t>::max())
+	{
+		clear();
+		origin = origin_; finish = finish_; len = len_; min_point = min_point_;
+		pts.assign(len+1, 0); lks.assign(len, 0); sg.assign(len, 0);
+		cur.assign(len+1, 0); endp.assign(len+1, 0);
+		if (len == 0) { depth = -1; return; }
+
+		bfs_from(finish, len - 1);
+		auto e0 = g.edges(origin);
+		size_t base = e0.data() - edge_base();
+		cur[0] = base + std::min(first_begin, e0.size());
+		endp[0] = base + std::min(first_end, e0.size());
+		pts[0] = origin;
+		mark(origin);
+		depth = 0;
+	}
+
+	// Advances to the next path; false once the search is exhausted
+	bool next(){
+		const LinkGraphEdge* E = edge_base();
+		while (depth >= 0) {
+			if (cur[depth] == endp[depth]) {
+				if (depth > 0) unmark(pts[depth]);
+				depth--;
+				continue;
+			}
+			const LinkGraphEdge& e = E[cur[depth]++];
+			unsigned remaining = len - depth - 1;
+			if (remaining == 0) {
+				if (e.point != finish) continue;
+				if (origin == finish && !(lks[0] < e.link) && depth > 0) continue;
+				lks[depth] = e.link; sg[depth] = e.sign; pts[depth+1] = e.point;
+				return true;
+			}
+			if (e.point == finish || e.point < min_point || is_marked(e.point)) continue;
+			if (dist[e.point] > remaining) continue;
+			lks[depth] = e.link; sg[depth] = e.sign;
+			depth++;
+			pts[depth] = e.point;
+			mark(e.point);
+			auto row = g.edges(e.point);
+			cur[depth] = row.data() - E;
+			endp[depth] = cur[depth] + row.size();
+		}
+		return false;
+	}
+
+	// The current path (valid after next() returned true)
+	PathView path() const { return {pts, lks, sg}; }
+
+private:
+	const LinkGraph& g;
+	idx_t origin = 0, finish = 0, min_point = 0;
+	unsigned len = 0;
+	int depth = -1;
+
+	// incremental path state
+	std::vector<idx_t> pts, lks;
+	std::vector<int> sg;
+	// adjacency cursors (offsets into the edge array) per depth
+	std::vector<size_t> cur, endp;
+
+	std::vector<uint64_t> visited;
+	std::vector<uint32_t> dist;
+	std::vector<idx_t> touched;
+
+	inline const LinkGraphEdge* edge_base() const {
+		return g.num_points() ? g.edges(0).data() : nullptr;
+	}
+	inline void mark(idx_t J) { visited[J >> 6] |= (uint64_t(1) << (J & 63)); }
+	inline void unmark(idx_t J) { visited[J >> 6] &= ~(uint64_t(1) << (J & 63)); }
+	inline bool is_marked(idx_t J) const { return visited[J >> 6] >> (J & 63) & 1; }
+
+	void clear(){
+		for (int i=0; i<=depth; i++) unmark(pts[i]);
+		for (auto J : touched) dist[J] = unreached;
+		touched.clear();
+		depth = -1;
+	}
+
+	// Distances from `src` out to `radius`; everything else stays unreached
+	void bfs_from(idx_t src, unsigned radius){
+		dist[src] = 0;
+		touched.push_back(src);
+		for (size_t head=0; head<touched.size(); head++){
+			idx_t J = touched[head];
+			if (dist[J] == radius) continue;
+			for (const auto& e : g.edges(J)){
+				if (dist[e.point] != unreached) continue;
+				dist[e.point] = dist[J] + 1;
+				touched.push_back(e.point);
+			}
+		}
+	}
+};
+
+
+namespace detail {
+	// Calls fn(args...), treating a void return as "keep going"
+	template<typename F, typename... Args>
+	inline bool invoke_continue(F& fn, Args&&... args){
+		if constexpr (std::is_void_v<std::invoke_result_t<F&, Args...>>) {
+			fn(std::forward<Args>(args)...);
+			return true;
+		} else {
+			return static_cast<bool>(fn(std::forward<Args>(args)...));
+		}
+	}
+
+	inline unsigned resolve_threads(unsigned n_threads){
+		if (n_threads == 0) n_threads = std::thread::hardware_concurrency();
+		return n_threads == 0 ? 1 : n_threads;
+	}
+}
+
+
+/**
+ * Calls fn(const PathView&) for every self-avoiding path of `len` links
+ * from point `origin` to point `finish` (lattice indices). If fn returns
+ * bool, returning false stops the search. Returns the number of paths seen.
+ */
+template<typename F>
+size_t for_each_path(const LinkGraph& g, idx_t origin, idx_t finish,
+		unsigned len, F&& fn)
+{
+	PathSearch search(g);
+	search.start(origin, finish, len);
+	size_t n = 0;
+	while (search.next()) {
+		n++;
+		if (!detail::invoke_continue(fn, search.path())) break;
+	}
+	return n;
+}
+
+// Loops of `len` links through `origin`, each reported once
+template<typename F>
+size_t for_each_loop(const LinkGraph& g, idx_t origin, unsigned len, F&& fn){
+	return for_each_path(g, origin, origin, len, std::forward<F>(fn));
+}
+
+// Every loop of `len` links in the lattice, each reported once (from its
+// lowest-index point)
+template<typename F>
+size_t for_each_lattice_loop(const LinkGraph& g, unsigned len, F&& fn){
+	PathSearch search(g);
+	size_t n = 0;
+	for (idx_t J=0; J<g.num_points(); J++){
+		search.start(J, J, len, J);
+		while (search.next()) {
+			n++;
+			if (!detail::invoke_continue(fn, search.path())) return n;
+		}
+	}
+	return n;
+}
+
+
+namespace detail {
+	// Runs the tasks [0, n_tasks) over a pool of threads, each owning a
+	// PathSearch; task(search, i) must prepare the search via start()
+	template<typename Task, typename F>
+	size_t parallel_path_tasks(const LinkGraph& g, size_t n_tasks, Task&& task,
+			F& fn, unsigned n_threads)
+	{
+		n_threads = resolve_threads(n_threads);
+		std::atomic<size_t> next_task = 0;
+		std::atomic<size_t> total = 0;
+		std::atomic<bool> stop = false;
+		auto worker = [&](unsigned tid){
+			PathSearch search(g);
+			size_t n = 0;
+			for (size_t i = next_task++; i < n_tasks && !stop; i = next_task++){
+				task(search, i);
+				while (!stop && search.next()) {
+					n++;
+					if (!invoke_continue(fn, search.path(), tid)) stop = true;
+				}
+			}
+			total += n;
+		};
+		std::vector<std::thread> pool;
+		for (unsigned t=1; t<n_threads; t++) pool.emplace_back(worker, t);
+		worker(0);
+		for (auto& t : pool) t.join();
+		return total;
+	}
+}
+
+/**
+ * Parallel for_each_path: the first steps out of `origin` are handed out to
+ * n_threads workers (0 = hardware concurrency). fn(const PathView&,
+ * unsigned thread) is called concurrently and must be thread safe; the
+ * order of results is unspecified.
+ */
+template<typename F>
+size_t parallel_for_each_path(const LinkGraph& g, idx_t origin, idx_t finish,
+		unsigned len, F&& fn, unsigned n_threads=0)
+{
+	size_t n_first = g.edges(origin).size();
+	return detail::parallel_path_tasks(g, n_first,
+			[&](PathSearch& s, size_t i){ s.start(origin, finish, len, 0, i, i+1); },
+			fn, n_threads);
+}
+
+// Parallel for_each_lattice_loop, splitting over (lowest point, first step)
+template<typename F>
+size_t parallel_for_each_lattice_loop(const LinkGraph& g, unsigned len,
+		F&& fn, unsigned n_threads=0)
+{
+	return detail::parallel_path_tasks(g, g.num_edges(),
+			[&](PathSearch& s, size_t e){
+				const idx_t J = g.edge_point(e);
+				const size_t i = e - g.first_edge(J);
+				s.start(J, J, len, J, i, i+1);
+			},
+			fn, n_threads);
+}
+
+
+/**
+ * Lazy interface: paths are produced on demand, so a caller may stop (or
+ * sample) early at no extra cost.
+ *
+ *   for (const PathView& p : paths(g, o, f, 8)) { ... break; }
+ *
+ * `g` must outlive the generator.
+ */
+inline Generator<const PathView&> paths(const LinkGraph& g, idx_t origin,
+		idx_t finish, unsigned len)
+{
+	PathSearch search(g);
+	search.start(origin, finish, len);
+	while (search.next()) {
+		PathView p = search.path();
+		co_yield p;
+	}
+}
+
+}; // end of namespace
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/**
+ * Phase timing.
+ *
+ * A trace::Scope times the enclosing block. While tracing is switched on
+ * it is recorded in a process-wide collector, which can be written as
+ * Chrome trace_event JSON (open it in ui.perfetto.dev or chrome://tracing)
+ * or summarised as a table:
+ *
+ *   trace::enable();
+ *   Lattice lat(spec, supercell);
+ *   save(lat, "out.lat.json");
+ *   trace::save_chrome_trace("run.trace.json");
+ *   trace::write_summary(std::cerr);
+ *
+ * The library times the Smith decomposition ("snf"), every initialise_*
+ * and connect_* phase, erase cascades and the file writers and readers.
+ * Names and categories are stored as pointers, so they must be string
+ * literals.
+ *
+ * With tracing off a Scope costs one relaxed atomic load. Built with
+ * -DLATLIB_NO_TRACE (meson -Denable-trace=false) Scope is empty and the
+ * collector never records anything; the flag must be the same for the
+ * library and its users.
+ */
+namespace CellGeometry {
+namespace trace {
+
+struct Event {
+	const char* name;
+	const char* category;
+	// since the collector started
+	int64_t start_ns;
+	int64_t duration_ns;
+	// small thread number, in order of each thread's first event
+	uint32_t thread;
+};
+
+// Totals per (category, name)
+struct PhaseSummary {
+	std::string name;
+	std::string category;
+	size_t count = 0;
+	int64_t total_ns = 0;
+	int64_t max_ns = 0;
+};
+
+
+#ifndef LATLIB_NO_TRACE
+
+inline constexpr bool compiled = true;
+
+namespace detail {
+	extern std::atomic<bool> on;
+	// depth of CascadeScopes on this thread
+	inline thread_local int cascade_depth = 0;
+
+	int64_t now_ns();
+	void record(const char* name, const char* category, int64_t start_ns, int64_t end_ns);
+}
+
+inline bool enabled(){ return detail::on.load(std::memory_order_relaxed); }
+
+void enable(bool on = true);
+// Drops the recorded events
+void clear();
+std::vector<Event> events();
+// Sorted by total time, longest first
+std::vector<PhaseSummary> summary();
+
+void write_chrome_trace(std::ostream& os);
+void write_summary(std::ostream& os);
+
+
+// Times the enclosing block
+class Scope {
+public:
+	explicit Scope(const char* name, const char* category = "lattice") :
+		name(enabled() ? name : nullptr), category(category)
+	{
+		if (this->name) t0 = detail::now_ns();
+	}
+	~Scope(){
+		if (name) detail::record(name, category, t0, detail::now_ns());
+	}
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+private:
+	const char* name;
+	const char* category;
+	int64_t t0 = 0;
+};
+
+// Like Scope, but only the outermost CascadeScope on a thread is recorded:
+// the erase_link calls made by erase_point fold into one "erase_point"
+// event instead of flooding the trace
+class CascadeScope {
+public:
+	explicit CascadeScope(const char* name, const char* category = "erase") :
+		name(detail::cascade_depth++ == 0 && enabled() ? name : nullptr), category(category)
+	{
+		if (this->name) t0 = detail::now_ns();
+	}
+	~CascadeScope(){
+		--detail::cascade_depth;
+		if (name) detail::record(name, category, t0, detail::now_ns());
+	}
+	CascadeScope(const CascadeScope&) = delete;
+	CascadeScope& operator=(const CascadeScope&) = delete;
+private:
+	const char* name;
+	const char* category;
+	int64_t t0 = 0;
+};
+
+#else
+
+inline constexpr bool compiled = false;
+
+inline bool enabled(){ return false; }
+inline void enable(bool = true){}
+inline void clear(){}
+inline std::vector<Event> events(){ return {}; }
+inline std::vector<PhaseSummary> summary(){ return {}; }
+
+inline void write_chrome_trace(std::ostream& os){
+	os << "{\"traceEvents\": []}\n";
+}
+inline void write_summary(std::ostream& os){
+	os << "(phase tracing was compiled out)\n";
+}
+
+class Scope {
+public:
+	explicit Scope(const char*, const char* = "lattice"){}
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+};
+
+class CascadeScope {
+public:
+	explicit CascadeScope(const char*, const char* = "erase"){}
+	CascadeScope(const CascadeScope&) = delete;
+	CascadeScope& operator=(const CascadeScope&) = delete;
+};
+
+#endif
+
+
+/**
+ * Writes the trace to a file. Returns false if it could not be opened.
+ */
+inline bool save_chrome_trace(const std::filesystem::path& path){
+	std::ofstream of(path, std::ios::trunc);
+	if (!of.is_open()) return false;
+	write_chrome_trace(of);
+	return bool(of);
+}
+
+}; // end of namespace trace
+}; // end of namespace
@@ -1,47 +1,126 @@
 #pragma once
 
 #include "UnitCellSpecifier.hpp"
+#include "static_cellspec.hpp"
+#include <bit>
+#include <utility>
 
 namespace CellGeometry {
 namespace PrimitiveSpecifiers {
 
-const UnitCellSpecifier DiamondSpec();
-const UnitCellSpecifier CubicSpec();
-
-
-struct Diamond : public UnitCellSpecifier {
-	Diamond() : UnitCellSpecifier(
-		imat33_t::from_cols({0, 4, 4}, {4, 0, 4}, {4, 4, 0}) )
-	{
-		setup_points();
-		setup_links();
-		setup_plaqs();
-		setup_vols();
-	}
-private:
-	void setup_points();
-	void setup_links();
-	void setup_plaqs();
-	void setup_vols();
+// The preset unit cells, as compile-time constants for StaticLattice
+// (static_lattice.hpp); DiamondSpec() and CubicSpec() below are to_unitcell()
+// of these
+inline constexpr StaticCellSpec<2, 4, 4, 2, 2, 6, 4> StaticDiamondSpec = {
+	{{ {0, 4, 4}, {4, 0, 4}, {4, 4, 0} }},
+	{{ {{0, 0, 0}, {}}, {{2, 2, 2}, {}} }},
+	{{
+		{{ 1, 1, 1}, {{ {1, { 1, 1, 1}}, {-1, {-1,-1,-1}} }}},
+		{{ 1,-1,-1}, {{ {1, { 1,-1,-1}}, {-1, {-1, 1, 1}} }}},
+		{{-1, 1,-1}, {{ {1, {-1, 1,-1}}, {-1, { 1,-1, 1}} }}},
+		{{-1,-1, 1}, {{ {1, {-1,-1, 1}}, {-1, { 1, 1,-1}} }}}
+	}},
+	{{
+		{{-3,-3,-3}, {{
+			{ 1,{ 0,-2, 2}}, {-1,{ 2,-2, 0}},
+			{ 1,{ 2, 0,-2}}, {-1,{ 0, 2,-2}},
+			{ 1,{-2, 2, 0}}, {-1,{-2, 0, 2}} }}},
+		{{-3,-1,-1}, {{
+			{ 1,{ 0, 2,-2}}, {-1,{ 2, 2, 0}},
+			{ 1,{ 2, 0, 2}}, {-1,{ 0,-2, 2}},
+			{ 1,{-2,-2, 0}}, {-1,{-2, 0,-2}} }}},
+		{{-1,-3,-1}, {{
+			{ 1,{ 0,-2,-2}}, {-1,{-2,-2, 0}},
+			{ 1,{-2, 0, 2}}, {-1,{ 0, 2, 2}},
+			{ 1,{ 2, 2, 0}}, {-1,{ 2, 0,-2}} }}},
+		{{-1,-1,-3}, {{
+			{ 1,{ 0, 2, 2}}, {-1,{-2, 2, 0}},
+			{ 1,{-2, 0,-2}}, {-1,{ 0,-2,-2}},
+			{ 1,{ 2,-2, 0}}, {-1,{ 2, 0, 2}} }}}
+	}},
+	{{
+		{{4, 4, 4}, {{
+			{ 1, { 1, 1, 1}}, { 1, { 1,-1,-1}},
+			{ 1, {-1, 1,-1}}, { 1, {-1,-1, 1}} }}},
+		{{6, 6, 6}, {{
+			{-1, {-1,-1,-1}}, {-1, {-1, 1, 1}},
+			{-1, { 1,-1, 1}}, {-1, { 1, 1,-1}} }}}
+	}}
 };
+static_assert(StaticDiamondSpec.valid());
 
-struct Cubic : public UnitCellSpecifier {
-	Cubic() : UnitCellSpecifier(
-		imat33_t::from_cols({2,0,0},{0,2,0},{0,0,2}) )
-	{
-		setup_points();
-		setup_links();
-		setup_plaqs();
-		setup_vols();
-	}
-private:
-	void setup_points();
-	void setup_links();
-	void setup_plaqs();
-	void setup_vols();
+inline constexpr StaticCellSpec<1, 3, 3, 1, 2, 4, 6> StaticCubicSpec = {
+	{{ {2, 0, 0}, {0, 2, 0}, {0, 0, 2} }},
+	{{ {{0, 0, 0}, {}} }},
+	{{
+		{{1, 0, 0}, {{ {1, {-1, 0, 0}}, {-1, {1, 0, 0}} }}},
+		{{0, 1, 0}, {{ {1, {0, -1, 0}}, {-1, {0, 1, 0}} }}},
+		{{0, 0, 1}, {{ {1, {0, 0, -1}}, {-1, {0, 0, 1}} }}}
+	}},
+	{{
+		{{0, 1, 1}, {{ {1, {0,0,-1}}, {1, {0,1,0}}, {-1, {0,0,-1}}, {-1, {0,-1,0}} }}},
+		{{1, 0, 1}, {{ {1, {-1,0,0}}, {1, {0,0,1}}, {-1, {-1,0,0}}, {-1, {0,0,-1}} }}},
+		{{1, 1, 0}, {{ {1, {0,-1,0}}, {1, {1,0,0}}, {-1, {0,-1,0}}, {-1, {-1,0,0}} }}}
+	}},
+	{{
+		{{1, 1, 1}, {{
+			{1, {1,0,0}}, {-1, {-1,0,0}},
+			{1, {0,1,0}}, {-1, {0,-1,0}},
+			{1, {0,0,1}}, {-1, {0,0,-1}} }}}
+	}}
 };
+static_assert(StaticCubicSpec.valid());
+
+
+const UnitCellSpecifier DiamondSpec();
+const UnitCellSpecifier CubicSpec();
 
 };
 };
 
 
+namespace CellGeometry {
+namespace nd {
+namespace PrimitiveSpecifiers {
+
+/**
+ * The hypercubic cell complex in Dim dimensions, lattice vectors 2 e_mu. A
+ * k-cell sits at the sum of k distinct e_mu (sublattices in the binary order
+ * of that set of directions) and its boundary is
+ *   sum_i (-1)^i ([face at -e_mu_i] - [face at +e_mu_i])
+ * over its directions mu_0 < mu_1 < ..., so that a link has +1 at -e_mu and
+ * -1 at +e_mu, as in CubicSpec. HypercubicSpec<4>() is the lattice of 3+1D
+ * lattice gauge theory.
+ */
+template<int Dim>
+UnitCellSpecifier<Dim> HypercubicSpec(){
+	UnitCellSpecifier<Dim> spec(2 * imat<Dim>::identity());
+	[&]<int... k>(std::integer_sequence<int, k...>){
+		(..., [&]{
+			for (unsigned dirs=0; dirs < (1u << Dim); dirs++){
+				if (std::popcount(dirs) != k) continue;
+				CellSpecifier<Dim, k> c = {};
+				int i = 0;
+				for (int mu=0; mu<Dim; mu++){
+					if (!(dirs & (1u << mu))) continue;
+					ivec<Dim> e = {};
+					e[mu] = 1;
+					c.position += e;
+					const int sign = (i++ % 2 == 0) ? 1 : -1;
+					c.boundary.push_back({sign, -e});
+					c.boundary.push_back({-sign, e});
+				}
+				spec.add_cell(c);
+			}
+		}());
+	}(std::make_integer_sequence<int, Dim+1>{});
+	return spec;
+}
+
+// The kagome lattice in the oblique basis of its triangular Bravais
+// lattice, with up and down triangles and hexagons as plaquettes
+UnitCellSpecifier<2> KagomeSpec();
+
+};
+};
+};
@@ -1,18 +1,73 @@
 #pragma once
+#include "checked_int.hpp"
 #include "vec3.hpp"
 
 #include <cstdint>
 #include <iostream>
+#include <limits>
+#include <numeric>
 #include <stdexcept>
 #include <nlohmann/json.hpp>
 namespace rational {
 
+/**
+ * Exact rational arithmetic on int64_t numerator and denominator.
+ *
+ * Results are computed in __int128 and are not reduced by their gcd until
+ * numerator or denominator passes normalise_above, so chains of cheap
+ * operations skip the gcd entirely. A result that does not fit in int64_t
+ * even after reduction throws std::overflow_error (see checked_int.hpp)
+ * instead of wrapping. Results of arithmetic have a positive denominator;
+ * constructed values are kept as given.
+ */
+inline constexpr int64_t normalise_above = int64_t(1) << 32;
+
+struct Rational;
+
+namespace detail {
+	typedef checked::int128_t wide_t;
+
+	inline wide_t wide_abs(wide_t x){ return x < 0 ? -x : x; }
+
+	inline int wide_ctz(checked::uint128_t x){
+		const uint64_t lo = static_cast<uint64_t>(x);
+		return lo ? __builtin_ctzll(lo) : 64 + __builtin_ctzll(static_cast<uint64_t>(x >> 64));
+	}
+
+	// Binary gcd: 128-bit division is a library call, shifts are not
+	inline wide_t wide_gcd(wide_t a, wide_t b){
+		checked::uint128_t u = wide_abs(a), v = wide_abs(b);
+		if (u == 0) return v;
+		if (v == 0) return u;
+		const int shift = wide_ctz(u | v);
+		u >>= wide_ctz(u);
+		do {
+			v >>= wide_ctz(v);
+			if (u > v) std::swap(u, v);
+			v -= u;
+		} while (v != 0);
+		return u << shift;
+	}
+
+	// Stores n/d (d != 0) into r, reducing only if it is large
+	inline void store(Rational& r, wide_t n, wide_t d);
+	inline void store(Rational& r, int64_t n, int64_t d);
+
+	// r = an/ad + bn/bd and r = an/ad * bn/bd, in 64 bits unless that
+	// overflows
+	inline void set_sum(Rational& r, int64_t an, int64_t ad, int64_t bn, int64_t bd);
+	inline void set_product(Rational& r, int64_t an, int64_t ad, int64_t bn, int64_t bd);
+
+	// Stores n/d (d != 0) into r in lowest terms
+	inline void store_reduced(Rational& r, wide_t n, wide_t d);
+}
+
 
 struct Rational {
 	int64_t num;
 	int64_t denom;
 
-	Rational() {};
+	Rational() : num(0), denom(1) {};
 
 	Rational(int64_t _num) : num(_num), denom(1){};
 
@@ -22,9 +77,19 @@ struct Rational {
 	}
 	};
 
-	Rational& operator+=(const Rational& other);
+	inline Rational& operator+=(const Rational& other){
+		detail::set_sum(*this, num, denom, other.num, other.denom);
+		return *this;
+	}
+
+	inline Rational& operator-=(const Rational& other){
+		detail::set_sum(*this, num, denom, checked::neg(other.num), other.denom);
+		return *this;
+	}
 
-	Rational& operator-=(const Rational& other);
+	// this += a*b and this -= a*b, with a single rounding of the product
+	inline Rational& add_mul(const Rational& a, const Rational& b);
+	inline Rational& sub_mul(const Rational& a, const Rational& b);
 
 	void simplify();
 
@@ -34,28 +99,123 @@ struct Rational {
 
 	Rational& operator/=(const Rational& x); 
 
-	Rational& operator*=(int64_t x) ;
+	inline Rational& operator*=(int64_t x){
+		detail::set_product(*this, num, denom, x, 1);
+		return *this;
+	}
 
-	Rational& operator*=(const Rational& x); 
+	inline Rational& operator*=(const Rational& x){
+		detail::set_product(*this, num, denom, x.num, x.denom);
+		return *this;
+	}
 
 	Rational operator/(int64_t x) const; 
 
 	bool operator==(int64_t x) const {
-		return num == x * denom;
+		return num == detail::wide_t(x) * denom;
 	}
 
 	bool operator==(const Rational& r) const {
-		return static_cast<int64_t>(num) * r.denom == static_cast<int64_t>(r.num)*denom;
+		return detail::wide_t(num) * r.denom == detail::wide_t(r.num) * denom;
 	}
 };
 
+
+inline void detail::store(Rational& r, wide_t n, wide_t d){
+	if (d < 0) { n = -n; d = -d; }
+	if (wide_abs(n) <= normalise_above && d <= normalise_above) [[likely]] {
+		r.num = static_cast<int64_t>(n);
+		r.denom = static_cast<int64_t>(d);
+		return;
+	}
+	store_reduced(r, n, d);
+}
+
+
+inline void detail::store(Rational& r, int64_t n, int64_t d){
+	if (d < 0) {
+		// -INT64_MIN doesn't fit, but the reduced value may
+		if (d == std::numeric_limits<int64_t>::min() || n == std::numeric_limits<int64_t>::min()) {
+			return store(r, wide_t(n), wide_t(d));
+		}
+		n = -n;
+		d = -d;
+	}
+	if (n <= normalise_above && n >= -normalise_above && d <= normalise_above) [[likely]] {
+		r.num = n;
+		r.denom = d;
+		return;
+	}
+	store_reduced(r, n, d);
+}
+
+
+inline void detail::set_sum(Rational& r, int64_t an, int64_t ad, int64_t bn, int64_t bd){
+	int64_t n, d, p, q;
+	if (ad == bd) {
+		if (!__builtin_add_overflow(an, bn, &n)) return store(r, n, ad);
+		return store(r, wide_t(an) + bn, wide_t(ad));
+	}
+	if (!__builtin_mul_overflow(an, bd, &p) && !__builtin_mul_overflow(bn, ad, &q)
+			&& !__builtin_add_overflow(p, q, &n) && !__builtin_mul_overflow(ad, bd, &d)) {
+		return store(r, n, d);
+	}
+	store(r, wide_t(an) * bd + wide_t(bn) * ad, wide_t(ad) * bd);
+}
+
+
+inline void detail::set_product(Rational& r, int64_t an, int64_t ad, int64_t bn, int64_t bd){
+	int64_t n, d;
+	if (!__builtin_mul_overflow(an, bn, &n) && !__builtin_mul_overflow(ad, bd, &d)) {
+		return store(r, n, d);
+	}
+	store(r, wide_t(an) * bn, wide_t(ad) * bd);
+}
+
+
+inline void detail::store_reduced(Rational& r, wide_t n, wide_t d){
+	if (d < 0) { n = -n; d = -d; }
+	constexpr wide_t max64 = std::numeric_limits<int64_t>::max();
+	// 128-bit division is a library call; most reductions fit in 64 bits
+	if (wide_abs(n) <= max64 && d <= max64) {
+		const int64_t n64 = static_cast<int64_t>(n), d64 = static_cast<int64_t>(d);
+		const int64_t g = std::gcd(n64, d64);
+		r.num = n64 / g;
+		r.denom = d64 / g;
+		return;
+	}
+	const wide_t g = wide_gcd(n, d);
+	r.num = checked::narrow(n / g);
+	r.denom = checked::narrow(d / g);
+}
+
+
+inline Rational& Rational::add_mul(const Rational& a, const Rational& b){
+	Rational p;
+	detail::set_product(p, a.num, a.denom, b.num, b.denom);
+	detail::set_sum(*this, num, denom, p.num, p.denom);
+	return *this;
+}
+
+inline Rational& Rational::sub_mul(const Rational& a, const Rational& b){
+	Rational p;
+	detail::set_product(p, a.num, a.denom, b.num, b.denom);
+	detail::set_sum(*this, num, denom, checked::neg(p.num), p.denom);
+	return *this;
+}
+
+
 inline Rational operator*(int64_t x, const Rational& f){
-	return Rational(x*f.num, f.denom);
+	Rational retval(f);
+	retval *= x;
+	return retval;
 }
 
 
 inline Rational operator*(const Rational& x, const Rational& f){
-	return Rational(x.num*f.num, x.denom*f.denom);
+	Rational retval(x);
+	retval *= f;
+	return retval;
 }
 
 inline Rational operator+(const Rational& x, const Rational& y){
@@ -71,7 +231,7 @@ inline Rational operator-(const Rational& x, const Rational& y){
 }
 
 inline Rational operator-(const Rational& x){
-	return Rational(-x.num, x.denom);
+	return Rational(checked::neg(x.num), x.denom);
 }
 
 
@@ -85,13 +245,8 @@ typedef vector3::mat33<Rational> rmat33;
 void rswap(rmat33& A, int row_i, int row_j, rvec3& b);
 
 
-// Performs A[row_i] <- a*A[row_j] - A[row_i]
-void rsub(rmat33& A, Rational a_j, int row_j, int row_i, rvec3& b);
-
-void rmult(rmat33& A, int row, Rational a, rvec3& b);
-
 inline Rational inv(const Rational& a){	
-	if (a.denom == 0) {
+	if (a.num == 0) {
 		throw std::domain_error("Attempted inverse of 0");
 	}
 	return Rational(a.denom, a.num);
@@ -123,20 +278,38 @@ inline std::istream& operator>>(std::istream& is, Rational& r){
 // where X has +ve denominator, and x.num is in [0, x.denom)
 int64_t make_proper(Rational& x);
 
+namespace detail {
+	// a0 x0 + a1 x1 + a2 x2 for integer x, in one wide accumulator
+	template<typename S>
+	inline Rational dot_int(const Rational& a0, const Rational& a1, const Rational& a2,
+			S x0, S x1, S x2){
+		Rational res(0);
+		res.add_mul(a0, Rational(x0));
+		res.add_mul(a1, Rational(x1));
+		res.add_mul(a2, Rational(x2));
+		return res;
+	}
+}
+
 template<typename S>
 requires std::signed_integral<S>
-inline rmat33 operator*(const rmat33& a, const vector3::mat33<S> b){
-	// suboptimal but idc
-	return a * rmat33::from_other(b);
+inline rmat33 operator*(const rmat33& a, const vector3::mat33<S>& b){
+	rmat33 res;
+	for (int i=0; i<3; i++){
+		for (int j=0; j<3; j++){
+			res(i,j) = detail::dot_int(a(i,0), a(i,1), a(i,2), b(0,j), b(1,j), b(2,j));
+		}
+	}
+	return res;
 }
 
 
 template<typename S>
 requires std::signed_integral<S>
-inline rvec3 operator*(const rmat33& a, const vector3::vec3<S> b){
+inline rvec3 operator*(const rmat33& a, const vector3::vec3<S>& b){
 	rvec3 res;
 	for (int i=0; i<3; i++){
-		res[i] = a(i, 0)*b(0) + a(i,1)*b(1) + a(i,2)*b(2);
+		res[i] = detail::dot_int(a(i,0), a(i,1), a(i,2), b(0), b(1), b(2));
 	}
 	return res;
 }
@@ -166,14 +339,12 @@ inline void from_json(const json& j, Rational& r) {
 inline bool operator<(rational::Rational a, rational::Rational b){
     a.make_denom_positive();
     b.make_denom_positive();
-    return a.num * b.denom < b.num*a.denom;
+    return detail::wide_t(a.num) * b.denom < detail::wide_t(b.num) * a.denom;
 }
 
 
 inline bool operator>(rational::Rational a, rational::Rational b){
-    a.make_denom_positive();
-    b.make_denom_positive();
-    return a.num * b.denom > b.num*a.denom;
+    return b < a;
 }
 
 inline rational::Rational min(rational::Rational a, rational::Rational b){
@@ -201,10 +372,10 @@ struct std::hash<rational::Rational>
     using std::size_t;
     using std::hash;
 
-    // Compute individual hash values for first,
-    // second and third and combine them using XOR
-    // and bit shifting:
-
-    return hash<int64_t>()(k.num * 0x10000 / k.denom) ;
+    // equal values in any representation hash alike
+    rational::Rational r(k);
+    r.simplify();
+    r.make_denom_positive();
+    return hash<int64_t>()(r.num) ^ (hash<int64_t>()(r.denom) << 1);
   }
 };
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "cell_geometry.hpp"
+#include "cell_rows.hpp"
+#include "parallel.hpp"
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/**
+ * The boundary operators d_k : C_k -> C_{k-1} as sparse matrices, for
+ * external solvers.
+ *
+ * Cells of each order are numbered by CellRows (row r is the r'th smallest
+ * lattice index present), and that numbering is shared between orders: the
+ * columns of d_k and the rows of d_{k+1} both count the k-cells the same
+ * way, so d_k * d_{k+1} = 0 holds as a matrix product.
+ *
+ * save_boundary_operators() writes, for each k the lattice has:
+ *   dk.mtx                          MatrixMarket coordinate, integer, 1-based
+ *   dk.indptr, dk.indices, dk.data  raw CSR arrays (uint32, uint32, int32)
+ *   cellsk.index                    lattice index J of each row (uint32)
+ * in native byte order, plus operators.json describing shapes and files.
+ * From numpy:
+ *   d1 = scipy.sparse.csr_matrix((np.fromfile('d1.data', np.int32),
+ *       np.fromfile('d1.indices', np.uint32), np.fromfile('d1.indptr', np.uint32)),
+ *       shape=(n0, n1))
+ */
+namespace CellGeometry {
+
+struct BoundaryOperators {
+	int max_order = 0;
+	std::vector<CellRows> rows;
+	// d[k] is d_k, rows (k-1)-cells and columns k-cells; d[0] is empty
+	std::array<IncidenceCSR, 4> d;
+
+	inline size_t num_cells(int k) const { return rows.at(k).size(); }
+};
+
+struct SparseExportOptions {
+	bool matrix_market = true;
+	bool raw_csr = true;
+	// Workers to use (0 = the whole pool) and rows per chunk
+	unsigned n_threads = 0;
+	size_t grain = 4096;
+};
+
+
+namespace detail {
+	/**
+	 * build_incidence() over the pool: one pass sizes the rows, a second
+	 * fills them in place.
+	 */
+	template<typename Map, typename ChainOf>
+	IncidenceCSR build_incidence_parallel(const Map& cellmap, const CellRows& rows,
+			const CellRows& targets, ChainOf&& chain_of, const ParallelOptions& opts)
+	{
+		IncidenceCSR csr;
+		const size_t n = rows.size();
+		csr.row_ptr.assign(n + 1, 0);
+		std::vector<typename Map::mapped_type> cells(n);
+		ThreadPool& pool = opts.get_pool();
+		pool.parallel_for(n, opts.grain, [&](size_t r0, size_t r1, unsigned){
+			for (size_t r=r0; r<r1; r++){
+				cells[r] = cellmap.at(rows.index[r]);
+				csr.row_ptr[r+1] = chain_of(*cells[r]).size();
+			}
+		}, opts.n_threads);
+		for (size_t r=0; r<n; r++){
+			csr.row_ptr[r+1] = checked_u32(size_t(csr.row_ptr[r]) + csr.row_ptr[r+1]);
+		}
+		csr.col.resize(csr.row_ptr[n]);
+		csr.val.resize(csr.row_ptr[n]);
+		pool.parallel_for(n, opts.grain, [&](size_t r0, size_t r1, unsigned){
+			std::vector<std::pair<uint32_t, int32_t>> entries;
+			for (size_t r=r0; r<r1; r++){
+				entries.clear();
+				for (const auto& [x, m] : chain_of(*cells[r])){
+					entries.emplace_back(targets.row_of(x), m);
+				}
+				std::sort(entries.begin(), entries.end());
+				uint32_t e = csr.row_ptr[r];
+				for (const auto& [c, m] : entries){
+					csr.col[e] = c;
+					csr.val[e] = m;
+					e++;
+				}
+			}
+		}, opts.n_threads);
+		return csr;
+	}
+
+	template<typename T>
+	bool write_raw(const std::filesystem::path& path, const std::vector<T>& v){
+		std::ofstream of(path, std::ios::binary | std::ios::trunc);
+		if (!of.is_open()) return false;
+		of.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+		return bool(of);
+	}
+
+	// Formats rows [r0, r1) of a CSR as 1-based "i j v" lines
+	inline void format_mtx_rows(const IncidenceCSR& a, size_t r0, size_t r1, std::string& out){
+		char buf[24];
+		auto put = [&](auto x, char sep){
+			out.append(buf, std::to_chars(buf, buf + sizeof(buf), x).ptr);
+			out.push_back(sep);
+		};
+		for (size_t r=r0; r<r1; r++){
+			for (uint32_t e=a.row_ptr[r]; e<a.row_ptr[r+1]; e++){
+				put(r + 1, ' ');
+				put(uint64_t(a.col[e]) + 1, ' ');
+				put(a.val[e], '\n');
+			}
+		}
+	}
+}
+
+
+/**
+ * Numbers the cells and builds d_1 .. d_K from the coboundaries, in
+ * parallel.
+ */
+template<typename Lattice>
+	requires std::derived_from<Lattice, PeriodicAbstractLattice>
+BoundaryOperators boundary_operators(const Lattice& lat, const ParallelOptions& opts = {}){
+	constexpr int K = max_order_of<Lattice>();
+	BoundaryOperators ops;
+	ops.max_order = K;
+	ops.rows.reserve(K+1);
+	ops.rows.emplace_back(cells_of<0>(lat));
+	if constexpr (K >= 1) ops.rows.emplace_back(cells_of<1>(lat));
+	if constexpr (K >= 2) ops.rows.emplace_back(cells_of<2>(lat));
+	if constexpr (K >= 3) ops.rows.emplace_back(cells_of<3>(lat));
+
+	auto build = [&]<int k>(){
+		ops.d[k] = detail::build_incidence_parallel(cells_of<k-1>(lat),
+				ops.rows[k-1], ops.rows[k],
+				[](const auto& c) -> const auto& { return c.coboundary; }, opts);
+	};
+	if constexpr (K >= 1) build.template operator()<1>();
+	if constexpr (K >= 2) build.template operator()<2>();
+	if constexpr (K >= 3) build.template operator()<3>();
+	return ops;
+}
+
+
+/**
+ * Writes a as a MatrixMarket coordinate matrix with n_cols columns. The
+ * entries are formatted on the pool in batches and written in row order.
+ */
+inline void write_matrix_market(std::ostream& os, const IncidenceCSR& a, size_t n_cols,
+		const std::string& comment = "", const ParallelOptions& opts = {})
+{
+	os << "%%MatrixMarket matrix coordinate integer general\n";
+	if (!comment.empty()) os << "% " << comment << "\n";
+	os << a.rows() << " " << n_cols << " " << a.nnz() << "\n";
+
+	ThreadPool& pool = opts.get_pool();
+	std::vector<std::string> parts(2 * pool.size());
+	const size_t rows_per_part = std::max<size_t>(opts.grain, 1);
+	const size_t batch = rows_per_part * parts.size();
+	for (size_t b0=0; b0<a.rows(); b0+=batch){
+		const size_t b1 = std::min(a.rows(), b0 + batch);
+		pool.parallel_for(parts.size(), 1, [&](size_t p0, size_t p1, unsigned){
+			for (size_t p=p0; p<p1; p++){
+				parts[p].clear();
+				const size_t lo = std::min(b1, b0 + p*rows_per_part);
+				detail::format_mtx_rows(a, lo, std::min(b1, lo + rows_per_part), parts[p]);
+			}
+		}, opts.n_threads);
+		for (const auto& s : parts) os.write(s.data(), s.size());
+	}
+	if (!os) throw std::runtime_error("Failed to write MatrixMarket file");
+}
+
+
+/**
+ * Writes the boundary operators of `lat` into the directory `dir` (created
+ * if needed), as described at the top of this file. Returns false if a
+ * file could not be opened.
+ */
+template<typename Lattice>
+	requires std::derived_from<Lattice, PeriodicAbstractLattice>
+bool save_boundary_operators(const Lattice& lat, const std::filesystem::path& dir,
+		const SparseExportOptions& opts = {})
+{
+	alloc_stats::Scope scope(alloc_stats::Subsystem::IO);
+	trace::Scope phase("save_boundary_operators", "io");
+	ParallelOptions popts;
+	popts.n_threads = opts.n_threads;
+	popts.grain = opts.grain;
+	const BoundaryOperators ops = boundary_operators(lat, popts);
+	std::filesystem::create_directories(dir);
+
+	const int K = ops.max_order;
+	for (int k=0; k<=K; k++){
+		if (!detail::write_raw(dir / ("cells" + std::to_string(k) + ".index"),
+					ops.rows[k].index)) return false;
+	}
+	for (int k=1; k<=K; k++){
+		const std::string name = "d" + std::to_string(k);
+		const IncidenceCSR& a = ops.d[k];
+		if (opts.raw_csr) {
+			if (!detail::write_raw(dir / (name + ".indptr"), a.row_ptr)
+					|| !detail::write_raw(dir / (name + ".indices"), a.col)
+					|| !detail::write_raw(dir / (name + ".data"), a.val)) return false;
+		}
+		if (opts.matrix_market) {
+			std::ofstream of(dir / (name + ".mtx"), std::ios::trunc);
+			if (!of.is_open()) return false;
+			write_matrix_market(of, a, ops.num_cells(k),
+					"boundary operator " + name + ": rows cells" + std::to_string(k-1)
+					+ ", columns cells" + std::to_string(k), popts);
+		}
+	}
+
+	std::ofstream of(dir / "operators.json", std::ios::trunc);
+	if (!of.is_open()) return false;
+	of << "{\n  \"byte_order\": \""
+		<< (std::endian::native == std::endian::little ? "little" : "big") << "\",\n";
+	of << "  \"cells\": [";
+	for (int k=0; k<=K; k++){
+		of << (k ? ", " : "") << "{\"count\": " << ops.num_cells(k)
+			<< ", \"index\": \"cells" << k << ".index\", \"dtype\": \"uint32\"}";
+	}
+	of << "],\n  \"operators\": [";
+	for (int k=1; k<=K; k++){
+		const std::string name = "d" + std::to_string(k);
+		of << (k > 1 ? ", " : "") << "\n    {\"name\": \"" << name << "\", \"shape\": ["
+			<< ops.num_cells(k-1) << ", " << ops.num_cells(k) << "], \"nnz\": " << ops.d[k].nnz();
+		if (opts.raw_csr) {
+			of << ", \"indptr\": \"" << name << ".indptr\", \"indices\": \"" << name
+				<< ".indices\", \"data\": \"" << name << ".data\""
+				<< ", \"dtypes\": [\"uint32\", \"uint32\", \"int32\"]";
+		}
+		if (opts.matrix_market) of << ", \"mtx\": \"" << name << ".mtx\"";
+		of << "}";
+	}
+	of << "\n  ]\n}\n";
+	return bool(of);
+}
+
+}; // end of namespace
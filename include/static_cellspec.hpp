@@ -0,0 +1,182 @@
+#pragma once
+
+#include "UnitCellSpecifier.hpp"
+#include "chain.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Unit cells fixed at compile time.
+ *
+ * A StaticCellSpec holds what a UnitCellSpecifier holds, in std::arrays, so
+ * it is a literal structural type: it can be a constexpr variable and a
+ * template argument. Sublattice counts and boundary sizes are template
+ * parameters, and which sublattice each boundary term lands on is worked
+ * out by the compiler (boundary_sl). StaticLattice (static_lattice.hpp)
+ * builds lattices on top of one.
+ *
+ *   inline constexpr StaticCellSpec<1, 3, 3, 1, 2, 4, 6> MyCubic = {...};
+ *   static_assert(MyCubic.valid());
+ *   const UnitCellSpecifier spec = to_unitcell(MyCubic);
+ *
+ * Every cell of one order has the same number of boundary terms. Cells are
+ * listed in sublattice order, and to_unitcell adds them in that order, so
+ * the sublattice indices agree with the runtime specifier's.
+ */
+namespace CellGeometry {
+
+typedef std::array<int64_t, 3> static_pos_t;
+
+struct StaticBoundaryTerm {
+	int multiplier;
+	static_pos_t relative_position;
+};
+
+template<size_t B>
+struct StaticCell {
+	static_pos_t position;
+	std::array<StaticBoundaryTerm, B> boundary;
+};
+
+
+template<size_t NP, size_t NL, size_t NQ, size_t NV,
+	size_t BL, size_t BQ, size_t BV>
+struct StaticCellSpec {
+	// Sublattices and boundary terms per cell, by order
+	static constexpr std::array<size_t, 4> num_sl = {NP, NL, NQ, NV};
+	static constexpr std::array<size_t, 4> boundary_size = {0, BL, BQ, BV};
+
+	// Columns of the lattice vectors, as in imat33_t::from_cols
+	std::array<static_pos_t, 3> latvecs;
+	std::array<StaticCell<0>, NP> points;
+	std::array<StaticCell<BL>, NL> links;
+	std::array<StaticCell<BQ>, NQ> plaqs;
+	std::array<StaticCell<BV>, NV> vols;
+
+	template<int order>
+	requires (order >= 0 && order <= 3)
+	constexpr const auto& cells() const {
+		if constexpr (order == 0) { return points; }
+		else if constexpr (order == 1) { return links; }
+		else if constexpr (order == 2) { return plaqs; }
+		else { return vols; }
+	}
+
+	// |det| of the lattice vectors; UnitCellSpecifier::abs_det_latvecs
+	constexpr int64_t abs_det() const {
+		const int64_t d = dot(latvecs[0], cross(latvecs[1], latvecs[2]));
+		return d < 0 ? -d : d;
+	}
+
+	// adj(a) X mod abs_det(): the coordinates UnitCellSpecifier::wrap reduces
+	// to. Two positions are the same cell up to a lattice vector iff these
+	// agree.
+	constexpr static_pos_t reduced(const static_pos_t& X) const {
+		const int64_t d = abs_det();
+		const std::array<static_pos_t, 3> adj = {
+			cross(latvecs[1], latvecs[2]),
+			cross(latvecs[2], latvecs[0]),
+			cross(latvecs[0], latvecs[1])};
+		static_pos_t x;
+		for (int n=0; n<3; n++){
+			const int64_t r = dot(adj[n], X) % d;
+			x[n] = r < 0 ? r + d : r;
+		}
+		return x;
+	}
+
+	// Sublattice of the cell of the given order at X, or -1 if there is none
+	template<int order>
+	constexpr sl_t sl_of(const static_pos_t& X) const {
+		const auto x = reduced(X);
+		const auto& cs = cells<order>();
+		for (size_t sl=0; sl<cs.size(); sl++){
+			if (reduced(cs[sl].position) == x) return static_cast<sl_t>(sl);
+		}
+		return -1;
+	}
+
+	// boundary_sl<order>()[sl][b] is the sublattice of the (order-1)-cell
+	// that boundary term b of sublattice sl points at
+	template<int order>
+	requires (order >= 1 && order <= 3)
+	constexpr auto boundary_sl() const {
+		std::array<std::array<sl_t, boundary_size[order]>, num_sl[order]> out = {};
+		const auto& cs = cells<order>();
+		for (size_t sl=0; sl<num_sl[order]; sl++){
+			for (size_t b=0; b<boundary_size[order]; b++){
+				out[sl][b] = sl_of<order-1>(add(cs[sl].position,
+							cs[sl].boundary[b].relative_position));
+			}
+		}
+		return out;
+	}
+
+	// Everything UnitCellSpecifier::add_* checks: the lattice vectors are
+	// independent and every boundary term lands on a cell. Also that no two
+	// sublattices of one order coincide.
+	constexpr bool valid() const {
+		if (abs_det() == 0) return false;
+		return distinct<0>() && distinct<1>() && distinct<2>() && distinct<3>()
+			&& resolves<1>() && resolves<2>() && resolves<3>();
+	}
+
+private:
+	static constexpr static_pos_t add(const static_pos_t& a, const static_pos_t& b){
+		return {a[0] + b[0], a[1] + b[1], a[2] + b[2]};
+	}
+
+	static constexpr static_pos_t cross(const static_pos_t& a, const static_pos_t& b){
+		return {a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0]};
+	}
+
+	static constexpr int64_t dot(const static_pos_t& a, const static_pos_t& b){
+		return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+	}
+
+	template<int order>
+	constexpr bool distinct() const {
+		const auto& cs = cells<order>();
+		for (size_t i=0; i<cs.size(); i++){
+			if (sl_of<order>(cs[i].position) != static_cast<sl_t>(i)) return false;
+		}
+		return true;
+	}
+
+	template<int order>
+	constexpr bool resolves() const {
+		for (const auto& row : boundary_sl<order>()){
+			for (sl_t s : row) { if (s < 0) return false; }
+		}
+		return true;
+	}
+};
+
+
+inline ipos_t to_ipos(const static_pos_t& x){
+	return ipos_t(x[0], x[1], x[2]);
+}
+
+
+// The runtime specifier of a static one, with the same sublattice numbering
+template<size_t NP, size_t NL, size_t NQ, size_t NV,
+	size_t BL, size_t BQ, size_t BV>
+UnitCellSpecifier to_unitcell(const StaticCellSpec<NP, NL, NQ, NV, BL, BQ, BV>& s){
+	UnitCellSpecifier spec(imat33_t::from_cols(s.latvecs[0], s.latvecs[1], s.latvecs[2]));
+	auto fill = [](auto& cellspec, const auto& c){
+		cellspec.position = to_ipos(c.position);
+		cellspec.boundary.clear();
+		for (const auto& t : c.boundary){
+			cellspec.boundary.push_back({t.multiplier, to_ipos(t.relative_position)});
+		}
+	};
+	PointSpec p; LinkSpec l; PlaqSpec q; VolSpec v;
+	for (const auto& c : s.points) { fill(p, c); spec.add_point(p); }
+	for (const auto& c : s.links) { fill(l, c); spec.add_link(l); }
+	for (const auto& c : s.plaqs) { fill(q, c); spec.add_plaq(q); }
+	for (const auto& c : s.vols) { fill(v, c); spec.add_vol(v); }
+	return spec;
+}
+
+}; // end of namespace
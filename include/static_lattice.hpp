@@ -0,0 +1,227 @@
+#pragma once
+
+#include "cell_geometry.hpp"
+#include "cell_rows.hpp"
+#include "static_cellspec.hpp"
+#include <array>
+#include <cassert>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+/**
+ * Lattices whose unit cell is a compile-time constant.
+ *
+ *   StaticVolLattice<PrimitiveSpecifiers::StaticDiamondSpec,
+ *       Point, Link, Plaq, Vol> lat(supercell);
+ *
+ * is a PeriodicVolLattice<Point, Link, Plaq, Vol> built from
+ * to_unitcell(StaticDiamondSpec), cell for cell and index for index, so
+ * anything written against the Periodic*Lattice types takes it as well.
+ * What differs is the work done per cell:
+ *
+ *  - Construction numbers each cell directly from its primitive cell and
+ *    sublattice, and finds a boundary cell from a per-(sublattice, term)
+ *    step in primitive-cell coordinates, worked out once per lattice. The
+ *    sublattice it lands on, the multiplier and the number of terms are
+ *    constants, and the cells are found in flat arrays rather than the
+ *    maps.
+ *  - get_*_idx_at divides by a constant |det| and identifies the
+ *    sublattice from its reduced coordinates with an unrolled search,
+ *    instead of wrapping the position a second time and searching the
+ *    specifier.
+ *
+ * erase_* are inherited unchanged.
+ */
+namespace CellGeometry {
+
+template<auto Spec, typename Base>
+requires std::derived_from<Base, PeriodicAbstractLattice>
+struct StaticLattice : public Base {
+	static constexpr int max_order = max_order_of<Base>();
+	static constexpr int64_t abs_det = Spec.abs_det();
+	static_assert(Spec.valid(), "StaticLattice needs a valid StaticCellSpec");
+
+	explicit StaticLattice(const imat33_t& supercell) :
+		Base(unit_cell(), supercell, empty_lattice)
+	{
+		assert(this->primitive_spec.abs_det_latvecs == abs_det);
+		set_up_tables();
+		[&]<int... k>(std::integer_sequence<int, k...>){
+			std::tuple<std::vector<cell_type_of<k, Base>*>...> byJ;
+			(..., initialise<k>(std::get<k>(byJ)));
+			(..., connect<k>(byJ));
+		}(std::make_integer_sequence<int, max_order+1>{});
+	}
+
+	// The runtime specifier the lattice is built on
+	static const UnitCellSpecifier& unit_cell(){
+		static const UnitCellSpecifier spec = to_unitcell(Spec);
+		return spec;
+	}
+
+	// Lattice index J of the cell of the given order at position R
+	template<int order>
+	inline sl_t idx_at(const ipos_t& R) const {
+		ipos_t x = this->primitive_spec.latvecs_unnormed_inverse * R;
+		idx3_t I;
+		for (int n=0; n<3; n++){
+			int64_t q = x[n] / abs_det;
+			x[n] -= q * abs_det;
+			if (x[n] < 0) { x[n] += abs_det; q--; }
+			I[n] = mod(q, static_cast<int64_t>(this->size(n)));
+		}
+		const auto& reduced = std::get<order>(tables).reduced;
+		for (size_t sl=0; sl<Spec.num_sl[order]; sl++){
+			if (reduced[sl] == x) {
+				return this->idx_from_idxn(I) + static_cast<sl_t>(sl) * this->num_primitive;
+			}
+		}
+		std::stringstream s;
+		s << "No " << order << "-cell found at " << R;
+		throw std::out_of_range(s.str());
+	}
+
+	// The lookups of the Periodic*Lattice bases, through idx_at
+	inline sl_t get_point_idx_at(const ipos_t& R) const { return idx_at<0>(R); }
+	inline auto& get_point_at(const ipos_t& R) { return *this->points.at(idx_at<0>(R)); }
+	inline const auto& get_point_at(const ipos_t& R) const { return *this->points.at(idx_at<0>(R)); }
+
+	inline sl_t get_link_idx_at(const ipos_t& R) const requires (max_order >= 1) { return idx_at<1>(R); }
+	inline auto& get_link_at(const ipos_t& R) requires (max_order >= 1) { return *this->links.at(idx_at<1>(R)); }
+	inline const auto& get_link_at(const ipos_t& R) const requires (max_order >= 1) { return *this->links.at(idx_at<1>(R)); }
+
+	inline sl_t get_plaq_idx_at(const ipos_t& R) const requires (max_order >= 2) { return idx_at<2>(R); }
+	inline auto& get_plaq_at(const ipos_t& R) requires (max_order >= 2) { return *this->plaqs.at(idx_at<2>(R)); }
+	inline const auto& get_plaq_at(const ipos_t& R) const requires (max_order >= 2) { return *this->plaqs.at(idx_at<2>(R)); }
+
+	inline sl_t get_vol_idx_at(const ipos_t& R) const requires (max_order >= 3) { return idx_at<3>(R); }
+	inline auto& get_vol_at(const ipos_t& R) requires (max_order >= 3) { return *this->vols.at(idx_at<3>(R)); }
+	inline const auto& get_vol_at(const ipos_t& R) const requires (max_order >= 3) { return *this->vols.at(idx_at<3>(R)); }
+
+private:
+	// What the compile-time spec can't know: positions in the primitive cell
+	// the supercell's Smith form picks
+	template<int order>
+	struct Tables {
+		// primitive-cell positions and their reduced coordinates
+		std::array<ipos_t, Spec.num_sl[order]> position;
+		std::array<ipos_t, Spec.num_sl[order]> reduced;
+		// step[sl][b]: primitive-cell offset of boundary term b's cell
+		std::array<std::array<idx3_t, Spec.boundary_size[order]>, Spec.num_sl[order]> step;
+	};
+
+	std::tuple<Tables<0>, Tables<1>, Tables<2>, Tables<3>> tables;
+
+	template<int order>
+	const ipos_t& primitive_position(sl_t sl) const {
+		if constexpr (order == 0) return this->primitive_spec.point_no(sl).position;
+		else if constexpr (order == 1) return this->primitive_spec.link_no(sl).position;
+		else if constexpr (order == 2) return this->primitive_spec.plaq_no(sl).position;
+		else return this->primitive_spec.vol_no(sl).position;
+	}
+
+	void set_up_tables(){
+		const auto& inv = this->primitive_spec.latvecs_unnormed_inverse;
+		[&]<int... k>(std::integer_sequence<int, k...>){
+			(..., [&]{
+				auto& t = std::get<k>(tables);
+				for (size_t sl=0; sl<Spec.num_sl[k]; sl++){
+					t.position[sl] = primitive_position<k>(sl);
+					t.reduced[sl] = inv * t.position[sl];
+				}
+			}());
+		}(std::make_integer_sequence<int, 4>{});
+
+		[&]<int... k>(std::integer_sequence<int, k...>){
+			(..., [&]{
+				constexpr auto target = Spec.template boundary_sl<k>();
+				const auto& cs = Spec.template cells<k>();
+				auto& t = std::get<k>(tables);
+				const auto& below = std::get<k-1>(tables);
+				for (size_t sl=0; sl<Spec.num_sl[k]; sl++){
+					for (size_t b=0; b<Spec.boundary_size[k]; b++){
+						ipos_t d = inv * (t.position[sl]
+								+ to_ipos(cs[sl].boundary[b].relative_position));
+						d -= below.reduced[target[sl][b]];
+						for (int n=0; n<3; n++){
+							assert(d[n] % abs_det == 0);
+							t.step[sl][b][n] = d[n] / abs_det;
+						}
+					}
+				}
+			}());
+		}(std::integer_sequence<int, 1, 2, 3>{});
+	}
+
+	template<int order>
+	void initialise(std::vector<cell_type_of<order, Base>*>& byJ){
+		trace::Scope phase(nd::detail::initialise_phase[order], "construct");
+		alloc_stats::Scope scope(alloc_stats::Subsystem::IndexMaps);
+		typedef cell_type_of<order, Base> T;
+		auto& cellmap = cells_of<order>(*this);
+		const auto& t = std::get<order>(tables);
+		byJ.assign(this->index_size(order), nullptr);
+		idx3_t IDX = {0,0,0};
+		for (IDX[0]=0; IDX[0]<this->size(0); IDX[0]++){
+		for (IDX[1]=0; IDX[1]<this->size(1); IDX[1]++){
+		for (IDX[2]=0; IDX[2]<this->size(2); IDX[2]++){
+			const size_t f = this->idx_from_idxn(IDX);
+			for (size_t sl=0; sl<Spec.num_sl[order]; sl++){
+				T* tmp = new_cell<T>();
+				tmp->position = t.position[sl] + this->primitive_spec.latvecs * IDX;
+				const size_t J = f + sl * this->num_primitive;
+				cellmap[J] = tmp;
+				byJ[J] = tmp;
+			}
+		}}}
+	}
+
+	template<int order, typename ByJ>
+	void connect(const ByJ& byJ){
+		if constexpr (order > 0) {
+			trace::Scope phase(nd::detail::connect_phase[order], "construct");
+			alloc_stats::Scope scope(alloc_stats::Subsystem::Chains);
+			constexpr auto target = Spec.template boundary_sl<order>();
+			const auto& cs = Spec.template cells<order>();
+			const auto& cells = std::get<order>(byJ);
+			const auto& below = std::get<order-1>(byJ);
+			const auto& step = std::get<order>(tables).step;
+			const ivec3_t D = this->size();
+			const size_t np = this->num_primitive;
+			idx3_t IDX = {0,0,0};
+			for (IDX[0]=0; IDX[0]<D[0]; IDX[0]++){
+			for (IDX[1]=0; IDX[1]<D[1]; IDX[1]++){
+			for (IDX[2]=0; IDX[2]<D[2]; IDX[2]++){
+				const size_t f = this->idx_from_idxn(IDX);
+				for (size_t sl=0; sl<Spec.num_sl[order]; sl++){
+					auto* c = cells[f + sl * np];
+					for (size_t b=0; b<Spec.boundary_size[order]; b++){
+						idx3_t I;
+						for (int n=0; n<3; n++) I[n] = mod(IDX[n] + step[sl][b][n], D[n]);
+						auto* x = below[this->idx_from_idxn(I) + target[sl][b] * np];
+						const int m = cs[sl].boundary[b].multiplier;
+						c->boundary[x] = m;
+						x->coboundary[c] = m;
+					}
+				}
+			}}}
+		}
+	}
+};
+
+
+template<auto Spec, CellLike<0> Point>
+using StaticPointLattice = StaticLattice<Spec, PeriodicPointLattice<Point>>;
+
+template<auto Spec, CellLike<0> Point, CellLike<1> Link>
+using StaticLinkLattice = StaticLattice<Spec, PeriodicLinkLattice<Point, Link>>;
+
+template<auto Spec, CellLike<0> Point, CellLike<1> Link, CellLike<2> Plaq>
+using StaticPlaqLattice = StaticLattice<Spec, PeriodicPlaqLattice<Point, Link, Plaq>>;
+
+template<auto Spec, CellLike<0> Point, CellLike<1> Link, CellLike<2> Plaq, CellLike<3> Vol>
+using StaticVolLattice = StaticLattice<Spec, PeriodicVolLattice<Point, Link, Plaq, Vol>>;
+
+}; // end of namespace
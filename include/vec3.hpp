@@ -146,7 +146,13 @@ vec3<T> operator-(const vec3<T>& v1, const vec3<T>& v2){
 template <typename T>
 struct mat33 {
 	static constexpr size_t size(){ return 9; }
-	
+
+	static constexpr mat33 identity(){
+		mat33 out;
+		for (int i=0; i<3; i++) out(i,i) = 1;
+		return out;
+	}
+
 	template<typename S=T>
 	requires std::convertible_to<S, T>
 	static constexpr mat33 from_cols(std::array<S,3> a0,
@@ -0,0 +1,230 @@
+#pragma once
+
+#include "checked_int.hpp"
+#include "vec3.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+
+/**
+ * Integer vectors and square matrices of a compile-time dimension N, the
+ * counterparts of vec3<int64_t> and mat33<int64_t> for lattice_nd.hpp.
+ *
+ * Both are aggregates over a std::array, so they take N (or N*N) int64_t's
+ * and nothing more:
+ *
+ *   ivec<2> x = {1, 2};
+ *   auto A = imat<2>::from_cols({{ {2, 0}, {1, 3} }});
+ *
+ * Matrices are stored row-major. det and adjugate go by cofactors and check
+ * for overflow; they are meant for unit cells and supercells, not for
+ * large N.
+ *
+ * coords<N> names the position and matrix types of an N-dimensional
+ * lattice. In three dimensions these are vec3<int64_t> and mat33<int64_t>,
+ * so that the 3D API is the N = 3 case of the dimension-generic one.
+ */
+namespace vectorn {
+
+template<int N>
+struct ivec {
+	std::array<int64_t, N> x;
+
+	static constexpr size_t size(){ return N; }
+
+	constexpr int64_t& operator[](size_t i){ return x[i]; }
+	constexpr int64_t operator[](size_t i) const { return x[i]; }
+
+	constexpr ivec& operator+=(const ivec& v){
+		for (int i=0; i<N; i++) x[i] += v.x[i];
+		return *this;
+	}
+	constexpr ivec& operator-=(const ivec& v){
+		for (int i=0; i<N; i++) x[i] -= v.x[i];
+		return *this;
+	}
+
+	friend constexpr ivec operator+(ivec a, const ivec& b){ return a += b; }
+	friend constexpr ivec operator-(ivec a, const ivec& b){ return a -= b; }
+	friend constexpr ivec operator-(ivec a){
+		for (int i=0; i<N; i++) a.x[i] = -a.x[i];
+		return a;
+	}
+	friend constexpr ivec operator*(int64_t alpha, ivec a){
+		for (int i=0; i<N; i++) a.x[i] *= alpha;
+		return a;
+	}
+	friend constexpr bool operator==(const ivec&, const ivec&) = default;
+	friend constexpr auto operator<=>(const ivec&, const ivec&) = default;
+};
+
+
+template<int N>
+struct imat {
+	std::array<int64_t, N*N> x;
+
+	static constexpr imat identity(){
+		imat m = {};
+		for (int i=0; i<N; i++) m(i,i) = 1;
+		return m;
+	}
+
+	// cols[j] is column j
+	static constexpr imat from_cols(const std::array<ivec<N>, N>& cols){
+		imat m = {};
+		for (int i=0; i<N; i++)
+			for (int j=0; j<N; j++) m(i,j) = cols[j][i];
+		return m;
+	}
+
+	static constexpr imat diagonal(const ivec<N>& d){
+		imat m = {};
+		for (int i=0; i<N; i++) m(i,i) = d[i];
+		return m;
+	}
+
+	constexpr int64_t& operator()(int i, int j){ return x[N*i + j]; }
+	constexpr int64_t operator()(int i, int j) const { return x[N*i + j]; }
+
+	constexpr ivec<N> col(int j) const {
+		ivec<N> c;
+		for (int i=0; i<N; i++) c[i] = (*this)(i,j);
+		return c;
+	}
+
+	friend constexpr ivec<N> operator*(const imat& A, const ivec<N>& v){
+		ivec<N> r = {};
+		for (int i=0; i<N; i++)
+			for (int j=0; j<N; j++) r[i] += A(i,j) * v[j];
+		return r;
+	}
+	friend constexpr imat operator*(const imat& A, const imat& B){
+		imat r = {};
+		for (int i=0; i<N; i++)
+			for (int k=0; k<N; k++)
+				for (int j=0; j<N; j++) r(i,j) += A(i,k) * B(k,j);
+		return r;
+	}
+	friend constexpr imat operator*(int64_t alpha, imat A){
+		for (auto& a : A.x) a *= alpha;
+		return A;
+	}
+	friend constexpr bool operator==(const imat&, const imat&) = default;
+};
+
+
+// A with row i and column j removed
+template<int N>
+requires (N > 1)
+imat<N-1> minor_of(const imat<N>& A, int i, int j){
+	imat<N-1> m;
+	for (int r=0, rr=0; r<N; r++){
+		if (r == i) continue;
+		for (int c=0, cc=0; c<N; c++){
+			if (c == j) continue;
+			m(rr, cc++) = A(r, c);
+		}
+		rr++;
+	}
+	return m;
+}
+
+// Throws std::overflow_error if a cofactor leaves int64_t
+template<int N>
+int64_t det(const imat<N>& A){
+	if constexpr (N == 1) {
+		return A(0,0);
+	} else {
+		int64_t d = 0;
+		for (int j=0; j<N; j++){
+			if (A(0,j) == 0) continue;
+			const int64_t c = checked::mul(A(0,j), det(minor_of(A, 0, j)));
+			d = (j % 2 == 0) ? checked::add(d, c) : checked::sub(d, c);
+		}
+		return d;
+	}
+}
+
+// adj(A) A = A adj(A) = det(A) I
+template<int N>
+imat<N> adjugate(const imat<N>& A){
+	imat<N> adj;
+	if constexpr (N == 1) {
+		adj(0,0) = 1;
+	} else {
+		for (int i=0; i<N; i++)
+			for (int j=0; j<N; j++){
+				const int64_t m = det(minor_of(A, j, i));
+				adj(i,j) = ((i + j) % 2 == 0) ? m : checked::neg(m);
+			}
+	}
+	return adj;
+}
+
+
+// The 3D types as imat<3>, and back
+inline imat<3> from_mat33(const vector3::mat33<int64_t>& A){
+	imat<3> B;
+	for (int i=0; i<9; i++) B.x[i] = A[i];
+	return B;
+}
+
+inline vector3::mat33<int64_t> to_mat33(const imat<3>& B){
+	vector3::mat33<int64_t> A;
+	for (int i=0; i<9; i++) A[i] = B.x[i];
+	return A;
+}
+
+inline int64_t det(const vector3::mat33<int64_t>& A){
+	return det(from_mat33(A));
+}
+
+inline vector3::mat33<int64_t> adjugate(const vector3::mat33<int64_t>& A){
+	return to_mat33(adjugate(from_mat33(A)));
+}
+
+
+template<int N>
+struct coords {
+	typedef ivec<N> vec;
+	typedef imat<N> mat;
+};
+
+template<>
+struct coords<3> {
+	typedef vector3::vec3<int64_t> vec;
+	typedef vector3::mat33<int64_t> mat;
+};
+
+
+template<int N>
+std::ostream& operator<<(std::ostream& os, const ivec<N>& v){
+	os << "[";
+	for (int i=0; i<N; i++) os << (i ? " " : "") << v[i];
+	return os << "]";
+}
+
+template<int N>
+std::ostream& operator<<(std::ostream& os, const imat<N>& A){
+	for (int i=0; i<N; i++){
+		os << "[";
+		for (int j=0; j<N; j++) os << (j ? "\t" : "") << A(i,j);
+		os << "]\n";
+	}
+	return os;
+}
+
+}; // end of namespace
+
+
+template<int N>
+struct std::hash<vectorn::ivec<N>>
+{
+	std::size_t operator()(const vectorn::ivec<N>& k) const {
+		std::size_t h = 0;
+		for (int i=0; i<N; i++) h ^= std::hash<int64_t>()(k[i]) << i;
+		return h;
+	}
+};
@@ -0,0 +1,411 @@
+#pragma once
+
+#include "cell_geometry.hpp"
+#include "cell_rows.hpp"
+#include "chain.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * Export to VTK's XML unstructured grid (.vtu), with all arrays stored as
+ * raw binary in the appended section, for ParaView and friends.
+ *
+ * Every cell becomes one VTK cell: points are VTK_VERTEX, links VTK_LINE
+ * (tail to head), plaquettes VTK_POLYGON (vertices in the order of the
+ * plaquette's orientation) and volumes VTK_POLYHEDRON (faces oriented by
+ * their incidence numbers). The vertices of each cell are the lattice
+ * points on its boundary, shifted to their periodic image nearest the cell,
+ * so cells crossing the supercell boundary are drawn whole; such images
+ * are extra VTK points appended after the lattice points.
+ *
+ * Cell data always includes "order" and "index" (the lattice index J), plus
+ * any VTKCellArray given in the options.
+ */
+namespace CellGeometry {
+
+// A user array attached as cell data: values[J] for the cell of `order`
+// with lattice index J. Cells of other orders get NaN.
+struct VTKCellArray {
+	std::string name;
+	int order;
+	std::span<const double> values;
+};
+
+struct VTKExportOptions {
+	// Which orders become VTK cells
+	std::array<bool, 4> orders = {true, true, true, true};
+	std::vector<VTKCellArray> cell_data;
+};
+
+
+/**
+ * Periodic image of a displacement d closest to the origin, as the
+ * supercell translation n with d - A n shortest (A = cell_vectors).
+ * Rounding the fractional coordinates is exact whenever the result lies
+ * within the inscribed sphere of the supercell; otherwise the 27
+ * neighbouring translations are searched.
+ */
+class MinimumImage {
+public:
+	explicit MinimumImage(const imat33_t& cell_vectors) :
+		MinimumImage(UnitCellSpecifier(cell_vectors))
+	{}
+
+	explicit MinimumImage(const UnitCellSpecifier& period) :
+		A(period.latvecs),
+		adj(period.latvecs_unnormed_inverse),
+		det(period.abs_det_latvecs)
+	{
+		// adj * A = det * I; keep det > 0 so rounding below is symmetric
+		if (det == 0) throw std::invalid_argument("Degenerate cell vectors");
+		if (det < 0) { adj = -1 * adj; det = -det; }
+		double h_min = std::numeric_limits<double>::infinity();
+		for (int i=0; i<3; i++){
+			const int j = (i+1)%3, k = (i+2)%3;
+			double c[3];
+			for (int m=0; m<3; m++){
+				const int m1 = (m+1)%3, m2 = (m+2)%3;
+				c[m] = double(A(m1,j))*A(m2,k) - double(A(m2,j))*A(m1,k);
+			}
+			h_min = std::min(h_min, double(det) / std::sqrt(c[0]*c[0] + c[1]*c[1] + c[2]*c[2]));
+		}
+		safe_norm2 = 0.25 * h_min * h_min;
+	}
+
+	ivec3_t translation(const ipos_t& d) const {
+		ivec3_t n = adj * d;
+		for (int i=0; i<3; i++){
+			n[i] = moddiv(2*n[i] + det, 2*det).quot;
+		}
+		ipos_t r = d - A * n;
+		if (norm2(r) < safe_norm2) return n;
+
+		ivec3_t best = n;
+		double best_norm = norm2(r);
+		ivec3_t m;
+		for (m[0]=n[0]-1; m[0]<=n[0]+1; m[0]++)
+		for (m[1]=n[1]-1; m[1]<=n[1]+1; m[1]++)
+		for (m[2]=n[2]-1; m[2]<=n[2]+1; m[2]++){
+			const double x = norm2(d - A * m);
+			if (x < best_norm) { best_norm = x; best = m; }
+		}
+		return best;
+	}
+
+	inline ipos_t operator()(const ipos_t& d) const { return d - A * translation(d); }
+
+private:
+	imat33_t A;
+	imat33_t adj;
+	int64_t det;
+	double safe_norm2;
+
+	static double norm2(const ipos_t& r){
+		return double(r[0])*r[0] + double(r[1])*r[1] + double(r[2])*r[2];
+	}
+};
+
+
+namespace vtk {
+	constexpr uint8_t VERTEX = 1;
+	constexpr uint8_t LINE = 3;
+	constexpr uint8_t POLYGON = 7;
+	constexpr uint8_t POLYHEDRON = 42;
+
+	// The unstructured grid, as the flat arrays of the .vtu format
+	struct Grid {
+		std::vector<double> points;        // x,y,z per VTK point
+		std::vector<int64_t> connectivity;
+		std::vector<int64_t> offsets;      // end of each cell in connectivity
+		std::vector<uint8_t> types;
+		std::vector<int64_t> faces;        // polyhedron face streams
+		std::vector<int64_t> faceoffsets;  // end of each cell in faces, or -1
+		std::vector<int32_t> order;
+		std::vector<int64_t> index;
+		std::vector<std::vector<double>> data;
+	};
+
+	// VTK point ids of lattice points, with images outside the supercell
+	// created on demand
+	class Vertices {
+	public:
+		template<typename Map>
+		Vertices(const Map& points, const imat33_t& cell_vectors, std::vector<double>& out) :
+			rows(points), A(cell_vectors), mi(cell_vectors), out(out)
+		{
+			out.reserve(3 * rows.size());
+			for (const auto& x : rows.position) push(x);
+		}
+
+		// id of the image of p nearest to x
+		int64_t id(const Cell<0>* p, const ipos_t& x){
+			const int64_t r = rows.row_of(p);
+			const ivec3_t n = mi.translation(p->position - x);
+			if (n[0] == 0 && n[1] == 0 && n[2] == 0) return r;
+			const Key k = {r, n[0], n[1], n[2]};
+			auto [it, inserted] = images.try_emplace(k, n_points);
+			if (inserted) push(p->position - A * n);
+			return it->second;
+		}
+
+	private:
+		typedef std::array<int64_t, 4> Key;
+		struct KeyHash {
+			size_t operator()(const Key& k) const {
+				size_t h = 0;
+				for (auto x : k) h = h * 0x9e3779b97f4a7c15ull + std::hash<int64_t>()(x);
+				return h;
+			}
+		};
+
+		CellRows rows;
+		imat33_t A;
+		MinimumImage mi;
+		std::vector<double>& out;
+		std::unordered_map<Key, int64_t, KeyHash> images;
+		int64_t n_points = 0;
+
+		void push(const ipos_t& x){
+			out.push_back(x[0]); out.push_back(x[1]); out.push_back(x[2]);
+			n_points++;
+		}
+	};
+
+	// Ends of a link, tail first, as point ids near x
+	template<typename Link>
+	std::pair<int64_t, int64_t> link_ends(const Link& l, const ipos_t& x, Vertices& V){
+		int64_t tail = -1, head = -1;
+		for (const auto& [p, m] : l.boundary){
+			(m < 0 ? tail : head) = V.id(p, x);
+		}
+		if (tail < 0 || head < 0) throw std::runtime_error("Link without two ends");
+		return {tail, head};
+	}
+
+	// Vertices of a plaquette around its boundary, in the sense of its
+	// orientation (or reversed), as point ids near x
+	template<typename Plaq>
+	void polygon(const Plaq& pl, const ipos_t& x, bool reversed, Vertices& V,
+			std::vector<int64_t>& out)
+	{
+		std::vector<std::pair<int64_t, int64_t>> edges;
+		for (const auto& [l, m] : pl.boundary){
+			auto e = link_ends(*l, x, V);
+			if ((m < 0) != reversed) std::swap(e.first, e.second);
+			edges.push_back(e);
+		}
+		const size_t n = edges.size();
+		if (n == 0) return;
+		// walk the edges head to tail
+		std::vector<bool> used(n, false);
+		used[0] = true;
+		const size_t start = out.size();
+		out.push_back(edges[0].first);
+		int64_t cur = edges[0].second;
+		for (size_t step=1; step<n; step++){
+			size_t e = 0;
+			while (e < n && (used[e] || edges[e].first != cur)) e++;
+			if (e == n) {
+				// not a simple cycle: fall back to the edges as listed
+				out.resize(start);
+				for (const auto& [a, b] : edges) out.push_back(a);
+				return;
+			}
+			used[e] = true;
+			out.push_back(cur);
+			cur = edges[e].second;
+		}
+	}
+
+	template<typename T>
+	void write_array(std::ostream& os, const std::vector<T>& v){
+		const uint64_t n = v.size() * sizeof(T);
+		os.write(reinterpret_cast<const char*>(&n), sizeof(n));
+		os.write(reinterpret_cast<const char*>(v.data()), n);
+	}
+
+	template<typename T>
+	uint64_t block_size(const std::vector<T>& v){
+		return sizeof(uint64_t) + v.size() * sizeof(T);
+	}
+}
+
+
+/**
+ * Builds the grid of `lat` (see the top of this file)
+ */
+template<typename Lattice>
+	requires std::derived_from<Lattice, PeriodicAbstractLattice>
+vtk::Grid build_vtk_grid(const Lattice& lat, const VTKExportOptions& opts = {}){
+	constexpr int K = max_order_of<Lattice>();
+	for (const auto& a : opts.cell_data){
+		if (a.order < 0 || a.order > K) {
+			throw std::invalid_argument("Cell array '" + a.name + "' has no cells of its order");
+		}
+		if (a.values.size() < lat.index_size(a.order)) {
+			throw std::invalid_argument("Cell array '" + a.name
+					+ "' is shorter than the lattice index range");
+		}
+	}
+
+	vtk::Grid g;
+	vtk::Vertices V(lat.points, lat.cell_vectors, g.points);
+	g.data.resize(opts.cell_data.size());
+	std::vector<int64_t> poly, ids;
+
+	auto finish_cell = [&](int order, idx_t J, uint8_t type){
+		g.offsets.push_back(g.connectivity.size());
+		g.types.push_back(type);
+		if (type != vtk::POLYHEDRON) g.faceoffsets.push_back(-1);
+		g.order.push_back(order);
+		g.index.push_back(J);
+		for (size_t a=0; a<opts.cell_data.size(); a++){
+			const auto& arr = opts.cell_data[a];
+			g.data[a].push_back(arr.order == order ? arr.values[J]
+					: std::numeric_limits<double>::quiet_NaN());
+		}
+	};
+
+	// each order in lattice index order, so output is deterministic
+	auto sorted = [](const auto& cells){
+		std::vector<std::pair<idx_t, decltype(cells.begin()->second)>> v(cells.begin(), cells.end());
+		std::sort(v.begin(), v.end());
+		return v;
+	};
+
+	if (opts.orders[0]) {
+		for (const auto& [J, p] : sorted(lat.points)){
+			g.connectivity.push_back(V.id(p, p->position));
+			finish_cell(0, J, vtk::VERTEX);
+		}
+	}
+	if constexpr (K >= 1) if (opts.orders[1]) {
+		for (const auto& [J, l] : sorted(lat.links)){
+			auto [a, b] = vtk::link_ends(*l, l->position, V);
+			g.connectivity.push_back(a);
+			g.connectivity.push_back(b);
+			finish_cell(1, J, vtk::LINE);
+		}
+	}
+	if constexpr (K >= 2) if (opts.orders[2]) {
+		for (const auto& [J, pl] : sorted(lat.plaqs)){
+			poly.clear();
+			vtk::polygon(*pl, pl->position, false, V, poly);
+			g.connectivity.insert(g.connectivity.end(), poly.begin(), poly.end());
+			finish_cell(2, J, vtk::POLYGON);
+		}
+	}
+	if constexpr (K >= 3) if (opts.orders[3]) {
+		for (const auto& [J, v] : sorted(lat.vols)){
+			ids.clear();
+			g.faces.push_back(v->boundary.size());
+			for (const auto& [pl, m] : v->boundary){
+				poly.clear();
+				vtk::polygon(*pl, v->position, m < 0, V, poly);
+				g.faces.push_back(poly.size());
+				g.faces.insert(g.faces.end(), poly.begin(), poly.end());
+				ids.insert(ids.end(), poly.begin(), poly.end());
+			}
+			std::sort(ids.begin(), ids.end());
+			ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+			g.connectivity.insert(g.connectivity.end(), ids.begin(), ids.end());
+			g.faceoffsets.push_back(g.faces.size());
+			finish_cell(3, J, vtk::POLYHEDRON);
+		}
+	}
+	return g;
+}
+
+
+// Writes a grid as .vtu with raw appended data
+inline void write_vtu(std::ostream& os, const vtk::Grid& g,
+		const std::vector<std::string>& data_names = {})
+{
+	const size_t n_points = g.points.size() / 3;
+	const size_t n_cells = g.types.size();
+	const bool polyhedra = !g.faces.empty();
+	uint64_t offset = 0;
+	auto array = [&](const char* type, const std::string& name, int components,
+			uint64_t size){
+		os << "<DataArray type=\"" << type << "\" Name=\"" << name << "\"";
+		if (components > 1) os << " NumberOfComponents=\"" << components << "\"";
+		os << " format=\"appended\" offset=\"" << offset << "\"/>\n";
+		offset += size;
+	};
+
+	os << "<?xml version=\"1.0\"?>\n"
+		<< "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\""
+		<< (std::endian::native == std::endian::little ? "LittleEndian" : "BigEndian")
+		<< "\" header_type=\"UInt64\">\n"
+		<< "<UnstructuredGrid>\n"
+		<< "<Piece NumberOfPoints=\"" << n_points << "\" NumberOfCells=\"" << n_cells << "\">\n";
+	os << "<Points>\n";
+	array("Float64", "Points", 3, vtk::block_size(g.points));
+	os << "</Points>\n<Cells>\n";
+	array("Int64", "connectivity", 1, vtk::block_size(g.connectivity));
+	array("Int64", "offsets", 1, vtk::block_size(g.offsets));
+	array("UInt8", "types", 1, vtk::block_size(g.types));
+	if (polyhedra) {
+		array("Int64", "faces", 1, vtk::block_size(g.faces));
+		array("Int64", "faceoffsets", 1, vtk::block_size(g.faceoffsets));
+	}
+	os << "</Cells>\n<CellData Scalars=\"order\">\n";
+	array("Int32", "order", 1, vtk::block_size(g.order));
+	array("Int64", "index", 1, vtk::block_size(g.index));
+	for (size_t a=0; a<g.data.size(); a++){
+		array("Float64", a < data_names.size() ? data_names[a] : "data" + std::to_string(a),
+				1, vtk::block_size(g.data[a]));
+	}
+	os << "</CellData>\n</Piece>\n</UnstructuredGrid>\n"
+		<< "<AppendedData encoding=\"raw\">\n_";
+
+	vtk::write_array(os, g.points);
+	vtk::write_array(os, g.connectivity);
+	vtk::write_array(os, g.offsets);
+	vtk::write_array(os, g.types);
+	if (polyhedra) {
+		vtk::write_array(os, g.faces);
+		vtk::write_array(os, g.faceoffsets);
+	}
+	vtk::write_array(os, g.order);
+	vtk::write_array(os, g.index);
+	for (const auto& d : g.data) vtk::write_array(os, d);
+	os << "\n</AppendedData>\n</VTKFile>\n";
+	if (!os) throw std::runtime_error("Failed to write VTK file");
+}
+
+
+/**
+ * Writes `lat` to `out_path` as .vtu. Returns false if the file could not
+ * be opened, like save().
+ */
+template<typename Lattice>
+	requires std::derived_from<Lattice, PeriodicAbstractLattice>
+bool save_vtu(const Lattice& lat, const std::filesystem::path& out_path,
+		const VTKExportOptions& opts = {})
+{
+	alloc_stats::Scope scope(alloc_stats::Subsystem::IO);
+	trace::Scope phase("save_vtu", "io");
+	std::ofstream os(out_path, std::ios::binary);
+	if (!os.is_open()) return false;
+	std::vector<std::string> names;
+	for (const auto& a : opts.cell_data) names.push_back(a.name);
+	write_vtu(os, build_vtk_grid(lat, opts), names);
+	return true;
+}
+
+}; // end of namespace
@@ -1,6 +1,7 @@
 #include <cell_geometry.hpp>
 #include <preset_cellspecs.hpp>
 #include <chrono>
+#include <ranges>
 
 using namespace CellGeometry;
 using namespace std;
@@ -86,6 +87,38 @@ void benchmark_coboundary(const string& label, const Container& container, size_
 
 
 
+// Times a raw map loop against the equivalent range view; both should match
+template <typename Container, typename View>
+void benchmark_view(const string& label, const Container& container,
+		View&& view, size_t n_samples) {
+    cout << label << endl;
+	int64_t raw_sum = 0, view_sum = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n_samples; ++i) {
+        for (const auto& [_, p] : container) {
+			raw_sum += p->position[0];
+            clobber();
+        }
+    }
+    auto mid = chrono::steady_clock::now();
+    for (size_t i = 0; i < n_samples; ++i) {
+        for (const auto& x : view) {
+			view_sum += x.position[0];
+            clobber();
+        }
+    }
+    auto end = chrono::steady_clock::now();
+	cout << "  raw loop:";
+    print_dt(start, mid, n_samples * container.size());
+	cout << "  view:    ";
+    print_dt(mid, end, n_samples * container.size());
+	auto t_raw = chrono::duration<double>(mid - start).count();
+	auto t_view = chrono::duration<double>(end - mid).count();
+	cout << "\tview / raw = " << t_view / t_raw 
+		<< (raw_sum == view_sum ? "" : "  (MISMATCH)") << "\n";
+}
+
+
 void iter_bench( int L){
 
 	const size_t n_samples=100;
@@ -103,6 +136,13 @@ void iter_bench( int L){
 
 	benchmark_boundary("Link boundary enumeration", lat.links, n_samples);
 	benchmark_coboundary("Link coboundary enumeration", lat.links, n_samples);
+	cout<<"\n";
+
+	benchmark_view("Link view vs raw", lat.links, lat.get_links(), n_samples);
+	benchmark_view("Vol view vs raw", lat.vols, lat.get_vols(), n_samples);
+	benchmark_view("Filtered link view vs raw", lat.links, 
+			lat.get_links() | std::views::filter([](const Cell<1>&){ return true; }),
+			n_samples);
 
 
 }
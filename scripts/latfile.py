@@ -0,0 +1,70 @@
+import json
+
+ORDERS = ('points', 'links', 'plaqs', 'vols')
+
+
+def expand_compact(data):
+    '''
+    Rewrites a compact (index-based) .lat.json in place into the verbose
+    layout, where every cell is {'pos': [x,y,z], 'boundary': [[pos, m], ...],
+    'coboundary': ...} and incidences are given by position.
+    Coboundaries left out of the file are rebuilt from the boundaries.
+    '''
+    cells = {}
+    for name in ORDERS:
+        sec = data.get(name)
+        if sec is None:
+            data[name] = None
+            continue
+        index = sec['index']
+        pos = sec['pos']
+        cells[name] = {
+            J: {'pos': pos[3*r:3*r+3]} for r, J in enumerate(index)
+        }
+
+    for k, name in enumerate(ORDERS):
+        if name not in cells:
+            continue
+        sec = data[name]
+        if k > 0:
+            faces = cells[ORDERS[k-1]]
+            for c in cells[name].values():
+                c['boundary'] = []
+            ptr = sec['boundary_ptr']
+            for r, J in enumerate(sec['index']):
+                c = cells[name][J]
+                for e in range(ptr[r], ptr[r+1]):
+                    f = faces[sec['boundary'][e]]
+                    c['boundary'].append([f['pos'], sec['boundary_mult'][e]])
+        if k < 3:
+            for c in cells[name].values():
+                c['coboundary'] = []
+
+    # coboundaries as the transpose of the boundaries
+    for k in range(1, 4):
+        name = ORDERS[k]
+        if name not in cells or ORDERS[k-1] not in cells:
+            continue
+        faces = cells[ORDERS[k-1]]
+        sec = data[name]
+        ptr = sec['boundary_ptr']
+        for r, J in enumerate(sec['index']):
+            for e in range(ptr[r], ptr[r+1]):
+                faces[sec['boundary'][e]]['coboundary'].append(
+                    [cells[name][J]['pos'], sec['boundary_mult'][e]])
+
+    for name in ORDERS:
+        if name in cells:
+            data[name] = list(cells[name].values())
+    return data
+
+
+def load_latfile(path):
+    '''
+    Reads a .lat.json file in either schema, returning the verbose layout
+    '''
+    with open(path, 'r') as f:
+        data = json.load(f)
+    if data.get('format') == 'lat.json/compact':
+        expand_compact(data)
+    return data
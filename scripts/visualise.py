@@ -2,11 +2,11 @@ import sys
 import matplotlib.pyplot as plt
 import numpy as np
 import numpy.linalg as LA
-import json
 from os.path import basename
 import argparse
 from mpl_toolkits.mplot3d.art3d import Poly3DCollection
 import itertools
+from latfile import load_latfile
 
 
 
@@ -216,9 +216,7 @@ ap.add_argument("--save")
 
 args = ap.parse_args()
 
-data = None
-with open(args.file, 'r') as f:
-    data = json.load(f)
+data = load_latfile(args.file)
 
 fig = plt.figure()
 ax = fig.add_subplot(projection='3d')
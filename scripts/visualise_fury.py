@@ -1,11 +1,11 @@
 import sys
 import numpy as np
 import numpy.linalg as LA
-import json
 from os.path import basename
 import argparse
 from fury import window, actor, ui, pick
 import itertools
+from latfile import load_latfile
 
 
 actors = []
@@ -187,9 +187,7 @@ ap.add_argument("--thick_links", action="store_true")
 
 args = ap.parse_args()
 
-data = None
-with open(args.file, 'r') as f:
-    data = json.load(f)
+data = load_latfile(args.file)
 
 
 def parse_filename(fname):
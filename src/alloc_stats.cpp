@@ -0,0 +1,131 @@
+#include "alloc_stats.hpp"
+
+#ifdef LATLIB_ALLOC_STATS
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace CellGeometry {
+namespace alloc_stats {
+
+namespace {
+	struct alignas(64) Slot {
+		std::atomic<uint64_t> allocations{0};
+		std::atomic<uint64_t> frees{0};
+		std::atomic<uint64_t> bytes{0};
+		std::atomic<uint64_t> live{0};
+		std::atomic<uint64_t> peak{0};
+	};
+
+	Slot slots[num_subsystems];
+
+	// Stored just below each allocation
+	struct Header {
+		uint64_t size;
+		uint32_t offset;  // from the start of the malloc'd block
+		uint8_t tag;
+	};
+	constexpr size_t header_space = 16;
+	static_assert(sizeof(Header) <= header_space);
+
+	void* allocate(size_t n, size_t align) noexcept {
+		const size_t offset = std::max(header_space, align);
+		void* raw = align > header_space
+			? std::aligned_alloc(align, (n + offset + align - 1) / align * align)
+			: std::malloc(n + offset);
+		if (!raw) return nullptr;
+		char* p = static_cast<char*>(raw) + offset;
+		const auto tag = detail::current;
+		new (p - header_space) Header{n, uint32_t(offset), uint8_t(tag)};
+
+		Slot& s = slots[size_t(tag)];
+		s.allocations.fetch_add(1, std::memory_order_relaxed);
+		s.bytes.fetch_add(n, std::memory_order_relaxed);
+		const uint64_t live = s.live.fetch_add(n, std::memory_order_relaxed) + n;
+		uint64_t peak = s.peak.load(std::memory_order_relaxed);
+		while (live > peak && !s.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+		return p;
+	}
+
+	void release(void* p) noexcept {
+		if (!p) return;
+		char* c = static_cast<char*>(p);
+		const Header h = *reinterpret_cast<Header*>(c - header_space);
+		Slot& s = slots[h.tag];
+		s.frees.fetch_add(1, std::memory_order_relaxed);
+		s.live.fetch_sub(h.size, std::memory_order_relaxed);
+		std::free(c - h.offset);
+	}
+
+	void* allocate_or_throw(size_t n, size_t align){
+		void* p = allocate(n, align);
+		if (!p) throw std::bad_alloc();
+		return p;
+	}
+}
+
+
+Counters get(Subsystem sub){
+	const Slot& s = slots[size_t(sub)];
+	Counters c;
+	c.allocations = s.allocations.load(std::memory_order_relaxed);
+	c.frees = s.frees.load(std::memory_order_relaxed);
+	c.bytes = s.bytes.load(std::memory_order_relaxed);
+	c.live_bytes = s.live.load(std::memory_order_relaxed);
+	c.peak_live_bytes = s.peak.load(std::memory_order_relaxed);
+	return c;
+}
+
+std::array<Counters, num_subsystems> snapshot(){
+	std::array<Counters, num_subsystems> out;
+	for (size_t i=0; i<num_subsystems; i++) out[i] = get(Subsystem(i));
+	return out;
+}
+
+void reset(){
+	for (auto& s : slots){
+		s.allocations = 0;
+		s.frees = 0;
+		s.bytes = 0;
+	}
+	reset_peak();
+}
+
+void reset_peak(){
+	for (auto& s : slots) s.peak = s.live.load();
+}
+
+}; // end of namespace alloc_stats
+}; // end of namespace
+
+
+using CellGeometry::alloc_stats::allocate;
+using CellGeometry::alloc_stats::allocate_or_throw;
+using CellGeometry::alloc_stats::release;
+using CellGeometry::alloc_stats::header_space;
+
+void* operator new(size_t n){ return allocate_or_throw(n, header_space); }
+void* operator new[](size_t n){ return allocate_or_throw(n, header_space); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { return allocate(n, header_space); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { return allocate(n, header_space); }
+void* operator new(size_t n, std::align_val_t a){ return allocate_or_throw(n, size_t(a)); }
+void* operator new[](size_t n, std::align_val_t a){ return allocate_or_throw(n, size_t(a)); }
+void* operator new(size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return allocate(n, size_t(a)); }
+void* operator new[](size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return allocate(n, size_t(a)); }
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { release(p); }
+
+#endif
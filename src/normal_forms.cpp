@@ -0,0 +1,90 @@
+#include "normal_forms.hpp"
+#include "normal_forms_nd.hpp"
+#include <array>
+#include <map>
+#include <mutex>
+
+namespace CellGeometry {
+
+SNF_decomp smith_normal_form(const imat33_t& A){
+	const auto s = nd::smith_normal_form(vectorn::from_mat33(A));
+	return SNF_decomp(vectorn::to_mat33(s.L), vectorn::to_mat33(s.Linv),
+			ivec3_t(s.D[0], s.D[1], s.D[2]),
+			vectorn::to_mat33(s.R), vectorn::to_mat33(s.Rinv));
+}
+
+
+HNF_decomp hermite_normal_form(const imat33_t& A){
+	const auto h = nd::hermite_normal_form(vectorn::from_mat33(A));
+	return {vectorn::to_mat33(h.H), vectorn::to_mat33(h.U), vectorn::to_mat33(h.Uinv)};
+}
+
+
+namespace {
+	typedef std::array<int64_t, 9> SNFKey;
+
+	// Beyond this many supercells the cache starts over, so that a scan
+	// over supercells doesn't grow it without bound
+	constexpr size_t snf_cache_capacity = 4096;
+
+	struct SNFCache {
+		std::mutex mtx;
+		std::map<SNFKey, SNF_decomp> entries;
+		size_t hits = 0;
+		size_t misses = 0;
+	};
+
+	SNFCache& snf_cache(){
+		static SNFCache cache;
+		return cache;
+	}
+
+	SNFKey snf_key(const imat33_t& A){
+		SNFKey k;
+		for (int i=0; i<9; i++) k[i] = A[i];
+		return k;
+	}
+}
+
+
+SNF_decomp cached_smith_normal_form(const imat33_t& A){
+	auto& cache = snf_cache();
+	const SNFKey key = snf_key(A);
+	{
+		std::lock_guard<std::mutex> lock(cache.mtx);
+		auto it = cache.entries.find(key);
+		if (it != cache.entries.end()) {
+			cache.hits++;
+			return it->second;
+		}
+		cache.misses++;
+	}
+	// computed unlocked; a racing thread may duplicate the work, not the entry
+	SNF_decomp d = smith_normal_form(A);
+	std::lock_guard<std::mutex> lock(cache.mtx);
+	if (cache.entries.size() >= snf_cache_capacity) cache.entries.clear();
+	cache.entries.emplace(key, d);
+	return d;
+}
+
+
+SNFCacheStats snf_cache_stats(){
+	auto& cache = snf_cache();
+	std::lock_guard<std::mutex> lock(cache.mtx);
+	SNFCacheStats s;
+	s.hits = cache.hits;
+	s.misses = cache.misses;
+	s.entries = cache.entries.size();
+	return s;
+}
+
+
+void clear_snf_cache(){
+	auto& cache = snf_cache();
+	std::lock_guard<std::mutex> lock(cache.mtx);
+	cache.entries.clear();
+	cache.hits = 0;
+	cache.misses = 0;
+}
+
+}; // end of namespace
@@ -0,0 +1,158 @@
+#include "phase_trace.hpp"
+
+#ifndef LATLIB_NO_TRACE
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace CellGeometry {
+namespace trace {
+
+namespace detail {
+	std::atomic<bool> on{false};
+}
+
+namespace {
+	const auto epoch = std::chrono::steady_clock::now();
+
+	std::mutex mtx;
+	std::vector<Event> recorded;
+
+	std::atomic<uint32_t> num_threads{0};
+	thread_local uint32_t thread_id = UINT32_MAX;
+
+	// Names are literals, but may still need escaping
+	void put_string(std::ostream& os, const char* s){
+		os << '"';
+		for (; *s; s++){
+			const char c = *s;
+			if (c == '"' || c == '\\') os << '\\' << c;
+			else if (static_cast<unsigned char>(c) < 0x20) {
+				char buf[8];
+				std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+				os << buf;
+			}
+			else os << c;
+		}
+		os << '"';
+	}
+
+	// Chrome wants microseconds
+	void put_us(std::ostream& os, int64_t ns){
+		os << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000
+			<< std::setfill(' ');
+	}
+}
+
+
+int64_t detail::now_ns(){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - epoch).count();
+}
+
+void detail::record(const char* name, const char* category, int64_t start_ns, int64_t end_ns){
+	if (thread_id == UINT32_MAX) thread_id = num_threads++;
+	std::lock_guard<std::mutex> lock(mtx);
+	recorded.push_back({name, category, start_ns, end_ns - start_ns, thread_id});
+}
+
+
+void enable(bool on){
+	detail::on.store(on, std::memory_order_relaxed);
+}
+
+void clear(){
+	std::lock_guard<std::mutex> lock(mtx);
+	recorded.clear();
+}
+
+std::vector<Event> events(){
+	std::lock_guard<std::mutex> lock(mtx);
+	return recorded;
+}
+
+std::vector<PhaseSummary> summary(){
+	std::map<std::pair<std::string, std::string>, PhaseSummary> by_name;
+	for (const auto& e : events()){
+		auto& s = by_name[{e.category, e.name}];
+		s.name = e.name;
+		s.category = e.category;
+		s.count++;
+		s.total_ns += e.duration_ns;
+		s.max_ns = std::max(s.max_ns, e.duration_ns);
+	}
+	std::vector<PhaseSummary> out;
+	for (auto& [_, s] : by_name) out.push_back(std::move(s));
+	std::stable_sort(out.begin(), out.end(), [](const auto& a, const auto& b){
+		return a.total_ns > b.total_ns;
+	});
+	return out;
+}
+
+
+void write_chrome_trace(std::ostream& os){
+	const auto ev = events();
+	os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	os << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, "
+		"\"args\": {\"name\": \"latticelab\"}}";
+	// complete ("X") events; viewers nest them by time on each thread
+	for (const auto& e : ev){
+		os << ",\n{\"name\": ";
+		put_string(os, e.name);
+		os << ", \"cat\": ";
+		put_string(os, e.category);
+		os << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.thread << ", \"ts\": ";
+		put_us(os, e.start_ns);
+		os << ", \"dur\": ";
+		put_us(os, e.duration_ns);
+		os << "}";
+	}
+	os << "\n]}\n";
+}
+
+void write_summary(std::ostream& os){
+	const auto rows = summary();
+	if (rows.empty()) {
+		os << "(no phases recorded)\n";
+		return;
+	}
+	// percentages are of the span from the first event to the last; nested
+	// phases are counted in their parents too, so they need not add to 100
+	int64_t t0 = INT64_MAX, t1 = 0;
+	for (const auto& e : events()){
+		t0 = std::min(t0, e.start_ns);
+		t1 = std::max(t1, e.start_ns + e.duration_ns);
+	}
+	const double span = std::max<int64_t>(1, t1 - t0);
+
+	// leave the caller's stream formatting as it was
+	const auto flags = os.flags();
+	const auto precision = os.precision();
+	const auto fill = os.fill();
+	os << std::left << std::setw(28) << "phase" << std::setw(10) << "category"
+		<< std::right << std::setw(9) << "count" << std::setw(13) << "total ms"
+		<< std::setw(12) << "mean ms" << std::setw(12) << "max ms" << std::setw(8) << "%" << "\n";
+	os << std::fixed;
+	for (const auto& r : rows){
+		os << std::left << std::setw(28) << r.name << std::setw(10) << r.category
+			<< std::right << std::setw(9) << r.count
+			<< std::setprecision(3)
+			<< std::setw(13) << r.total_ns * 1e-6
+			<< std::setw(12) << r.total_ns * 1e-6 / r.count
+			<< std::setw(12) << r.max_ns * 1e-6
+			<< std::setprecision(1) << std::setw(8) << 100 * r.total_ns / span << "\n";
+	}
+	os.flags(flags);
+	os.precision(precision);
+	os.fill(fill);
+}
+
+}; // end of namespace trace
+}; // end of namespace
+
+#endif
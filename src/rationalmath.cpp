@@ -1,24 +1,11 @@
 #include "rationalmath.hpp"
 #include "modulus.hpp"
 #include <limits>
+#include <numeric>
 #include <stdexcept>
 namespace rational {
 
 
-	Rational& Rational::operator+=(const Rational& other){
-		int64_t tmp = static_cast<int64_t>(num)*other.denom + static_cast<int64_t>(other.num)*denom;
-		denom = denom * other.denom;
-		num = tmp;
-		return *this;
-	}
-
-	Rational& Rational::operator-=(const Rational& other){
-		int64_t tmp = static_cast<int64_t>(num)*other.denom - static_cast<int64_t>(other.num)*denom;
-		denom = denom * other.denom;
-		num = tmp;
-		return *this;
-	}
-
 	void Rational::simplify(){
 		int64_t this_gcd = std::gcd(num, denom);
 		num /= this_gcd;
@@ -27,8 +14,8 @@ namespace rational {
 
 	void Rational::make_denom_positive(){
 		if (denom < 0){
-			denom = -denom;
-			num = -num;
+			denom = checked::neg(denom);
+			num = checked::neg(num);
 		}
 	}
 
@@ -36,7 +23,7 @@ namespace rational {
 		if (x == 0) {
 			throw std::domain_error("Attempted division by zero");
 		}
-		denom *= x;
+		detail::set_product(*this, num, denom, 1, x);
 		return *this;
 	}
 
@@ -45,27 +32,14 @@ namespace rational {
 		if (x.num == 0) {
 			throw std::domain_error("Attempted division by zero");
 		}
-		denom *= x.num;
-		num *= x.denom;
-		return *this;
-	}
-
-	Rational& Rational::operator*=(int64_t x) {
-		num *= x;
-		return *this;
-	}
-
-	Rational& Rational::operator*=(const Rational& x) {
-		num *= x.num;
-		denom *= x.denom;
+		detail::set_product(*this, num, denom, x.denom, x.num);
 		return *this;
 	}
 
 	Rational Rational::operator/(int64_t x) const {
-		if (x == 0) {
-			throw std::domain_error("Attempted division by zero");
-		}
-		return Rational(num, denom*x);
+		Rational retval(*this);
+		retval /= x;
+		return retval;
 	}
 
 
@@ -81,21 +55,6 @@ void rswap(rmat33& A, int row_i, int row_j, rvec3& b){
 	std::swap(b(row_i), b(row_j));
 }
 
-// Performs A[row_i] <- a*A[row_j] - A[row_i]
-void rsub(rmat33& A, Rational a_j, int row_j, int row_i, rvec3& b){
-	for (int j=0; j<3; j++){
-		A(row_i, j) -= a_j*A(row_j, j);
-	}
-	b(row_i) -= a_j*b(row_j);
-}
-
-void rmult(rmat33& A, int row, Rational a, rvec3& b){
-	for (int j=0; j<3; j++){
-		A(row, j) *= a;
-	}
-	b(row) *= a;
-}
-
 
 // Solves Ax = b using Gaussian elimination
 void rlinsolve(rvec3& x, const rmat33& A, const rvec3& b){
@@ -103,41 +62,37 @@ void rlinsolve(rvec3& x, const rmat33& A, const rvec3& b){
 	x = b;
 	
 	for (int col = 0; col<3; col++){
-		// pemute rows until A(col, col) != 0
-		int row = col + 1;
-		while ((B(col,col) == 0)) {
-			if (row > 3){
+		// bring a row with B(row, col) != 0 up
+		int row = col;
+		while (B(row, col).num == 0) {
+			if (++row > 2){
 				throw std::invalid_argument("Matrix is singular");
 			}
-
-			rswap(B, col, row, x);
-			row += 1;
 		}
+		if (row != col) rswap(B, col, row, x);
 
-		// rmult to make B(col, col) == 1
-		rmult(B, col, inv(B(col,col)), x);
-		// simplify the row
-		for (int ci=col; ci<3; ci++){
-			B(col, ci).simplify();
+		// scale to make B(col, col) == 1; only the right of it is used again
+		const Rational p = inv(B(col, col));
+		for (int ci=col+1; ci<3; ci++){
+			B(col, ci) *= p;
 		}
+		x[col] *= p;
 
 		// delete the lower part
 		for (row = col + 1; row < 3; row++){
-			rsub(B, B(row, col), col, row, x);
-		}
-
-		// Simplify
-		for (int i=0; i<9; i++){
-			B[i].simplify();
+			const Rational f = B(row, col);
+			if (f.num == 0) continue;
+			for (int ci=col+1; ci<3; ci++){
+				B(row, ci).sub_mul(f, B(col, ci));
+			}
+			x[row].sub_mul(f, x[col]);
 		}
 	}
 
-
-	// matrix shold now be upper triangular with 1s on diagonal
-	// Remove top part and simplify answer
+	// B is now unit upper triangular: back substitute
 	for (int col=2; col>=0; col--){
 		for (int row=0; row<col; row++){
-			rsub(B, B(row,col), col, row, x);
+			x[row].sub_mul(B(row, col), x[col]);
 		}
 		x[col].simplify();
 	}
@@ -149,30 +104,30 @@ void rlinsolve(rvec3& x, const rmat33& A, const rvec3& b){
 
 // Computes the closed-form, simplified matrix inverse
 rmat33 inv(const rmat33& A){
-	auto denom = vector3::det(A);
-	std::array<Rational, 3> b0 = {-A(1, 2) * A(2, 1) + A(1, 1) * A(2, 2),
-		A(0, 2) * A(2, 1) - A(0, 1) * A(2, 2),
-		-A(0, 2) * A(1, 1) + A(0, 1) * A(1, 2)};
-	std::array<Rational, 3> b1 = {A(1, 2) * A(2, 0) - A(1, 0) * A(2, 2),
-		-A(0, 2) * A(2, 0) + A(0, 0) * A(2, 2),
-		A(0, 2) * A(1, 0) - A(0, 0) * A(1, 2)};
-	std::array<Rational, 3> b2 = {-A(1, 1) * A(2, 0) + A(1, 0) * A(2, 1),
-		A(0, 1) * A(2, 0) - A(0, 0) * A(2, 1),
-		-A(0, 1) * A(1, 0) + A(0, 0) * A(1, 1)};
-
-	auto retval =  inv(denom) * rmat33::from_rows(b0,b1,b2);
-	for (int i=0; i<9; i++){
-		retval[i].simplify();
-
-#ifndef NDEBUG
-	if (retval[i].denom == 0) {
+	// adjugate, with the cofactor signs from cycling the indices
+	rmat33 adj;
+	for (int i=0; i<3; i++){
+		for (int j=0; j<3; j++){
+			const int i1 = (i+1)%3, i2 = (i+2)%3, j1 = (j+1)%3, j2 = (j+2)%3;
+			Rational& c = adj(i, j);
+			c = A(j1, i1) * A(j2, i2);
+			c.sub_mul(A(j1, i2), A(j2, i1));
+		}
+	}
+	Rational det(0);
+	for (int j=0; j<3; j++){
+		det.add_mul(A(0, j), adj(j, 0));
+	}
+	if (det.num == 0) {
 		throw std::domain_error("Inverse of singular matrix");
 	}
-#endif
 
+	for (int i=0; i<9; i++){
+		// adj / det, in lowest terms
+		detail::store_reduced(adj[i], detail::wide_t(adj[i].num) * det.denom,
+				detail::wide_t(adj[i].denom) * det.num);
 	}
-
-	return retval;
+	return adj;
 }
 
 
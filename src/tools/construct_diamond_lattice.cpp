@@ -1,8 +1,15 @@
 #include "cell_geometry.hpp"
 #include "argparse/argparse.hpp"
 #include "chain.hpp"
+#include "binary_lattice_IO.hpp"
 #include "lattice_IO.hpp"
+#include "memory_usage.hpp"
+#include "npy_IO.hpp"
+#include "path_enumeration.hpp"
+#include "phase_trace.hpp"
 #include "preset_cellspecs.hpp"
+#include "sparse_export.hpp"
+#include "vtk_export.hpp"
 #include <UnitCellSpecifier.hpp>
 #include <algorithm>
 #include <sstream>
@@ -69,86 +76,51 @@ struct Point : public Cell<0> {
 };
 
 struct Link : public Cell<1> {
-    bool visited = false;
 };
 
 struct Plaq : public Cell<2> {
 };
 
 struct Vol : public Cell<3> {
-    bool visited = false;
 };
 
 typedef PeriodicVolLattice<Point, Link, Plaq, Vol> Lattice;
 
 using namespace std;
 
-struct bfs_node {
-    const Cell<0>* point;
-    Chain<1> path;
-};
-
-
 inline std::vector<Chain<1>> find_paths_neighbours(Lattice& lat, Point* origin, Point* finish, unsigned len){
-    // finds all chains of length 'len' connecting p0 to p1
+    // finds all self-avoiding chains of length 'len' connecting p0 to p1
     std::vector<Chain<1>> res;
-    for (auto [_, l] : lat.links){
-        l->visited = false;
-    }
-    std::stack<bfs_node> to_visit;
-    to_visit.push(bfs_node(origin, Chain<1>()));
-
-    Chain<0> expected_boundary;
-    expected_boundary[origin] = -1;
-    expected_boundary[finish] = 1;
-
-    while (!to_visit.empty()){
-        auto curr = to_visit.top();
-        to_visit.pop();
-        if (curr.path.size() == len){
-            if (curr.point == finish) {
-                assert( d(curr.path) == expected_boundary );
-                res.push_back(curr.path);
-            }
-        }
-        for (const auto& [l, m] : curr.point->coboundary){
-            const Link* ln = static_cast<const Link*>(l);
-            if (ln->visited) continue;
-            Chain<1> this_ln; this_ln[l]=m;
-            for (auto& [p2, n] : d(this_ln)){
-                if (p2 != curr.point){ 
-                    to_visit.push(bfs_node(p2,curr.path + this_ln));
-                }
-            }
-        }
-    }
+    LinkGraph g(lat);
+    for_each_path(g, lat.get_point_idx_at(origin->position),
+            lat.get_point_idx_at(finish->position), len,
+            [&](const PathView& path){ res.push_back(to_chain(g, path)); });
     return res;
 }
 
 
 inline std::vector<std::set<Vol*>> find_connected_components(Lattice& lat){
-    // greedy algorithm -- traverse via all boundaries recursively
-    std::stack<Vol*> vols;
-
-    for (const auto& [_,v] : lat.vols){
-        v->visited = false;
-    }
+    // greedy algorithm -- DFS over the cached vol adjacency
+    const auto& nbrs = neighbour_table<3, NeighbourRelation::Boundary>(lat);
+    std::vector<bool> visited(nbrs.size(), false);
+    std::stack<idx_t> vols;
 
     std::vector<std::set<Vol*>> retval;
 
-    for (const auto& [_,v] : lat.vols){
-        if (!v->visited){
+    for (const auto& [J, v] : lat.vols){
+        if (!visited[J]){
             retval.push_back({});
             // start a DFS
-            vols.push(v);
+            visited[J] = true;
+            vols.push(J);
             while(!vols.empty()){
-                auto curr =vols.top();
-                retval.back().insert(curr);
+                auto curr = vols.top();
                 vols.pop();
-                curr->visited = true;
-                for(auto v2 :  get_neighbours<Vol>(curr)){
-                    if (! v2->visited ){
-                        vols.push(v2);
+                retval.back().insert(&nbrs.cell(curr));
+                for (auto J2 : nbrs[curr]){
+                    if (!visited[J2]){
+                        visited[J2] = true;
+                        vols.push(J2);
                     }
                 }
             }
@@ -177,24 +149,44 @@ int main (int argc, const char *argv[]) {
         .scan<'i', int>()
         .default_value(0);
 
+    prog.add_argument("--format")
+        .help("Output format: json (.lat.json), json-compact (index-based .lat.json), latb (native binary), vtu (VTK, for ParaView), npz (NumPy) or operators (boundary matrices, see sparse_export.hpp)")
+        .default_value(std::string("json"))
+        .choices("json", "json-compact", "latb", "vtu", "npz", "operators");
+
+    prog.add_argument("--trace")
+        .help("Time the construction, erasure and output phases; writes a Chrome trace (open in ui.perfetto.dev) to this path and prints a summary")
+        .default_value(std::string(""));
+
+    prog.add_argument("--max-memory")
+        .help("Refuse to build a lattice estimated to need more than this many GiB (default: the memory available now)")
+        .scan<'g', double>()
+        .default_value(0.0);
+
+    prog.add_argument("--force")
+        .help("Build even if the lattice is estimated not to fit in memory")
+        .default_value(false)
+        .implicit_value(true);
+
+    const std::string del_note = " (lattice indices; for some supercells these differ from those of versions before the closed-form SNF, so indices and d*= file names from older runs may select other cells)";
     std::array<std::vector<int>, 4> del_list;
     prog.add_argument("--d0")
-        .help("Specifies index of 0-forms to delete")
+        .help("Specifies index of 0-forms to delete" + del_note)
         .default_value<std::vector<int>>({})
         .append()
         .store_into(del_list[0]);
     prog.add_argument("--d1")
-        .help("Specifies index of 1-forms to delete")
+        .help("Specifies index of 1-forms to delete" + del_note)
         .default_value<std::vector<int>>({})
         .append()
         .store_into(del_list[1]);
     prog.add_argument("--d2")
-        .help("Specifies index of 2-forms to delete")
+        .help("Specifies index of 2-forms to delete" + del_note)
         .default_value<std::vector<int>>({})
         .append()
         .store_into(del_list[2]);
     prog.add_argument("--d3")
-        .help("Specifies index of 3-forms to delete")
+        .help("Specifies index of 3-forms to delete" + del_note)
         .default_value<std::vector<int>>({})
         .append()
         .store_into(del_list[3]);
@@ -210,6 +202,12 @@ int main (int argc, const char *argv[]) {
 
 
 
+    const auto trace_path = prog.get<string>("--trace");
+    if (!trace_path.empty()) {
+        if (!trace::compiled) cerr << "Warning: phase tracing was compiled out (enable-trace=false)" << endl;
+        trace::enable();
+    }
+
     std::filesystem::path outpath(prog.get<string>("outpath"));
     string Z1_s = prog.get<string>("Z1");
     string Z2_s = prog.get<string>("Z2");
@@ -224,6 +222,22 @@ int main (int argc, const char *argv[]) {
     const auto spec = PrimitiveSpecifiers::DiamondSpec(); // primitive diamond unit cell
     auto name = hash_parameters(Z1_s, Z2_s, Z3_s);
 
+    const auto est = estimate_memory<Lattice>(spec, supercell_spec);
+    const double max_gib = prog.get<double>("--max-memory");
+    const size_t limit = max_gib > 0 ? size_t(max_gib * (1<<30)) : available_memory();
+    std::cout << "Estimated memory:\n" << est;
+    if (est.total() > limit) {
+        cerr << "Lattice needs about " << est.total() / double(1<<30) << " GiB, more than the "
+            << limit / double(1<<30) << " GiB allowed" << endl;
+        if (!prog.get<bool>("--force")) {
+            cerr << "Use a smaller supercell, raise --max-memory or pass --force" << endl;
+            return 1;
+        }
+    } else if (est.total() > limit / 2) {
+        cerr << "Warning: lattice needs over half of the " << limit / double(1<<30)
+            << " GiB allowed" << endl;
+    }
+
     Lattice lat(spec, supercell_spec);
 
 
@@ -262,7 +276,28 @@ int main (int argc, const char *argv[]) {
     auto verbosity = prog.get<int>("--verbosity");
     lat.print_state(verbosity);
 
-    save(lat, outpath/(name+".lat.json"));
+    if (prog.get<string>("--format") == "latb") {
+        save_binary(lat, outpath/(name+".latb"));
+    } else if (prog.get<string>("--format") == "json-compact") {
+        JsonWriteOptions opts;
+        opts.schema = JsonSchema::Compact;
+        save(lat, outpath/(name+".lat.json"), opts);
+    } else if (prog.get<string>("--format") == "vtu") {
+        save_vtu(lat, outpath/(name+".vtu"));
+    } else if (prog.get<string>("--format") == "npz") {
+        save_npz(lat, outpath/(name+".npz"));
+    } else if (prog.get<string>("--format") == "operators") {
+        save_boundary_operators(lat, outpath/(name+".ops"));
+    } else {
+        save(lat, outpath/(name+".lat.json"));
+    }
+
+    if (!trace_path.empty()) {
+        if (!trace::save_chrome_trace(trace_path)) {
+            cerr << "Cannot write trace to " << trace_path << endl;
+        }
+        trace::write_summary(cout);
+    }
 
     return 0;
 }
@@ -1,7 +1,11 @@
 #include "cell_geometry.hpp"
 #include "basic_parser.hh"
 #include "chain.hpp"
+#include "binary_lattice_IO.hpp"
+#include "disorder_delta.hpp"
 #include "lattice_IO.hpp"
+#include "memory_usage.hpp"
+#include "phase_trace.hpp"
 #include "preset_cellspecs.hpp"
 #include <UnitCellSpecifier.hpp>
 #include <algorithm>
@@ -62,6 +66,10 @@ typedef Cell<3> Vol;
 int main (int argc, const char *argv[]) {
 	std::string Z1_s, Z2_s, Z3_s;
 	double cell_disorder[4];
+	std::string format;
+	std::string trace_path;
+	double max_memory_gb;
+	bool force;
 
     std::filesystem::path outpath;
 
@@ -74,6 +82,15 @@ int main (int argc, const char *argv[]) {
     args.declare_optional("cell1_disorder",cell_disorder+1, 0.);
     args.declare_optional("cell2_disorder",cell_disorder+2, 0.);
     args.declare_optional("cell3_disorder",cell_disorder+3, 0.);
+    // json (.lat.json), json-compact (index-based .lat.json), latb (native
+    // binary) or delta (removed cells only, against the pristine lattice)
+    args.declare_optional("format", &format, "json");
+    // if set, times the phases of the run and writes a Chrome trace here
+    args.declare_optional("trace", &trace_path, "");
+    // refuse lattices estimated to need more than this many GiB (0: the
+    // memory available now), unless force is set
+    args.declare_optional("max_memory_gb", &max_memory_gb, 0.);
+    args.declare_optional("force", &force, false);
 
 
     if (argc == 1){
@@ -85,6 +102,11 @@ int main (int argc, const char *argv[]) {
 
     args.assert_initialised();
 
+    if (!trace_path.empty()) {
+        if (!trace::compiled) std::cerr << "Warning: phase tracing was compiled out (enable-trace=false)" << std::endl;
+        trace::enable();
+    }
+
     // parse L1 L2 L3
     imat33_t supercell_spec;
     parse_supercell_spec(supercell_spec, Z1_s, Z2_s, Z3_s);
@@ -99,7 +121,24 @@ int main (int argc, const char *argv[]) {
     PeriodicLinkLattice<Cell<0>, Cell<1>> lat1(spec, supercell_spec);
     PeriodicPlaqLattice<Cell<0>, Cell<1>, Cell<2>> lat2(spec, supercell_spec);
     */
-    PeriodicVolLattice<Cell<0>, Cell<1>, Cell<2>, Cell<3>> lat(spec, supercell_spec);
+    typedef PeriodicVolLattice<Cell<0>, Cell<1>, Cell<2>, Cell<3>> Lattice;
+
+    const auto est = estimate_memory<Lattice>(spec, supercell_spec);
+    const size_t limit = max_memory_gb > 0 ? size_t(max_memory_gb * (1<<30)) : available_memory();
+    std::cout << "Estimated memory:\n" << est;
+    if (est.total() > limit) {
+        std::cerr << "Lattice needs about " << est.total() / double(1<<30) << " GiB, more than the "
+            << limit / double(1<<30) << " GiB allowed" << std::endl;
+        if (!force) {
+            std::cerr << "Use a smaller supercell, raise --max_memory_gb or pass --force=true" << std::endl;
+            return 1;
+        }
+    } else if (est.total() > limit / 2) {
+        std::cerr << "Warning: lattice needs over half of the " << limit / double(1<<30)
+            << " GiB allowed" << std::endl;
+    }
+
+    Lattice lat(spec, supercell_spec);
 
 
 
@@ -169,7 +208,24 @@ int main (int argc, const char *argv[]) {
     // debug
     lat.print_state(0);
 
-    save(lat, outpath/(name+".lat.json"));
+    if (format == "latb") {
+        save_binary(lat, outpath/(name+".latb"));
+    } else if (format == "delta") {
+        save_delta(make_delta(lat), outpath/(name+".latd"));
+    } else if (format == "json-compact") {
+        JsonWriteOptions opts;
+        opts.schema = JsonSchema::Compact;
+        save(lat, outpath/(name+".lat.json"), opts);
+    } else {
+        save(lat, outpath/(name+".lat.json"));
+    }
+
+    if (!trace_path.empty()) {
+        if (!trace::save_chrome_trace(trace_path)) {
+            std::cerr << "Cannot write trace to " << trace_path << std::endl;
+        }
+        trace::write_summary(std::cout);
+    }
 
     return 0;
 }
@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+#include <alloc_stats.hpp>
+#include <atomic>
+#include <cell_geometry.hpp>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <parallel.hpp>
+#include <preset_cellspecs.hpp>
+#include <ranges>
+#include <vector>
+
+using namespace CellGeometry;
+namespace as = CellGeometry::alloc_stats;
+
+typedef PeriodicVolLattice<Cell<0>,Cell<1>,Cell<2>,Cell<3>> PeriodicVolLattice_std;
+
+
+#ifndef LATLIB_ALLOC_STATS
+// Without alloc_stats the library leaves operator new alone; count here
+static std::atomic<uint64_t> news = 0;
+
+void* operator new(size_t n){
+	news.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(n ? n : 1)) return p;
+	throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+#endif
+
+// Heap allocations by this process so far
+static uint64_t allocations_so_far(){
+#ifdef LATLIB_ALLOC_STATS
+	uint64_t n = 0;
+	for (const auto& c : as::snapshot()) n += c.allocations;
+	return n;
+#else
+	return news.load(std::memory_order_relaxed);
+#endif
+}
+
+
+TEST(AllocStatsTest, ScopesNest){
+	EXPECT_EQ(as::current(), as::Subsystem::Other);
+	{
+		as::Scope a(as::Subsystem::Cells);
+		{
+			as::Scope b(as::Subsystem::IO);
+			if (as::enabled) {
+				EXPECT_EQ(as::current(), as::Subsystem::IO);
+			}
+		}
+		if (as::enabled) {
+			EXPECT_EQ(as::current(), as::Subsystem::Cells);
+		}
+	}
+	EXPECT_EQ(as::current(), as::Subsystem::Other);
+}
+
+
+TEST(AllocStatsTest, CountsByScope){
+	if (!as::enabled) GTEST_SKIP() << "built without LATLIB_ALLOC_STATS";
+	as::reset();
+	std::unique_ptr<std::vector<int>> v;
+	{
+		as::Scope scope(as::Subsystem::IO);
+		v = std::make_unique<std::vector<int>>(1000);
+	}
+	auto io = as::get(as::Subsystem::IO);
+	EXPECT_EQ(io.allocations, 2u);
+	EXPECT_EQ(io.bytes, sizeof(std::vector<int>) + 1000 * sizeof(int));
+	EXPECT_EQ(io.live_bytes, io.bytes);
+
+	// freed outside the scope, still charged to IO
+	v.reset();
+	io = as::get(as::Subsystem::IO);
+	EXPECT_EQ(io.frees, 2u);
+	EXPECT_EQ(io.live_bytes, 0u);
+	EXPECT_EQ(io.peak_live_bytes, io.bytes);
+
+	as::reset_peak();
+	EXPECT_EQ(as::get(as::Subsystem::IO).peak_live_bytes, 0u);
+}
+
+
+TEST(AllocStatsTest, LatticeConstruction){
+	if (!as::enabled) GTEST_SKIP() << "built without LATLIB_ALLOC_STATS";
+	as::reset();
+	PeriodicVolLattice_std lat(PrimitiveSpecifiers::DiamondSpec(),
+			imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2}));
+	const size_t n = lat.points.size() + lat.links.size() + lat.plaqs.size() + lat.vols.size();
+	EXPECT_EQ(as::get(as::Subsystem::Cells).allocations, n);
+	EXPECT_GT(as::get(as::Subsystem::Chains).allocations, 0u);
+	EXPECT_GT(as::get(as::Subsystem::IndexMaps).allocations, n / 2);
+
+	// erasing frees the cell against Cells, wherever it happens
+	const auto before = as::get(as::Subsystem::Cells);
+	lat.erase_point(lat.points.begin()->second);
+	const auto after = as::get(as::Subsystem::Cells);
+	EXPECT_GT(after.frees, before.frees);
+	EXPECT_LT(after.live_bytes, before.live_bytes);
+}
+
+
+TEST(AllocStatsTest, PoolWorkersInheritScope){
+	if (!as::enabled) GTEST_SKIP() << "built without LATLIB_ALLOC_STATS";
+	ThreadPool pool(4);
+	as::reset();
+	{
+		as::Scope scope(as::Subsystem::IO);
+		pool.parallel_for(64, 1, [](size_t, size_t, unsigned){
+			auto p = std::make_unique<std::vector<int>>(16);
+		});
+	}
+	// plus the pool's own bookkeeping for the job
+	EXPECT_GE(as::get(as::Subsystem::IO).allocations, 128u);
+	EXPECT_LE(as::get(as::Subsystem::IO).allocations, 130u);
+}
+
+
+// Walking cells and chains through the range views never touches the heap
+TEST(AllocStatsTest, RangeViewsAllocateNothing){
+	const PeriodicVolLattice_std lat(PrimitiveSpecifiers::DiamondSpec(),
+			imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2}));
+	size_t n = 0;
+	int total = 0;
+	auto pred = [](const Cell<0>& p){ return p.position[0] % 4 == 0; };
+
+	const uint64_t before = allocations_so_far();
+	for ([[maybe_unused]] const Cell<0>& p : lat.get_points() | std::views::filter(pred)) n++;
+	for (const Cell<1>& l : lat.get_links()){
+		for ([[maybe_unused]] const Cell<0>& p : lat.boundary_of(l)) n++;
+		for ([[maybe_unused]] const Cell<2>& q : lat.coboundary_of(l)) n++;
+		for (auto [p, m] : terms_view<Cell<0>>(l.boundary)) total += m;
+	}
+	for (const Cell<3>& v : lat.get_vols()){
+		for ([[maybe_unused]] const Cell<2>& q : cells_view<Cell<2>>(v.boundary)) n++;
+	}
+	const uint64_t after = allocations_so_far();
+
+	EXPECT_EQ(after, before);
+	EXPECT_GT(n, lat.links.size());
+	EXPECT_EQ(total, 0);
+}
@@ -602,3 +602,106 @@ TEST_F(PyroVolTest, VolRemoveWorks){
 		EXPECT_FALSE(i==2);
 	}
 }
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+/////// Neighbour tables  /////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+/// These check the cached CSR tables against the allocating get_neighbours
+
+
+TEST_F(PyroVolTest, NeighbourTableMatchesGetNeighbours){
+	PeriodicVolLattice_std lat(cell, 
+			imat33_t::from_cols({-3,3,3},{3,-3,3},{3,3,-3})
+			);
+	const auto& nbrs = neighbour_table<1, NeighbourRelation::Boundary>(lat);
+	ASSERT_EQ(nbrs.size(), lat.index_size(1));
+	for (const auto& [J, l] : lat.links){
+		auto expected = get_neighbours(l);
+		std::set<Cell<1>*> found;
+		for (auto J1 : nbrs[J]){
+			EXPECT_TRUE(found.insert(&nbrs.cell(J1)).second);
+		}
+		EXPECT_EQ(found, std::set<Cell<1>*>(expected.begin(), expected.end()));
+	}
+}
+
+
+TEST_F(PyroVolTest, CoNeighbourTableWeights){
+	PeriodicVolLattice_std lat(cell, 
+			imat33_t::from_cols({-3,3,3},{3,-3,3},{3,3,-3})
+			);
+	const auto& nbrs = neighbour_table<2, NeighbourRelation::Coboundary>(lat, true);
+	for (const auto& [J, p] : lat.plaqs){
+		auto row = nbrs[J];
+		auto w = nbrs.weights(J);
+		ASSERT_EQ(row.size(), w.size());
+		for (size_t i=0; i<row.size(); i++){
+			// weight is the incidence product summed over shared vols
+			int expected = 0;
+			for (const auto& [v, m] : p->coboundary){
+				auto it = v->boundary.find(&nbrs.cell(row[i]));
+				if (it != v->boundary.end()) expected += m * it->second;
+			}
+			EXPECT_EQ(w[i], expected);
+		}
+	}
+}
+
+
+TEST_F(PyroVolTest, NeighbourTablePatchedOnErase){
+	PeriodicVolLattice_std lat(cell, 
+			imat33_t::from_cols({-3,3,3},{3,-3,3},{3,3,-3})
+			);
+	const auto& nbrs = neighbour_table<1, NeighbourRelation::Boundary>(lat);
+	// warm the point table too, which must be rebuilt after a link erasure
+	neighbour_table<0, NeighbourRelation::Coboundary>(lat);
+
+	lat.erase_point(lat.points[0]);
+	lat.erase_link(lat.links[5]);
+
+	for (const auto& [J, l] : lat.links){
+		auto expected = get_neighbours(l);
+		EXPECT_EQ(nbrs[J].size(), expected.size());
+		for (auto J1 : nbrs[J]){
+			EXPECT_TRUE(lat.links.contains(J1));
+		}
+	}
+	EXPECT_EQ(nbrs[5].size(), 0);
+
+	const auto& pt_nbrs = neighbour_table<0, NeighbourRelation::Coboundary>(lat);
+	for (const auto& [J, p] : lat.points){
+		EXPECT_EQ(pt_nbrs[J].size(), get_coneighbours(p).size());
+	}
+}
+
+
+TEST_F(PyroVolTest, RangeViews){
+	const PeriodicVolLattice_std lat(cell, 
+			imat33_t::from_cols({-3,3,3},{3,-3,3},{3,3,-3})
+			);
+	size_t n = 0;
+	for ([[maybe_unused]] const Cell<1>& l : lat.get_links()) { n++; }
+	EXPECT_EQ(n, lat.links.size());
+
+	auto pred = [](const Cell<0>& p){ return p.position[0] % 4 == 0; };
+	size_t n_expected = 0;
+	for (const auto& [_, p] : lat.points){ if (pred(*p)) n_expected++; }
+	auto filtered = lat.get_points() | std::views::filter(pred);
+	EXPECT_EQ(std::ranges::distance(filtered), n_expected);
+
+	for (const Cell<1>& l : lat.get_links()){
+		for (const Cell<0>& p : lat.boundary_of(l)){
+			EXPECT_NE(p.coboundary.find(const_cast<Cell<1>*>(&l)), p.coboundary.end());
+		}
+		for (const Cell<2>& pl : lat.coboundary_of(l)){
+			EXPECT_NE(pl.boundary.find(const_cast<Cell<1>*>(&l)), pl.boundary.end());
+		}
+		int total = 0;
+		for (auto [p, m] : terms_view<Cell<0>>(l.boundary)){ total += m; }
+		EXPECT_EQ(total, 0);
+	}
+}
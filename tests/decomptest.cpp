@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <cell_geometry.hpp>
+#include <domain_decomposition.hpp>
+#include <preset_cellspecs.hpp>
+
+using namespace CellGeometry;
+
+typedef PeriodicVolLattice<Cell<0>,Cell<1>,Cell<2>,Cell<3>> PeriodicVolLattice_std;
+
+class DiamondDecompTest : public testing::Test {
+	protected:
+		DiamondDecompTest() :
+			lat(PrimitiveSpecifiers::DiamondSpec(),
+					imat33_t::from_cols({4,0,0},{0,4,0},{0,0,4}))
+		{}
+		PeriodicVolLattice_std lat;
+
+		template<int order>
+		idx_t idx_of(const GeometricObject* x) const {
+			if constexpr (order == 0) return lat.get_point_idx_at(x->position);
+			else if constexpr (order == 1) return lat.get_link_idx_at(x->position);
+			else if constexpr (order == 2) return lat.get_plaq_idx_at(x->position);
+			else return lat.get_vol_idx_at(x->position);
+		}
+
+		// every face and coface of an owned cell must be available locally
+		template<int order>
+		void check_ghosts_complete(const DomainDecomposition& dd){
+			for (int r=0; r<dd.num_ranks(); r++){
+				const auto& blk = dd.block(r);
+				for (idx_t J : blk.owned(order)){
+					const auto& c = *cells_of<order>(lat).at(J);
+					if constexpr (order > 0) {
+						for (const auto& [f, _] : c.boundary){
+							EXPECT_LT(blk.local_index(order-1, idx_of<order-1>(f)),
+									blk.local_size(order-1));
+						}
+					}
+					if constexpr (order < 3) {
+						for (const auto& [F, _] : c.coboundary){
+							EXPECT_LT(blk.local_index(order+1, idx_of<order+1>(F)),
+									blk.local_size(order+1));
+						}
+					}
+				}
+			}
+		}
+};
+
+
+TEST_F(DiamondDecompTest, OwnershipPartitionsLattice){
+	DomainDecomposition dd(lat, {2,2,2});
+	ASSERT_EQ(dd.num_ranks(), 8);
+	for (int order=0; order<4; order++){
+		std::vector<int> owner(lat.index_size(order), -1);
+		for (int r=0; r<dd.num_ranks(); r++){
+			const auto& blk = dd.block(r);
+			for (idx_t J : blk.owned(order)){
+				EXPECT_EQ(owner[J], -1);
+				owner[J] = r;
+				EXPECT_EQ(dd.owner_of_idx(J), r);
+			}
+			for (idx_t J : blk.ghosts(order)){
+				EXPECT_NE(dd.owner_of_idx(J), r);
+			}
+		}
+		for (int r : owner) EXPECT_NE(r, -1);
+	}
+}
+
+
+TEST_F(DiamondDecompTest, GhostsCoverNeighbours){
+	for (const auto& dd : {DomainDecomposition(lat, {2,2,2}),
+			DomainDecomposition::slabs(lat, 3, 0)}){
+		EXPECT_GT(dd.ghost_width()[0] + dd.ghost_width()[1] + dd.ghost_width()[2], 0);
+		check_ghosts_complete<0>(dd);
+		check_ghosts_complete<1>(dd);
+		check_ghosts_complete<2>(dd);
+		check_ghosts_complete<3>(dd);
+	}
+}
+
+
+TEST_F(DiamondDecompTest, HaloExchangeThreads){
+	DomainDecomposition dd(lat, {2,1,2});
+	run_ranks_as_threads(dd.num_ranks(), [&](HaloTransport& comm){
+		const auto& blk = dd.block(comm.rank());
+		for (int order=0; order<4; order++){
+			std::vector<int64_t> field(blk.local_size(order), -1);
+			for (size_t i=0; i<blk.n_owned[order]; i++){
+				field[i] = 3*blk.cells[order][i] + 1;
+			}
+			exchange_halo(dd, order, comm, std::span<int64_t>(field));
+			for (size_t i=0; i<field.size(); i++){
+				EXPECT_EQ(field[i], 3*blk.cells[order][i] + 1);
+			}
+		}
+	});
+}
+
+
+TEST_F(DiamondDecompTest, BadInputsThrow){
+	EXPECT_THROW(DomainDecomposition(lat, {5,1,1}), std::invalid_argument);
+	EXPECT_THROW(DomainDecomposition::slabs(lat, 2, 3), std::out_of_range);
+
+	// a failing rank must not leave the others waiting forever
+	EXPECT_THROW(run_ranks_as_threads(2, [](HaloTransport& comm){
+		if (comm.rank() == 0) throw std::runtime_error("rank 0 failed");
+		std::byte b;
+		comm.recv(0, 0, std::span<std::byte>(&b, 1));
+	}), std::runtime_error);
+}
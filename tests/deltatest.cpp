@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include <cell_geometry.hpp>
+#include <disorder_delta.hpp>
+#include <filesystem>
+#include "lattice_compare.hpp"
+#include <preset_cellspecs.hpp>
+#include <random>
+#include <sstream>
+
+using namespace CellGeometry;
+
+typedef PeriodicVolLattice<Cell<0>,Cell<1>,Cell<2>,Cell<3>> PeriodicVolLattice_std;
+
+const imat33_t supercell = imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2});
+
+class DiamondDeltaTest : public testing::Test {
+	protected:
+		DiamondDeltaTest() :
+			lat(PrimitiveSpecifiers::DiamondSpec(), supercell)
+		{
+			// a random dilution of every order, through erase_*
+			std::mt19937 gen(1234);
+			std::bernoulli_distribution coin(0.1);
+			dilute(lat.points, [&](Cell<0>* x){ lat.erase_point(x); }, gen, coin);
+			dilute(lat.links, [&](Cell<1>* x){ lat.erase_link(x); }, gen, coin);
+			dilute(lat.plaqs, [&](Cell<2>* x){ lat.erase_plaq(x); }, gen, coin);
+			dilute(lat.vols, [&](Cell<3>* x){ lat.erase_vol(x); }, gen, coin);
+		}
+		PeriodicVolLattice_std lat;
+
+		template<typename Map, typename Erase>
+		static void dilute(Map& cells, Erase&& erase, std::mt19937& gen,
+				std::bernoulli_distribution& coin)
+		{
+			std::vector<typename Map::mapped_type> to_delete;
+			for (const auto& [_, x] : cells){
+				if (coin(gen)) to_delete.push_back(x);
+			}
+			for (auto x : to_delete) erase(x);
+		}
+};
+
+
+TEST_F(DiamondDeltaTest, ApplyReproducesDilution){
+	auto d = make_delta(lat);
+	PeriodicVolLattice_std pristine(PrimitiveSpecifiers::DiamondSpec(), supercell);
+	EXPECT_EQ(d.parent, lattice_fingerprint(pristine));
+	for (int k=0; k<4; k++){
+		EXPECT_EQ(d.index_size[k], pristine.index_size(k));
+		EXPECT_TRUE(std::is_sorted(d.removed[k].begin(), d.removed[k].end()));
+	}
+	EXPECT_EQ(d.removed[0].size(), pristine.points.size() - lat.points.size());
+	EXPECT_EQ(d.removed[3].size(), pristine.vols.size() - lat.vols.size());
+
+	apply_delta(pristine, d);
+	expect_same_cells<0>(lat, pristine);
+	expect_same_cells<1>(lat, pristine);
+	expect_same_cells<2>(lat, pristine);
+	expect_same_cells<3>(lat, pristine);
+}
+
+
+TEST_F(DiamondDeltaTest, ApplyCascadesLikeErase){
+	// a delta naming only a point takes its links, plaqs and vols along
+	PeriodicVolLattice_std a(PrimitiveSpecifiers::DiamondSpec(), supercell);
+	PeriodicVolLattice_std b(PrimitiveSpecifiers::DiamondSpec(), supercell);
+	a.erase_point(a.points.at(5));
+	auto d = make_delta(b);
+	d.removed[0] = {5};
+	apply_delta(b, d);
+	expect_same_cells<0>(a, b);
+	expect_same_cells<1>(a, b);
+	expect_same_cells<2>(a, b);
+	expect_same_cells<3>(a, b);
+}
+
+
+TEST_F(DiamondDeltaTest, StreamRoundTrip){
+	auto sparse = make_delta(lat);
+	// nearly everything removed, so the bitmap is shorter
+	auto dense = sparse;
+	dense.removed[1].clear();
+	for (uint32_t J=0; J<dense.index_size[1]; J++) {
+		if (J % 7) dense.removed[1].push_back(J);
+	}
+
+	std::stringstream ss;
+	write_delta(ss, sparse);
+	write_delta(ss, dense);
+	const size_t n_bytes = ss.str().size();
+	EXPECT_LT(n_bytes, 2*sizeof(latd::Header) + (dense.index_size[1] + 7)/8 + 400);
+
+	DisorderDelta r;
+	ASSERT_TRUE(read_delta(ss, r));
+	EXPECT_EQ(r.parent, sparse.parent);
+	EXPECT_EQ(r.removed, sparse.removed);
+	EXPECT_EQ(r.index_size, sparse.index_size);
+	ASSERT_TRUE(read_delta(ss, r));
+	EXPECT_EQ(r.removed, dense.removed);
+	EXPECT_FALSE(read_delta(ss, r));
+
+	auto path = std::filesystem::temp_directory_path() / "latticelab_deltatest.latd";
+	ASSERT_TRUE(save_delta(sparse, path));
+	auto all = load_deltas(path);
+	ASSERT_EQ(all.size(), 1u);
+	EXPECT_EQ(all[0].removed, sparse.removed);
+	std::filesystem::remove(path);
+}
+
+
+TEST_F(DiamondDeltaTest, RejectsMismatches){
+	auto d = make_delta(lat);
+	PeriodicVolLattice_std other(PrimitiveSpecifiers::DiamondSpec(),
+			imat33_t::from_cols({2,0,0},{0,2,0},{0,0,2}));
+	EXPECT_THROW(apply_delta(other, d), std::invalid_argument);
+
+	std::stringstream ss;
+	write_delta(ss, d);
+	std::string bytes = ss.str();
+	std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+	DisorderDelta r;
+	EXPECT_THROW(read_delta(truncated, r), std::runtime_error);
+	bytes[0] = 'X';
+	std::stringstream bad(bytes);
+	EXPECT_THROW(read_delta(bad, r), std::runtime_error);
+}
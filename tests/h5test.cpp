@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include <cell_geometry.hpp>
+#include <filesystem>
+#include <h5_lattice_IO.hpp>
+#include <preset_cellspecs.hpp>
+
+using namespace CellGeometry;
+
+typedef PeriodicVolLattice<Cell<0>,Cell<1>,Cell<2>,Cell<3>> PeriodicVolLattice_std;
+
+class DiamondH5Test : public testing::Test {
+	protected:
+		DiamondH5Test() :
+			lat(PrimitiveSpecifiers::DiamondSpec(),
+					imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2})),
+			tmpdir(std::filesystem::temp_directory_path() / "latticelab_h5test")
+		{
+			std::filesystem::create_directories(tmpdir);
+			lat.erase_point(lat.points.at(3));
+			lat.erase_plaq(lat.plaqs.at(7));
+		}
+		~DiamondH5Test(){
+			std::filesystem::remove_all(tmpdir);
+		}
+		PeriodicVolLattice_std lat;
+		std::filesystem::path tmpdir;
+};
+
+
+TEST_F(DiamondH5Test, RoundTrip){
+	auto path = tmpdir / "out.h5";
+	H5WriteOptions opts;
+	opts.chunk_rows = 50; // several chunks per dataset
+	ASSERT_TRUE(save_h5(lat, path, opts));
+
+	H5LatticeReader f(path);
+	EXPECT_EQ(f.max_order(), 3);
+	EXPECT_EQ(f.size(), lat.size());
+	for (int i=0; i<3; i++){
+		for (int j=0; j<3; j++){
+			EXPECT_EQ(f.cell_vectors()(i,j), lat.cell_vectors(i,j));
+		}
+	}
+	EXPECT_EQ(f.num_cells(0), lat.points.size());
+	EXPECT_EQ(f.num_cells(1), lat.links.size());
+	EXPECT_EQ(f.num_cells(2), lat.plaqs.size());
+	EXPECT_EQ(f.num_cells(3), lat.vols.size());
+
+	// the whole boundary of the vols, checked against the lattice
+	auto idx = f.indices(3);
+	auto plaq_pos = f.positions(2);
+	auto d3 = f.boundary(3);
+	ASSERT_EQ(d3.rows(), idx.size());
+	for (size_t r=0; r<idx.size(); r++){
+		const auto& vol = *lat.vols.at(idx[r]);
+		ASSERT_EQ(d3.row_ptr[r+1] - d3.row_ptr[r], vol.boundary.size());
+		for (auto i=d3.row_ptr[r]; i<d3.row_ptr[r+1]; i++){
+			bool found = false;
+			for (const auto& [p, m] : vol.boundary){
+				if (p->position == plaq_pos[d3.col[i]]) {
+					EXPECT_EQ(m, d3.val[i]);
+					found = true;
+				}
+			}
+			EXPECT_TRUE(found);
+		}
+	}
+}
+
+
+TEST_F(DiamondH5Test, PartialReads){
+	auto path = tmpdir / "out.h5";
+	H5WriteOptions opts;
+	opts.chunk_rows = 16;
+	opts.compression = 0;
+	ASSERT_TRUE(save_h5(lat, path, opts));
+	H5LatticeReader f(path);
+
+	auto all_pos = f.positions(1);
+	auto all_d1 = f.boundary(1);
+	const size_t begin = 37, count = 20;
+	auto pos = f.positions(1, begin, count);
+	auto d1 = f.boundary(1, begin, count);
+	ASSERT_EQ(pos.size(), count);
+	ASSERT_EQ(d1.rows(), count);
+	EXPECT_EQ(d1.row_ptr[0], 0u);
+	for (size_t r=0; r<count; r++){
+		EXPECT_EQ(pos[r], all_pos[begin + r]);
+		for (auto i=d1.row_ptr[r]; i<d1.row_ptr[r+1]; i++){
+			auto i_all = all_d1.row_ptr[begin + r] + (i - d1.row_ptr[r]);
+			EXPECT_EQ(d1.col[i], all_d1.col[i_all]);
+			EXPECT_EQ(d1.val[i], all_d1.val[i_all]);
+		}
+	}
+
+	// ranges are clipped at the end, and rejected past it
+	EXPECT_EQ(f.indices(1, f.num_cells(1) - 3).size(), 3u);
+	EXPECT_THROW(f.positions(1, f.num_cells(1) + 1), std::out_of_range);
+	EXPECT_THROW(f.boundary(0), std::out_of_range);
+	EXPECT_THROW(H5LatticeReader(tmpdir / "missing.h5"), std::runtime_error);
+}
@@ -0,0 +1,488 @@
+#include <gtest/gtest.h>
+#include <binary_lattice_IO.hpp>
+#include <cell_geometry.hpp>
+#include <filesystem>
+#include <fstream>
+#include "lattice_compare.hpp"
+#include <lattice_IO.hpp>
+#include <map>
+#include <npy_IO.hpp>
+#include <preset_cellspecs.hpp>
+#include <sparse_export.hpp>
+#include <vtk_export.hpp>
+
+using namespace CellGeometry;
+
+typedef PeriodicVolLattice<Cell<0>,Cell<1>,Cell<2>,Cell<3>> PeriodicVolLattice_std;
+
+class DiamondIOTest : public testing::Test {
+	protected:
+		DiamondIOTest() :
+			lat(PrimitiveSpecifiers::DiamondSpec(),
+					imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2})),
+			tmpdir(std::filesystem::temp_directory_path() / "latticelab_iotest")
+		{
+			std::filesystem::create_directories(tmpdir);
+			// dilute a little, so that rows and lattice indices differ
+			lat.erase_point(lat.points.at(3));
+			lat.erase_link(lat.links.at(10));
+		}
+		~DiamondIOTest(){
+			std::filesystem::remove_all(tmpdir);
+		}
+		PeriodicVolLattice_std lat;
+		std::filesystem::path tmpdir;
+
+		// checks the CSR of `order` against the cells' (co)boundaries
+		template<int order, typename ChainOf>
+		void check_incidence(const MappedLattice& m, const CSRView& csr,
+				int target_order, ChainOf&& chain_of)
+		{
+			auto idx = m.indices(order);
+			auto target_pos = m.positions(target_order);
+			ASSERT_EQ(csr.rows(), idx.size());
+			for (size_t r=0; r<idx.size(); r++){
+				const auto& chain = chain_of(*cells_of<order>(lat).at(idx[r]));
+				ASSERT_EQ(csr.cols(r).size(), chain.size());
+				for (size_t i=0; i<chain.size(); i++){
+					const ipos_t& x = target_pos[csr.cols(r)[i]];
+					bool found = false;
+					for (const auto& [c, mult] : chain){
+						if (c->position == x) {
+							EXPECT_EQ(mult, csr.vals(r)[i]);
+							found = true;
+						}
+					}
+					EXPECT_TRUE(found);
+				}
+			}
+		}
+};
+
+
+TEST_F(DiamondIOTest, BinaryRoundTrip){
+	auto path = tmpdir / "out.latb";
+	ASSERT_TRUE(save_binary(lat, path));
+	MappedLattice m(path, true);
+
+	EXPECT_EQ(m.max_order(), 3);
+	for (int i=0; i<3; i++){
+		for (int j=0; j<3; j++){
+			EXPECT_EQ(m.cell_vectors()(i,j), lat.cell_vectors(i,j));
+		}
+	}
+	EXPECT_EQ(m.size(), lat.size());
+	EXPECT_EQ(m.spec_cells().size(), size_t(lat.primitive_spec.num_point_sl()
+			+ lat.primitive_spec.num_link_sl() + lat.primitive_spec.num_plaq_sl()
+			+ lat.primitive_spec.num_vol_sl()));
+
+	EXPECT_EQ(m.num_cells(0), lat.points.size());
+	EXPECT_EQ(m.num_cells(1), lat.links.size());
+	EXPECT_EQ(m.num_cells(2), lat.plaqs.size());
+	EXPECT_EQ(m.num_cells(3), lat.vols.size());
+
+	for (const auto& [J, l] : lat.links){
+		size_t r = m.row_of(1, J);
+		ASSERT_NE(r, MappedLattice::npos);
+		EXPECT_EQ(m.positions(1)[r], l->position);
+	}
+	EXPECT_EQ(m.row_of(0, 3), MappedLattice::npos);
+
+	auto bdry = [](const auto& c) -> const auto& { return c.boundary; };
+	auto cobdry = [](const auto& c) -> const auto& { return c.coboundary; };
+	check_incidence<1>(m, m.boundary(1), 0, bdry);
+	check_incidence<2>(m, m.boundary(2), 1, bdry);
+	check_incidence<3>(m, m.boundary(3), 2, bdry);
+	check_incidence<0>(m, m.coboundary(0), 1, cobdry);
+	check_incidence<1>(m, m.coboundary(1), 2, cobdry);
+	check_incidence<2>(m, m.coboundary(2), 3, cobdry);
+	EXPECT_EQ(m.boundary(0).nnz(), 0u);
+	EXPECT_EQ(m.coboundary(3).nnz(), 0u);
+}
+
+
+TEST_F(DiamondIOTest, BinaryRejectsBadFiles){
+	auto path = tmpdir / "bad.latb";
+	{
+		std::ofstream of(path, std::ios::binary);
+		of << "this is not a lattice";
+	}
+	EXPECT_THROW(MappedLattice m(path), std::runtime_error);
+	EXPECT_THROW(MappedLattice m(tmpdir / "missing.latb"), std::runtime_error);
+
+	// truncating a valid file breaks the section table
+	ASSERT_TRUE(save_binary(lat, path));
+	std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+	EXPECT_THROW(MappedLattice m(path), std::runtime_error);
+}
+
+
+TEST_F(DiamondIOTest, StreamingJsonMatchesDOM){
+	nlohmann::json j;
+	write_data(lat, j);
+	std::stringstream dom, streamed;
+	dom << j;
+	write_json(lat, JsonSink(streamed));
+	EXPECT_EQ(streamed.str(), dom.str());
+
+	// a tiny buffer forces many partial writes
+	JsonWriteOptions opts;
+	opts.buffer_size = 7;
+	std::stringstream small;
+	write_json(lat, JsonSink(small), opts);
+	EXPECT_EQ(small.str(), dom.str());
+}
+
+
+TEST_F(DiamondIOTest, ThreadedJsonSameCells){
+	nlohmann::json j;
+	write_data(lat, j);
+
+	JsonWriteOptions opts;
+	opts.n_threads = 4;
+	opts.grain = 3;
+	auto path = tmpdir / "threaded.lat.json";
+	ASSERT_TRUE(save(lat, path, opts));
+	std::ifstream is(path);
+	auto k = nlohmann::json::parse(is);
+
+	// cell order differs, the cells do not
+	for (const char* key : {"points", "links", "plaqs", "vols"}){
+		auto a = j[key].get<std::vector<nlohmann::json>>();
+		auto b = k[key].get<std::vector<nlohmann::json>>();
+		std::sort(a.begin(), a.end());
+		std::sort(b.begin(), b.end());
+		EXPECT_EQ(a, b) << key;
+	}
+	EXPECT_EQ(j["cell_vectors"], k["cell_vectors"]);
+}
+
+
+TEST_F(DiamondIOTest, JsonLoadRoundTrip){
+	auto path = tmpdir / "out.lat.json";
+	ASSERT_TRUE(save(lat, path));
+	auto loaded = load(path);
+
+	for (int i=0; i<3; i++){
+		for (int j=0; j<3; j++){
+			EXPECT_EQ(loaded->cell_vectors(i,j), lat.cell_vectors(i,j));
+		}
+	}
+	EXPECT_EQ(loaded->num_primitive, lat.num_primitive);
+	for (int k=0; k<4; k++){
+		EXPECT_EQ(loaded->primitive_spec.num_sl(k), lat.primitive_spec.num_sl(k));
+	}
+	expect_same_cells<0>(lat, *loaded);
+	expect_same_cells<1>(lat, *loaded);
+	expect_same_cells<2>(lat, *loaded);
+	expect_same_cells<3>(lat, *loaded);
+
+	// a pristine lattice, through the string overload
+	PeriodicVolLattice_std pristine(PrimitiveSpecifiers::DiamondSpec(),
+			imat33_t::from_cols({2,0,0},{0,1,0},{0,1,3}));
+	std::stringstream ss;
+	write_json(pristine, JsonSink(ss));
+	auto reloaded = read_json(ss.str());
+	expect_same_cells<0>(pristine, *reloaded);
+	expect_same_cells<1>(pristine, *reloaded);
+	expect_same_cells<2>(pristine, *reloaded);
+	expect_same_cells<3>(pristine, *reloaded);
+}
+
+
+TEST_F(DiamondIOTest, JsonLoadRejectsBadFiles){
+	EXPECT_THROW(load(tmpdir / "missing.lat.json"), std::runtime_error);
+
+	std::stringstream ss;
+	write_json(lat, JsonSink(ss));
+	const std::string text = ss.str();
+	EXPECT_THROW(read_json(std::string_view(text).substr(0, text.size() / 2)),
+			std::runtime_error);
+
+	// a boundary term pointing at a cell that is not in the file
+	nlohmann::json j;
+	write_data(lat, j);
+	j["points"].erase(0);
+	EXPECT_THROW(read_json(j.dump()), std::runtime_error);
+
+	j = nlohmann::json();
+	write_data(lat, j);
+	j["links"][0]["pos"] = {1, 2};
+	EXPECT_THROW(read_json(j.dump()), std::runtime_error);
+}
+
+
+TEST_F(DiamondIOTest, CompactJsonRoundTrip){
+	JsonWriteOptions opts;
+	opts.schema = JsonSchema::Compact;
+	std::stringstream full, compact;
+	write_json(lat, JsonSink(full));
+	write_json(lat, JsonSink(compact), opts);
+	EXPECT_LT(compact.str().size(), full.str().size() / 2);
+
+	auto j = nlohmann::json::parse(compact.str());
+	EXPECT_EQ(j["format"], "lat.json/compact");
+	EXPECT_EQ(j["links"]["index"].size(), lat.links.size());
+	EXPECT_EQ(j["links"]["pos"].size(), 3 * lat.links.size());
+	EXPECT_EQ(j["links"]["boundary_ptr"].size(), lat.links.size() + 1);
+	EXPECT_TRUE(std::is_sorted(j["vols"]["index"].begin(), j["vols"]["index"].end()));
+
+	auto loaded = read_json(compact.str());
+	expect_same_cells<0>(lat, *loaded);
+	expect_same_cells<1>(lat, *loaded);
+	expect_same_cells<2>(lat, *loaded);
+	expect_same_cells<3>(lat, *loaded);
+
+	// coboundaries are rebuilt when left out
+	opts.coboundaries = false;
+	std::stringstream slim;
+	write_json(lat, JsonSink(slim), opts);
+	EXPECT_LT(slim.str().size(), compact.str().size());
+	EXPECT_FALSE(nlohmann::json::parse(slim.str())["points"].contains("coboundary"));
+	loaded = read_json(slim.str());
+	expect_same_cells<0>(lat, *loaded);
+	expect_same_cells<1>(lat, *loaded);
+	expect_same_cells<2>(lat, *loaded);
+	expect_same_cells<3>(lat, *loaded);
+
+	j["plaqs"]["boundary_ptr"].back() = 0;
+	EXPECT_THROW(read_json(j.dump()), std::runtime_error);
+}
+
+
+TEST_F(DiamondIOTest, VTKGridUnwrapsCells){
+	std::vector<double> weight(lat.index_size(1));
+	for (size_t J=0; J<weight.size(); J++) weight[J] = J;
+	VTKExportOptions opts;
+	opts.cell_data.push_back({"weight", 1, weight});
+	auto g = build_vtk_grid(lat, opts);
+
+	const size_t n_cells = lat.points.size() + lat.links.size()
+		+ lat.plaqs.size() + lat.vols.size();
+	ASSERT_EQ(g.types.size(), n_cells);
+	ASSERT_EQ(g.offsets.size(), n_cells);
+	ASSERT_EQ(g.faceoffsets.size(), n_cells);
+	ASSERT_EQ(g.data.at(0).size(), n_cells);
+	EXPECT_GE(g.points.size(), 3 * lat.points.size());
+
+	auto dist2 = [&](int64_t a, int64_t b){
+		double s = 0;
+		for (int i=0; i<3; i++) {
+			const double d = g.points[3*a+i] - g.points[3*b+i];
+			s += d*d;
+		}
+		return s;
+	};
+
+	int64_t begin = 0, face_begin = 0;
+	for (size_t c=0; c<n_cells; c++){
+		const int64_t end = g.offsets[c];
+		const auto* v = g.connectivity.data();
+		switch (g.types[c]) {
+			case vtk::VERTEX:
+				EXPECT_EQ(end - begin, 1);
+				break;
+			case vtk::LINE:
+				// no link may stretch across the supercell
+				ASSERT_EQ(end - begin, 2);
+				EXPECT_EQ(dist2(v[begin], v[begin+1]), 12);
+				EXPECT_EQ(g.data[0][c], g.index[c]);
+				break;
+			case vtk::POLYGON:
+				ASSERT_EQ(end - begin, 6);
+				for (int64_t k=begin; k<end; k++){
+					EXPECT_EQ(dist2(v[k], v[k+1 < end ? k+1 : begin]), 12);
+				}
+				break;
+			case vtk::POLYHEDRON: {
+				const int64_t* f = g.faces.data() + face_begin;
+				ASSERT_EQ(f[0], 4);
+				int64_t k = 1;
+				for (int face=0; face<4; face++){
+					ASSERT_EQ(f[k], 6);
+					for (int64_t i=1; i<=6; i++){
+						EXPECT_EQ(dist2(f[k+i], f[k + (i%6) + 1]), 12);
+						EXPECT_TRUE(std::find(v+begin, v+end, f[k+i]) != v+end);
+					}
+					k += 7;
+				}
+				ASSERT_EQ(face_begin + k, g.faceoffsets[c]);
+				face_begin = g.faceoffsets[c];
+				break;
+			}
+			default:
+				ADD_FAILURE() << "unexpected cell type";
+		}
+		if (g.types[c] != vtk::LINE) {
+			EXPECT_TRUE(std::isnan(g.data[0][c]));
+		}
+		begin = end;
+	}
+}
+
+
+TEST_F(DiamondIOTest, VTUFile){
+	auto path = tmpdir / "out.vtu";
+	ASSERT_TRUE(save_vtu(lat, path));
+	std::ifstream is(path, std::ios::binary);
+	std::string head(512, '\0');
+	is.read(head.data(), head.size());
+	const size_t n_cells = lat.points.size() + lat.links.size()
+		+ lat.plaqs.size() + lat.vols.size();
+	EXPECT_NE(head.find("NumberOfCells=\"" + std::to_string(n_cells) + "\""), std::string::npos);
+
+	VTKExportOptions opts;
+	opts.orders = {false, true, false, false};
+	EXPECT_EQ(build_vtk_grid(lat, opts).types.size(), lat.links.size());
+	std::vector<double> too_short(lat.index_size(2) - 1);
+	opts.cell_data.push_back({"short", 2, too_short});
+	EXPECT_THROW(save_vtu(lat, path, opts), std::invalid_argument);
+}
+
+
+TEST_F(DiamondIOTest, BoundaryOperatorsCompose){
+	ParallelOptions popts;
+	popts.grain = 3;
+	auto ops = boundary_operators(lat, popts);
+	ASSERT_EQ(ops.max_order, 3);
+	for (int k=1; k<=3; k++){
+		ASSERT_EQ(ops.d[k].rows(), ops.num_cells(k-1));
+		// columns are k-cells, entries match their boundaries
+		for (size_t r=0; r<ops.d[k].rows(); r++){
+			for (uint32_t e=ops.d[k].row_ptr[r]; e<ops.d[k].row_ptr[r+1]; e++){
+				ASSERT_LT(ops.d[k].col[e], ops.num_cells(k));
+			}
+		}
+	}
+	for (size_t c=0; c<ops.num_cells(1); c++){
+		auto* l = lat.links.at(ops.rows[1].index[c]);
+		int n = 0;
+		for (size_t r=0; r<ops.num_cells(0); r++){
+			for (uint32_t e=ops.d[1].row_ptr[r]; e<ops.d[1].row_ptr[r+1]; e++){
+				if (ops.d[1].col[e] != c) continue;
+				auto* p = lat.points.at(ops.rows[0].index[r]);
+				EXPECT_EQ(l->boundary.at(p), ops.d[1].val[e]);
+				n++;
+			}
+		}
+		EXPECT_EQ(n, 2);
+	}
+
+	// d_k d_{k+1} = 0
+	for (int k=1; k<3; k++){
+		const auto& a = ops.d[k];
+		const auto& b = ops.d[k+1];
+		for (size_t r=0; r<a.rows(); r++){
+			std::map<uint32_t, int> prod;
+			for (uint32_t e=a.row_ptr[r]; e<a.row_ptr[r+1]; e++){
+				for (uint32_t f=b.row_ptr[a.col[e]]; f<b.row_ptr[a.col[e]+1]; f++){
+					prod[b.col[f]] += a.val[e] * b.val[f];
+				}
+			}
+			for (const auto& [c, x] : prod) EXPECT_EQ(x, 0) << "d" << k << "d" << k+1;
+		}
+	}
+}
+
+
+TEST_F(DiamondIOTest, BoundaryOperatorFiles){
+	auto dir = tmpdir / "ops";
+	ASSERT_TRUE(save_boundary_operators(lat, dir));
+	auto ops = boundary_operators(lat);
+	for (int k=1; k<=3; k++){
+		const std::string name = "d" + std::to_string(k);
+		EXPECT_EQ(std::filesystem::file_size(dir / (name + ".indices")),
+				ops.d[k].nnz() * sizeof(uint32_t));
+		EXPECT_EQ(std::filesystem::file_size(dir / (name + ".indptr")),
+				(ops.num_cells(k-1) + 1) * sizeof(uint32_t));
+
+		std::ifstream is(dir / (name + ".mtx"));
+		std::string line;
+		std::getline(is, line);
+		EXPECT_EQ(line, "%%MatrixMarket matrix coordinate integer general");
+		while (is.peek() == '%') std::getline(is, line);
+		size_t m, n, nnz;
+		is >> m >> n >> nnz;
+		EXPECT_EQ(m, ops.num_cells(k-1));
+		EXPECT_EQ(n, ops.num_cells(k));
+		ASSERT_EQ(nnz, ops.d[k].nnz());
+		size_t r = 0;
+		for (size_t e=0; e<nnz; e++){
+			size_t i, j;
+			int v;
+			ASSERT_TRUE(is >> i >> j >> v);
+			while (ops.d[k].row_ptr[r+1] <= e) r++;
+			EXPECT_EQ(i, r + 1);
+			EXPECT_EQ(j, ops.d[k].col[e] + 1);
+			EXPECT_EQ(v, ops.d[k].val[e]);
+		}
+	}
+	EXPECT_TRUE(std::filesystem::exists(dir / "operators.json"));
+	auto j = nlohmann::json::parse(std::ifstream(dir / "operators.json"));
+	EXPECT_EQ(j["operators"][1]["shape"][0], lat.links.size());
+	EXPECT_EQ(j["cells"][3]["count"], lat.vols.size());
+}
+
+
+TEST(NpyTest, Header){
+	std::vector<int64_t> x = {1, 2, 3, 4, 5, 6};
+	auto a = npy::array("x", x.data(), {2, 3});
+	ASSERT_EQ(a.header.size() % 64, 0u);
+	EXPECT_EQ(a.header.substr(0, 8), std::string("\x93NUMPY\x01\x00", 8));
+	EXPECT_EQ(uint8_t(a.header[8]) + 256 * uint8_t(a.header[9]), a.header.size() - 10);
+	EXPECT_EQ(a.header.back(), '\n');
+	EXPECT_NE(a.header.find("{'descr': '<i8', 'fortran_order': False, 'shape': (2, 3), }"),
+			std::string::npos);
+	EXPECT_EQ(a.bytes, 6 * sizeof(int64_t));
+	EXPECT_NE(npy::array("y", std::vector<uint32_t>(4)).header.find("'<u4'"), std::string::npos);
+	EXPECT_NE(npy::array("y", std::vector<uint32_t>(4)).header.find("(4,)"), std::string::npos);
+	EXPECT_EQ(npy::crc32("123456789", 9), 0xcbf43926u);
+}
+
+
+TEST_F(DiamondIOTest, NpzMembers){
+	std::vector<double> weight(lat.index_size(2));
+	for (size_t J=0; J<weight.size(); J++) weight[J] = 0.5 * J;
+	NpyExportOptions opts;
+	opts.cell_data.push_back({"weight", 2, weight});
+	auto path = tmpdir / "out.npz";
+	ASSERT_TRUE(save_npz(lat, path, opts));
+
+	NpyLatticeArrays a;
+	collect_npy_arrays(lat, a, opts);
+	std::ifstream is(path, std::ios::binary);
+	std::string zip((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+	auto u16 = [&](size_t at){ return uint8_t(zip[at]) | uint8_t(zip[at+1]) << 8; };
+	auto u32 = [&](size_t at){ return uint32_t(u16(at)) | uint32_t(u16(at+2)) << 16; };
+
+	// walk the local headers, checking each member's contents
+	size_t at = 0;
+	for (const auto& x : a.arrays){
+		ASSERT_EQ(u32(at), 0x04034b50u);
+		const size_t size = u32(at + 18), name_len = u16(at + 26);
+		EXPECT_EQ(zip.substr(at + 30, name_len), x.name + ".npy");
+		ASSERT_EQ(size, x.header.size() + x.bytes);
+		const char* body = zip.data() + at + 30 + name_len;
+		EXPECT_EQ(u32(at + 14), npy::crc32(body, size));
+		EXPECT_EQ(std::string(body, x.header.size()), x.header);
+		EXPECT_EQ(std::memcmp(body + x.header.size(), x.data, x.bytes), 0);
+		at += 30 + name_len + size;
+	}
+	EXPECT_EQ(u32(at), 0x02014b50u);
+	const size_t end = zip.size() - 22;
+	EXPECT_EQ(u32(end), 0x06054b50u);
+	EXPECT_EQ(u16(end + 10), a.arrays.size());
+	EXPECT_EQ(u32(end + 16), at);
+
+	// the user array follows the rows of its order
+	const auto& w = a.cell_data.at(0);
+	ASSERT_EQ(w.size(), lat.plaqs.size());
+	for (size_t r=0; r<w.size(); r++) EXPECT_EQ(w[r], 0.5 * a.ops.rows[2].index[r]);
+
+	auto dir = tmpdir / "npy";
+	ASSERT_TRUE(save_npy_dir(lat, dir, opts));
+	EXPECT_EQ(std::filesystem::file_size(dir / "pos1.npy"),
+			npy::header("<i8", {lat.links.size(), 3}).size()
+			+ 3 * sizeof(int64_t) * lat.links.size());
+	EXPECT_TRUE(std::filesystem::exists(dir / "weight.npy"));
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <array>
+#include <cell_geometry.hpp>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Checks shared by the tests that compare two lattices built on the same
+ * unit cell and supercell.
+ */
+
+// every cell of a at the same position (hence lattice index) in b, with the
+// same (co)boundary
+template<int order, typename Lattice>
+void expect_same_cells(const Lattice& a, const Lattice& b){
+	using namespace CellGeometry;
+	const auto& ca = cells_of<order>(a);
+	const auto& cb = cells_of<order>(b);
+	ASSERT_EQ(ca.size(), cb.size()) << "order " << order;
+	auto terms = [](const auto& chain){
+		std::vector<std::pair<std::array<int64_t,3>, int>> t;
+		for (const auto& [c, m] : chain){
+			t.push_back({{c->position[0], c->position[1], c->position[2]}, m});
+		}
+		std::sort(t.begin(), t.end());
+		return t;
+	};
+	for (const auto& [_, x] : ca){
+		auto it = cb.find(cell_idx_at<order>(b, x->position));
+		ASSERT_NE(it, cb.end()) << "order " << order;
+		const auto& y = *it->second;
+		EXPECT_EQ(y.position, x->position);
+		if constexpr (order > 0) { EXPECT_EQ(terms(y.boundary), terms(x->boundary)); }
+		if constexpr (order < max_order_of<Lattice>()) {
+			EXPECT_EQ(terms(y.coboundary), terms(x->coboundary));
+		}
+	}
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include <alloc_stats.hpp>
+#include <cell_geometry.hpp>
+#include <memory_usage.hpp>
+#include <preset_cellspecs.hpp>
+
+using namespace CellGeometry;
+
+typedef PeriodicVolLattice<Cell<0>,Cell<1>,Cell<2>,Cell<3>> PeriodicVolLattice_std;
+typedef PeriodicLinkLattice<Cell<0>,Cell<1>> PeriodicLinkLattice_std;
+
+struct Link : public Cell<1> {
+	double field[4];
+};
+typedef PeriodicVolLattice<Cell<0>,Link,Cell<2>,Cell<3>> FieldLattice;
+
+
+static void expect_close(size_t estimate, size_t actual, double rtol, const char* what){
+	EXPECT_NEAR(double(estimate), double(actual), rtol * double(actual)) << what;
+}
+
+// The map's buckets are the only part estimated; on small lattices they are
+// a larger share of the total, so allow more slack there
+template<typename Lattice>
+void check_estimate(const UnitCellSpecifier& spec, const imat33_t& supercell,
+		double rtol=0.05){
+	const auto est = estimate_memory<Lattice>(spec, supercell);
+	Lattice lat(spec, supercell);
+	const auto m = memory_usage(lat);
+	ASSERT_EQ(est.max_order, m.max_order);
+	for (int k=0; k<=m.max_order; k++){
+		const auto& e = est.by_order[k];
+		const auto& a = m.by_order[k];
+		EXPECT_EQ(e.num_cells, a.num_cells) << "order " << k;
+		EXPECT_EQ(e.positions, a.positions) << "order " << k;
+		EXPECT_EQ(e.cells, a.cells) << "order " << k;
+		EXPECT_EQ(e.chains, a.chains) << "order " << k;
+	}
+	expect_close(est.index_maps(), m.index_maps(), 4*rtol, "index maps");
+	expect_close(est.total(), m.total(), rtol, "total");
+}
+
+
+TEST(MemoryTest, EstimateMatchesDiamond){
+	check_estimate<PeriodicVolLattice_std>(PrimitiveSpecifiers::DiamondSpec(),
+			imat33_t::from_cols({-4,4,4},{4,-4,4},{4,4,-4}));
+}
+
+TEST(MemoryTest, EstimateMatchesCubic){
+	check_estimate<PeriodicVolLattice_std>(PrimitiveSpecifiers::CubicSpec(),
+			imat33_t::from_cols({6,0,0},{0,8,0},{0,0,10}));
+}
+
+// The cell types and the orders present are those of the lattice type
+TEST(MemoryTest, EstimateFollowsCellTypes){
+	const auto spec = PrimitiveSpecifiers::DiamondSpec();
+	const auto Z = imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2});
+	check_estimate<PeriodicLinkLattice_std>(spec, Z, 0.1);
+	check_estimate<FieldLattice>(spec, Z, 0.1);
+	EXPECT_GT(estimate_memory<FieldLattice>(spec, Z).by_order[1].cells,
+			estimate_memory<PeriodicVolLattice_std>(spec, Z).by_order[1].cells);
+	EXPECT_EQ(estimate_memory<PeriodicLinkLattice_std>(spec, Z).by_order[2].num_cells, 0u);
+	EXPECT_THROW(estimate_memory(spec, imat33_t::from_cols({1,0,0},{1,0,0},{0,0,1})),
+			std::invalid_argument);
+}
+
+
+TEST(MemoryTest, ErasureShrinks){
+	PeriodicVolLattice_std lat(PrimitiveSpecifiers::DiamondSpec(),
+			imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2}));
+	const auto before = memory_usage(lat);
+	lat.erase_point(lat.points.begin()->second);
+	const auto after = memory_usage(lat);
+	EXPECT_EQ(after.by_order[0].num_cells, before.by_order[0].num_cells - 1);
+	EXPECT_LT(after.by_order[1].num_cells, before.by_order[1].num_cells);
+	EXPECT_LT(after.positions(), before.positions());
+	EXPECT_LT(after.total(), before.total());
+}
+
+
+// Cross-check against the allocator, where it is counting
+TEST(MemoryTest, AgreesWithAllocStats){
+	namespace as = alloc_stats;
+	if (!as::enabled) GTEST_SKIP() << "built without LATLIB_ALLOC_STATS";
+	const auto before = as::snapshot();
+	auto lat = std::make_unique<PeriodicVolLattice_std>(PrimitiveSpecifiers::DiamondSpec(),
+			imat33_t::from_cols({-3,3,3},{3,-3,3},{3,3,-3}));
+	const auto after = as::snapshot();
+	size_t live = 0;
+	for (size_t i=0; i<as::num_subsystems; i++) live += after[i].live_bytes - before[i].live_bytes;
+	// alloc_stats counts requested bytes, memory_usage malloc's blocks
+	const auto m = memory_usage(*lat);
+	EXPECT_LT(double(live), double(m.total()));
+	EXPECT_GT(double(live), 0.5 * double(m.total()));
+}
@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include <cell_geometry.hpp>
+#include <lattice_nd.hpp>
+#include <normal_forms_nd.hpp>
+#include <preset_cellspecs.hpp>
+#include <map>
+#include <random>
+#include "snf_checks.hpp"
+#include <stdexcept>
+#include <type_traits>
+
+using namespace CellGeometry;
+using nd::ivec;
+using nd::imat;
+
+typedef PeriodicVolLattice<Cell<0>,Cell<1>,Cell<2>,Cell<3>> VolLattice;
+
+// d(boundary of c) vanishes on every cell of order 2 and up
+template<int k, typename Lattice>
+static void expect_boundary_of_boundary_vanishes(const Lattice& lat){
+	if constexpr (k >= 2) {
+		for (const auto& [_, x] : lat.template cells<k>()){
+			for (const auto& [y, m] : nd::d<Lattice::dim, k-1>(x->boundary)) EXPECT_EQ(m, 0);
+		}
+	}
+}
+
+template<int Dim, int K = Dim>
+static void expect_cell_counts(const nd::StandardLattice<Dim, K>& lat,
+		const std::array<size_t, K+1>& per_primitive){
+	for (int k=0; k<=K; k++) EXPECT_EQ(lat.index_size(k), per_primitive[k] * lat.num_primitive);
+	[&]<int... k>(std::integer_sequence<int, k...>){
+		(..., [&]{
+			EXPECT_EQ(lat.template cells<k>().size(), per_primitive[k] * lat.num_primitive);
+		}());
+		(..., expect_boundary_of_boundary_vanishes<k>(lat));
+	}(std::make_integer_sequence<int, K+1>{});
+}
+
+
+TEST(NDTest, DeterminantAndAdjugate){
+	std::mt19937 gen(50);
+	for (int n=0; n<200; n++){
+		const auto A = random_matrix<4>(gen, 6);
+		EXPECT_EQ(vectorn::adjugate(A) * A, vectorn::det(A) * imat<4>::identity());
+	}
+	const auto B = imat<2>::from_cols({{ {2, 1}, {1, 3} }});
+	EXPECT_EQ(vectorn::det(B), 5);
+	EXPECT_EQ(vectorn::adjugate(B), imat<2>::from_cols({{ {3, -1}, {-1, 2} }}));
+}
+
+TEST(NDTest, SmithNormalFormAnyDimension){
+	std::mt19937 gen(51);
+	for (int n=0; n<500; n++){
+		check_snf<2>(random_matrix<2>(gen, 20));
+		check_snf<4>(random_matrix<4>(gen, 5));
+	}
+	EXPECT_EQ(nd::smith_normal_form(imat<4>::diagonal({{6, 10, 15, 1}})).D, (ivec<4>{{1, 1, 30, 30}}));
+}
+
+// The 3D types are the Dim = 3 instantiations, and a PeriodicLattice<3>
+// indexes like PeriodicVolLattice
+TEST(NDTest, ThreeDimensionsIsThe3DAPI){
+	static_assert(std::is_same_v<Cell<2>, nd::Cell<3, 2>>);
+	static_assert(std::is_same_v<UnitCellSpecifier, nd::UnitCellSpecifier<3>>);
+	static_assert(std::is_same_v<ivec<3>, ipos_t>);
+	static_assert(std::is_base_of_v<nd::PeriodicAbstractLattice<3>, VolLattice>);
+
+	const auto spec = PrimitiveSpecifiers::DiamondSpec();
+	for (const auto& Z : {imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2}),
+			imat33_t::from_cols({3,1,0},{0,2,1},{1,0,2})}){
+		SCOPED_TRACE(::testing::Message() << "Z=\n" << Z);
+		VolLattice ref(spec, Z);
+		nd::StandardLattice<3> lat(spec, Z);
+		EXPECT_EQ(lat.size(), ref.size());
+
+		auto check = [&]<int k>(const auto& refmap){
+			const auto& cellmap = lat.template cells<k>();
+			ASSERT_EQ(cellmap.size(), refmap.size());
+			for (const auto& [J, x] : refmap){
+				ASSERT_TRUE(cellmap.contains(J));
+				const auto& y = cellmap.at(J);
+				EXPECT_EQ(y->position, x->position);
+				if constexpr (k > 0) {
+					std::map<sl_t, int> a, b;
+					for (const auto& [z, m] : x->boundary) a[cell_idx_at<k-1>(ref, z->position)] = m;
+					for (const auto& [z, m] : y->boundary) b[lat.template get_idx_at<k-1>(z->position)] = m;
+					EXPECT_EQ(a, b);
+				}
+			}
+		};
+		check.template operator()<0>(ref.points);
+		check.template operator()<1>(ref.links);
+		check.template operator()<2>(ref.plaqs);
+		check.template operator()<3>(ref.vols);
+	}
+}
+
+TEST(NDTest, HypercubicLinksAreCubicSpecs){
+	const auto cubic = PrimitiveSpecifiers::CubicSpec();
+	const auto hyper = nd::PrimitiveSpecifiers::HypercubicSpec<3>();
+	for (int i=0; i<9; i++) EXPECT_EQ(hyper.latvecs[i], cubic.latvecs[i]);
+	ASSERT_EQ(hyper.num_point_sl(), cubic.num_point_sl());
+	ASSERT_EQ(hyper.num_link_sl(), cubic.num_link_sl());
+	EXPECT_EQ(hyper.point_no(0).position, cubic.point_no(0).position);
+	for (sl_t sl=0; sl<cubic.num_link_sl(); sl++){
+		const auto& a = hyper.link_no(sl);
+		const auto& b = cubic.link_no(sl);
+		EXPECT_EQ(a.position, b.position);
+		ASSERT_EQ(a.boundary.size(), b.boundary.size());
+		for (size_t i=0; i<a.boundary.size(); i++){
+			EXPECT_EQ(a.boundary[i].multiplier, b.boundary[i].multiplier);
+			EXPECT_EQ(a.boundary[i].relative_position, b.boundary[i].relative_position);
+		}
+	}
+}
+
+TEST(NDTest, SquareAndKagome){
+	nd::StandardLattice<2> sq(nd::PrimitiveSpecifiers::HypercubicSpec<2>(),
+			imat<2>::from_cols({{ {4, 0}, {0, 3} }}));
+	expect_cell_counts<2>(sq, {1, 2, 1});
+	for (const auto& [_, p] : sq.cells<0>()) EXPECT_EQ(p->coboundary.size(), 4u);
+
+	// a skewed supercell
+	nd::StandardLattice<2> kag(nd::PrimitiveSpecifiers::KagomeSpec(),
+			imat<2>::from_cols({{ {3, 1}, {-1, 2} }}));
+	EXPECT_EQ(kag.num_primitive, 7);
+	expect_cell_counts<2>(kag, {3, 6, 3});
+	for (const auto& [_, p] : kag.cells<0>()) EXPECT_EQ(p->coboundary.size(), 4u);
+	for (const auto& [_, l] : kag.cells<1>()) EXPECT_EQ(l->coboundary.size(), 2u);
+	std::map<size_t, int> plaq_sizes;
+	for (const auto& [_, q] : kag.cells<2>()) plaq_sizes[q->boundary.size()]++;
+	EXPECT_EQ(plaq_sizes, (std::map<size_t, int>{{3, 14}, {6, 7}}));
+}
+
+TEST(NDTest, FourDimensionalHypercubic){
+	nd::StandardLattice<4> lat(nd::PrimitiveSpecifiers::HypercubicSpec<4>(),
+			2 * imat<4>::identity());
+	EXPECT_EQ(lat.num_primitive, 16);
+	expect_cell_counts<4>(lat, {1, 4, 6, 4, 1});
+	// each link bounds 2(D-1) plaquettes, each plaquette 2(D-2) cubes
+	for (const auto& [_, l] : lat.cells<1>()) EXPECT_EQ(l->coboundary.size(), 6u);
+	for (const auto& [_, q] : lat.cells<2>()) EXPECT_EQ(q->coboundary.size(), 4u);
+
+	// links and plaquettes only
+	nd::StandardLattice<4, 2> gauge(nd::PrimitiveSpecifiers::HypercubicSpec<4>(),
+			3 * imat<4>::identity());
+	expect_cell_counts<4, 2>(gauge, {1, 4, 6});
+	auto& U = gauge.get_at<1>({{1, 0, 0, 0}});
+	EXPECT_EQ(U.position, (ivec<4>{{1, 0, 0, 0}}));
+	EXPECT_EQ(&gauge.get_at<1>({{7, 6, 0, -6}}), &U);
+	EXPECT_THROW(gauge.get_at<1>({{1, 1, 0, 0}}), std::out_of_range);
+}
+
+TEST(NDTest, EraseCascades){
+	nd::StandardLattice<2> sq(nd::PrimitiveSpecifiers::HypercubicSpec<2>(),
+			3 * imat<2>::identity());
+	auto& p = sq.get_at<0>({{0, 0}});
+	sq.erase<0>(&p);
+	EXPECT_EQ(sq.cells<0>().size(), 8u);
+	EXPECT_EQ(sq.cells<1>().size(), 14u);
+	EXPECT_EQ(sq.cells<2>().size(), 5u);
+	for (const auto& [_, l] : sq.cells<1>()) EXPECT_EQ(l->boundary.size(), 2u);
+}
+
+TEST(NDTest, FootprintScalesWithDimension){
+	static_assert(sizeof(ivec<2>) == 2 * sizeof(int64_t));
+	static_assert(sizeof(ivec<4>) == 4 * sizeof(int64_t));
+	static_assert(sizeof(nd::GeometricObject<2>) < sizeof(GeometricObject));
+	static_assert(sizeof(imat<2>) == 4 * sizeof(int64_t));
+	SUCCEED();
+}
+
+TEST(NDTest, BadSpecsThrow){
+	nd::UnitCellSpecifier<2> spec(2 * imat<2>::identity());
+	spec.add_point({{{0, 0}}, {}});
+	EXPECT_THROW(spec.add_link({{{1, 0}}, {{1, {{1, 1}}}}}), std::out_of_range);
+	EXPECT_THROW(spec.num_sl(3), std::out_of_range);
+	EXPECT_THROW(nd::UnitCellSpecifier<2>(imat<2>::from_cols({{ {1, 2}, {2, 4} }})),
+			std::invalid_argument);
+}
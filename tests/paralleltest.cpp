@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cell_geometry.hpp>
+#include <graph_distance.hpp>
+#include <parallel.hpp>
+#include <preset_cellspecs.hpp>
+
+using namespace CellGeometry;
+
+typedef PeriodicVolLattice<Cell<0>,Cell<1>,Cell<2>,Cell<3>> PeriodicVolLattice_std;
+
+class DiamondParallelTest : public testing::Test {
+	protected:
+		DiamondParallelTest() :
+			lat(PrimitiveSpecifiers::DiamondSpec(),
+					imat33_t::from_cols({4,0,0},{0,4,0},{0,0,4})),
+			pool(4)
+		{
+			opts.pool = &pool;
+			opts.grain = 3;
+		}
+		PeriodicVolLattice_std lat;
+		ThreadPool pool;
+		ParallelOptions opts;
+};
+
+
+TEST(ThreadPoolTest, CoversEveryIndexOnce){
+	ThreadPool pool(4);
+	for (size_t grain : {1, 7, 1000}){
+		std::vector<std::atomic<int>> hits(5000);
+		pool.parallel_for(hits.size(), grain, [&](size_t b, size_t e, unsigned w){
+			ASSERT_LT(w, pool.size());
+			ASSERT_LE(e - b, grain);
+			for (size_t i=b; i<e; i++){
+				// very uneven work, so that stealing kicks in
+				if (i < 64) std::this_thread::sleep_for(std::chrono::microseconds(200));
+				hits[i]++;
+			}
+		});
+		for (auto& h : hits) EXPECT_EQ(h, 1);
+	}
+}
+
+
+TEST(ThreadPoolTest, ExceptionsAndNesting){
+	ThreadPool pool(3);
+	EXPECT_THROW(pool.parallel_for(100, 1, [](size_t b, size_t, unsigned){
+		if (b == 50) throw std::runtime_error("boom");
+	}), std::runtime_error);
+
+	// the pool is still usable, and nested loops run serially
+	std::atomic<size_t> total = 0;
+	pool.parallel_for(10, 1, [&](size_t, size_t, unsigned){
+		pool.parallel_for(10, 1, [&](size_t b, size_t e, unsigned){ total += e - b; });
+	});
+	EXPECT_EQ(total, 100u);
+}
+
+
+TEST(ThreadPoolTest, MaxWorkers){
+	ThreadPool pool(4);
+	auto peak = [&](unsigned max_workers){
+		pool.reset_peak_workers();
+		pool.parallel_for(64, 1, [](size_t, size_t, unsigned){
+			std::this_thread::sleep_for(std::chrono::microseconds(500));
+		}, max_workers);
+		return pool.peak_workers();
+	};
+	EXPECT_EQ(peak(1), 1u);
+	EXPECT_EQ(peak(2), 2u);
+	EXPECT_EQ(peak(0), 4u);
+	EXPECT_EQ(peak(8), 4u);
+}
+
+
+TEST_F(DiamondParallelTest, ForEachVisitsAll){
+	for (int order=0; order<4; order++){
+		std::vector<std::atomic<int>> hits(lat.index_size(order));
+		parallel_for_each(lat, order, [&](idx_t J, auto&){ hits[J]++; }, opts);
+		size_t n = 0;
+		for (auto& h : hits){
+			EXPECT_LE(h, 1);
+			n += h;
+		}
+		EXPECT_EQ(n, lat.index_size(order));
+	}
+}
+
+
+TEST_F(DiamondParallelTest, ReduceMatchesSerial){
+	// diluted, so that the work is uneven
+	for (idx_t J=0; J<lat.index_size(0); J+=5){
+		lat.erase_point(lat.points.at(J));
+	}
+	size_t expected = 0;
+	for (const auto& [J, l] : lat.links) expected += J * l->coboundary.size();
+
+	auto sum = parallel_reduce<1>(lat, size_t(0),
+			[](idx_t J, const Cell<1>& l){ return J * l.coboundary.size(); },
+			std::plus<size_t>(), opts);
+	EXPECT_EQ(sum, expected);
+
+	auto n_vols = parallel_reduce(lat, 3, size_t(0),
+			[](const auto&){ return size_t(1); }, std::plus<size_t>());
+	EXPECT_EQ(n_vols, lat.vols.size());
+}
+
+
+TEST_F(DiamondParallelTest, BFSRespectsThreadCount){
+	const auto& nbrs = neighbour_table<0, NeighbourRelation::Coboundary>(lat);
+	BFSOptions bopts;
+	bopts.pool = &pool;
+	bopts.grain = 1;
+	bopts.direction_optimising = false;
+
+	bopts.n_threads = 1;
+	pool.reset_peak_workers();
+	const auto serial = bfs(nbrs, idx_t(0), bopts);
+	EXPECT_EQ(pool.peak_workers(), 1u);
+
+	bopts.n_threads = 2;
+	pool.reset_peak_workers();
+	EXPECT_EQ(bfs(nbrs, idx_t(0), bopts).dist, serial.dist);
+	EXPECT_EQ(pool.peak_workers(), 2u);
+}
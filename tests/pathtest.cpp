@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cell_geometry.hpp>
+#include <graph_distance.hpp>
+#include <path_enumeration.hpp>
+#include <preset_cellspecs.hpp>
+
+using namespace CellGeometry;
+
+typedef PeriodicVolLattice<Cell<0>,Cell<1>,Cell<2>,Cell<3>> PeriodicVolLattice_std;
+
+class DiamondPathTest : public testing::Test {
+	protected:
+		DiamondPathTest() :
+			lat(PrimitiveSpecifiers::DiamondSpec(),
+					imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2})),
+			g(lat)
+		{}
+		PeriodicVolLattice_std lat;
+		LinkGraph g;
+};
+
+
+TEST_F(DiamondPathTest, GraphMatchesCoboundary){
+	for (const auto& [J, p] : lat.points){
+		EXPECT_EQ(g.edges(J).size(), p->coboundary.size());
+		for (const auto& e : g.edges(J)){
+			EXPECT_NE(g.point(e.point)->coboundary.find(g.link(e.link)),
+					g.point(e.point)->coboundary.end());
+		}
+	}
+}
+
+
+TEST_F(DiamondPathTest, PathBoundaryCorrect){
+	const idx_t origin = 0;
+	// some point three steps away
+	idx_t finish = g.edges(g.edges(g.edges(origin)[0].point)[1].point)[1].point;
+	Chain<0> expected;
+	expected[g.point(origin)] = -1;
+	expected[g.point(finish)] = 1;
+
+	for (unsigned len : {3u, 5u, 7u}){
+		size_t n = for_each_path(g, origin, finish, len, [&](const PathView& path){
+			EXPECT_EQ(path.links.size(), len);
+			EXPECT_EQ(path.points.front(), origin);
+			EXPECT_EQ(path.points.back(), finish);
+			EXPECT_EQ(d(to_chain(g, path)), expected);
+		});
+		EXPECT_GT(n, 0);
+	}
+}
+
+
+TEST_F(DiamondPathTest, HexagonLoops){
+	// the only 6-loops on a large enough diamond lattice are the plaquettes
+	// (the shortest winding loops here have 8 links)
+	size_t n = for_each_lattice_loop(g, 6, [&](const PathView& path){
+		auto c = to_chain(g, path);
+		EXPECT_EQ(d(c), Chain<0>());
+		bool is_plaq = false;
+		for (const auto& [_, pl] : lat.plaqs){
+			is_plaq |= (c == pl->boundary) || (c == -1 * pl->boundary);
+		}
+		EXPECT_TRUE(is_plaq);
+	});
+	EXPECT_EQ(n, lat.plaqs.size());
+	EXPECT_EQ(for_each_lattice_loop(g, 4, [](const PathView&){}), 0);
+	// each point sits on 12 hexagons
+	EXPECT_EQ(for_each_loop(g, 0, 6, [](const PathView&){}), 12);
+}
+
+
+TEST_F(DiamondPathTest, ParallelAndLazyAgree){
+	const idx_t origin = 0;
+	const idx_t finish = g.edges(origin)[0].point;
+	for (unsigned len : {5u, 7u, 9u}){
+		size_t n_serial = for_each_path(g, origin, finish, len, [](const PathView&){});
+		std::atomic<size_t> n_cb = 0;
+		size_t n_par = parallel_for_each_path(g, origin, finish, len,
+				[&](const PathView&, unsigned){ n_cb++; }, 4);
+		size_t n_lazy = 0;
+		for ([[maybe_unused]] const PathView& p : paths(g, origin, finish, len)) n_lazy++;
+		EXPECT_EQ(n_serial, n_par);
+		EXPECT_EQ(n_serial, n_cb);
+		EXPECT_EQ(n_serial, n_lazy);
+	}
+	for (unsigned len : {6u, 8u}){
+		size_t n_serial = for_each_lattice_loop(g, len, [](const PathView&){});
+		EXPECT_GT(n_serial, 0);
+		EXPECT_EQ(n_serial,
+				parallel_for_each_lattice_loop(g, len, [](const PathView&, unsigned){}, 3));
+	}
+}
+
+
+TEST_F(DiamondPathTest, EarlyStop){
+	size_t seen = 0;
+	for_each_lattice_loop(g, 6, [&](const PathView&){ return ++seen < 5; });
+	EXPECT_EQ(seen, 5);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////// BFS distances  ////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+
+TEST_F(DiamondPathTest, BFSNeighboursAtDistanceOne){
+	const auto& nbrs = neighbour_table<0, NeighbourRelation::Coboundary>(lat);
+	auto res = bfs(nbrs, 0);
+	EXPECT_EQ(res.dist[0], 0);
+	for (const auto& e : g.edges(0)){
+		EXPECT_EQ(res.dist[e.point], 1);
+	}
+	for (const auto& [J, _] : lat.points){
+		ASSERT_TRUE(res.reached(J));
+		// triangle inequality along every link
+		for (const auto& e : g.edges(J)){
+			EXPECT_LE(res.dist[e.point], res.dist[J] + 1);
+		}
+	}
+}
+
+
+TEST_F(DiamondPathTest, BFSStrategiesAgree){
+	const auto& nbrs = neighbour_table<0, NeighbourRelation::Coboundary>(lat);
+	std::vector<idx_t> sources = {0, 17, 40};
+
+	BFSOptions top_down;
+	top_down.direction_optimising = false;
+	auto expected = bfs(nbrs, sources, top_down).dist;
+
+	// multi-source distance is the minimum over sources
+	for (const auto& [J, _] : lat.points){
+		uint32_t d_min = BFSResult::unreached;
+		for (auto s : sources) d_min = std::min(d_min, bfs(nbrs, s).dist[J]);
+		EXPECT_EQ(expected[J], d_min);
+	}
+
+	BFSOptions par;
+	par.n_threads = 4;
+	par.grain = 1;
+	par.alpha = 1e6; // go bottom-up almost immediately
+	EXPECT_EQ(bfs(nbrs, sources).dist, expected);
+	EXPECT_EQ(bfs(nbrs, sources, par).dist, expected);
+	par.direction_optimising = false;
+	EXPECT_EQ(bfs(nbrs, sources, par).dist, expected);
+}
+
+
+TEST_F(DiamondPathTest, BFSPathReconstruction){
+	const auto& nbrs = neighbour_table<3, NeighbourRelation::Boundary>(lat);
+	idx_t a = lat.vols.begin()->first;
+	for (const auto& [b, _] : lat.vols){
+		auto path = shortest_path(nbrs, a, b);
+		ASSERT_EQ(path.size(), graph_distance(nbrs, a, b) + 1);
+		EXPECT_EQ(path.front(), a);
+		EXPECT_EQ(path.back(), b);
+		for (size_t i=1; i<path.size(); i++){
+			auto row = nbrs[path[i-1]];
+			EXPECT_TRUE(std::binary_search(row.begin(), row.end(), path[i]));
+		}
+	}
+}
+
+
+TEST_F(DiamondPathTest, BFSEarlyTermination){
+	const auto& nbrs = neighbour_table<0, NeighbourRelation::Coboundary>(lat);
+	idx_t near = g.edges(0)[0].point;
+	BFSOptions opts;
+	opts.targets = std::span<const idx_t>(&near, 1);
+	auto res = bfs(nbrs, 0, opts);
+	EXPECT_EQ(res.dist[near], 1);
+	size_t n_reached = 0;
+	for (auto x : res.dist) n_reached += (x != BFSResult::unreached);
+	EXPECT_LE(n_reached, 1 + 2*g.edges(0).size());
+
+	opts.targets = {};
+	opts.max_distance = 2;
+	res = bfs(nbrs, 0, opts);
+	for (auto x : res.dist) EXPECT_TRUE(x <= 2 || x == BFSResult::unreached);
+}
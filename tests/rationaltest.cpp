@@ -76,3 +76,74 @@ TEST(RationalTest, JSONify){
 	EXPECT_EQ(r,r2);
 	EXPECT_EQ(j, json(-0.1996007984031936));
 }
+
+TEST(RationalTest, LargeDenominatorsStayExact){
+	// sum of 1/(k(k+1)) telescopes to 1 - 1/(n+1); the naive product of
+	// denominators would have wrapped long before n
+	Rational s(0);
+	const int64_t n = 2000;
+	for (int64_t k=1; k<=n; k++) s += Rational(1, k*(k+1));
+	EXPECT_EQ(s, Rational(n, n+1));
+
+	Rational p(1);
+	for (int64_t k=2; k<=200; k++) p *= Rational(k, k-1);
+	EXPECT_EQ(p, Rational(200));
+}
+
+TEST(RationalTest, OverflowThrows){
+	const int64_t big = std::numeric_limits<int64_t>::max() / 3;
+	Rational r(big, 1);
+	EXPECT_THROW(r *= 5, std::overflow_error);
+	// coprime denominators near 2^62 have no common factor to cancel
+	Rational a(1, (int64_t(1) << 62) - 1), b(1, (int64_t(1) << 62) + 1);
+	EXPECT_THROW(a += b, std::overflow_error);
+	// but large intermediates that cancel are fine
+	Rational c(big, 7);
+	c *= Rational(7, big);
+	EXPECT_EQ(c, 1);
+	// a negative denominator on INT64_MIN, with a result that fits
+	const int64_t min = std::numeric_limits<int64_t>::min();
+	Rational m(min);
+	m /= -2;
+	EXPECT_EQ(m, int64_t(1) << 62);
+	Rational h(min, 2);
+	h *= Rational(1, -1);
+	EXPECT_EQ(h, int64_t(1) << 62);
+}
+
+TEST(RationalTest, ComparisonsDoNotWrap){
+	const int64_t big = std::numeric_limits<int64_t>::max() / 2;
+	EXPECT_LT(Rational(big, big - 1), Rational(big - 1, big - 2));
+	EXPECT_GT(Rational(-1, big), Rational(-1, big - 1));
+	EXPECT_EQ(Rational(big, big), 1);
+	EXPECT_EQ(std::hash<Rational>()(Rational(2, -12)), std::hash<Rational>()(Rational(-1, 6)));
+}
+
+TEST(RationalTest, LinearAlgebra){
+	const rmat33 A = rmat33::from_rows<Rational>(
+			{Rational(1, 3), Rational(2, 7), Rational(-5, 11)},
+			{Rational(4, 13), Rational(0), Rational(1, 1009)},
+			{Rational(-6, 17), Rational(9, 19), Rational(1, 2)});
+	const rvec3 b(Rational(1), Rational(-2, 3), Rational(5, 1013));
+	rvec3 x;
+	rlinsolve(x, A, b);
+	EXPECT_EQ(A * x, b);
+
+	const rmat33 Ainv = inv(A);
+	const rmat33 I = A * Ainv;
+	for (int i=0; i<3; i++){
+		for (int j=0; j<3; j++){
+			EXPECT_EQ(I(i,j), i == j ? 1 : 0);
+		}
+	}
+	EXPECT_EQ(Ainv * b, x);
+
+	const auto Z = vector3::mat33<int64_t>::from_cols({-2,2,2},{2,-2,2},{2,2,-2});
+	const rmat33 AZ = A * Z;
+	for (int i=0; i<3; i++){
+		for (int j=0; j<3; j++){
+			EXPECT_EQ(AZ(i,j), A(i,0)*Z(0,j) + A(i,1)*Z(1,j) + A(i,2)*Z(2,j));
+		}
+	}
+	EXPECT_THROW(inv(rmat33()), std::domain_error);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <array>
+#include <checked_int.hpp>
+#include <normal_forms_nd.hpp>
+#include <random>
+#include <vecn.hpp>
+
+
+/**
+ * Checks shared by the tests of the Smith normal form, in any dimension and
+ * for both the vectorn and the 3D matrix types.
+ */
+
+template<int Dim>
+vectorn::imat<Dim> random_matrix(std::mt19937& gen, int range){
+	std::uniform_int_distribution<int64_t> u(-range, range);
+	vectorn::imat<Dim> A;
+	for (auto& a : A.x) a = u(gen);
+	return A;
+}
+
+// L*A*R == diag(D), L*Linv == R*Rinv == 1, D >= 0 and D[n-1] | D[n].
+// The products are taken in 128 bits: the transforms can be large enough
+// that they would wrap in int64_t even when A and D are small.
+template<int Dim, typename Mat, typename Decomp>
+void expect_snf(const Mat& A, const Decomp& s){
+	SCOPED_TRACE(::testing::Message() << "A=\n" << A);
+	typedef checked::int128_t wide_t;
+	typedef std::array<wide_t, Dim*Dim> wmat_t;
+	auto widen = [](const auto& X){
+		wmat_t W;
+		for (int i=0; i<Dim; i++) for (int j=0; j<Dim; j++) W[Dim*i+j] = X(i,j);
+		return W;
+	};
+	auto mul = [](const wmat_t& X, const wmat_t& Y){
+		wmat_t Z = {};
+		for (int i=0; i<Dim; i++) for (int j=0; j<Dim; j++) for (int k=0; k<Dim; k++){
+			Z[Dim*i+j] += X[Dim*i+k] * Y[Dim*k+j];
+		}
+		return Z;
+	};
+	wmat_t D = {}, I = {};
+	for (int n=0; n<Dim; n++){
+		D[Dim*n+n] = s.D[n];
+		I[Dim*n+n] = 1;
+	}
+	EXPECT_TRUE(mul(mul(widen(s.L), widen(A)), widen(s.R)) == D);
+	EXPECT_TRUE(mul(widen(s.L), widen(s.Linv)) == I);
+	EXPECT_TRUE(mul(widen(s.R), widen(s.Rinv)) == I);
+	for (int n=0; n<Dim; n++){
+		EXPECT_GE(s.D[n], 0);
+		if (n > 0 && s.D[n-1] != 0) {
+			EXPECT_EQ(s.D[n] % s.D[n-1], 0);
+		}
+	}
+}
+
+template<int Dim>
+void check_snf(const vectorn::imat<Dim>& A){
+	expect_snf<Dim>(A, CellGeometry::nd::smith_normal_form(A));
+}
@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+
+#include <cell_geometry.hpp>
+#include <checked_int.hpp>
+#include <normal_forms.hpp>
+#include <preset_cellspecs.hpp>
+#include <limits>
+#include <random>
+#include "snf_checks.hpp"
+#include <stdexcept>
+
+using namespace CellGeometry;
+
+static const imat33_t I3 = imat33_t::from_rows({1,0,0}, {0,1,0}, {0,0,1});
+
+static void expect_mat_eq(const imat33_t& A, const imat33_t& B){
+	for (int i=0; i<9; i++) EXPECT_EQ(A[i], B[i]) << "A=\n" << A << "B=\n" << B;
+}
+
+// The 3D wrapper agrees with the reduction it calls
+static void check_snf(const imat33_t& A){
+	const auto s = smith_normal_form(A);
+	expect_snf<3>(A, s);
+	const int64_t d = vector3::det(A);
+	EXPECT_EQ(s.D[0]*s.D[1]*s.D[2], d < 0 ? -d : d);
+}
+
+static void check_hnf(const imat33_t& A){
+	SCOPED_TRACE(::testing::Message() << "A=\n" << A);
+	const auto h = hermite_normal_form(A);
+	expect_mat_eq(A * h.U, h.H);
+	expect_mat_eq(h.U * h.Uinv, I3);
+	for (int i=0; i<3; i++){
+		EXPECT_GT(h.H(i,i), 0);
+		for (int j=i+1; j<3; j++) EXPECT_EQ(h.H(i,j), 0);
+		for (int j=0; j<i; j++){
+			EXPECT_GE(h.H(i,j), 0);
+			EXPECT_LT(h.H(i,j), h.H(i,i));
+		}
+	}
+}
+
+static imat33_t random_matrix3(std::mt19937& gen, int range){
+	return vectorn::to_mat33(random_matrix<3>(gen, range));
+}
+
+
+TEST(SNFTest, KnownInvariants){
+	const auto s = smith_normal_form(imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2}));
+	EXPECT_EQ(s.D, ivec3_t({2,4,4}));
+	const auto t = smith_normal_form(imat33_t::from_cols({6,0,0},{0,10,0},{0,0,15}));
+	EXPECT_EQ(t.D, ivec3_t({1,30,30}));
+	check_snf(imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2}));
+}
+
+TEST(SNFTest, RandomMatrices){
+	std::mt19937 gen(47);
+	for (int n=0; n<2000; n++){
+		const auto A = random_matrix3(gen, n < 1000 ? 5 : 50);
+		check_snf(A);
+		if (vector3::det(A) != 0) check_hnf(A);
+	}
+}
+
+// The transforms can outgrow int64_t long before A does; then the result is
+// an exception, never a wrong decomposition
+TEST(SNFTest, LargeEntries){
+	// two coprime entries near 2^31: D = (1, 1, p*q), just below 2^62, with
+	// transforms of order 2^58
+	const int64_t p = 2147483647, q = 2147483629;
+	const auto A = imat33_t::from_cols({p,q,0},{0,q,0},{0,0,1});
+	ASSERT_NO_THROW(smith_normal_form(A));
+	expect_snf<3>(A, smith_normal_form(A));
+	EXPECT_EQ(smith_normal_form(A).D, ivec3_t(1, 1, p*q));
+
+	// the same with a 3 in place of the 1: |det A| = 3pq does not fit
+	EXPECT_THROW(smith_normal_form(imat33_t::from_cols({p,q,0},{0,q,0},{0,0,3})),
+			std::overflow_error);
+
+	std::mt19937 gen(48);
+	for (int n=0; n<2000; n++){
+		const auto A = random_matrix3(gen, 1000);
+		try {
+			expect_snf<3>(A, smith_normal_form(A));
+		} catch (const std::overflow_error&) {
+		}
+	}
+}
+
+TEST(SNFTest, SingularMatrices){
+	check_snf(imat33_t());
+	check_snf(imat33_t::from_cols({1,2,3},{2,4,6},{0,0,1}));
+	check_snf(imat33_t::from_cols({0,0,0},{0,4,0},{0,6,2}));
+	EXPECT_THROW(hermite_normal_form(imat33_t::from_cols({1,2,3},{2,4,6},{0,0,1})),
+			std::invalid_argument);
+}
+
+// Two bases of one lattice share an HNF
+TEST(SNFTest, HermiteIsCanonical){
+	const auto A = imat33_t::from_cols({-4,4,4},{4,-4,4},{4,4,-4});
+	const auto U = imat33_t::from_cols({1,0,0},{3,1,0},{-2,5,1});
+	expect_mat_eq(hermite_normal_form(A).H, hermite_normal_form(A * U).H);
+}
+
+TEST(SNFTest, OverflowThrows){
+	const int64_t big = std::numeric_limits<int64_t>::max() / 2;
+	EXPECT_THROW(smith_normal_form(imat33_t::from_cols({big,0,0},{0,big,0},{0,0,3})),
+			std::overflow_error);
+	EXPECT_THROW(checked::mul(big, 3), std::overflow_error);
+	// the products overflow, the sum doesn't
+	EXPECT_EQ(checked::lincomb(big, 4, -big, 4), 0);
+	EXPECT_THROW(checked::lincomb(big, 4, big, 4), std::overflow_error);
+
+	// INT64_MIN / -1 comes up in the quotients and must throw, not trap
+	const int64_t M = std::numeric_limits<int64_t>::min();
+	EXPECT_THROW(checked::div(M, -1), std::overflow_error);
+	EXPECT_THROW(checked::rem(M, -1), std::overflow_error);
+	EXPECT_EQ(checked::div(M, 2), M / 2);
+	EXPECT_THROW(hermite_normal_form(imat33_t::from_cols({-1,0,0},{M,1,0},{0,0,1})),
+			std::overflow_error);
+	EXPECT_THROW(hermite_normal_form(imat33_t::from_cols({M,M,0},{-1,1,0},{0,0,1})),
+			std::overflow_error);
+	EXPECT_THROW(hermite_normal_form(imat33_t::from_cols({M,0,0},{-1,0,0},{0,0,1})),
+			std::overflow_error);
+}
+
+TEST(SNFTest, CacheReusesDecomposition){
+	clear_snf_cache();
+	const auto Z = imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2});
+	const auto spec = PrimitiveSpecifiers::DiamondSpec();
+	for (int n=0; n<5; n++){
+		PeriodicPointLattice<Cell<0>> lat(spec, Z);
+		EXPECT_EQ(lat.smith_decomposition().D, smith_normal_form(Z).D);
+	}
+	auto st = snf_cache_stats();
+	EXPECT_EQ(st.misses, 1u);
+	EXPECT_EQ(st.hits, 4u);
+	EXPECT_EQ(st.entries, 1u);
+
+	const auto s = cached_smith_normal_form(imat33_t::from_cols({3,0,0},{0,3,0},{0,0,3}));
+	EXPECT_EQ(s.D, ivec3_t({3,3,3}));
+	EXPECT_EQ(snf_cache_stats().entries, 2u);
+	clear_snf_cache();
+	st = snf_cache_stats();
+	EXPECT_EQ(st.hits + st.misses + st.entries, 0u);
+}
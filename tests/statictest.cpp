@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include <cell_geometry.hpp>
+#include <preset_cellspecs.hpp>
+#include <static_lattice.hpp>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+using namespace CellGeometry;
+using PrimitiveSpecifiers::StaticDiamondSpec;
+using PrimitiveSpecifiers::StaticCubicSpec;
+
+typedef PeriodicVolLattice<Cell<0>,Cell<1>,Cell<2>,Cell<3>> VolLattice;
+template<auto Spec>
+using StaticVol = StaticVolLattice<Spec, Cell<0>,Cell<1>,Cell<2>,Cell<3>>;
+
+// Everything below is decided by the compiler
+static_assert(StaticDiamondSpec.num_sl[2] == 4);
+static_assert(StaticDiamondSpec.boundary_size[2] == 6);
+static_assert(StaticDiamondSpec.abs_det() == 128);
+static_assert(StaticDiamondSpec.sl_of<0>({4, 4, 0}) == 0);
+static_assert(StaticDiamondSpec.sl_of<0>({6, 6, 2}) == 1);
+static_assert(StaticDiamondSpec.sl_of<0>({1, 1, 1}) == -1);
+// the link at (1,1,1) runs from the point at (0,0,0) to the one at (2,2,2)
+static_assert(StaticDiamondSpec.boundary_sl<1>()[0][0] == 1);
+static_assert(StaticDiamondSpec.boundary_sl<1>()[0][1] == 0);
+static_assert(StaticCubicSpec.boundary_sl<3>()[0][5] == 2);
+
+
+// Every lattice vector, position (wrapped into the cell, as add_* stores it)
+// and boundary term of the table, in the table's sublattice order
+template<typename Table>
+static void expect_matches_table(const Table& t, const UnitCellSpecifier& spec){
+	for (int i=0; i<3; i++){
+		for (int j=0; j<3; j++) EXPECT_EQ(spec.latvecs(i,j), t.latvecs[j][i]);
+	}
+	ASSERT_EQ(spec.num_point_sl(), t.points.size());
+	ASSERT_EQ(spec.num_link_sl(), t.links.size());
+	ASSERT_EQ(spec.num_plaq_sl(), t.plaqs.size());
+	ASSERT_EQ(spec.num_vol_sl(), t.vols.size());
+	auto same_cell = [&](const auto& x, const auto& c){
+		EXPECT_EQ(x.position, spec.wrap_copy(to_ipos(c.position)));
+		ASSERT_EQ(x.boundary.size(), c.boundary.size());
+		for (size_t n=0; n<c.boundary.size(); n++){
+			EXPECT_EQ(x.boundary[n].multiplier, c.boundary[n].multiplier);
+			EXPECT_EQ(x.boundary[n].relative_position, to_ipos(c.boundary[n].relative_position));
+		}
+	};
+	for (sl_t s=0; s<spec.num_point_sl(); s++) same_cell(spec.point_no(s), t.points[s]);
+	for (sl_t s=0; s<spec.num_link_sl(); s++) same_cell(spec.link_no(s), t.links[s]);
+	for (sl_t s=0; s<spec.num_plaq_sl(); s++) same_cell(spec.plaq_no(s), t.plaqs[s]);
+	for (sl_t s=0; s<spec.num_vol_sl(); s++) same_cell(spec.vol_no(s), t.vols[s]);
+}
+
+// The (co)boundary of every cell as (J, multiplier) pairs
+template<int order, bool co, typename Lattice>
+static std::map<idx_t, std::map<idx_t, int>> incidence(const Lattice& lat){
+	std::map<idx_t, std::map<idx_t, int>> out;
+	for (const auto& [J, x] : cells_of<order>(lat)){
+		auto& row = out[J];
+		if constexpr (co) {
+			for (const auto& [y, m] : x->coboundary) row[cell_idx_at<order+1>(lat, y->position)] = m;
+		} else {
+			for (const auto& [y, m] : x->boundary) row[cell_idx_at<order-1>(lat, y->position)] = m;
+		}
+	}
+	return out;
+}
+
+template<int order, typename A, typename B>
+static void expect_same_order(const A& a, const B& b){
+	SCOPED_TRACE(::testing::Message() << "order " << order);
+	const auto& ca = cells_of<order>(a);
+	const auto& cb = cells_of<order>(b);
+	ASSERT_EQ(ca.size(), cb.size());
+	for (const auto& [J, x] : ca){
+		ASSERT_TRUE(cb.contains(J));
+		EXPECT_EQ(x->position, cb.at(J)->position);
+		// both lookups, also from an equivalent position in another supercell
+		const ipos_t R = x->position + a.cell_vectors * ipos_t(1, -2, 3);
+		EXPECT_EQ(cell_idx_at<order>(a, R), J);
+		EXPECT_EQ(cell_idx_at<order>(b, R), J);
+	}
+	if constexpr (order > 0) {
+		EXPECT_EQ((incidence<order, false>(a)), (incidence<order, false>(b)));
+	}
+	if constexpr (order < 3) {
+		EXPECT_EQ((incidence<order, true>(a)), (incidence<order, true>(b)));
+	}
+}
+
+template<auto Spec>
+static void check_against_runtime(const UnitCellSpecifier& spec, const imat33_t& Z){
+	SCOPED_TRACE(::testing::Message() << "Z=\n" << Z);
+	StaticVol<Spec> s(Z);
+	VolLattice r(spec, Z);
+	expect_same_order<0>(s, r);
+	expect_same_order<1>(s, r);
+	expect_same_order<2>(s, r);
+	expect_same_order<3>(s, r);
+}
+
+
+TEST(StaticTest, RuntimePresetsAreTheStaticTables){
+	expect_matches_table(StaticDiamondSpec, PrimitiveSpecifiers::DiamondSpec());
+	expect_matches_table(StaticCubicSpec, PrimitiveSpecifiers::CubicSpec());
+}
+
+TEST(StaticTest, InvalidSpecIsRejected){
+	constexpr StaticCellSpec<1, 1, 0, 0, 2, 0, 0> dangling = {
+		{{ {2, 0, 0}, {0, 2, 0}, {0, 0, 2} }},
+		{{ {{0, 0, 0}, {}} }},
+		{{ {{1, 0, 0}, {{ {1, {-1, 0, 0}}, {-1, {0, 0, 0}} }}} }},
+		{}, {}
+	};
+	static_assert(!dangling.valid());
+	EXPECT_THROW(to_unitcell(dangling), std::out_of_range);
+}
+
+TEST(StaticTest, DiamondMatchesRuntimeLattice){
+	const UnitCellSpecifier spec = PrimitiveSpecifiers::DiamondSpec();
+	check_against_runtime<StaticDiamondSpec>(spec, imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2}));
+	check_against_runtime<StaticDiamondSpec>(spec, imat33_t::from_cols({1,0,0},{0,1,0},{0,0,1}));
+	check_against_runtime<StaticDiamondSpec>(spec, imat33_t::from_cols({3,1,0},{0,2,1},{1,0,2}));
+}
+
+TEST(StaticTest, CubicMatchesRuntimeLattice){
+	const UnitCellSpecifier spec = PrimitiveSpecifiers::CubicSpec();
+	check_against_runtime<StaticCubicSpec>(spec, imat33_t::from_cols({4,0,0},{0,6,0},{0,0,2}));
+	check_against_runtime<StaticCubicSpec>(spec, imat33_t::from_cols({2,1,0},{0,3,0},{1,0,2}));
+}
+
+TEST(StaticTest, LookupsAndErasure){
+	StaticVol<StaticDiamondSpec> lat(imat33_t::from_cols({-2,2,2},{2,-2,2},{2,2,-2}));
+	EXPECT_THROW(lat.get_point_idx_at({1,1,1}), std::out_of_range);
+	const auto& l = lat.get_link_at({1,1,1});
+	EXPECT_EQ(lat.get_link_idx_at(l.position), lat.get_link_idx_at({1,1,1}));
+
+	auto& p = lat.get_point_at({0,0,0});
+	const size_t nlinks = lat.links.size();
+	lat.erase_point(&p);
+	EXPECT_EQ(lat.links.size(), nlinks - 4);
+	EXPECT_THROW(lat.get_point_at({0,0,0}), std::out_of_range);
+
+	// lower orders only
+	StaticLinkLattice<StaticCubicSpec, Cell<0>, Cell<1>> links(
+			imat33_t::from_cols({3,0,0},{0,3,0},{0,0,3}));
+	EXPECT_EQ(links.points.size(), 27u);
+	EXPECT_EQ(links.links.size(), 81u);
+	for (const auto& [_, x] : links.points) EXPECT_EQ(x->coboundary.size(), 6u);
+}
@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include <cell_geometry.hpp>
+#include <iomanip>
+#include <nlohmann/json.hpp>
+#include <phase_trace.hpp>
+#include <preset_cellspecs.hpp>
+#include <set>
+#include <sstream>
+#include <string>
+
+using namespace CellGeometry;
+
+typedef PeriodicVolLattice<Cell<0>,Cell<1>,Cell<2>,Cell<3>> PeriodicVolLattice_std;
+
+
+// Records nothing unless enabled
+TEST(TraceTest, OffByDefault){
+	trace::clear();
+	{
+		trace::Scope s("ignored");
+	}
+	EXPECT_TRUE(trace::events().empty());
+}
+
+
+TEST(TraceTest, ConstructionPhases){
+	if (!trace::compiled) GTEST_SKIP() << "built with LATLIB_NO_TRACE";
+	trace::clear();
+	trace::enable();
+	PeriodicVolLattice_std lat(PrimitiveSpecifiers::DiamondSpec(), imat33_t::from_cols({2,0,0},{0,2,0},{0,0,2}));
+	trace::enable(false);
+
+	std::set<std::string> names;
+	for (const auto& e : trace::events()){
+		names.insert(e.name);
+		EXPECT_GE(e.duration_ns, 0);
+	}
+	for (auto n : {"snf", "initialise_points", "initialise_links", "connect_link_boundaries",
+			"initialise_plaqs", "connect_plaq_boundaries", "initialise_vols", "connect_vol_boundaries"}){
+		EXPECT_TRUE(names.count(n)) << n;
+	}
+}
+
+
+// An erase cascade is one event, named for the outermost call
+TEST(TraceTest, CascadesFold){
+	if (!trace::compiled) GTEST_SKIP() << "built with LATLIB_NO_TRACE";
+	PeriodicVolLattice_std lat(PrimitiveSpecifiers::DiamondSpec(), imat33_t::from_cols({2,0,0},{0,2,0},{0,0,2}));
+	trace::clear();
+	trace::enable();
+	lat.erase_point(lat.points.begin()->second);
+	lat.erase_link(lat.links.begin()->second);
+	trace::enable(false);
+
+	const auto ev = trace::events();
+	ASSERT_EQ(ev.size(), 2u);
+	EXPECT_STREQ(ev[0].name, "erase_point");
+	EXPECT_STREQ(ev[1].name, "erase_link");
+	EXPECT_STREQ(ev[0].category, "erase");
+
+	const auto rows = trace::summary();
+	ASSERT_EQ(rows.size(), 2u);
+	EXPECT_EQ(rows[0].count, 1u);
+}
+
+
+TEST(TraceTest, ChromeTrace){
+	if (!trace::compiled) GTEST_SKIP() << "built with LATLIB_NO_TRACE";
+	trace::clear();
+	trace::enable();
+	{
+		trace::Scope outer("outer", "test");
+		trace::Scope inner("in \"quotes\"", "test");
+	}
+	trace::enable(false);
+
+	std::stringstream ss;
+	trace::write_chrome_trace(ss);
+	const auto j = nlohmann::json::parse(ss.str());
+	std::set<std::string> names;
+	for (const auto& e : j.at("traceEvents")){
+		if (e.at("ph") != "X") continue;
+		names.insert(e.at("name").get<std::string>());
+		EXPECT_EQ(e.at("cat"), "test");
+		EXPECT_GE(e.at("dur").get<double>(), 0);
+	}
+	EXPECT_EQ(names, (std::set<std::string>{"outer", "in \"quotes\""}));
+
+	std::stringstream table;
+	table << std::setprecision(9) << std::setfill('*');
+	const auto flags = table.flags();
+	trace::write_summary(table);
+	EXPECT_NE(table.str().find("outer"), std::string::npos);
+	// the caller's formatting survives
+	EXPECT_EQ(table.precision(), 9);
+	EXPECT_EQ(table.fill(), '*');
+	EXPECT_EQ(table.flags(), flags);
+}